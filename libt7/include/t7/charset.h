@@ -7,6 +7,7 @@
  */
 #ifndef T7_CHARSET_H
 #define T7_CHARSET_H
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -81,10 +82,19 @@ typedef enum charset_enum charset_t;
  * charset_t.  If the string does not contain a valid character set, then the
  * function returns INVALID_CHARSET.
  *
+ * Names are compared without regard to case, white space or punctuation, so
+ * "UTF-8", "utf8" and "Utf_8" are all the same.  IANA names and aliases of
+ * the built-in character sets are accepted, such as "latin1", "cp819",
+ * "us-ascii", "ANSI_X3.4-1968" and "ucs-2".  Registered character sets are
+ * matched by name without regard to case.
+ *
  * EXAMPLE
  * // Returns UTF8
  * charset_t ch = parse_charset ("utf8");
  *
+ * // Returns ISO8859_1
+ * charset_t ch = parse_charset ("ISO_8859-1:1987");
+ *
  * SYNOPSIS
  */
 charset_t parse_charset (const char *p);
@@ -118,6 +128,14 @@ const char *nameof_charset (charset_t t);
  * Convert pseudo character set T into machine dependent character set such as
  * UTF16LE (lower-endian) or UTF16BE (big-endian).
  *
+ * Character sets of FILESYSTEM_CHARSET and LOCALE_CHARSET are detected at
+ * the first call and cached so that subsequent calls are cheap.  The locale
+ * character set comes from the locale selected with setlocale or, if the
+ * program runs in the C locale, from environment variables LC_ALL, LC_CTYPE
+ * and LANG.  File names are assumed to be in the locale character set
+ * unless that is plain ASCII, in which case UTF-8 is used.  Either one
+ * resolves to INVALID_CHARSET if the character set is not supported.
+ *
  * EXAMPLE
  * // Returns UTF16LE or UTF16BE depending on the platform
  * charset_t t = resolve_charset (UTF16);
@@ -131,6 +149,217 @@ charset_t resolve_charset (charset_t t);
 /****/
 
 
+/****f* libt7/refresh_charsets
+ * NAME
+ * refresh_charsets - detect file system and locale character sets again
+ *
+ * FUNCTION
+ * Discard cached character sets of FILESYSTEM_CHARSET and LOCALE_CHARSET and
+ * detect them again.  Call the function after changing the locale with
+ * setlocale, after changing the environment or after registering the
+ * character set of locale with register_charset_table.  Transcoders opened
+ * earlier keep their character sets.
+ *
+ * The function is thread-safe with respect to resolve_charset but, like
+ * setlocale and setenv themselves, not with respect to threads changing the
+ * locale or environment at the same time.
+ *
+ * EXAMPLE
+ * setlocale (LC_ALL, "");
+ * refresh_charsets ();
+ *
+ * SYNOPSIS
+ */
+void refresh_charsets (void);
+/****/
+
+
+/****d* libt7/CHARSET_UNMAPPED
+ * NAME
+ * CHARSET_UNMAPPED - byte without character
+ *
+ * FUNCTION
+ * Marks bytes which have no Unicode character in the map passed to
+ * register_charset_table.
+ *
+ * SOURCE
+ */
+#define CHARSET_UNMAPPED 0xFFFFFFFFu
+/****/
+
+
+/****s* libt7/charset_table
+ * NAME
+ * charset_table - mapping of single-byte character set
+ *
+ * FUNCTION
+ * Translation table between a single-byte character set and Unicode.  Each
+ * byte maps to one character of the Basic Multilingual Plane through DECODE.
+ * In the other direction, characters are looked up in pages of 256
+ * characters: PAGE gives the index of the page in ENCODE for the upper bits
+ * of the character and the page gives the byte for the lower bits.  Page
+ * zero holds no characters, so a character is mapped only if decoding the
+ * byte found gives the character back.
+ *
+ * Tables of ASCII and ISO8859_1 are built in.  Use register_charset_table
+ * to add more single-byte character sets such as other parts of ISO 8859 or
+ * Windows code pages.
+ *
+ * SOURCE
+ */
+#define CHARSET_TABLE_PAGES 8
+struct charset_table {
+    /* Lower-case name of character set */
+    char name[32];
+
+    /* Character of each byte or CHARSET_UNMAPPED */
+    uint32_t decode[256];
+
+    /* Index of page in ENCODE for each 256 characters */
+    unsigned char page[256];
+
+    /* Byte of each character in page */
+    unsigned char encode[CHARSET_TABLE_PAGES][256];
+};
+/****/
+
+
+/****f* libt7/register_charset_table
+ * NAME
+ * register_charset_table - define single-byte character set
+ *
+ * FUNCTION
+ * Register single-byte character set NAME whose bytes map to the Unicode
+ * characters in MAP.  Bytes without a character are marked with
+ * CHARSET_UNMAPPED.  Characters must come from the Basic Multilingual Plane
+ * and no two bytes may map to the same character.
+ *
+ * The function returns a new character set which can be passed to the
+ * transcoder, nameof_charset and parse_charset.  Registering the same name
+ * twice returns the existing character set if the maps are identical.  The
+ * function returns INVALID_CHARSET if the map is invalid, if the name is
+ * taken by another character set, if the map needs more than
+ * CHARSET_TABLE_PAGES - 1 pages of encode table or if T7_MAX_CHARSET_TABLES
+ * character sets have been registered already.
+ *
+ * Registered character sets remain valid until the program exits.
+ *
+ * EXAMPLE
+ * uint32_t map[256];
+ * for (unsigned i = 0; i < 256; i++) {
+ *     map[i] = i;
+ * }
+ * map[0x80] = 0x20AC;  // Euro sign
+ * charset_t t = register_charset_table ("my-latin", map);
+ *
+ * SYNOPSIS
+ */
+charset_t register_charset_table (const char *name, const uint32_t map[256]);
+/****/
+
+
+/****f* libt7/get_charset_table
+ * NAME
+ * get_charset_table - get translation table of character set
+ *
+ * FUNCTION
+ * Returns translation table of single-byte character set T or NULL if T is
+ * not a single-byte character set.
+ *
+ * SYNOPSIS
+ */
+const struct charset_table *get_charset_table (charset_t t);
+/****/
+
+
+/****f* libt7/validate_utf8
+ * NAME
+ * validate_utf8 - check UTF-8 string
+ *
+ * FUNCTION
+ * Returns true if N bytes at P form valid UTF-8.  Overlong forms, encoded
+ * surrogates, values beyond U+10FFFF and sequences cut short by the end of
+ * the string are rejected.  Zero bytes are valid characters.
+ *
+ * The function processes up to 64 bytes at a time with vector instructions
+ * if the processor supports them.  The fastest implementation is selected
+ * at the first call.
+ *
+ * EXAMPLE
+ * if (!validate_utf8 (buffer, len)) {
+ *     return error ("Invalid input");
+ * }
+ *
+ * SYNOPSIS
+ */
+int validate_utf8 (const char *p, size_t n);
+/****/
+
+
+/****f* libt7/count_utf8_codepoints
+ * NAME
+ * count_utf8_codepoints - count characters in UTF-8 string
+ *
+ * FUNCTION
+ * Returns the number of characters in N bytes of valid UTF-8 at P.  The
+ * function counts bytes which do not continue a multi-byte sequence, so
+ * validate the string first if it comes from an untrusted source.
+ *
+ * SYNOPSIS
+ */
+size_t count_utf8_codepoints (const char *p, size_t n);
+/****/
+
+
+/****s* libt7/utf8_kernel
+ * NAME
+ * utf8_kernel - implementations of UTF-8 functions
+ *
+ * FUNCTION
+ * Implementations of validate_utf8 and count_utf8_codepoints which can be
+ * forced with force_utf8_kernel.  UTF8_SSE2 counts with SSE2 but validates
+ * one character at a time.
+ *
+ * SOURCE
+ */
+enum utf8_kernel {
+    UTF8_AUTOMATIC = 0,
+    UTF8_SCALAR = 1,
+    UTF8_SSE2 = 2,
+    UTF8_SSSE3 = 3,
+    UTF8_AVX2 = 4
+};
+/****/
+
+
+/****f* libt7/force_utf8_kernel
+ * NAME
+ * force_utf8_kernel - select implementation of UTF-8 functions
+ *
+ * FUNCTION
+ * Makes validate_utf8 and count_utf8_codepoints use implementation K from
+ * now on.  Returns false and keeps the current implementation if the
+ * processor cannot run K.  Pass UTF8_AUTOMATIC to go back to the fastest
+ * implementation.
+ *
+ * The function is meant for unit tests which need to cover every
+ * implementation regardless of the processor running them.  Do not call
+ * the function while other threads use the UTF-8 functions.
+ *
+ * EXAMPLE
+ * for (k = UTF8_SCALAR; k <= UTF8_AVX2; k++) {
+ *     if (force_utf8_kernel (k)) {
+ *         assert (validate_utf8 ("\xC3\xA4", 2));
+ *     }
+ * }
+ * force_utf8_kernel (UTF8_AUTOMATIC);
+ *
+ * SYNOPSIS
+ */
+int force_utf8_kernel (enum utf8_kernel k);
+/****/
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,10 +47,14 @@ typedef void exit_function (void);
  * Custom functions should use priorities of 100 and above to ensure that
  * system is fully functional when the exit function is called.
  *
+ * Exit functions of the same priority are called in reverse order of
+ * registration.  There is no limit on the number of exit functions and
+ * registration does not lock other threads, so the function is cheap to call
+ * from anywhere.
+ *
  * The function returns true if the exit function was registered properly.
  * Otherwise, the function returns zero.  The function is known to return zero
- * if more than 32 exit handlers are registered, or the function F has already
- * been registered.
+ * if the function F has already been registered.
  *
  * EXAMPLE
  * // Local variable
@@ -83,6 +87,95 @@ int exit_handler (exit_function *f, int priority);
 /****/
 
 
+/****d* libt7/EXIT_CONCURRENT
+ * NAME
+ * EXIT_CONCURRENT - flags of exit function
+ *
+ * FUNCTION
+ * Flags which may be passed to exit_handler_flags.
+ *
+ *     Flag                 | Meaning
+ *     ---------------------+------------------------------------------------
+ *     EXIT_CONCURRENT      | Function may run at the same time with other
+ *                          | concurrent functions of the same priority
+ *     EXIT_RELEASES_MEMORY | Function only releases memory and is skipped
+ *                          | when the program exits through fast_exit
+ *
+ * SOURCE
+ */
+#define EXIT_CONCURRENT 1
+#define EXIT_RELEASES_MEMORY 2
+/****/
+
+
+/****f* libt7/exit_handler_flags
+ * NAME
+ * exit_handler_flags - register exit function with flags
+ *
+ * FUNCTION
+ * Register function F to be called at the program exit with priority
+ * PRIORITY like exit_handler.  The argument FLAGS is zero or a combination
+ * of EXIT_CONCURRENT and EXIT_RELEASES_MEMORY.
+ *
+ * Exit functions of the same priority form a tier.  Consecutive concurrent
+ * functions of a tier are run in parallel on a few threads, and the next
+ * exit function is called only after all of them have returned.  Use the
+ * same priority for independent subsystems, such as caches of different
+ * modules, and different priorities for functions which depend on each
+ * other.
+ *
+ * The function returns true if the exit function was registered properly
+ * and zero if the function F has already been registered.
+ *
+ * EXAMPLE
+ * // Release caches of two modules at the same time
+ * exit_handler_flags (free_font_cache, 100,
+ *     EXIT_CONCURRENT | EXIT_RELEASES_MEMORY);
+ * exit_handler_flags (free_image_cache, 100,
+ *     EXIT_CONCURRENT | EXIT_RELEASES_MEMORY);
+ *
+ * SYNOPSIS
+ */
+int exit_handler_flags (exit_function *f, int priority, int flags);
+/****/
+
+
+/****f* libt7/fast_exit
+ * NAME
+ * fast_exit - exit from application without releasing memory
+ *
+ * FUNCTION
+ * Exit from application with the exit status STATUS like exit_application
+ * but skip exit functions registered with EXIT_RELEASES_MEMORY.  The
+ * operating system reclaims memory of the process anyway, so the program
+ * exits in constant time regardless of the size of its heap.  Use
+ * exit_application instead when checking for memory leaks.
+ *
+ * Allocators and thread-local storage of the main thread are not released
+ * on fast exit, so destroy functions of allocators and thread-local
+ * variables are not called either.  Static allocators skip filling released
+ * buffers in debug builds if they are deleted anyway.
+ *
+ * SYNOPSIS
+ */
+void fast_exit (int status);
+/****/
+
+
+/****f* libt7/is_fast_exit
+ * NAME
+ * is_fast_exit - returns true if program is exiting through fast_exit
+ *
+ * FUNCTION
+ * Returns true if fast_exit has been called.  Exit functions which do more
+ * than release memory may use this to skip expensive work.
+ *
+ * SYNOPSIS
+ */
+int is_fast_exit (void);
+/****/
+
+
 #ifdef __cplusplus
 }
 #endif
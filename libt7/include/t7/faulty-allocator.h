@@ -14,15 +14,52 @@ extern "C" {
 #endif
 
 
-/* Faulty allocator type */
+/* Forward-decl */
+struct faulty_allocator;
+
+
+/*
+ * Faulty allocator type.  Faulty allocator forwards requests to a backing
+ * allocator but fails whenever simulate_failure() returns true.  Allocator
+ * retrieved with get_allocator(faulty_allocator) is backed by the default
+ * heap allocator.
+ */
 extern const struct allocator_vtable *faulty_allocator;
 
+/* Create faulty allocator on top of allocator BACKING */
+struct allocator *new_faulty_allocator(struct allocator *backing);
+
+/* Initialize faulty allocator with backing allocator */
+int create_faulty_allocator_with_backing(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	struct allocator *backing);
+
 /* For defining custom fixtures */
-static struct allocator *get_faulty_allocator(fixture_t *fp);
+struct allocator *get_faulty_allocator(fixture_t *fp);
+
+
+/* Structure of faulty allocator */
+struct faulty_allocator {
+	/* Base allocator, must be first member of the structure */
+	struct allocator base;
+
+	/* Allocator which serves the requests, not owned */
+	struct allocator *backing;
+};
+
+
+/* Virtual functions */
+struct allocator *allocate_faulty_allocator(void);
+void free_faulty_allocator(struct allocator *ap);
+int create_faulty_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable);
+void destroy_faulty_allocator(struct allocator *ap);
+void *faulty_grab_memory(struct allocator *ap, size_t n);
+void faulty_release_memory(struct allocator *ap, void *p);
+void *faulty_resize_memory(struct allocator *ap, void *p, size_t n);
 
 
 #ifdef __cplusplus
 }
 #endif
 #endif /*T7_FAULTY_ALLOCATOR_H*/
-
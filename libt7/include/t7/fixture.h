@@ -96,11 +96,12 @@ struct fixture_data {
  *
  * FUNCTION
  * Pointer to the default fixture which provides unrestricted access to the
- * execution environment.
+ * execution environment.  The pointer is constant, so every thread starts
+ * in the same fixture.
  *
  * SOURCE
  */
-extern fixture_t *default_fixture;
+extern fixture_t *const default_fixture;
 /****/
 
 
@@ -156,7 +157,11 @@ fixture_t *get_fixture (void);
  * However, existing threads will not be affected.
  *
  * The fixture object pointed by the FP must be held available until the
- * current thread is destroyed or the fixture is changed.
+ * current thread and its sub-threads are destroyed or the fixture is changed.
+ * Sub-threads share the fixture object with the thread that started them.
+ *
+ * The function replaces the fixture of the innermost scope and discards any
+ * allocator set for the scope.  See push_fixture for nested scopes.
  *
  * EXAMPLE
  * #include "t7/fixture.h"
@@ -178,6 +183,97 @@ void set_fixture (fixture_t *fp);
 /****/
 
 
+/****f* libt7/push_fixture
+ * NAME
+ * push_fixture - start scope with fixture
+ *
+ * FUNCTION
+ * Make fixture FP active in the current thread until the matching call to
+ * pop_fixture.  The allocator of the fixture is resolved once when the
+ * scope starts, so memory allocations within the scope do not need to ask
+ * the fixture for the allocator.
+ *
+ * Scopes nest up to T7_MAX_FIXTURE_DEPTH levels.  The function returns
+ * true on success and zero if the maximum depth has been reached.
+ *
+ * EXAMPLE
+ * #include "t7/fixture.h"
+ *
+ * void handle_request (struct request *rp) {
+ *     // Allocate everything from request-specific region
+ *     if (push_allocator (rp->region)) {
+ *         process_request (rp);
+ *         pop_fixture ();
+ *     }
+ * }
+ *
+ * SYNOPSIS
+ */
+int push_fixture (fixture_t *fp);
+/****/
+
+
+/****f* libt7/push_allocator
+ * NAME
+ * push_allocator - start scope with allocator
+ *
+ * FUNCTION
+ * Make allocator AP the default allocator of the current thread until the
+ * matching call to pop_fixture.  The active fixture does not change.
+ *
+ * The function returns true on success and zero if the maximum depth of
+ * scopes has been reached.
+ *
+ * SYNOPSIS
+ */
+int push_allocator (struct allocator *ap);
+/****/
+
+
+/****f* libt7/pop_fixture
+ * NAME
+ * pop_fixture - end scope
+ *
+ * FUNCTION
+ * Restore the fixture and the allocator which were active before the
+ * matching call to push_fixture or push_allocator.
+ *
+ * SYNOPSIS
+ */
+void pop_fixture (void);
+/****/
+
+
+/****f* libt7/get_scope_allocator
+ * NAME
+ * get_scope_allocator - get allocator of current scope
+ *
+ * FUNCTION
+ * Return the allocator resolved for the innermost scope of the current
+ * thread, or NULL if the allocator is to be retrieved from the active
+ * fixture.  Use get_default_allocator to get the allocator in effect.
+ *
+ * SYNOPSIS
+ */
+struct allocator *get_scope_allocator (void);
+/****/
+
+
+/****f* libt7/set_scope_allocator
+ * NAME
+ * set_scope_allocator - set allocator of current scope
+ *
+ * FUNCTION
+ * Override the allocator of the innermost scope of the current thread with
+ * AP.  If AP is NULL, then the allocator is retrieved from the active
+ * fixture.
+ *
+ * SYNOPSIS
+ */
+void set_scope_allocator (struct allocator *ap);
+/****/
+
+
 /****f* libt7/copy_fixture
  * NAME
  * copy_fixture - copy fixture data
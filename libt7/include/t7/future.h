@@ -0,0 +1,266 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_FUTURE_H
+#define T7_FUTURE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct future;
+
+
+/****t* libt7/future_t
+ * NAME
+ * future_t - result of an asynchronous task
+ *
+ * FUNCTION
+ * Handle to a value which becomes available once an asynchronous task
+ * completes.  Futures are created with async_task, then_future, when_all or
+ * when_any and they must be released with delete_future.
+ *
+ * The result of the task is stored in memory owned by the future.  The size
+ * of the result is given when the future is created and the memory remains
+ * valid until the future is deleted.
+ *
+ * EXAMPLE
+ * #include "t7/future.h"
+ *
+ * // Decode input in a separate thread
+ * static int decode (void *arg, void *result) {
+ *     *(int*) result = atoi ((const char*) arg);
+ *     return 1;
+ * }
+ *
+ * // Transform decoded value in the thread which completed decode
+ * static int twice (void *arg, const void *input, void *result) {
+ *     (void) arg;
+ *     *(int*) result = *(const int*) input * 2;
+ *     return 1;
+ * }
+ *
+ * int main (void) {
+ *     future_t *f1 = async_task (decode, "21", sizeof (int));
+ *     future_t *f2 = then_future (f1, twice, NULL, sizeof (int));
+ *
+ *     // Wait for the pipeline to finish
+ *     if (wait_future (f2) == FUTURE_READY) {
+ *         printf ("%d\n", *(int*) get_future_result (f2));
+ *     }
+ *
+ *     delete_future (f2);
+ *     delete_future (f1);
+ *     return 0;
+ * }
+ *
+ * SOURCE
+ */
+typedef struct future future_t;
+/****/
+
+
+/****s* libt7/future_state
+ * NAME
+ * future_state - state of future
+ *
+ * FUNCTION
+ * Enumeration of states that a future may be in.  A future starts in
+ * FUTURE_PENDING and moves to either FUTURE_READY or FUTURE_FAILED exactly
+ * once.
+ *
+ * SOURCE
+ */
+enum future_state {
+	FUTURE_PENDING = 0,
+	FUTURE_READY = 1,
+	FUTURE_FAILED = 2
+};
+typedef enum future_state future_state_t;
+/****/
+
+
+/****p* libt7/task_function
+ * NAME
+ * task_function - prototype of asynchronous task
+ *
+ * FUNCTION
+ * Prototype of a function executed by async_task.  The function receives
+ * the argument ARG given to async_task and a pointer RESULT to the memory
+ * reserved for the result of the task.  The function should return a
+ * non-zero value on success and zero on failure.
+ *
+ * SOURCE
+ */
+typedef int task_function (void *arg, void *result);
+/****/
+
+
+/****p* libt7/continuation_function
+ * NAME
+ * continuation_function - prototype of continuation
+ *
+ * FUNCTION
+ * Prototype of a function executed by then_future once the preceding
+ * future completes successfully.  The argument INPUT points to the result
+ * of the preceding future and RESULT points to the memory reserved for the
+ * result of the continuation.  The function should return a non-zero value
+ * on success and zero on failure.
+ *
+ * SOURCE
+ */
+typedef int continuation_function (
+	void *arg, const void *input, void *result);
+/****/
+
+
+/****f* libt7/async_task
+ * NAME
+ * async_task - execute function asynchronously
+ *
+ * FUNCTION
+ * Start executing task F with argument ARG in a new thread and return a
+ * future which completes once F returns.  The future reserves SIZE bytes
+ * for the result of F.  If the future or the thread cannot be created, then
+ * the function returns NULL.
+ *
+ * SYNOPSIS
+ */
+future_t *async_task (task_function *f, void *arg, size_t size);
+/****/
+
+
+/****f* libt7/then_future
+ * NAME
+ * then_future - chain continuation to future
+ *
+ * FUNCTION
+ * Create a future which completes once continuation F has processed the
+ * result of future FP.  The continuation is executed by the thread which
+ * completes FP, or immediately by the calling thread if FP has already
+ * completed.  If FP fails, then F is not called and the new future fails
+ * as well.  The new future reserves SIZE bytes for the result of F.
+ *
+ * The function returns NULL if the future cannot be created.
+ *
+ * SYNOPSIS
+ */
+future_t *then_future (
+	future_t *fp, continuation_function *f, void *arg, size_t size);
+/****/
+
+
+/****f* libt7/when_all
+ * NAME
+ * when_all - wait for multiple futures
+ *
+ * FUNCTION
+ * Create a future which completes once all N futures in the array FUTURES
+ * have completed.  The new future fails if any of the futures fails.  The
+ * new future has no result.
+ *
+ * SYNOPSIS
+ */
+future_t *when_all (future_t **futures, size_t n);
+/****/
+
+
+/****f* libt7/when_any
+ * NAME
+ * when_any - wait for first of multiple futures
+ *
+ * FUNCTION
+ * Create a future which completes as soon as any of the N futures in the
+ * array FUTURES completes.  The new future takes the state of the first
+ * completed future and its result is the index of that future stored as
+ * size_t.
+ *
+ * SYNOPSIS
+ */
+future_t *when_any (future_t **futures, size_t n);
+/****/
+
+
+/****f* libt7/wait_future
+ * NAME
+ * wait_future - wait for future to complete
+ *
+ * FUNCTION
+ * Block the calling thread until future FP completes and return either
+ * FUTURE_READY or FUTURE_FAILED.
+ *
+ * SYNOPSIS
+ */
+future_state_t wait_future (future_t *fp);
+/****/
+
+
+/****f* libt7/wait_future_for
+ * NAME
+ * wait_future_for - wait for future with timeout
+ *
+ * FUNCTION
+ * Block the calling thread until future FP completes or until MS
+ * milliseconds have passed.  The function returns the state of the future
+ * which is FUTURE_PENDING if the wait timed out.
+ *
+ * SYNOPSIS
+ */
+future_state_t wait_future_for (future_t *fp, unsigned long ms);
+/****/
+
+
+/****f* libt7/is_future_ready
+ * NAME
+ * is_future_ready - check if future has completed
+ *
+ * FUNCTION
+ * Returns true if future FP has completed either successfully or with a
+ * failure.  The function never blocks.
+ *
+ * SYNOPSIS
+ */
+int is_future_ready (future_t *fp);
+/****/
+
+
+/****f* libt7/get_future_result
+ * NAME
+ * get_future_result - get pointer to result
+ *
+ * FUNCTION
+ * Get pointer to the result of future FP.  The result is only valid after
+ * the future has completed with FUTURE_READY.  The function returns NULL if
+ * the future has no room for a result.
+ *
+ * SYNOPSIS
+ */
+void *get_future_result (future_t *fp);
+/****/
+
+
+/****f* libt7/delete_future
+ * NAME
+ * delete_future - release future
+ *
+ * FUNCTION
+ * Release future FP.  If the future was created with async_task, then the
+ * function waits for the thread executing the task to finish.  Pending
+ * continuations remain valid: the memory is released once the last
+ * continuation referring to the future has completed.
+ *
+ * SYNOPSIS
+ */
+void delete_future (future_t *fp);
+/****/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_FUTURE_H*/
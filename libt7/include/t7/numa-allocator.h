@@ -0,0 +1,74 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_NUMA_ALLOCATOR_H
+#define T7_NUMA_ALLOCATOR_H
+#include "t7/allocator.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct numa_allocator;
+struct numa_arena;
+
+
+/*
+ * NUMA allocator type.  NUMA allocator keeps backing allocators per NUMA
+ * node and serves each request from the allocators of the node which runs
+ * the calling thread.  Backing allocators are created by a thread of the
+ * node on first use and whenever the previous ones run out of memory, so
+ * allocators which place their memory on the node of the creating thread
+ * keep memory local.  Blocks of 256 KiB or more, and blocks which a new
+ * backing allocator cannot hold, come from the default allocator.  Memory
+ * is always released and resized through the allocator which allocated it,
+ * even if another node frees it.  Allocator retrieved with
+ * get_allocator(numa_allocator) is backed by mapped_static_allocator.
+ */
+extern const struct allocator_vtable *numa_allocator;
+
+/* Create NUMA allocator with backing allocators of type BACKING */
+struct allocator *new_numa_allocator(const struct allocator_vtable *backing);
+
+/* Initialize NUMA allocator with type of backing allocators */
+int create_numa_allocator_with_backing(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	const struct allocator_vtable *backing);
+
+/* Get first backing allocator of NUMA node, creating it if needed */
+struct allocator *get_node_allocator(struct allocator *ap, int node);
+
+
+/* Structure of NUMA allocator */
+struct numa_allocator {
+	/* Base allocator, must be first member of the structure */
+	struct allocator base;
+
+	/* Type of backing allocators */
+	const struct allocator_vtable *backing;
+
+	/* Newest backing allocator of each node, created on first use */
+	struct numa_arena *nodes[T7_MAX_NUMA_NODES];
+};
+
+
+/* Virtual functions */
+struct allocator *allocate_numa_allocator(void);
+void free_numa_allocator(struct allocator *ap);
+int create_numa_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable);
+void destroy_numa_allocator(struct allocator *ap);
+void *numa_grab_memory(struct allocator *ap, size_t n);
+void numa_release_memory(struct allocator *ap, void *p);
+void *numa_resize_memory(struct allocator *ap, void *p, size_t n);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_NUMA_ALLOCATOR_H*/
@@ -0,0 +1,176 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_QUEUE_H
+#define T7_QUEUE_H
+#include "t7/allocator.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct queue;
+
+
+/****t* libt7/queue_t
+ * NAME
+ * queue_t - bounded multi-producer multi-consumer queue
+ *
+ * FUNCTION
+ * Fixed-size ring of pointers which may be pushed and popped by any number
+ * of threads concurrently without locks.  Items are popped in the order
+ * they were pushed.  Threads blocked in push_queue or pop_queue sleep in
+ * the kernel until the queue changes state.
+ *
+ * EXAMPLE
+ * #include "t7/queue.h"
+ *
+ * // Producer thread
+ * static int produce (thread_t *tp) {
+ *     for (size_t i = 0; i < 1000; i++) {
+ *         push_queue (qp, make_work (i));
+ *     }
+ *     push_queue (qp, NULL);
+ *     return 1;
+ * }
+ *
+ * // Consumer thread
+ * static int consume (thread_t *tp) {
+ *     void *work;
+ *     while ((work = pop_queue (qp)) != NULL) {
+ *         process_work (work);
+ *     }
+ *     return 1;
+ * }
+ *
+ * SOURCE
+ */
+typedef struct queue queue_t;
+/****/
+
+
+/****f* libt7/new_queue
+ * NAME
+ * new_queue - create queue
+ *
+ * FUNCTION
+ * Create queue with room for at least CAPACITY items.  The capacity is
+ * rounded up to the next power of two.  Memory for the queue is allocated
+ * from allocator AP or from the default allocator if AP is NULL.  The
+ * function returns NULL if memory cannot be allocated.
+ *
+ * SYNOPSIS
+ */
+queue_t *new_queue (struct allocator *ap, size_t capacity);
+/****/
+
+
+/****f* libt7/delete_queue
+ * NAME
+ * delete_queue - release queue
+ *
+ * FUNCTION
+ * Release queue QP.  No thread may be using the queue at the time of the
+ * call.  Items remaining in the queue are not released.
+ *
+ * SYNOPSIS
+ */
+void delete_queue (queue_t *qp);
+/****/
+
+
+/****f* libt7/try_push_queue
+ * NAME
+ * try_push_queue - add item to queue without blocking
+ *
+ * FUNCTION
+ * Add ITEM to the end of queue QP and return true.  If the queue is full,
+ * then the function returns zero immediately.
+ *
+ * SYNOPSIS
+ */
+int try_push_queue (queue_t *qp, void *item);
+/****/
+
+
+/****f* libt7/try_pop_queue
+ * NAME
+ * try_pop_queue - remove item from queue without blocking
+ *
+ * FUNCTION
+ * Remove the first item from queue QP, store it to ITEM and return true.
+ * If the queue is empty, then the function returns zero immediately.
+ *
+ * SYNOPSIS
+ */
+int try_pop_queue (queue_t *qp, void **item);
+/****/
+
+
+/****f* libt7/push_queue
+ * NAME
+ * push_queue - add item to queue
+ *
+ * FUNCTION
+ * Add ITEM to the end of queue QP.  If the queue is full, then the function
+ * waits until another thread pops an item.
+ *
+ * SYNOPSIS
+ */
+void push_queue (queue_t *qp, void *item);
+/****/
+
+
+/****f* libt7/pop_queue
+ * NAME
+ * pop_queue - remove item from queue
+ *
+ * FUNCTION
+ * Remove and return the first item from queue QP.  If the queue is empty,
+ * then the function waits until another thread pushes an item.
+ *
+ * SYNOPSIS
+ */
+void *pop_queue (queue_t *qp);
+/****/
+
+
+/****f* libt7/push_queue_batch
+ * NAME
+ * push_queue_batch - add multiple items to queue
+ *
+ * FUNCTION
+ * Add up to N items from array ITEMS to the end of queue QP without
+ * blocking.  The items are stored contiguously so that no other producer
+ * can interleave its items with them.  The function returns the number of
+ * items added, which is less than N if the queue fills up.
+ *
+ * SYNOPSIS
+ */
+size_t push_queue_batch (queue_t *qp, void *const *items, size_t n);
+/****/
+
+
+/****f* libt7/pop_queue_batch
+ * NAME
+ * pop_queue_batch - remove multiple items from queue
+ *
+ * FUNCTION
+ * Remove up to N items from queue QP into array ITEMS without blocking.
+ * The function returns the number of items removed.
+ *
+ * SYNOPSIS
+ */
+size_t pop_queue_batch (queue_t *qp, void **items, size_t n);
+/****/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_QUEUE_H*/
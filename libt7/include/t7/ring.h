@@ -0,0 +1,197 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_RING_H
+#define T7_RING_H
+#include "t7/allocator.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct ring;
+
+
+/****t* libt7/ring_t
+ * NAME
+ * ring_t - single-producer single-consumer byte ring
+ *
+ * FUNCTION
+ * Circular byte buffer which passes data from one producer thread to one
+ * consumer thread without locks and without copying.  The producer reserves
+ * space with reserve_ring, writes data directly to the buffer and publishes
+ * the data with commit_ring.  The consumer reads published data in place
+ * with peek_ring and gives the space back with release_ring.
+ *
+ * EXAMPLE
+ * #include "t7/ring.h"
+ *
+ * // Producer thread
+ * struct ring_span span = reserve_ring (rp, len);
+ * if (span.size >= len) {
+ *     memcpy (span.data, record, len);
+ *     commit_ring (rp, len);
+ * }
+ *
+ * // Consumer thread
+ * struct ring_span span = peek_ring (rp);
+ * if (span.size > 0) {
+ *     size_t n = process_records (span.data, span.size);
+ *     release_ring (rp, n);
+ * }
+ *
+ * SOURCE
+ */
+typedef struct ring ring_t;
+/****/
+
+
+/****d* libt7/RING_MIRROR
+ * NAME
+ * RING_MIRROR - map ring buffer twice
+ *
+ * FUNCTION
+ * Flag for new_ring.  Map the storage of the ring twice to consecutive
+ * virtual addresses so that data which wraps around the end of the buffer
+ * can still be accessed as one contiguous span.
+ *
+ * SOURCE
+ */
+#define RING_MIRROR 1
+/****/
+
+
+/****s* libt7/ring_span
+ * NAME
+ * ring_span - contiguous part of ring buffer
+ *
+ * FUNCTION
+ * Pointer to DATA and the number of bytes which may be accessed through the
+ * pointer.  Empty span has SIZE zero.
+ *
+ * SOURCE
+ */
+struct ring_span {
+	char *data;
+	size_t size;
+};
+/****/
+
+
+/****f* libt7/new_ring
+ * NAME
+ * new_ring - create ring buffer
+ *
+ * FUNCTION
+ * Create ring buffer which holds at least SIZE bytes.  The size is rounded
+ * up to the next power of two, or to a multiple of page size if FLAGS
+ * contains RING_MIRROR.  Control structures and storage are allocated from
+ * allocator AP or from the default allocator if AP is NULL.  Mirrored
+ * storage is always mapped directly from the operating system.
+ *
+ * The function returns NULL if memory cannot be allocated or if mirroring
+ * is not supported on the platform.
+ *
+ * SYNOPSIS
+ */
+ring_t *new_ring (struct allocator *ap, size_t size, int flags);
+/****/
+
+
+/****f* libt7/delete_ring
+ * NAME
+ * delete_ring - release ring buffer
+ *
+ * FUNCTION
+ * Release ring buffer RP.  Neither producer nor consumer may be using the
+ * ring at the time of the call.
+ *
+ * SYNOPSIS
+ */
+void delete_ring (ring_t *rp);
+/****/
+
+
+/****f* libt7/reserve_ring
+ * NAME
+ * reserve_ring - get writable span
+ *
+ * FUNCTION
+ * Return writable span at the end of ring RP if the ring has room for at
+ * least N bytes.  Otherwise, the function returns an empty span.
+ *
+ * The span covers all contiguous free space at the time of the call.  In a
+ * mirrored ring, the span thus contains at least N bytes.  In a ring
+ * without mirror, the span may end at the end of the buffer before N bytes.
+ * In that case, write the first part of the data, commit it and call
+ * reserve_ring again to get the remaining space from the start of the
+ * buffer.
+ *
+ * The function may only be called from the producer thread.
+ *
+ * SYNOPSIS
+ */
+struct ring_span reserve_ring (ring_t *rp, size_t n);
+/****/
+
+
+/****f* libt7/commit_ring
+ * NAME
+ * commit_ring - publish data
+ *
+ * FUNCTION
+ * Make first N bytes of the span returned by reserve_ring visible to the
+ * consumer.  The function may only be called from the producer thread.
+ *
+ * SYNOPSIS
+ */
+void commit_ring (ring_t *rp, size_t n);
+/****/
+
+
+/****f* libt7/peek_ring
+ * NAME
+ * peek_ring - get readable span
+ *
+ * FUNCTION
+ * Return span covering contiguous data at the start of ring RP.  In a
+ * mirrored ring, the span covers all data in the ring.  In a ring without
+ * mirror, the span ends at the end of the buffer and the rest of the data
+ * becomes available after the span has been released.  If the ring is
+ * empty, then the function returns an empty span.
+ *
+ * In order to avoid reading the producer's position on every call, the
+ * function only picks up data committed after the previous call once the
+ * data returned by the previous call has been released.
+ *
+ * The function may only be called from the consumer thread.
+ *
+ * SYNOPSIS
+ */
+struct ring_span peek_ring (ring_t *rp);
+/****/
+
+
+/****f* libt7/release_ring
+ * NAME
+ * release_ring - free consumed data
+ *
+ * FUNCTION
+ * Give first N bytes of the span returned by peek_ring back to the
+ * producer.  The function may only be called from the consumer thread.
+ *
+ * SYNOPSIS
+ */
+void release_ring (ring_t *rp, size_t n);
+/****/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_RING_H*/
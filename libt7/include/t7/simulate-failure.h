@@ -67,6 +67,92 @@ int simulate_failure (void);
 /****/
 
 
+/****f* libt7/simulate_failure_at
+ * NAME
+ * simulate_failure_at - simulate failure at named call site
+ *
+ * FUNCTION
+ * Same as simulate_failure but attribute the call to SITE in the report
+ * printed by repeat_test.  SITE must point to a string which remains valid
+ * until the end of the test, usually a string literal.  By default,
+ * simulate_failure attributes calls to the address of the caller or to the
+ * site given to enter_failure_site.
+ *
+ * EXAMPLE
+ * if (!simulate_failure_at ("read config")) {
+ *     fp = fopen (fn, "r");
+ * } else {
+ *     fp = NULL;
+ * }
+ *
+ * SYNOPSIS
+ */
+int simulate_failure_at (const char *site);
+/****/
+
+
+/****f* libt7/set_failure_report
+ * NAME
+ * set_failure_report - print call sites at the end of repeat_test
+ *
+ * FUNCTION
+ * Make repeat_test record every call to simulate_failure and print a report
+ * to stream OUT when the test is over.  The report lists the number of
+ * iterations with their total and longest wall time, followed by the call
+ * sites sorted by the number of calls.  For each site, the report gives the
+ * number of calls and the number of simulated failures.  Sites which never
+ * failed are marked since their error paths went untested.
+ *
+ * Call sites without a name are printed as return addresses, which may be
+ * mapped to source lines with addr2line.  Calls made through allocate_memory
+ * and friends are attributed to the code which asked for memory.  Pass NULL
+ * to stop reporting.
+ *
+ * SYNOPSIS
+ */
+void set_failure_report (FILE *out);
+/****/
+
+
+/****f* libt7/enter_failure_site
+ * NAME
+ * enter_failure_site - attribute nested calls to call site
+ *
+ * FUNCTION
+ * Attribute unnamed calls to simulate_failure to SITE in the report printed
+ * by repeat_test until the matching call to leave_failure_site.  Wrappers
+ * such as allocate_memory pass T7_CALLER_ADDRESS so that failures of
+ * faulty_allocator are charged to the code which asked for memory rather
+ * than to the allocator.  Only the outermost site counts, so wrappers may
+ * call each other.
+ *
+ * The function returns true if SITE was taken into use.  The return value
+ * must be passed to leave_failure_site.  When no report is requested, the
+ * function returns zero without doing anything else.
+ *
+ * EXAMPLE
+ * void *allocate_memory (size_t n) {
+ *     int entered = enter_failure_site (T7_CALLER_ADDRESS);
+ *     void *p = allocator_allocate_memory (get_default_allocator (), n);
+ *     leave_failure_site (entered);
+ *     return p;
+ * }
+ *
+ * SYNOPSIS
+ */
+int enter_failure_site (const void *site);
+void leave_failure_site (int entered);
+/****/
+
+
+/* Return address of current function, or NULL if not available */
+#if defined(__GNUC__)
+#   define T7_CALLER_ADDRESS __builtin_return_address (0)
+#else
+#   define T7_CALLER_ADDRESS NULL
+#endif
+
+
 /****f* libt7/repeat_test
  * NAME
  * repeat_test - branch and execute a test function repeatedly
@@ -127,6 +213,166 @@ int repeat_test (test_function *f);
 /****/
 
 
+/****f* libt7/repeat_test_parallel
+ * NAME
+ * repeat_test_parallel - execute test function with failures in parallel
+ *
+ * FUNCTION
+ * Execute the test_function F once without simulated failures and then once
+ * for every call to simulate_failure made during that run, such that only
+ * the selected call fails.  The runs are distributed to THREADS threads
+ * including the current one.
+ *
+ * Unlike repeat_test, which also tries every combination of failures after
+ * the first one, this function simulates exactly one failure per run.  The
+ * runs are independent of each other and thus may execute concurrently,
+ * which means that the test function must be thread-safe.  Each thread has
+ * a failure simulation of its own, and new threads use the fixture of the
+ * current thread.
+ *
+ * The test function must return true if it handles the simulated failure
+ * correctly.  The function returns true if every run passes.  Otherwise,
+ * the function stores the number of the first failing call to FAILED_AT,
+ * counting from zero, and returns zero.  If the test function fails even
+ * without simulated failures, then FAILED_AT is set to (size_t) -2.
+ *
+ * EXAMPLE
+ * #include "t7/fixture.h"
+ * #include "t7/simulate-failure.h"
+ *
+ * int main (void) {
+ *     size_t k;
+ *
+ *     set_fixture (test_fixture);
+ *     if (!repeat_test_parallel (allocate, 8, &k)) {
+ *         printf ("Failure at allocation %zu not handled\n", k);
+ *         return 1;
+ *     }
+ *     return 0;
+ * }
+ *
+ * SYNOPSIS
+ */
+int repeat_test_parallel (test_function *f, size_t threads, size_t *failed_at);
+/****/
+
+
+/****f* libt7/repeat_test_forked
+ * NAME
+ * repeat_test_forked - explore failures in child processes
+ *
+ * FUNCTION
+ * Execute the test_function F once without simulated failures.  At every
+ * call to simulate_failure, the process forks: the child process takes the
+ * failure branch and continues to the end of the test function with the
+ * remaining calls succeeding, while the parent continues down the success
+ * branch.  Thus, every failure point is tested without replaying the calls
+ * which lead to it.  At most MAX_CHILDREN child processes run at a time.
+ *
+ * Child processes report their results back to the parent through pipes
+ * and exit without running exit handlers.  A child which crashes counts as
+ * a failure.  Since only the calling thread is copied to a child process,
+ * the test function should not depend on other threads.
+ *
+ * The test function must return true if it handles the simulated failure
+ * correctly.  The function returns true if the test function passes with
+ * every failure point.  Otherwise, the function stores the number of the
+ * first failing call to FAILED_AT, counting from zero, and returns zero.
+ * If the test function fails even without simulated failures, then
+ * FAILED_AT is set to (size_t) -2.
+ *
+ * The function is available on Unix-like systems only.
+ *
+ * SYNOPSIS
+ */
+int repeat_test_forked (test_function *f, size_t max_children, size_t *failed_at);
+/****/
+
+
+/****f* libt7/enable_sampled_failures
+ * NAME
+ * enable_sampled_failures - fail calls to simulate_failure randomly
+ *
+ * FUNCTION
+ * Make simulate_failure fail outside of repeat_test and friends.  Each call
+ * fails with PROBABILITY, which ranges from 0.0 to 1.0, and additionally
+ * every INTERVALth call in each thread fails if INTERVAL is non-zero.  The
+ * mode is meant for long soak and load runs where exhaustive testing would
+ * be too expensive.  Since test_fixture and faulty_allocator are driven by
+ * simulate_failure, allocations through them fail in the same manner.
+ *
+ * Every thread draws random numbers from a generator of its own.  The
+ * generators are seeded from SEED and the stream number of the thread given
+ * to set_failure_stream, so a run can be repeated exactly by giving the same
+ * seed and stream numbers regardless of how threads are scheduled.
+ *
+ * Functions repeat_test, repeat_test_parallel and repeat_test_forked are
+ * not affected by the setting.  Calling the function again replaces the
+ * configuration and seeds the generators again.  The configuration may be
+ * replaced while other threads are calling simulate_failure, and each thread
+ * picks up the new configuration at its next call.  Replacing the
+ * configuration allocates no memory, so soak runs may seed the generators
+ * again as often as they like.
+ *
+ * EXAMPLE
+ * #include "t7/fixture.h"
+ * #include "t7/simulate-failure.h"
+ *
+ * int main (void) {
+ *     // Fail one allocation in a thousand
+ *     set_fixture (test_fixture);
+ *     enable_sampled_failures (0.001, 0, 12345);
+ *     run_server ();
+ *     disable_sampled_failures ();
+ *     return 0;
+ * }
+ *
+ * SYNOPSIS
+ */
+void enable_sampled_failures (double probability, size_t interval, unsigned long seed);
+/****/
+
+
+/****f* libt7/disable_sampled_failures
+ * NAME
+ * disable_sampled_failures - stop failing calls randomly
+ *
+ * FUNCTION
+ * Restore the default behavior where simulate_failure only fails during
+ * repeat_test and friends.  Sampled failures are disabled by default, and
+ * the disabled mode costs a single branch in simulate_failure.
+ *
+ * SYNOPSIS
+ */
+void disable_sampled_failures (void);
+/****/
+
+
+/****f* libt7/set_failure_stream
+ * NAME
+ * set_failure_stream - select random number stream of current thread
+ *
+ * FUNCTION
+ * Make sampled failures of the current thread draw random numbers from
+ * stream STREAM.  Threads use stream zero by default, and threads using the
+ * same stream fail at the same calls.  To repeat a multi-threaded run, give
+ * each thread a distinct number which does not depend on the thread
+ * schedule, such as the order in which the test creates the threads.  The
+ * generator of the thread is seeded again at the next call.
+ *
+ * EXAMPLE
+ * static int worker_main (thread_t *tp) {
+ *     struct worker *wp = (struct worker*) tp;
+ *     set_failure_stream (wp->index);
+ *     ...
+ * }
+ *
+ * SYNOPSIS
+ */
+void set_failure_stream (unsigned long stream);
+/****/
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,9 +23,30 @@ int create_static_allocator_with_buffer(
 	struct allocator *ap, const struct allocator_vtable *vtable,
 	char *buffer, size_t size);
 
+/* Options of static allocator with mapped buffer */
+#define STATIC_HUGE_PAGES 1
+#define STATIC_POPULATE 2
+#define STATIC_LOCAL_NODE 4
+
+/*
+ * Initialize static allocator with buffer of SIZE bytes mapped from system.
+ * STATIC_HUGE_PAGES maps the buffer to huge pages, either reserved ones or
+ * transparent ones, to reduce TLB misses.  STATIC_POPULATE faults the pages
+ * in before returning so that the first allocations do not stall.
+ * STATIC_LOCAL_NODE places the pages on the NUMA node of the calling thread.
+ * Size is rounded up to whole pages and the buffer is taken from the heap
+ * if memory cannot be mapped.
+ */
+int create_static_allocator_with_map(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	size_t size, int options);
+
 /* Static allocator type */
 extern const struct allocator_vtable *static_allocator;
 
+/* Static allocator type having 2 MiB buffer on huge pages of local node */
+extern const struct allocator_vtable *mapped_static_allocator;
+
 
 /* Structure of static allocator */
 struct static_allocator {
@@ -40,6 +61,12 @@ struct static_allocator {
 
 	/* Total size of memory buffer in bytes */
 	size_t size;
+
+	/* True if buffer is mapped from system */
+	int mapped;
+
+	/* Non-zero while a thread is using the allocator */
+	int lock;
 };
 
 /* Structure of internal memory node */
@@ -0,0 +1,203 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_TEXT_H
+#define T7_TEXT_H
+#include "t7/charset.h"
+#include "t7/allocator.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct text_builder;
+
+
+/****s* libt7/text_view_t
+ * NAME
+ * text_view_t - text in memory owned by someone else
+ *
+ * FUNCTION
+ * Reference to LEN bytes of text at DATA in character set CHARSET.  The
+ * view does not own the text, so the text must remain valid for as long as
+ * the view is used.  Views are small and passed by value.
+ *
+ * SOURCE
+ */
+typedef struct text_view {
+    /* Start of text */
+    const char *data;
+
+    /* Length of text in bytes */
+    size_t len;
+
+    /* Character set of text */
+    charset_t charset;
+} text_view_t;
+/****/
+
+
+/****f* libt7/make_text_view
+ * NAME
+ * make_text_view - refer to text
+ *
+ * FUNCTION
+ * Return view of N bytes at P in character set CHARSET.
+ *
+ * EXAMPLE
+ * text_view_t v = make_text_view (L"abc", 3 * sizeof (wchar_t), WCHAR);
+ *
+ * SYNOPSIS
+ */
+text_view_t make_text_view (const void *p, size_t n, charset_t charset);
+/****/
+
+
+/****f* libt7/make_string_view
+ * NAME
+ * make_string_view - refer to zero-terminated string
+ *
+ * FUNCTION
+ * Return view of zero-terminated string S in character set CHARSET.  The
+ * terminating zero is not part of the view.  Use make_text_view for
+ * character sets such as UTF16 whose characters may contain zero bytes.
+ *
+ * EXAMPLE
+ * text_view_t v = make_string_view ("Hello", UTF8);
+ *
+ * SYNOPSIS
+ */
+text_view_t make_string_view (const char *s, charset_t charset);
+/****/
+
+
+/****t* libt7/text_builder_t
+ * NAME
+ * text_builder_t - rope for building text from fragments
+ *
+ * FUNCTION
+ * Collects fragments of text in any character set and produces their
+ * concatenation in the character set of the builder.  Fragments are kept in
+ * their own character set and transcoded only when get_text is called.
+ *
+ * As long as all text is in the character set of the builder, the text is
+ * kept in one chunk of memory which grows with allocator_resize_memory, in
+ * place if the allocator can, and get_text returns it without copying.
+ * Other fragments are stored in a list of chunks which grow up to a limited
+ * size and are then linked together, so text already in the builder is not
+ * copied again when more is appended.
+ *
+ * EXAMPLE
+ * #include "t7/text.h"
+ *
+ * text_builder_t *bp = new_text_builder (NULL, UTF8);
+ * append_text (bp, make_string_view ("<p>", ASCII));
+ * append_text (bp, make_text_view (name, name_len, ISO8859_1));
+ * append_text (bp, make_string_view ("</p>", ASCII));
+ *
+ * text_view_t v;
+ * if (get_text (bp, &v)) {
+ *     fwrite (v.data, 1, v.len, stdout);
+ * }
+ * delete_text_builder (bp);
+ *
+ * SOURCE
+ */
+typedef struct text_builder text_builder_t;
+/****/
+
+
+/****f* libt7/new_text_builder
+ * NAME
+ * new_text_builder - create empty text builder
+ *
+ * FUNCTION
+ * Create builder which produces text in character set CHARSET.  Memory is
+ * allocated from allocator AP or from the default allocator if AP is NULL.
+ * The function returns NULL if memory cannot be allocated or if CHARSET is
+ * not supported by the transcoder.
+ *
+ * SYNOPSIS
+ */
+text_builder_t *new_text_builder (struct allocator *ap, charset_t charset);
+/****/
+
+
+/****f* libt7/delete_text_builder
+ * NAME
+ * delete_text_builder - release text builder
+ *
+ * FUNCTION
+ * Release builder BP and all text copied to it.  Views returned by get_text
+ * become invalid.
+ *
+ * SYNOPSIS
+ */
+void delete_text_builder (text_builder_t *bp);
+/****/
+
+
+/****f* libt7/append_text
+ * NAME
+ * append_text - copy text to end of builder
+ *
+ * FUNCTION
+ * Copy text of view V to the end of builder BP.  The text is kept in its
+ * own character set until get_text is called, so invalid input is only
+ * detected then.  The function returns true on success and zero if memory
+ * cannot be allocated or if the character set of V is invalid.
+ *
+ * SYNOPSIS
+ */
+int append_text (text_builder_t *bp, text_view_t v);
+/****/
+
+
+/****f* libt7/append_text_ref
+ * NAME
+ * append_text_ref - add text to end of builder without copying
+ *
+ * FUNCTION
+ * Add text of view V to the end of builder BP by reference.  Only the view
+ * is stored, so the text must remain valid until get_text has been called
+ * or until the builder is deleted.  Use this for large texts which live
+ * longer than the builder anyway.  The function returns true on success.
+ *
+ * SYNOPSIS
+ */
+int append_text_ref (text_builder_t *bp, text_view_t v);
+/****/
+
+
+/****f* libt7/get_text
+ * NAME
+ * get_text - get contents of builder
+ *
+ * FUNCTION
+ * Store view of the text collected in builder BP to VP.  Fragments are
+ * transcoded to the character set of the builder and joined into one chunk
+ * which then replaces them, so calling the function again without appending
+ * returns the same view for free.  The view remains valid until more text
+ * is appended or the builder is deleted.
+ *
+ * Fragments already in the character set of the builder are copied as is.
+ * The function returns zero if another fragment contains an invalid
+ * sequence or a character which cannot be represented in the character set
+ * of the builder, or if memory cannot be allocated.  The builder is left
+ * unchanged in that case.
+ *
+ * SYNOPSIS
+ */
+int get_text (text_builder_t *bp, text_view_t *vp);
+/****/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_TEXT_H*/
@@ -292,6 +292,42 @@ int start_thread (thread_t *tp);
 /****/
 
 
+/****f* libt7/start_thread_on_node
+ * NAME
+ * start_thread_on_node - start thread bound to NUMA node
+ *
+ * FUNCTION
+ * Start running thread TP like start_thread but only on processors of NUMA
+ * node NODE.  Memory allocated by the thread then stays on the same node as
+ * the thread, see numa_allocator.  If processors of NODE cannot be found
+ * out, such as when the system does not support NUMA, then the thread runs
+ * on any processor.  The function returns true if the thread was started.
+ *
+ * EXAMPLE
+ * // Run thread on the same node as the current thread
+ * start_thread_on_node (tp, get_current_node ());
+ *
+ * SYNOPSIS
+ */
+int start_thread_on_node (thread_t *tp, int node);
+/****/
+
+
+/****f* libt7/get_current_node
+ * NAME
+ * get_current_node - get NUMA node of current thread
+ *
+ * FUNCTION
+ * Return number of NUMA node of the processor which runs the current
+ * thread, or zero if the node cannot be found out.  Unless the thread has
+ * been bound to a node, the result may change at any time.
+ *
+ * SYNOPSIS
+ */
+int get_current_node (void);
+/****/
+
+
 /****f* libt7/join_thread
  * NAME
  * join_thread - wait for thread to finish
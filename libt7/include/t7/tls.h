@@ -55,6 +55,7 @@ struct tls_data;
  *     create_dummy,
  *     destroy_dummy,
  *     get_dummy,
+ *     NULL
  * };
  *
  * // Define shorthand for the type
@@ -227,6 +228,24 @@ typedef void *get_tls_function (tls_variable_t *vp);
  * Structure with pointers to various functions which define the functionality
  * of the thread-local variable.  See tls_type_t for more information.
  *
+ * The library assigns a unique slot number to the type when the type is
+ * first used and then locates variables of the type by the slot number.
+ * Field SLOT may point to a zero-initialized variable where the library
+ * stores the slot number.  Such types are located with a single load, while
+ * types without SLOT look up their slot number from a table.  The type
+ * itself is never modified, so types may be declared const.
+ *
+ * EXAMPLE
+ * static size_t dummy_slot;
+ * static const tls_type_t mytp1 = {
+ *     allocate_dummy,
+ *     free_dummy,
+ *     create_dummy,
+ *     destroy_dummy,
+ *     get_dummy,
+ *     &dummy_slot
+ * };
+ *
  * SOURCE
  */
 struct tls_type {
@@ -235,6 +254,7 @@ struct tls_type {
     create_tls_function *create;
     destroy_tls_function *destroy;
     get_tls_function *get;
+    size_t *slot;
 };
 /****/
 
@@ -273,6 +293,46 @@ void *get_tls (const tls_type_t *tp);
 /****/
 
 
+/****s* libt7/tls_statistics
+ * NAME
+ * tls_statistics - counters of thread-local variable lookups
+ *
+ * FUNCTION
+ * Number of times get_tls has located a variable in the current thread by
+ * each of the available methods.  Field FAST counts variables found directly
+ * by slot number.  Fields CACHED and HASHED count variables found from the
+ * storage of the thread either as the result of the previous lookup or from
+ * the hash table.  Field PROBES counts hash table entries examined, MISSES
+ * counts lookups which did not find a variable and CREATED counts the
+ * variables created.
+ *
+ * SOURCE
+ */
+struct tls_statistics {
+    size_t fast;
+    size_t cached;
+    size_t hashed;
+    size_t probes;
+    size_t misses;
+    size_t created;
+};
+/****/
+
+
+/****f* libt7/get_tls_statistics
+ * NAME
+ * get_tls_statistics - get counters of thread-local variable lookups
+ *
+ * FUNCTION
+ * Copy lookup counters of the current thread to the structure pointed by
+ * STATS and return true on success.
+ *
+ * SYNOPSIS
+ */
+int get_tls_statistics (struct tls_statistics *stats);
+/****/
+
+
 /****F* libt7/create_tls
  * NAME
  * create_tls - initialize thread-local variable
@@ -0,0 +1,171 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#ifndef T7_TRANSCODER_H
+#define T7_TRANSCODER_H
+#include "t7/charset.h"
+#include "t7/allocator.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Forward-decl */
+struct transcoder;
+
+
+/****t* libt7/transcoder_t
+ * NAME
+ * transcoder_t - streaming character set converter
+ *
+ * FUNCTION
+ * Converter which translates text from one character set to another in
+ * chunks of arbitrary size.  Multi-byte sequences which are split between
+ * chunks are kept in the transcoder until the rest of the sequence arrives.
+ *
+ * EXAMPLE
+ * #include "t7/transcoder.h"
+ *
+ * transcoder_t *tp = open_transcoder (UTF8, UTF16LE);
+ * while ((n = fread (in, 1, sizeof (in), fp)) > 0) {
+ *     size_t i = 0;
+ *     while (i < n) {
+ *         if (!transcode (tp, in + i, n - i, out, sizeof (out), &k, &m))
+ *             error ();
+ *         fwrite (out, 1, m, stdout);
+ *         i += k;
+ *     }
+ * }
+ * if (!transcode (tp, NULL, 0, out, sizeof (out), &k, &m))
+ *     error ();
+ * close_transcoder (tp);
+ *
+ * SOURCE
+ */
+typedef struct transcoder transcoder_t;
+/****/
+
+
+/****f* libt7/open_transcoder
+ * NAME
+ * open_transcoder - create character set converter
+ *
+ * FUNCTION
+ * Create transcoder which converts text from character set FROM to character
+ * set TO.  Pseudo character sets such as UTF16, WCHAR and LOCALE_CHARSET are
+ * resolved to their machine dependent counterparts with resolve_charset.
+ * The transcoder is allocated with the default allocator.
+ *
+ * The function returns NULL if memory cannot be allocated or if either
+ * character set is not supported.
+ *
+ * SYNOPSIS
+ */
+transcoder_t *open_transcoder (charset_t from, charset_t to);
+/****/
+
+
+/****f* libt7/new_transcoder
+ * NAME
+ * new_transcoder - create character set converter with allocator
+ *
+ * FUNCTION
+ * Works like open_transcoder but allocates the transcoder from allocator AP,
+ * or from the default allocator if AP is NULL.  The transcoder is released
+ * back to the same allocator by close_transcoder.
+ *
+ * SYNOPSIS
+ */
+transcoder_t *new_transcoder (
+    struct allocator *ap, charset_t from, charset_t to);
+/****/
+
+
+/****f* libt7/close_transcoder
+ * NAME
+ * close_transcoder - release character set converter
+ *
+ * FUNCTION
+ * Release transcoder TP.  Partial sequence held in the transcoder, if any,
+ * is discarded.
+ *
+ * SYNOPSIS
+ */
+void close_transcoder (transcoder_t *tp);
+/****/
+
+
+/****f* libt7/reset_transcoder
+ * NAME
+ * reset_transcoder - discard partial sequence
+ *
+ * FUNCTION
+ * Return transcoder TP to its initial state so that it can be used for
+ * converting another text.
+ *
+ * SYNOPSIS
+ */
+void reset_transcoder (transcoder_t *tp);
+/****/
+
+
+/****f* libt7/transcode
+ * NAME
+ * transcode - convert chunk of text
+ *
+ * FUNCTION
+ * Convert IN_LEN bytes from IN and store the result to OUT which has room
+ * for OUT_CAP bytes.  The function stores the number of input bytes used to
+ * CONSUMED and the number of output bytes written to PRODUCED.
+ *
+ * Conversion stops when the input is exhausted or when the next character
+ * does not fit in the output buffer.  The output buffer should have room
+ * for at least four bytes in order to guarantee progress.  Incomplete
+ * sequence at the end of input is consumed and kept in the transcoder until
+ * the next call.  Pass NULL as IN at the end of text to make sure that no
+ * incomplete sequence was left over.
+ *
+ * The function returns true on success.  If the input contains an invalid
+ * sequence or a character which cannot be represented in the target
+ * character set, then the function returns zero and CONSUMED tells the
+ * position of the offending sequence.  Output up to the position is valid.
+ *
+ * SYNOPSIS
+ */
+int transcode (
+	transcoder_t *tp, const void *in, size_t in_len,
+	void *out, size_t out_cap, size_t *consumed, size_t *produced);
+/****/
+
+
+/****f* libt7/transcode_all
+ * NAME
+ * transcode_all - convert whole text at once
+ *
+ * FUNCTION
+ * Convert IN_LEN bytes from IN from character set FROM to character set TO
+ * and return the result in a buffer allocated with allocate_memory.  The
+ * length of the result in bytes is stored to OUT_LEN.  The result is
+ * followed by four zero bytes which are not included in the length, so the
+ * buffer may be used as a zero-terminated string of any character set.
+ * Release the buffer with free_memory.
+ *
+ * The function returns NULL if the input is invalid, if the character sets
+ * are not supported or if memory cannot be allocated.
+ *
+ * SYNOPSIS
+ */
+char *transcode_all (
+	charset_t from, charset_t to, const void *in, size_t in_len,
+	size_t *out_len);
+/****/
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*T7_TRANSCODER_H*/
@@ -11,6 +11,7 @@
 #include "t7/memory.h"
 #include "t7/exit-handler.h"
 #include "t7/critical-section.h"
+#include "t7/simulate-failure.h"
 
 
 /* Get pointer to allocator */
@@ -49,6 +50,11 @@ static int initialized = 0;
 /* Get reference to default allocator */
 struct allocator *get_default_allocator(void)
 {
+	/* Use allocator resolved when entering current scope, if any */
+	struct allocator *ap = get_scope_allocator();
+	if (ap)
+		return ap;
+
 	/* Get current fixture (will terminate app on failure) */
 	fixture_t *fp = get_fixture();
 	assert(fp != NULL);
@@ -70,8 +76,13 @@ struct allocator *get_allocator(const struct allocator_vtable *vtable)
 		/* Yes, find/create allocator */
 		ap = find_allocator(vtable);
 	} else {
-		/* No, register exit function to clean up variables */
-		if (exit_handler(cleanup, 20)) {
+		/*
+		 * No, register exit function to clean up variables.  Cleanup
+		 * only touches allocators, so it may run concurrently with
+		 * other memory releasing functions of the same priority.
+		 */
+		if (exit_handler_flags(cleanup, 20,
+			EXIT_RELEASES_MEMORY | EXIT_CONCURRENT)) {
 			/* Initialize head node */
 			head.next = &tail;
 			head.prev = NULL;
@@ -202,9 +213,12 @@ void *allocator_allocate_memory(struct allocator *ap, size_t n)
 	if (!n)
 		return NULL;
 
-	/* Allocate memory through allocator */
+	/* Allocate memory through allocator on behalf of caller */
 	assert(ap->vtable->grab != NULL);
-	return ap->vtable->grab(ap, n);
+	int entered = enter_failure_site(T7_CALLER_ADDRESS);
+	void *p = ap->vtable->grab(ap, n);
+	leave_failure_site(entered);
+	return p;
 }
 
 
@@ -213,6 +227,9 @@ void *allocator_resize_memory(struct allocator *ap, void *p, size_t n)
 {
 	assert (ap != NULL);
 
+	/* Attribute simulated failures to caller */
+	int entered = enter_failure_site(T7_CALLER_ADDRESS);
+
 	/* Do we have a memory area to resize? */
 	void *q;
 	if (p) {
@@ -237,6 +254,7 @@ void *allocator_resize_memory(struct allocator *ap, void *p, size_t n)
 			q = NULL;
 		}
 	}
+	leave_failure_site(entered);
 	return q;
 }
 
@@ -7,609 +7,238 @@
  */
 #include "t7/types.h"
 #include "t7/charset.h"
-#include "t7/terminate.h"
-
-
-/* Parser modes for parse_charset() */
-enum parse_mode {
-    PARSE_INIT = 0,
-    PARSE_A = 1,
-    PARSE_AS = 2,
-    PARSE_ASC = 3,
-    PARSE_ASCI = 4,
-    PARSE_I = 5,
-    PARSE_IS = 6,
-    PARSE_ISO = 7,
-    PARSE_ISO8 = 8,
-    PARSE_ISO88 = 9,
-    PARSE_ISO885 = 10,
-    PARSE_ISO8859 = 11,
-    PARSE_ISO8859DASH = 12,
-    PARSE_L = 14,
-    PARSE_LA = 15,
-    PARSE_LAT = 16,
-    PARSE_LATI = 17,
-    PARSE_LATIN = 18,
-    PARSE_U = 19,
-    PARSE_UT = 20,
-    PARSE_UTF = 21,
-    PARSE_UTF1 = 22,
-    PARSE_UTF16 = 23,
-    PARSE_UTF16B = 24,
-    PARSE_UTF16L = 25,
-    PARSE_UTF3 = 26,
-    PARSE_UTF32 = 27,
-    PARSE_UTF32L = 28,
-    PARSE_UTF32B = 29,
-    PARSE_EXIT = 30,
-    PARSE_ERROR = 31
-};
-typedef enum parse_mode parse_mode_t;
-
-/* Returns true on little-endian system */
-static int little_endian (void);
-
-
-/* Convert string to character set */
-charset_t
-parse_charset (const char *p)
-{
-    unsigned i = 0;
-    parse_mode_t mode = PARSE_INIT;
-    int done = 0;
-    charset_t result = INVALID_CHARSET;
-
-    while (!done) {
-
-        /* Get next character from string */
-        char c = p[i];
-
-        /* Parse character according to current mode */
-        switch (mode) {
-        case PARSE_INIT:
-            /* Initial mode */
-            switch (c) {
-            case ' ':
-            case '\t':
-            case '\r':
-            case '\n':
-                /* Ignore void space */
-                i++;
-                break;
-
-            case 'a':
-            case 'A':
-                i++;
-                mode = PARSE_A;
-                break;
-
-            case 'i':
-            case 'I':
-                i++;
-                mode = PARSE_I;
-                break;
-
-            case 'l':
-            case 'L':
-                i++;
-                mode = PARSE_L;
-                break;
-
-            case 'u':
-            case 'U':
-                i++;
-                mode = PARSE_U;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_A:
-            /* After A */
-            switch (c) {
-            case 's':
-            case 'S':
-                i++;
-                mode = PARSE_AS;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_AS:
-            /* After AS */
-            switch (c) {
-            case 'c':
-            case 'C':
-                i++;
-                mode = PARSE_ASC;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ASC:
-            /* After ASC */
-            switch (c) {
-            case 'i':
-            case 'I':
-                i++;
-                mode = PARSE_ASCI;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ASCI:
-            /* After ASCI */
-            switch (c) {
-            case 'i':
-            case 'I':
-                i++;
-                mode = PARSE_EXIT;
-                result = ASCII;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_I:
-            /* After I */
-            switch (c) {
-            case 's':
-            case 'S':
-                i++;
-                mode = PARSE_IS;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_IS:
-            /* After IS */
-            switch (c) {
-            case 'o':
-            case 'O':
-                i++;
-                mode = PARSE_ISO;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO:
-            /* After ISO */
-            switch (c) {
-            case ' ':
-            case '-':
-                /* Ignore space or dash */
-                i++;
-                break;
-
-            case '8':
-                i++;
-                mode = PARSE_ISO8;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO8:
-            /* After ISO8 */
-            switch (c) {
-            case '8':
-                i++;
-                mode = PARSE_ISO88;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO88:
-            /* After ISO88 */
-            switch (c) {
-            case '5':
-                i++;
-                mode = PARSE_ISO885;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO885:
-            /* After ISO885 */
-            switch (c) {
-            case '9':
-                i++;
-                mode = PARSE_ISO8859;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO8859:
-            /* After ISO8859 */
-            switch (c) {
-            case '-':
-                i++;
-                mode = PARSE_ISO8859DASH;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_ISO8859DASH:
-            /* After ISO8859 */
-            switch (c) {
-            case '1':
-                i++;
-                mode = PARSE_EXIT;
-                result = ISO8859_1;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_L:
-            /* After L */
-            switch (c) {
-            case 'a':
-            case 'A':
-                i++;
-                mode = PARSE_LA;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_LA:
-            /* After LA */
-            switch (c) {
-            case 't':
-            case 'T':
-                i++;
-                mode = PARSE_LAT;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_LAT:
-            /* After LAT */
-            switch (c) {
-            case 'i':
-            case 'I':
-                i++;
-                mode = PARSE_LATI;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_LATI:
-            /* After LATI */
-            switch (c) {
-            case 'n':
-            case 'N':
-                i++;
-                mode = PARSE_LATIN;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_LATIN:
-            /* After LA */
-            switch (c) {
-            case ' ':
-            case '-':
-                /* Ignore space and dash */
-                i++;
-                break;
-
-            case '1':
-                i++;
-                mode = PARSE_EXIT;
-                result = ISO8859_1;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_U:
-            /* After U */
-            switch (c) {
-            case 't':
-            case 'T':
-                i++;
-                mode = PARSE_UT;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
-
-        case PARSE_UT:
-            /* After UT */
-            switch (c) {
-            case 'f':
-            case 'F':
-                i++;
-                mode = PARSE_UTF;
-                break;
-
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+#include "t7/critical-section.h"
+#include <stdint.h>
+#include <ctype.h>
+#if defined(HAVE_NL_LANGINFO)
+#   include <langinfo.h>
+#endif
 
-        case PARSE_UTF:
-            /* After UTF */
-            switch (c) {
-            case ' ':
-            case '-':
-                /* Ignore space or dash */
-                i++;
-                break;
-
-            case '1':
-                i++;
-                mode = PARSE_UTF1;
-                break;
-
-            case '3':
-                i++;
-                mode = PARSE_UTF3;
-                break;
+/* Compile vector kernels on x86 compilers which support target attributes */
+#if (defined(__GNUC__)  ||  defined(__clang__))  \
+    &&  (defined(__x86_64__)  ||  defined(__i386__))
+#   define UTF8_SIMD
+#   include <immintrin.h>
+#endif
 
-            case '8':
-                i++;
-                mode = PARSE_EXIT;
-                result = UTF8;
-                break;
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+/* Alias table has 1 << ALIAS_BITS slots */
+#define ALIAS_BITS 7
 
-        case PARSE_UTF1:
-            /* After UTF1 */
-            switch (c) {
-            case '6':
-                i++;
-                mode = PARSE_UTF16;
-                break;
+/* Room for the longest alias and terminating zero */
+#define ALIAS_SIZE 16
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+/* Seed of alias hash, chosen so that no two aliases share a slot */
+#define ALIAS_SEED 341u
 
-        case PARSE_UTF16:
-            /* After UTF16 */
-            switch (c) {
-            case ' ':
-                /* Ignore space */
-                i++;
-                break;
+/*
+ * Characters of name in parse_charset(): letters and digits in lower case,
+ * zero for punctuation and white space which are ignored and one for
+ * characters which cannot appear in any name.
+ */
+#define NAME_IGNORE 0
+#define NAME_INVALID 1
+static const unsigned char name_chars[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 0, 0, 0, 0, 0, 0,
+    0, 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+    'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0, 0, 0, 0, 0,
+    0, 'a', 'b', 'c', 'd', 'e', 'f', 'g',
+    'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0, 0, 0, 0, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
 
-            case 'b':
-            case 'B':
-                i++;
-                mode = PARSE_UTF16B;
-                break;
+/* Name of character set in lower case without punctuation */
+struct charset_alias {
+    char name[ALIAS_SIZE];
+    charset_t charset;
+};
 
-            case 'l':
-            case 'L':
-                i++;
-                mode = PARSE_UTF16L;
-                break;
+/*
+ * IANA names and aliases of built-in character sets.  Each alias is stored
+ * in the slot given by the top ALIAS_BITS of its FNV-1a hash so that
+ * parse_charset() compares at most one alias.  Adding an alias may require
+ * a new ALIAS_SEED for the hash to stay perfect.
+ */
+static const struct charset_alias aliases[1 << ALIAS_BITS] = {
+    [112] = { "utf8", UTF8 },
+    [7] = { "csutf8", UTF8 },
+    [55] = { "iso88591", ISO8859_1 },
+    [122] = { "iso885911987", ISO8859_1 },
+    [11] = { "isoir100", ISO8859_1 },
+    [121] = { "latin1", ISO8859_1 },
+    [36] = { "l1", ISO8859_1 },
+    [61] = { "ibm819", ISO8859_1 },
+    [5] = { "cp819", ISO8859_1 },
+    [104] = { "csisolatin1", ISO8859_1 },
+    [47] = { "ascii", ASCII },
+    [68] = { "usascii", ASCII },
+    [120] = { "ansix341968", ASCII },
+    [113] = { "ansix341986", ASCII },
+    [44] = { "iso646us", ASCII },
+    [21] = { "iso646irv1991", ASCII },
+    [69] = { "isoir6", ASCII },
+    [58] = { "us", ASCII },
+    [100] = { "ibm367", ASCII },
+    [34] = { "cp367", ASCII },
+    [79] = { "csascii", ASCII },
+    [71] = { "utf16", UTF16 },
+    [20] = { "csutf16", UTF16 },
+    [86] = { "ucs2", UTF16 },
+    [83] = { "utf16le", UTF16LE },
+    [117] = { "csutf16le", UTF16LE },
+    [62] = { "ucs2le", UTF16LE },
+    [89] = { "utf16be", UTF16BE },
+    [111] = { "csutf16be", UTF16BE },
+    [56] = { "ucs2be", UTF16BE },
+    [1] = { "utf32", UTF32 },
+    [30] = { "csutf32", UTF32 },
+    [85] = { "ucs4", UTF32 },
+    [2] = { "utf32le", UTF32LE },
+    [64] = { "csutf32le", UTF32LE },
+    [74] = { "ucs4le", UTF32LE },
+    [124] = { "utf32be", UTF32BE },
+    [70] = { "csutf32be", UTF32BE },
+    [73] = { "ucs4be", UTF32BE },
+    [94] = { "wchart", WCHAR }
+};
 
-            default:
-                /* Other character */
-                result = UTF16;
-                mode = PARSE_EXIT;
-            }
-            break;
+/* Returns true on little-endian system */
+static int little_endian (void);
 
-        case PARSE_UTF16B:
-            /* After UTF16B */
-            switch (c) {
-            case 'e':
-            case 'E':
-                i++;
-                result = UTF16BE;
-                mode = PARSE_EXIT;
-                break;
+/* Character sets of file system and locale */
+static void detect_charsets (int force);
+static charset_t detect_locale_charset (void);
+#if !defined(_WIN32)
+static charset_t parse_environment (void);
+#endif
+
+/* Character set tables */
+static charset_t find_charset_table (const char *p);
+static int build_table (
+    struct charset_table *tp, const char *name, const uint32_t map[256]);
+
+/* Sequences of numbers for built-in tables */
+#define SEQ4(n) (n), (n) + 1, (n) + 2, (n) + 3
+#define SEQ16(n) SEQ4 (n), SEQ4 ((n) + 4), SEQ4 ((n) + 8), SEQ4 ((n) + 12)
+#define SEQ64(n) \
+    SEQ16 (n), SEQ16 ((n) + 16), SEQ16 ((n) + 32), SEQ16 ((n) + 48)
+#define SEQ128(n) SEQ64 (n), SEQ64 ((n) + 64)
+#define UNMAPPED4 \
+    CHARSET_UNMAPPED, CHARSET_UNMAPPED, CHARSET_UNMAPPED, CHARSET_UNMAPPED
+#define UNMAPPED16 UNMAPPED4, UNMAPPED4, UNMAPPED4, UNMAPPED4
+#define UNMAPPED64 UNMAPPED16, UNMAPPED16, UNMAPPED16, UNMAPPED16
+#define UNMAPPED128 UNMAPPED64, UNMAPPED64
+
+/* ASCII maps to first 128 characters */
+static const struct charset_table ascii_table = {
+    "ascii",
+    { SEQ128 (0), UNMAPPED128 },
+    { 1 },
+    { { 0 }, { SEQ128 (0) } }
+};
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+/* ISO 8859-1 maps to first 256 characters */
+static const struct charset_table latin1_table = {
+    "iso-8859-1",
+    { SEQ128 (0), SEQ128 (128) },
+    { 1 },
+    { { 0 }, { SEQ128 (0), SEQ128 (128) } }
+};
 
-        case PARSE_UTF16L:
-            /* After UTF16L */
-            switch (c) {
-            case 'e':
-            case 'E':
-                i++;
-                result = UTF16LE;
-                mode = PARSE_EXIT;
-                break;
+/* Registered character sets are numbered from here on */
+#define FIRST_TABLE_CHARSET 0x100
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+/* Registered character sets */
+static struct charset_table tables[T7_MAX_CHARSET_TABLES];
 
-        case PARSE_UTF3:
-            /* After UTF3 */
-            switch (c) {
-            case '2':
-                i++;
-                mode = PARSE_UTF32;
-                break;
+/* Number of registered character sets, updated in critical section */
+static size_t num_tables = 0;
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+/* Detected character sets, valid after charsets_detected has been set */
+static charset_t filesystem_charset = INVALID_CHARSET;
+static charset_t locale_charset = INVALID_CHARSET;
+static int charsets_detected = 0;
 
-        case PARSE_UTF32:
-            /* After UTF32 */
-            switch (c) {
-            case ' ':
-                /* Ignore space */
-                i++;
-                break;
+/* Kernels for validate_utf8() and count_utf8_codepoints() */
+typedef int validate_function (const unsigned char *p, size_t n);
+typedef size_t count_function (const unsigned char *p, size_t n);
+static int validate_scalar (const unsigned char *p, size_t n);
+static size_t count_scalar (const unsigned char *p, size_t n);
+static void select_kernels (void);
+static int validate_first (const unsigned char *p, size_t n);
+static size_t count_first (const unsigned char *p, size_t n);
+#if defined(UTF8_SIMD)
+static int validate_ssse3 (const unsigned char *p, size_t n);
+static int validate_avx2 (const unsigned char *p, size_t n);
+static size_t count_sse2 (const unsigned char *p, size_t n);
+static size_t count_avx2 (const unsigned char *p, size_t n);
+#endif
 
-            case 'b':
-            case 'B':
-                i++;
-                mode = PARSE_UTF32B;
-                break;
+/* Kernels selected for this processor at first call */
+static validate_function *validate_kernel = validate_first;
+static count_function *count_kernel = count_first;
 
-            case 'l':
-            case 'L':
-                i++;
-                mode = PARSE_UTF32L;
-                break;
 
-            default:
-                /* Other character */
-                result = UTF32;
-                mode = PARSE_EXIT;
-            }
-            break;
+/* Convert string to character set */
+charset_t
+parse_charset (const char *p)
+{
+    char name[ALIAS_SIZE];
+    const struct charset_alias *ap;
+    charset_t result = INVALID_CHARSET;
+    uint32_t h = ALIAS_SEED;
+    size_t n = 0;
+    size_t i;
 
-        case PARSE_UTF32B:
-            /* After UTF32B */
-            switch (c) {
-            case 'e':
-            case 'E':
-                i++;
-                result = UTF32BE;
-                mode = PARSE_EXIT;
-                break;
+    /* Pre-conditions */
+    assert (p != NULL);
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+    /* Convert name to lower case and drop punctuation while hashing */
+    for (i = 0; p[i] != '\0'  &&  n < ALIAS_SIZE; i++) {
+        unsigned char c = name_chars[(unsigned char) p[i]];
+        if (c > NAME_INVALID) {
 
-        case PARSE_UTF32L:
-            /* After UTF32L */
-            switch (c) {
-            case 'e':
-            case 'E':
-                i++;
-                result = UTF32LE;
-                mode = PARSE_EXIT;
-                break;
+            /* Letter or digit */
+            name[n++] = (char) c;
+            h = (h ^ c) * 0x01000193u;
 
-            default:
-                /* Invalid character */
-                mode = PARSE_ERROR;
-            }
-            break;
+        } else if (c == NAME_INVALID) {
 
-        case PARSE_EXIT:
-            /* End of string */
-            switch (c) {
-            case ' ':
-            case '\t':
-            case '\r':
-            case '\n':
-                /* Ignore void space after character set */
-                i++;
-                break;
+            /* Control or non-ASCII character is not part of any alias */
+            n = ALIAS_SIZE;
 
-            case '\0':
-                /* End of string => character set successfully parsed */
-                done = 1;
-                break;
+        } else {
 
-            default:
-                /* Illegal characters after character set */
-                mode = PARSE_ERROR;
-            }
-            break;
+            /* Ignore punctuation and white space */
+            /*NOP*/;
 
-        case PARSE_ERROR:
-            /* Error */
-            done = 1;
-            result = INVALID_CHARSET;
-            break;
+        }
+    }
 
-        default:
-            /* Invalid mode */
-            terminate ("Invalid mode");
+    /* Compare to the only alias which may match */
+    if (n < ALIAS_SIZE) {
+        memset (name + n, 0, ALIAS_SIZE - n);
+        ap = &aliases[h >> (32 - ALIAS_BITS)];
+        if (memcmp (ap->name, name, ALIAS_SIZE) == 0) {
+            result = ap->charset;
         }
+    }
 
+    /* Not a built-in character set, try registered ones */
+    if (result == INVALID_CHARSET) {
+        result = find_charset_table (p);
     }
     return result;
 }
@@ -671,8 +300,16 @@ nameof_charset (charset_t t)
         break;
 
     case INVALID_CHARSET:
-    default:
         name = "invalid";
+        break;
+
+    default:
+        /* Registered character set */
+        if (get_charset_table (t) != NULL) {
+            name = get_charset_table (t)->name;
+        } else {
+            name = "invalid";
+        }
     }
 
     return name;
@@ -699,12 +336,18 @@ resolve_charset (charset_t t)
 
     case FILESYSTEM_CHARSET:
         /* An operating system dependent character set */
-        r = FILESYSTEM_CHARSET;
+        if (!__atomic_load_n (&charsets_detected, __ATOMIC_ACQUIRE)) {
+            detect_charsets (0);
+        }
+        r = __atomic_load_n (&filesystem_charset, __ATOMIC_RELAXED);
         break;
 
     case LOCALE_CHARSET:
         /* A user dependent character set */
-        r = LOCALE_CHARSET;
+        if (!__atomic_load_n (&charsets_detected, __ATOMIC_ACQUIRE)) {
+            detect_charsets (0);
+        }
+        r = __atomic_load_n (&locale_charset, __ATOMIC_RELAXED);
         break;
 
     case UTF16:
@@ -742,19 +385,952 @@ resolve_charset (charset_t t)
         break;
 
     case INVALID_CHARSET:
-    default:
         r = INVALID_CHARSET;
+        break;
+
+    default:
+        /* Registered character set is not an alias */
+        if (get_charset_table (t) != NULL) {
+            r = t;
+        } else {
+            r = INVALID_CHARSET;
+        }
     }
     return r;
 }
 
 
+/* Detect character sets of file system and locale again */
+void
+refresh_charsets (void)
+{
+    detect_charsets (1);
+}
+
+
+/* Define single-byte character set */
+charset_t
+register_charset_table (const char *name, const uint32_t map[256])
+{
+    struct charset_table tmp;
+    charset_t result = INVALID_CHARSET;
+    charset_t t;
+    size_t n;
+
+    /* Pre-conditions */
+    assert (name != NULL);
+    assert (map != NULL);
+
+    /* Build table before entering critical section */
+    if (build_table (&tmp, name, map)) {
+
+        enter_critical ();
+
+        /* Is the name already taken? */
+        t = parse_charset (tmp.name);
+        if (t != INVALID_CHARSET) {
+
+            /* Yes, accept identical table */
+            if (get_charset_table (t) != NULL
+                &&  memcmp (get_charset_table (t)->decode, tmp.decode,
+                    sizeof (tmp.decode)) == 0) {
+                result = t;
+            }
+
+        } else if (num_tables < T7_MAX_CHARSET_TABLES) {
+
+            /* Publish table after it has been copied */
+            n = num_tables;
+            memcpy (&tables[n], &tmp, sizeof (tmp));
+            __atomic_store_n (&num_tables, n + 1, __ATOMIC_RELEASE);
+            result = (charset_t) (FIRST_TABLE_CHARSET + n);
+
+        } else {
+
+            /* Too many character sets */
+            /*NOP*/;
+
+        }
+
+        leave_critical ();
+
+    }
+    return result;
+}
+
+
+/* Get translation table of character set */
+const struct charset_table *
+get_charset_table (charset_t t)
+{
+    const struct charset_table *tp;
+    size_t n;
+
+    switch (t) {
+    case ASCII:
+        tp = &ascii_table;
+        break;
+
+    case ISO8859_1:
+        tp = &latin1_table;
+        break;
+
+    case UTF8:
+    case FILESYSTEM_CHARSET:
+    case LOCALE_CHARSET:
+    case UTF16:
+    case UTF16LE:
+    case UTF16BE:
+    case UTF32:
+    case UTF32LE:
+    case UTF32BE:
+    case WCHAR:
+    case INVALID_CHARSET:
+        /* Not a single-byte character set */
+        tp = NULL;
+        break;
+
+    default:
+        /* Registered character set */
+        n = __atomic_load_n (&num_tables, __ATOMIC_ACQUIRE);
+        if ((size_t) t >= FIRST_TABLE_CHARSET
+            &&  (size_t) t < FIRST_TABLE_CHARSET + n) {
+            tp = &tables[(size_t) t - FIRST_TABLE_CHARSET];
+        } else {
+            tp = NULL;
+        }
+    }
+    return tp;
+}
+
+
+/* Detect character sets of file system and locale */
+static void
+detect_charsets (int force)
+{
+    charset_t locale;
+    charset_t fs;
+
+    enter_critical ();
+
+    /* Another thread may have detected character sets while we waited */
+    if (force  ||  !__atomic_load_n (&charsets_detected, __ATOMIC_RELAXED)) {
+
+        locale = detect_locale_charset ();
+
+#if defined(_WIN32)
+        /* File names are passed to the wide character API */
+        fs = resolve_charset (WCHAR);
+#elif defined(__APPLE__)
+        /* File names are always stored in UTF-8 */
+        fs = UTF8;
+#else
+        /*
+         * File names are plain bytes which are interpreted in the character
+         * set of locale.  Plain ASCII of the C locale cannot represent most
+         * file names, though, so assume UTF-8 as modern systems do.
+         */
+        if (locale != INVALID_CHARSET  &&  locale != ASCII) {
+            fs = locale;
+        } else {
+            fs = UTF8;
+        }
+#endif
+
+        /* Publish character sets */
+        __atomic_store_n (&locale_charset, locale, __ATOMIC_RELAXED);
+        __atomic_store_n (&filesystem_charset, fs, __ATOMIC_RELAXED);
+        __atomic_store_n (&charsets_detected, 1, __ATOMIC_RELEASE);
+
+    }
+
+    leave_critical ();
+}
+
+
+/* Find out character set of locale */
+static charset_t
+detect_locale_charset (void)
+{
+    charset_t t = INVALID_CHARSET;
+
+#if defined(_WIN32)
+
+    /* ANSI code page of the system */
+    switch (GetACP ()) {
+    case 65001:
+        t = UTF8;
+        break;
+
+    case 20127:
+        t = ASCII;
+        break;
+
+    case 28591:
+        t = ISO8859_1;
+        break;
+
+    default:
+        /* FIXME: other code pages */
+        /*NOP*/;
+    }
+
+#elif defined(HAVE_NL_LANGINFO)
+
+    /* Code set of locale selected with setlocale() */
+    const char *p = nl_langinfo (CODESET);
+    if (p != NULL  &&  *p != '\0'  &&  strcmp (p, "ANSI_X3.4-1968") != 0) {
+        t = parse_charset (p);
+    } else {
+        /* Program runs in the C locale, use locale of user instead */
+        t = parse_environment ();
+    }
+
+#else
+
+    /* Locale of user */
+    t = parse_environment ();
+
+#endif
+
+    return t;
+}
+
+
+/* Find out character set from locale of user, such as fi_FI.UTF-8@euro */
+#if !defined(_WIN32)
+static charset_t
+parse_environment (void)
+{
+    static const char *vars[] = { "LC_ALL", "LC_CTYPE", "LANG" };
+    charset_t t = INVALID_CHARSET;
+    const char *p = NULL;
+    const char *q;
+    char codeset[32];
+    size_t n;
+    size_t i;
+
+    /* First non-empty variable defines the locale */
+    for (i = 0; p == NULL  &&  i < sizeof (vars) / sizeof (vars[0]); i++) {
+        p = getenv (vars[i]);
+        if (p != NULL  &&  *p == '\0') {
+            p = NULL;
+        }
+    }
+
+    if (p == NULL  ||  strcmp (p, "C") == 0  ||  strcmp (p, "POSIX") == 0) {
+
+        /* C locale uses plain ASCII */
+        t = ASCII;
+
+    } else if ((q = strchr (p, '.')) != NULL) {
+
+        /* Code set follows dot and ends at modifier */
+        q++;
+        n = 0;
+        while (q[n] != '\0'  &&  q[n] != '@'  &&  n < sizeof (codeset) - 1) {
+            codeset[n] = q[n];
+            n++;
+        }
+        codeset[n] = '\0';
+        t = parse_charset (codeset);
+
+    } else {
+
+        /* Locale without code set, character set depends on the system */
+        /*NOP*/;
+
+    }
+    return t;
+}
+#endif
+
+
+/* Find registered character set by name */
+static charset_t
+find_charset_table (const char *p)
+{
+    charset_t result = INVALID_CHARSET;
+    size_t len;
+    size_t n;
+    size_t i;
+    size_t j;
+
+    /* Ignore white space around name */
+    while (*p == ' '  ||  *p == '\t'  ||  *p == '\r'  ||  *p == '\n') {
+        p++;
+    }
+    len = strlen (p);
+    while (len > 0
+        &&  (p[len - 1] == ' '  ||  p[len - 1] == '\t'
+        ||  p[len - 1] == '\r'  ||  p[len - 1] == '\n')) {
+        len--;
+    }
+
+    /* Compare to names of registered character sets */
+    n = __atomic_load_n (&num_tables, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n  &&  result == INVALID_CHARSET; i++) {
+        const char *name = tables[i].name;
+        if (strlen (name) != len) {
+            continue;
+        }
+
+        /* Names are stored in lower case */
+        j = 0;
+        while (j < len  &&  tolower ((unsigned char) p[j]) == name[j]) {
+            j++;
+        }
+        if (j == len) {
+            result = (charset_t) (FIRST_TABLE_CHARSET + i);
+        }
+    }
+    return result;
+}
+
+
+/* Build translation table from map */
+static int
+build_table (
+    struct charset_table *tp, const char *name, const uint32_t map[256])
+{
+    unsigned pages = 1;
+    size_t len = strlen (name);
+    size_t i;
+
+    /* Unused pages map nothing */
+    memset (tp, 0, sizeof (*tp));
+
+    /* Store name in lower case */
+    if (len == 0  ||  len >= sizeof (tp->name)) {
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) name[i];
+        if (c <= ' ') {
+            /* White space is not allowed within name */
+            return 0;
+        }
+        tp->name[i] = (char) tolower (c);
+    }
+
+    /* Fill decode table and pages of encode table */
+    for (i = 0; i < 256; i++) {
+        uint32_t cp = map[i];
+        tp->decode[i] = cp;
+        if (cp == CHARSET_UNMAPPED) {
+            continue;
+        }
+
+        /* Character must be from Basic Multilingual Plane */
+        if (cp > 0xFFFF  ||  (cp >= 0xD800  &&  cp <= 0xDFFF)) {
+            return 0;
+        }
+
+        /* Allocate page on first character */
+        if (tp->page[cp >> 8] == 0) {
+            if (pages >= CHARSET_TABLE_PAGES) {
+                return 0;
+            }
+            tp->page[cp >> 8] = (unsigned char) pages++;
+        }
+        tp->encode[tp->page[cp >> 8]][cp & 0xFF] = (unsigned char) i;
+    }
+
+    /* Each character must map back to its byte */
+    for (i = 0; i < 256; i++) {
+        uint32_t cp = map[i];
+        if (cp != CHARSET_UNMAPPED
+            &&  tp->encode[tp->page[cp >> 8]][cp & 0xFF] != i) {
+            /* Two bytes map to the same character */
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* Returns true if P contains N bytes of valid UTF-8 */
+int
+validate_utf8 (const char *p, size_t n)
+{
+    validate_function *f;
+
+    /* Pre-conditions */
+    assert (p != NULL  ||  n == 0);
+
+    /* Invoke kernel, which may be the one selecting the kernel */
+    f = __atomic_load_n (&validate_kernel, __ATOMIC_RELAXED);
+    return f ((const unsigned char*) p, n);
+}
+
+
+/* Count characters in UTF-8 string */
+size_t
+count_utf8_codepoints (const char *p, size_t n)
+{
+    count_function *f;
+
+    /* Pre-conditions */
+    assert (p != NULL  ||  n == 0);
+
+    f = __atomic_load_n (&count_kernel, __ATOMIC_RELAXED);
+    return f ((const unsigned char*) p, n);
+}
+
+
+/* Pick the fastest kernels supported by the processor */
+static void
+select_kernels (void)
+{
+    validate_function *validate = validate_scalar;
+    count_function *count = count_scalar;
+
+#if defined(UTF8_SIMD)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+
+        /* Process 32 bytes at a time */
+        validate = validate_avx2;
+        count = count_avx2;
+
+    } else if (__builtin_cpu_supports ("ssse3")) {
+
+        /* Process 16 bytes at a time */
+        validate = validate_ssse3;
+        count = count_sse2;
+
+    } else if (__builtin_cpu_supports ("sse2")) {
+
+        /* Validation needs byte shuffle of SSSE3 */
+        count = count_sse2;
+
+    }
+#endif
+
+    /*
+     * Publish kernels.  Threads racing through here store the very same
+     * values so no further synchronization is needed.
+     */
+    __atomic_store_n (&validate_kernel, validate, __ATOMIC_RELAXED);
+    __atomic_store_n (&count_kernel, count, __ATOMIC_RELAXED);
+}
+
+
+/* Use kernel K regardless of the fastest one */
+int
+force_utf8_kernel (enum utf8_kernel k)
+{
+    validate_function *validate;
+    count_function *count;
+
+    switch (k) {
+    case UTF8_AUTOMATIC:
+        select_kernels ();
+        return 1;
+
+    case UTF8_SCALAR:
+        validate = validate_scalar;
+        count = count_scalar;
+        break;
+
+#if defined(UTF8_SIMD)
+    case UTF8_SSE2:
+        __builtin_cpu_init ();
+        if (!__builtin_cpu_supports ("sse2")) {
+            return 0;
+        }
+        validate = validate_scalar;
+        count = count_sse2;
+        break;
+
+    case UTF8_SSSE3:
+        __builtin_cpu_init ();
+        if (!__builtin_cpu_supports ("ssse3")) {
+            return 0;
+        }
+        validate = validate_ssse3;
+        count = count_sse2;
+        break;
+
+    case UTF8_AVX2:
+        __builtin_cpu_init ();
+        if (!__builtin_cpu_supports ("avx2")) {
+            return 0;
+        }
+        validate = validate_avx2;
+        count = count_avx2;
+        break;
+#endif
+
+    default:
+        return 0;
+    }
+
+    __atomic_store_n (&validate_kernel, validate, __ATOMIC_RELAXED);
+    __atomic_store_n (&count_kernel, count, __ATOMIC_RELAXED);
+    return 1;
+}
+
+
+/* Select kernel on first call to validate_utf8() */
+static int
+validate_first (const unsigned char *p, size_t n)
+{
+    select_kernels ();
+    return validate_kernel (p, n);
+}
+
+
+/* Select kernel on first call to count_utf8_codepoints() */
+static size_t
+count_first (const unsigned char *p, size_t n)
+{
+    select_kernels ();
+    return count_kernel (p, n);
+}
+
+
+/* Validate UTF-8 one character at a time */
+static int
+validate_scalar (const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    size_t len;
+    unsigned char c;
+    unsigned char lo;
+    unsigned char hi;
+    uint64_t w;
+    size_t j;
+
+    while (i < n) {
+
+        /* Skip ASCII eight bytes at a time */
+        while (i + 8 <= n) {
+            memcpy (&w, p + i, 8);
+            if ((w & UINT64_C (0x8080808080808080)) != 0) {
+                break;
+            }
+            i += 8;
+        }
+        if (i >= n) {
+            break;
+        }
+
+        /* Determine length and range of second byte from lead byte */
+        c = p[i];
+        lo = 0x80;
+        hi = 0xBF;
+        if (c < 0x80) {
+
+            /* ASCII character */
+            i++;
+            continue;
+
+        } else if (c < 0xC2) {
+
+            /* Continuation byte or overlong two-byte sequence */
+            return 0;
+
+        } else if (c < 0xE0) {
+
+            /* Two-byte sequence */
+            len = 2;
+
+        } else if (c < 0xF0) {
+
+            /* Three-byte sequence, reject overlong forms and surrogates */
+            len = 3;
+            if (c == 0xE0) {
+                lo = 0xA0;
+            } else if (c == 0xED) {
+                hi = 0x9F;
+            }
+
+        } else if (c < 0xF5) {
+
+            /* Four-byte sequence, reject overlong forms and > U+10FFFF */
+            len = 4;
+            if (c == 0xF0) {
+                lo = 0x90;
+            } else if (c == 0xF4) {
+                hi = 0x8F;
+            }
+
+        } else {
+
+            /* Invalid lead byte */
+            return 0;
+
+        }
+
+        /* Check continuation bytes */
+        if (n - i < len) {
+            return 0;
+        }
+        if (p[i + 1] < lo  ||  p[i + 1] > hi) {
+            return 0;
+        }
+        for (j = 2; j < len; j++) {
+            if ((p[i + j] & 0xC0) != 0x80) {
+                return 0;
+            }
+        }
+        i += len;
+
+    }
+    return 1;
+}
+
+
+/* Count bytes which do not continue a sequence */
+static size_t
+count_scalar (const unsigned char *p, size_t n)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
+#if defined(UTF8_SIMD)
+
+/*
+ * Vector validation follows the lookup algorithm of Keiser and Lemire,
+ * "Validating UTF-8 In Less Than One Instruction Per Byte" (2021).  Each
+ * byte is classified by the high nibble of the previous byte, the low nibble
+ * of the previous byte and the high nibble of the byte itself.  Every
+ * nibble selects a set of error bits from a table of 16 entries, and an
+ * error exists where all three sets share a bit.  Bytes which must be the
+ * third or fourth byte of a sequence are checked separately.
+ */
+#define TOO_SHORT       (1 << 0)
+#define TOO_LONG        (1 << 1)
+#define OVERLONG_3      (1 << 2)
+#define TOO_LARGE       (1 << 3)
+#define SURROGATE       (1 << 4)
+#define OVERLONG_2      (1 << 5)
+#define TOO_LARGE_1000  (1 << 6)
+#define OVERLONG_4      (1 << 6)
+#define TWO_CONTS       (1 << 7)
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* Error bits selected by high nibble of previous byte */
+#define BYTE_1_HIGH \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+    TOO_SHORT | OVERLONG_2, \
+    TOO_SHORT, \
+    TOO_SHORT | OVERLONG_3 | SURROGATE, \
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+/* Error bits selected by low nibble of previous byte */
+#define BYTE_1_LOW \
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+    CARRY | OVERLONG_2, \
+    CARRY, \
+    CARRY, \
+    CARRY | TOO_LARGE, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000, \
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+
+/* Error bits selected by high nibble of current byte */
+#define BYTE_2_HIGH \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 \
+        | OVERLONG_4, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/* Lookup tables */
+static const unsigned char byte_1_high[16] = { BYTE_1_HIGH };
+static const unsigned char byte_1_low[16] = { BYTE_1_LOW };
+static const unsigned char byte_2_high[16] = { BYTE_2_HIGH };
+
+/*
+ * Bytes greater than the limit start a sequence which continues past the
+ * end of block.  Vectors of 16 bytes use the second half of the table.
+ */
+static const unsigned char incomplete_limits[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+
+/* Compute error bits for 16 bytes given the previous 16 bytes */
+__attribute__ ((target ("ssse3")))
+static __m128i
+check_block_ssse3 (__m128i input, __m128i prev_input)
+{
+    const __m128i nibble = _mm_set1_epi8 (0x0F);
+    const __m128i table1 = _mm_loadu_si128 ((const __m128i*) byte_1_high);
+    const __m128i table2 = _mm_loadu_si128 ((const __m128i*) byte_1_low);
+    const __m128i table3 = _mm_loadu_si128 ((const __m128i*) byte_2_high);
+    __m128i prev1;
+    __m128i prev2;
+    __m128i prev3;
+    __m128i sc;
+    __m128i must23;
+
+    /* Combine nibble lookups */
+    prev1 = _mm_alignr_epi8 (input, prev_input, 16 - 1);
+    sc = _mm_and_si128 (
+        _mm_and_si128 (
+            _mm_shuffle_epi8 (
+                table1, _mm_and_si128 (_mm_srli_epi16 (prev1, 4), nibble)),
+            _mm_shuffle_epi8 (table2, _mm_and_si128 (prev1, nibble))),
+        _mm_shuffle_epi8 (
+            table3, _mm_and_si128 (_mm_srli_epi16 (input, 4), nibble)));
+
+    /* Third and fourth bytes must be continuation bytes */
+    prev2 = _mm_alignr_epi8 (input, prev_input, 16 - 2);
+    prev3 = _mm_alignr_epi8 (input, prev_input, 16 - 3);
+    must23 = _mm_or_si128 (
+        _mm_subs_epu8 (prev2, _mm_set1_epi8 ((char) (0xE0 - 0x80))),
+        _mm_subs_epu8 (prev3, _mm_set1_epi8 ((char) (0xF0 - 0x80))));
+    must23 = _mm_and_si128 (must23, _mm_set1_epi8 ((char) 0x80));
+    return _mm_xor_si128 (must23, sc);
+}
+
+
+/* Validate UTF-8 16 bytes at a time */
+__attribute__ ((target ("ssse3")))
+static int
+validate_ssse3 (const unsigned char *p, size_t n)
+{
+    const __m128i limits = _mm_loadu_si128 (
+        (const __m128i*) (incomplete_limits + 16));
+    __m128i error = _mm_setzero_si128 ();
+    __m128i prev_input = _mm_setzero_si128 ();
+    __m128i prev_incomplete = _mm_setzero_si128 ();
+    __m128i in[4];
+    unsigned char tail[16];
+    size_t i = 0;
+    size_t k;
+
+    while (i < n) {
+
+        /* Skip 64 bytes of ASCII at once */
+        if (i + 64 <= n) {
+            for (k = 0; k < 4; k++) {
+                in[k] = _mm_loadu_si128 ((const __m128i*) (p + i + 16 * k));
+            }
+            if (_mm_movemask_epi8 (
+                _mm_or_si128 (
+                    _mm_or_si128 (in[0], in[1]),
+                    _mm_or_si128 (in[2], in[3]))) == 0) {
+                error = _mm_or_si128 (error, prev_incomplete);
+                prev_incomplete = _mm_setzero_si128 ();
+                prev_input = in[3];
+                i += 64;
+                continue;
+            }
+        }
+
+        /* Load one block, padding the end of input with zeros */
+        if (i + 16 <= n) {
+            in[0] = _mm_loadu_si128 ((const __m128i*) (p + i));
+        } else {
+            memset (tail, 0, sizeof (tail));
+            memcpy (tail, p + i, n - i);
+            in[0] = _mm_loadu_si128 ((const __m128i*) tail);
+        }
+
+        /* Check block */
+        if (_mm_movemask_epi8 (in[0]) == 0) {
+            error = _mm_or_si128 (error, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128 ();
+        } else {
+            error = _mm_or_si128 (error, check_block_ssse3 (in[0], prev_input));
+            prev_incomplete = _mm_subs_epu8 (in[0], limits);
+        }
+        prev_input = in[0];
+        i += 16;
+
+    }
+
+    /* Input must not end in the middle of sequence */
+    error = _mm_or_si128 (error, prev_incomplete);
+    return _mm_movemask_epi8 (
+        _mm_cmpeq_epi8 (error, _mm_setzero_si128 ())) == 0xFFFF;
+}
+
+
+/* Compute error bits for 32 bytes given the previous 32 bytes */
+__attribute__ ((target ("avx2")))
+static __m256i
+check_block_avx2 (__m256i input, __m256i prev_input)
+{
+    const __m256i nibble = _mm256_set1_epi8 (0x0F);
+    const __m256i table1 = _mm256_broadcastsi128_si256 (
+        _mm_loadu_si128 ((const __m128i*) byte_1_high));
+    const __m256i table2 = _mm256_broadcastsi128_si256 (
+        _mm_loadu_si128 ((const __m128i*) byte_1_low));
+    const __m256i table3 = _mm256_broadcastsi128_si256 (
+        _mm_loadu_si128 ((const __m128i*) byte_2_high));
+    __m256i shifted;
+    __m256i prev1;
+    __m256i prev2;
+    __m256i prev3;
+    __m256i sc;
+    __m256i must23;
+
+    /* Bring last bytes of previous block next to the first bytes of this */
+    shifted = _mm256_permute2x128_si256 (prev_input, input, 0x21);
+    prev1 = _mm256_alignr_epi8 (input, shifted, 16 - 1);
+    prev2 = _mm256_alignr_epi8 (input, shifted, 16 - 2);
+    prev3 = _mm256_alignr_epi8 (input, shifted, 16 - 3);
+
+    /* Combine nibble lookups */
+    sc = _mm256_and_si256 (
+        _mm256_and_si256 (
+            _mm256_shuffle_epi8 (
+                table1,
+                _mm256_and_si256 (_mm256_srli_epi16 (prev1, 4), nibble)),
+            _mm256_shuffle_epi8 (table2, _mm256_and_si256 (prev1, nibble))),
+        _mm256_shuffle_epi8 (
+            table3, _mm256_and_si256 (_mm256_srli_epi16 (input, 4), nibble)));
+
+    /* Third and fourth bytes must be continuation bytes */
+    must23 = _mm256_or_si256 (
+        _mm256_subs_epu8 (prev2, _mm256_set1_epi8 ((char) (0xE0 - 0x80))),
+        _mm256_subs_epu8 (prev3, _mm256_set1_epi8 ((char) (0xF0 - 0x80))));
+    must23 = _mm256_and_si256 (must23, _mm256_set1_epi8 ((char) 0x80));
+    return _mm256_xor_si256 (must23, sc);
+}
+
+
+/* Validate UTF-8 32 bytes at a time */
+__attribute__ ((target ("avx2")))
+static int
+validate_avx2 (const unsigned char *p, size_t n)
+{
+    const __m256i limits = _mm256_loadu_si256 (
+        (const __m256i*) incomplete_limits);
+    __m256i error = _mm256_setzero_si256 ();
+    __m256i prev_input = _mm256_setzero_si256 ();
+    __m256i prev_incomplete = _mm256_setzero_si256 ();
+    __m256i in0;
+    __m256i in1;
+    unsigned char tail[32];
+    size_t i = 0;
+
+    while (i < n) {
+
+        /* Skip 64 bytes of ASCII at once */
+        if (i + 64 <= n) {
+            in0 = _mm256_loadu_si256 ((const __m256i*) (p + i));
+            in1 = _mm256_loadu_si256 ((const __m256i*) (p + i + 32));
+            if (_mm256_movemask_epi8 (_mm256_or_si256 (in0, in1)) == 0) {
+                error = _mm256_or_si256 (error, prev_incomplete);
+                prev_incomplete = _mm256_setzero_si256 ();
+                prev_input = in1;
+                i += 64;
+                continue;
+            }
+        }
+
+        /* Load one block, padding the end of input with zeros */
+        if (i + 32 <= n) {
+            in0 = _mm256_loadu_si256 ((const __m256i*) (p + i));
+        } else {
+            memset (tail, 0, sizeof (tail));
+            memcpy (tail, p + i, n - i);
+            in0 = _mm256_loadu_si256 ((const __m256i*) tail);
+        }
+
+        /* Check block */
+        if (_mm256_movemask_epi8 (in0) == 0) {
+            error = _mm256_or_si256 (error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256 ();
+        } else {
+            error = _mm256_or_si256 (error, check_block_avx2 (in0, prev_input));
+            prev_incomplete = _mm256_subs_epu8 (in0, limits);
+        }
+        prev_input = in0;
+        i += 32;
+
+    }
+
+    /* Input must not end in the middle of sequence */
+    error = _mm256_or_si256 (error, prev_incomplete);
+    return _mm256_testz_si256 (error, error);
+}
+
+
+/* Count non-continuation bytes 16 at a time */
+__attribute__ ((target ("sse2")))
+static size_t
+count_sse2 (const unsigned char *p, size_t n)
+{
+    const __m128i limit = _mm_set1_epi8 ((char) 0xBF);
+    size_t count = 0;
+    size_t i = 0;
+    __m128i x;
+    unsigned mask;
+
+    /* Continuation bytes are the only ones below -64 as signed */
+    for (i = 0; i + 16 <= n; i += 16) {
+        x = _mm_loadu_si128 ((const __m128i*) (p + i));
+        mask = (unsigned) _mm_movemask_epi8 (_mm_cmpgt_epi8 (x, limit));
+        count += (size_t) __builtin_popcount (mask);
+    }
+    return count + count_scalar (p + i, n - i);
+}
+
+
+/* Count non-continuation bytes 32 at a time */
+__attribute__ ((target ("avx2,popcnt")))
+static size_t
+count_avx2 (const unsigned char *p, size_t n)
+{
+    const __m256i limit = _mm256_set1_epi8 ((char) 0xBF);
+    size_t count = 0;
+    size_t i = 0;
+    __m256i x;
+    unsigned mask;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        x = _mm256_loadu_si256 ((const __m256i*) (p + i));
+        mask = (unsigned) _mm256_movemask_epi8 (_mm256_cmpgt_epi8 (x, limit));
+        count += (size_t) __builtin_popcount (mask);
+    }
+    return count + count_scalar (p + i, n - i);
+}
+
+#endif /*UTF8_SIMD*/
+
+
 /* Returns true if running on little-endian system */
 static int
 little_endian (void)
 {
     int r;
 
+#if defined(__BYTE_ORDER__)  &&  defined(__ORDER_LITTLE_ENDIAN__)
+    /* Byte order is known at compile time */
+    r = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+#else
     union {
         short s;
         unsigned char c[2];
@@ -776,6 +1352,7 @@ little_endian (void)
         r = 0;
 
     }
+#endif
     return r;
 }
 
@@ -8,6 +8,8 @@
 #include "t7/types.h"
 #include "t7/exit-handler.h"
 #include "t7/terminate.h"
+#include "t7/memory.h"
+#include <stdint.h>
 
 
 /* Operating system specific variables */
@@ -31,174 +33,399 @@
 #endif
 
 
-/* For saving exit handlers */
+/* Registered exit handler */
 struct exit_handler {
+    /* Function, its priority and flags */
     exit_function *f;
     int priority;
+    int flags;
+
+    /* Next handler in the same bucket of hash set */
+    struct exit_handler *same_bucket;
+
+    /* Handler registered before this one */
+    struct exit_handler *next;
 };
 typedef struct exit_handler exit_handler_t;
 
 
+/* Concurrent exit functions being run */
+struct exit_tier {
+    /* Next function to run */
+    exit_handler_t *next;
+
+    /* First function after tier */
+    exit_handler_t *last;
+};
+typedef struct exit_tier exit_tier_t;
+
+
+/* Hash set of registered functions has 1 << HANDLER_BITS buckets */
+#define HANDLER_BITS 8
+
+/* Maximum number of helper threads running concurrent exit functions */
+#define TIER_THREADS 3
+
+
 /* Local functions */
 static void run_exit_handlers (void);
-static int add_exit_handler (exit_function *f, int priority);
-static int is_registered (exit_function *f);
+static void initialize (void);
+static exit_handler_t *sort_handlers (exit_handler_t *list);
+static exit_handler_t *run_handler (exit_handler_t *hp);
+static void run_tier (exit_tier_t *tp);
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+static void *tier_thread (void *arg);
+#endif
+static size_t hash_function (exit_function *f);
 static void enter_protected (void);
 static void leave_protected (void);
 
 
-/* List of registered exit handlers */
-static exit_handler_t handlers[T7_MAX_EXIT_HANDLERS];
+/* Hash set of registered functions, each bucket is a list of handlers */
+static exit_handler_t *buckets[1 << HANDLER_BITS];
 
-/* Number of registered exit handlers */
-static size_t count = 0;
+/* Handlers in reverse order of registration */
+static exit_handler_t *handlers = NULL;
 
 /* True if exit handler is initialized */
 static int initialized = 0;
 
+/* True if program is exiting through fast_exit */
+static int exiting_fast = 0;
+
 
 /* Register function to be called at program exit */
 int
 exit_handler (exit_function *f, int priority)
 {
-    int ok;
+    return exit_handler_flags (f, priority, 0);
+}
+
+
+/* Register function with flags */
+int
+exit_handler_flags (exit_function *f, int priority, int flags)
+{
+    exit_handler_t **bucket;
+    exit_handler_t *head;
+    exit_handler_t *hp;
+    exit_handler_t *p;
 
     /* Pre-conditions */
     assert (f != NULL);
 
     /* Has the module been initialized yet? */
-    if (initialized) {
+    if (!__atomic_load_n (&initialized, __ATOMIC_ACQUIRE)) {
+        initialize ();
+    }
 
-        /* Yes, continue with the insertion */
-        ok = add_exit_handler (f, priority);
+    /*
+     * Add handler to hash set unless the function is registered already.
+     * All handlers of a function end up in the same bucket, so a handler
+     * of the same function added concurrently either shows up in the scan
+     * or makes compare-and-swap fail and the scan is repeated.  Handler is
+     * allocated only once the function is known to be new.
+     */
+    bucket = &buckets[hash_function (f)];
+    head = __atomic_load_n (bucket, __ATOMIC_ACQUIRE);
+    hp = NULL;
+    do {
+        for (p = head; p != NULL; p = p->same_bucket) {
+            if (p->f == f) {
+
+                /* Trying to add same handler twice */
+                /* FIXME: error() */
+                system_free_memory (hp);
+                return 0;
+
+            }
+        }
 
-    } else {
+        /* Prepare handler before publishing it */
+        if (hp == NULL) {
+            hp = (exit_handler_t*) system_allocate_memory (
+                sizeof (exit_handler_t));
+            if (hp == NULL) {
+                return 0;
+            }
+            hp->f = f;
+            hp->priority = priority;
+            hp->flags = flags;
+        }
+        hp->same_bucket = head;
+    } while (!__atomic_compare_exchange_n (
+        bucket, &head, hp, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    /* Add handler to list of handlers */
+    hp->next = __atomic_load_n (&handlers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (
+        &handlers, &hp->next, hp, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        /*NOP*/;
+    }
+    return 1;
+}
 
-        /* Instruct system to call our exit function */
-        if (atexit (run_exit_handlers) == /*OK*/0) {
 
-            /* System exit function set up */
-            initialized = 1;
+/* Exit program without releasing memory */
+void
+fast_exit (int status)
+{
+    __atomic_store_n (&exiting_fast, 1, __ATOMIC_RELAXED);
+    exit_application (status);
+}
 
-            /* Continue with the insertion */
-            ok = add_exit_handler (f, priority);
 
-        } else {
+/* Returns true if program is exiting through fast_exit */
+int
+is_fast_exit (void)
+{
+    return __atomic_load_n (&exiting_fast, __ATOMIC_RELAXED);
+}
 
-            /* Error */
-            terminate ("Cannot register atexit function");
-            ok = 0;
 
+/* Instruct system to call our exit function */
+static void
+initialize (void)
+{
+    enter_protected ();
+
+    /* Another thread may have initialized module while we waited */
+    if (!__atomic_load_n (&initialized, __ATOMIC_RELAXED)) {
+        if (atexit (run_exit_handlers) != /*OK*/0) {
+            terminate ("Cannot register atexit function");
         }
+        __atomic_store_n (&initialized, 1, __ATOMIC_RELEASE);
     }
 
-    return ok;
+    leave_protected ();
 }
 
 
-/* Add exit function */
-static int
-add_exit_handler (exit_function *f, int priority)
+/* Invoke exit functions */
+static void
+run_exit_handlers (void)
 {
-    int ok;
+    exit_handler_t *list;
+    exit_handler_t *hp;
+    exit_handler_t *next;
+    size_t i;
 
-    /* Pre-conditions */
-    assert (initialized);
-    assert (f != NULL);
+    /*
+     * Loop through exit functions.
+     *
+     * At this point no threads should be running!  If a thread is running
+     * while the exit functions are called, then the application will crash.
+     *
+     * Exit functions may register more exit functions, so repeat until no
+     * new functions appear.
+     */
+    while ((list = __atomic_exchange_n (
+        &handlers, NULL, __ATOMIC_ACQUIRE)) != NULL) {
 
-    /* Lock other threads */
-    enter_protected ();
+        /* Invoke exit functions from highest to lowest priority */
+        hp = sort_handlers (list);
+        while (hp != NULL) {
+            hp = run_handler (hp);
+        }
 
-    /* Avoid registering duplicate handlers */
-    if (!is_registered (f)  &&  count < T7_MAX_EXIT_HANDLERS) {
-        size_t i;
-        size_t j;
+    }
 
-        /*
-         * Find position i in the handler table such that exit handlers remain
-         * ordered from highest to lowest priority after the new handler is
-         * inserted to position i.
-         */
-        i = 0;
-        while (i < count  &&  priority < handlers[i].priority) {
-            i++;
+    /* Release handlers unless exiting fast */
+    if (!is_fast_exit ()) {
+        for (i = 0; i < sizeof (buckets) / sizeof (buckets[0]); i++) {
+            hp = __atomic_exchange_n (&buckets[i], NULL, __ATOMIC_ACQUIRE);
+            while (hp != NULL) {
+                next = hp->same_bucket;
+                system_free_memory (hp);
+                hp = next;
+            }
         }
+    }
+}
+
+
+/*
+ * Sort list of handlers from highest to lowest priority.  The sort is stable
+ * so that handlers of the same priority remain in reverse order of
+ * registration.
+ */
+static exit_handler_t *
+sort_handlers (exit_handler_t *list)
+{
+    exit_handler_t *left;
+    exit_handler_t *right;
+    exit_handler_t *slow;
+    exit_handler_t *fast;
+    exit_handler_t **tail;
+
+    /* List of one handler is sorted */
+    if (list == NULL  ||  list->next == NULL) {
+        return list;
+    }
 
-        /* Shift handlers down to make room for new handler */
-        for (j = count; j > i; j--) {
-            handlers[j] = handlers[j-1];
+    /* Split list in half */
+    slow = list;
+    fast = list->next;
+    while (fast != NULL  &&  fast->next != NULL) {
+        slow = slow->next;
+        fast = fast->next->next;
+    }
+    right = slow->next;
+    slow->next = NULL;
+
+    /* Sort halves and merge them, taking from left half on ties */
+    left = sort_handlers (list);
+    right = sort_handlers (right);
+    tail = &list;
+    while (left != NULL  &&  right != NULL) {
+        if (left->priority >= right->priority) {
+            *tail = left;
+            left = left->next;
+        } else {
+            *tail = right;
+            right = right->next;
         }
+        tail = &(*tail)->next;
+    }
+    *tail = left != NULL ? left : right;
+    return list;
+}
 
-        /* Store new handler at position i */
-        handlers[i].f = f;
-        handlers[i].priority = priority;
 
-        /* Register slot as taken */
-        count++;
+/*
+ * Run exit function HP, or tier of concurrent exit functions starting from
+ * HP, and return the next exit function to run.
+ */
+static exit_handler_t *
+run_handler (exit_handler_t *hp)
+{
+    exit_tier_t tier;
+    exit_handler_t *p;
+    size_t n;
+
+    /* Memory is not worth releasing if program is exiting fast */
+    if ((hp->flags & EXIT_RELEASES_MEMORY) != 0  &&  is_fast_exit ()) {
+        return hp->next;
+    }
+
+    /* Exit function which needs to run alone */
+    if ((hp->flags & EXIT_CONCURRENT) == 0) {
+        hp->f ();
+        return hp->next;
+    }
 
-        /* Return with non-zero exit value */
-        ok = 1;
+    /* Find concurrent exit functions of the same priority */
+    n = 0;
+    p = hp;
+    while (p != NULL
+        &&  (p->flags & EXIT_CONCURRENT) != 0
+        &&  p->priority == hp->priority) {
+        n++;
+        p = p->next;
+    }
+    tier.next = hp;
+    tier.last = p;
 
-    } else if (count < T7_MAX_EXIT_HANDLERS) {
+#if defined(T7_DISABLE_THREADS)
 
-        /* Trying to add same handler twice */
-        /* FIXME: error() */
-        ok = 0;
+    /****** Single Threaded ******/
 
-    } else {
+    /* Run exit functions one by one */
+    run_tier (&tier);
 
-        /* Too many exit handlers */
-        terminate ("Too many exit functions");
-        ok = 0;
+#elif !defined(_WIN32)
 
-    }
+    /****** Linux/Unix ******/
 
-    leave_protected ();
-    return ok;
-}
+    {
+        pthread_t threads[TIER_THREADS];
+        size_t count;
+        size_t i;
 
+        /*
+         * Start helper threads and run exit functions in this thread too.
+         * Threads are created with pthreads directly as thread local storage
+         * and allocators may be gone by now.
+         */
+        count = 0;
+        while (count + 1 < n  &&  count < TIER_THREADS) {
+            if (pthread_create (
+                &threads[count], NULL, tier_thread, &tier) != /*OK*/0) {
 
-/* Returns true if exit function has already been registered */
-static int
-is_registered (exit_function *f)
-{
-    size_t i;
-    int registered = 0;
+                /* Cannot start thread => run the rest of tier inline */
+                break;
 
-    /* Check every registered function */
-    for (i = 0; i < count; i++) {
-        if (handlers[i].f == f) {
-            registered = 1;
-            break;
+            }
+            count++;
+        }
+
+        /* Run exit functions in this thread, alone if no thread started */
+        run_tier (&tier);
+
+        /* Wait until exit functions have completed */
+        for (i = 0; i < count; i++) {
+            if (pthread_join (threads[i], NULL) != /*OK*/0) {
+                terminate ("Cannot join thread");
+            }
         }
     }
-    return registered;
+
+#else
+
+    /****** Microsoft Windows ******/
+
+    /* FIXME: run exit functions one by one */
+    run_tier (&tier);
+
+#endif
+
+    return tier.last;
 }
 
 
-/* Invoke exit functions */
+/* Run exit functions of tier until none are left */
 static void
-run_exit_handlers (void)
+run_tier (exit_tier_t *tp)
 {
-    size_t i;
+    exit_handler_t *hp;
 
-    /*
-     * Loop through exit functions.
-     *
-     * At this point no threads should be running!  If a thread is running
-     * while the exit functions are called, then the application will crash.
-     */
-    for (i = 0; i < count; i++) {
+    /* Take next exit function from tier */
+    hp = __atomic_load_n (&tp->next, __ATOMIC_ACQUIRE);
+    while (hp != tp->last) {
+        if (__atomic_compare_exchange_n (
+            &tp->next, &hp, hp->next, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
 
-        /* Invoke ith exit function */
-        if (handlers[i].f != NULL) {
-            handlers[i].f ();
-        }
+            /* Skip functions releasing memory on fast exit */
+            if ((hp->flags & EXIT_RELEASES_MEMORY) == 0  ||  !is_fast_exit ()) {
+                hp->f ();
+            }
+            hp = __atomic_load_n (&tp->next, __ATOMIC_ACQUIRE);
 
+        }
     }
 }
 
 
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+/* Helper thread running concurrent exit functions */
+static void *
+tier_thread (void *arg)
+{
+    run_tier ((exit_tier_t*) arg);
+    return NULL;
+}
+#endif
+
+
+/* Get bucket of function in hash set */
+static size_t
+hash_function (exit_function *f)
+{
+    uint64_t h = (uint64_t) (uintptr_t) f * 0x9E3779B97F4A7C15u;
+    return (size_t) (h >> (64 - HANDLER_BITS));
+}
+
+
 /* Enter critical section */
 static void
 enter_protected (void)
@@ -12,28 +12,18 @@
 #include "t7/fixture.h"
 
 
-/* Internal allocator functions */
-static struct allocator *allocate_faulty_allocator(void);
-static void free_faulty_allocator(struct allocator *ap);
-static void *faulty_allocate_memory(struct allocator *ap, size_t n);
-static void faulty_free_memory(struct allocator *ap, void *p);
-static void *faulty_resize_memory(struct allocator *ap, void *p, size_t n);
-
 /* Allocator type */
 static struct allocator_vtable def1 = {
 	allocate_faulty_allocator,
 	free_faulty_allocator,
-	create_allocator,
-	destroy_allocator,
-	faulty_allocate_memory,
-	faulty_free_memory,
+	create_faulty_allocator,
+	destroy_faulty_allocator,
+	faulty_grab_memory,
+	faulty_release_memory,
 	faulty_resize_memory,
 };
 const struct allocator_vtable *faulty_allocator = &def1;
 
-/* Static allocator object */
-static struct allocator singleton;
-
 /* Default fixture for testing */
 static fixture_t def2 = {
 	get_faulty_allocator
@@ -42,38 +32,95 @@ fixture_t *test_fixture = &def2;
 
 
 /* Get allocator for test_fixture */
-static struct allocator *get_faulty_allocator(fixture_t *fp)
+struct allocator *get_faulty_allocator(fixture_t *fp)
 {
 	(void) fp;
 	return get_allocator(faulty_allocator);
 }
 
 
-/* Allocate allocator structure */
-static struct allocator *allocate_faulty_allocator(void)
+/* Create faulty allocator on top of another allocator */
+struct allocator *new_faulty_allocator(struct allocator *backing)
+{
+	assert(backing != NULL);
+
+	/* Allocate memory for allocator */
+	struct allocator *ap = allocate_faulty_allocator();
+	if (!ap)
+		return NULL;
+
+	/* Initialize allocator with backing */
+	if (!create_faulty_allocator_with_backing(ap, faulty_allocator, backing)) {
+		free_faulty_allocator(ap);
+		return NULL;
+	}
+	return ap;
+}
+
+
+/* Allocate room for faulty allocator object */
+struct allocator *allocate_faulty_allocator(void)
+{
+	return system_allocate_memory(sizeof(struct faulty_allocator));
+}
+
+
+/* Release faulty allocator object */
+void free_faulty_allocator(struct allocator *ap)
 {
-	/* Return reference to singleton instance */
-	return &singleton;
+	system_free_memory(ap);
 }
 
 
-/* Release allocator */
-static void free_faulty_allocator(struct allocator *ap)
+/* Initialize faulty allocator which forwards to backing allocator */
+int create_faulty_allocator_with_backing(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	struct allocator *backing)
 {
-	(void) ap;
-	/*NOP*/;
+	assert(backing != NULL);
+	assert(backing != ap);
+
+	/* Initialize standard fields */
+	if (!create_allocator(ap, vtable))
+		return /*error*/0;
+
+	/* Save backing allocator */
+	struct faulty_allocator *fp = (struct faulty_allocator*) ap;
+	fp->backing = backing;
+	return /*success*/1;
+}
+
+
+/* Initialize faulty allocator on top of the default heap allocator */
+int create_faulty_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable)
+{
+	struct allocator *backing = get_allocator(default_allocator);
+	if (!backing)
+		return /*error*/0;
+
+	return create_faulty_allocator_with_backing(ap, vtable, backing);
+}
+
+
+/* Un-initialize faulty allocator */
+void destroy_faulty_allocator(struct allocator *ap)
+{
+	/* Backing allocator is owned by the caller */
+	destroy_allocator(ap);
 }
 
 
 /* Allocate memory from faulty allocator */
-static void *faulty_allocate_memory(struct allocator *ap, size_t n)
+void *faulty_grab_memory(struct allocator *ap, size_t n)
 {
-	(void) ap;
+	struct faulty_allocator *fp = (struct faulty_allocator*) ap;
 
+	/* Failure is charged to the site entered by allocator_allocate_memory */
 	void *p;
 	if (!simulate_failure()) {
-		/* No simulation, allocate memory from system */
-		p = system_allocate_memory(n);
+		/* No simulation, allocate memory from backing allocator */
+		p = allocator_allocate_memory(fp->backing, n);
 	} else {
 		/* Simulated failure */
 		p = NULL;
@@ -83,29 +130,28 @@ static void *faulty_allocate_memory(struct allocator *ap, size_t n)
 
 
 /* Release memory back to faulty allocator */
-static void faulty_free_memory(struct allocator *ap, void *p)
+void faulty_release_memory(struct allocator *ap, void *p)
 {
-	(void) ap;
+	struct faulty_allocator *fp = (struct faulty_allocator*) ap;
 
-	/* Return memory directly to system */
-	system_free_memory(p);
+	/* Return memory directly to backing allocator */
+	allocator_free_memory(fp->backing, p);
 }
 
 
 /* Resize memory region */
-static void *faulty_resize_memory(struct allocator *ap, void *p, size_t n)
+void *faulty_resize_memory(struct allocator *ap, void *p, size_t n)
 {
-	(void)ap;
+	struct faulty_allocator *fp = (struct faulty_allocator*) ap;
 
+	/* Failure is charged to the site entered by allocator_resize_memory */
 	void *q;
 	if (!simulate_failure()) {
-		/* No simulation, allocate memory from system */
-		q = system_resize_memory(p, n);
+		/* No simulation, resize memory with backing allocator */
+		q = allocator_resize_memory(fp->backing, p, n);
 	} else {
 		/* Simulated failure */
 		q = NULL;
 	}
 	return q;
 }
-
-
@@ -7,24 +7,59 @@
  */
 #include "t7/types.h"
 #include "t7/fixture.h"
+#include "t7/memory.h"
+#include "t7/exit-handler.h"
 #include "t7/terminate.h"
 
 /* Virtual functions */
 static struct allocator *get_fixture_allocator(fixture_t *fp);
 
-/* Current fixture for main thread */
+/* Default fixture of every thread */
 static fixture_t def1 = {
 	get_fixture_allocator
 };
-fixture_t *default_fixture = &def1;
+fixture_t *const default_fixture = &def1;
+
+/* Saved scope */
+struct frame {
+	fixture_t *fixture;
+	struct allocator *allocator;
+};
+
+/* Fixture state of thread */
+struct state {
+	/* Fixture of innermost scope */
+	fixture_t *active;
+
+	/* Allocator of innermost scope or NULL to ask fixture */
+	struct allocator *allocator;
+
+	/* Outer scopes */
+	size_t depth;
+	struct frame frames[T7_MAX_FIXTURE_DEPTH];
+};
+
+/* Get state of current thread */
+static struct state *get_state(void);
 
 /* Operating system specific variables */
 #if defined(T7_DISABLE_THREADS)
-	/* Pointer to current fixture */
-	static fixture_t *active = default_fixture;
+	/* State of the only thread */
+	static struct state global_state = { &def1, NULL, 0, { { NULL, NULL } } };
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+	/* State of each thread */
+	static _Thread_local struct state thread_state = {
+		&def1, NULL, 0, { { NULL, NULL } }
+	};
 #elif !defined(_WIN32)
 	/* Initialize thread local storage */
-	static void init_pthread (void);
+	static void init_pthread(void);
+
+	/* Release state of thread */
+	static void done_pthread(void *p);
+
+	/* Release state of main thread */
+	static void multi_thread_exit(void);
 
 	/* Pthread key for thread local storage */
 	static pthread_key_t key;
@@ -39,33 +74,7 @@ fixture_t *default_fixture = &def1;
 /* Get pointer to current fixture */
 fixture_t *get_fixture(void)
 {
-	fixture_t *fp;
-
-#if defined(T7_DISABLE_THREADS)
-	/* Return pointer to global fixture */
-	fp = active;
-#elif !defined(_WIN32)
-	/* Initialize thread local key */
-	if (pthread_once(&key_once, init_pthread) == /*OK*/0) {
-		/* Does this thread have its own fixture? */
-		fp = (fixture_t*) pthread_getspecific(key);
-		if (fp != NULL) {
-			/* Yes, return pointer to thread's fixture */
-			/*NOP*/;
-		} else {
-			// FIXME: Copy fixture when creating a thread
-			/* No, return pointer to global fixture */
-			fp = default_fixture;
-		}
-	} else {
-		/* Thread once failed */
-		terminate("Cannot initialize fixtures");
-		fp = NULL;
-	}
-#else
-	terminate("Fixtures not implemented yet");
-#endif
-	return fp;
+	return get_state()->active;
 }
 
 
@@ -75,27 +84,74 @@ void set_fixture(fixture_t *fp)
 	assert(fp != NULL);
 	assert(fp->get_fixture_allocator != NULL);
 
-#if defined(T7_DISABLE_THREADS)
-	/* Set active fixture */
-	active = fp;
-#elif !defined(_WIN32)
-	/* Initialize thread local key */
-	if (pthread_once(&key_once, init_pthread) == /*OK*/0) {
-		/* Set pointer to fixture */
-		if (pthread_setspecific(key, fp) == /*OK*/0) {
-			/* Success */
-			/*NOP*/;
-		} else {
-			/* Error */
-			terminate("Cannot set fixture");
-		}
-	} else {
-		/* Thread once failed */
-		terminate("Cannot initialize fixtures");
-	}
-#else
-	terminate("Fixtures not implemented yet");
-#endif
+	/* Replace innermost scope */
+	struct state *sp = get_state();
+	sp->active = fp;
+	sp->allocator = NULL;
+}
+
+
+/* Get allocator of innermost scope */
+struct allocator *get_scope_allocator(void)
+{
+	return get_state()->allocator;
+}
+
+
+/* Set allocator of innermost scope */
+void set_scope_allocator(struct allocator *ap)
+{
+	get_state()->allocator = ap;
+}
+
+
+/* Start scope with fixture */
+int push_fixture(fixture_t *fp)
+{
+	assert(fp != NULL);
+	assert(fp->get_fixture_allocator != NULL);
+
+	/* Resolve allocator before saving the outer scope */
+	struct allocator *ap = fp->get_fixture_allocator(fp);
+	if (!push_allocator(ap))
+		return 0;
+
+	get_state()->active = fp;
+	return 1;
+}
+
+
+/* Start scope with allocator */
+int push_allocator(struct allocator *ap)
+{
+	assert(ap != NULL);
+
+	/* Is there room for one more scope? */
+	struct state *sp = get_state();
+	if (sp->depth >= T7_MAX_FIXTURE_DEPTH)
+		return 0;
+
+	/* Save outer scope */
+	struct frame *fp = &sp->frames[sp->depth++];
+	fp->fixture = sp->active;
+	fp->allocator = sp->allocator;
+
+	/* Use allocator in the new scope */
+	sp->allocator = ap;
+	return 1;
+}
+
+
+/* End scope */
+void pop_fixture(void)
+{
+	struct state *sp = get_state();
+	assert(sp->depth > 0);
+
+	/* Restore outer scope */
+	struct frame *fp = &sp->frames[--sp->depth];
+	sp->active = fp->fixture;
+	sp->allocator = fp->allocator;
 }
 
 
@@ -120,12 +176,50 @@ static struct allocator *get_fixture_allocator(fixture_t *fp)
 }
 
 
+/* Get state of current thread */
+static struct state *get_state(void)
+{
+	struct state *sp;
+
+#if defined(T7_DISABLE_THREADS)
+	/* Return pointer to global state */
+	sp = &global_state;
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+	/* Return pointer to thread's state */
+	sp = &thread_state;
+#elif !defined(_WIN32)
+	/* Initialize thread local key */
+	if (pthread_once(&key_once, init_pthread) != /*OK*/0)
+		terminate("Cannot initialize fixtures");
+
+	/* Does this thread have its own state? */
+	sp = (struct state*) pthread_getspecific(key);
+	if (sp == NULL) {
+		/* No, create state with default fixture */
+		sp = system_allocate_memory(sizeof(struct state));
+		if (!sp)
+			terminate("Cannot allocate fixture");
+		sp->active = default_fixture;
+		sp->allocator = NULL;
+		sp->depth = 0;
+		if (pthread_setspecific(key, sp) != /*OK*/0)
+			terminate("Cannot set fixture");
+	}
+#else
+	terminate("Fixtures not implemented yet");
+	sp = NULL;
+#endif
+	return sp;
+}
+
+
 /* Initialize pthread */
-#if !defined(T7_DISABLE_THREADS)  &&  !defined(_WIN32)
+#if !defined(T7_DISABLE_THREADS)  &&  !defined(HAVE_THREAD_LOCAL)  \
+	&&  !defined(_WIN32)
 static void init_pthread(void)
 {
 	/* Create fixture key in all threads */
-	if (pthread_key_create(&key, NULL) != /*OK*/0) {
+	if (pthread_key_create(&key, done_pthread) != /*OK*/0) {
 		/*
 		 * Cannot create pthread key.  This is a serious error because
 		 * we have no reasonable way to return error from this
@@ -133,5 +227,33 @@ static void init_pthread(void)
 		 */
 		terminate("Cannot create fixture key");
 	}
+
+	/* Destructor is not called for main thread */
+	if (!exit_handler(multi_thread_exit, 30))
+		terminate("Cannot register exit handler");
+}
+#endif
+
+
+/* Release state when thread exits */
+#if !defined(T7_DISABLE_THREADS)  &&  !defined(HAVE_THREAD_LOCAL)  \
+	&&  !defined(_WIN32)
+static void done_pthread(void *p)
+{
+	system_free_memory(p);
+}
+#endif
+
+
+/* Release state of main thread */
+#if !defined(T7_DISABLE_THREADS)  &&  !defined(HAVE_THREAD_LOCAL)  \
+	&&  !defined(_WIN32)
+static void multi_thread_exit(void)
+{
+	struct state *sp = (struct state*) pthread_getspecific(key);
+	if (sp) {
+		pthread_setspecific(key, NULL);
+		system_free_memory(sp);
+	}
 }
 #endif
@@ -0,0 +1,671 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/future.h"
+#include "t7/thread.h"
+#include "t7/memory.h"
+#include "t7/terminate.h"
+
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+#   include <time.h>
+#   include <errno.h>
+#endif
+
+/*
+ * Measure timeouts with monotonic clock where condition variables support it
+ * so that changes to wall-clock time do not shorten or extend timeouts.
+ */
+#if defined(HAVE_PTHREAD_CONDATTR_SETCLOCK)
+#   define WAIT_CLOCK CLOCK_MONOTONIC
+#else
+#   define WAIT_CLOCK CLOCK_REALTIME
+#endif
+
+
+/* Forward-decl */
+struct future_link;
+
+/* Function called when a future completes */
+typedef void notify_function(struct future_link *lp, future_t *src);
+
+/* Dependent future waiting for another future to complete */
+struct future_link {
+	/* Next link in list */
+	struct future_link *next;
+
+	/* Function called when source future completes */
+	notify_function *notify;
+
+	/* Future to be completed by notify function */
+	future_t *target;
+
+	/* Continuation for then_future */
+	continuation_function *f;
+	void *arg;
+
+	/* Index of source future for when_any */
+	size_t index;
+};
+
+/* Asynchronous result */
+struct future {
+	/* Number of references to this future */
+	size_t refs;
+
+	/* Current state */
+	future_state_t state;
+
+	/* Dependent futures to be notified on completion */
+	struct future_link *links;
+
+	/* Thread executing the task or NULL */
+	thread_t *thread;
+
+	/* Number of source futures left for when_all and when_any */
+	size_t pending;
+
+	/* True if any source future failed in when_all */
+	int failed;
+
+	/* Pointer to result or NULL */
+	void *result;
+
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+	/* Protects the fields above */
+	pthread_mutex_t mutex;
+
+	/* Signaled when the future completes */
+	pthread_cond_t cond;
+#endif
+};
+
+/* Thread executing an asynchronous task */
+struct task_thread {
+	/* Base thread, must be the first member of the structure */
+	thread_t base;
+
+	/* Future to complete */
+	future_t *future;
+
+	/* Task to execute */
+	task_function *f;
+	void *arg;
+};
+
+
+/* Local functions */
+static future_t *new_future(size_t size);
+static void retain_future(future_t *fp);
+static void release_future(future_t *fp);
+static void complete_future(future_t *fp, future_state_t state);
+static struct future_link *new_link(notify_function *notify, future_t *target);
+static void add_link(future_t *fp, struct future_link *lp);
+static void notify_then(struct future_link *lp, future_t *src);
+static void notify_all(struct future_link *lp, future_t *src);
+static void notify_any(struct future_link *lp, future_t *src);
+static void lock_future(future_t *fp);
+static void unlock_future(future_t *fp);
+static thread_t *allocate_task_thread(void);
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+static int init_condition(pthread_cond_t *cp);
+#endif
+static int run_task_thread(thread_t *tp);
+
+/* Thread type for executing tasks */
+static thread_type_t def1 = {
+	allocate_task_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	run_task_thread
+};
+static thread_type_t *task_type = &def1;
+
+
+/* Start task in a new thread */
+future_t *async_task(task_function *f, void *arg, size_t size)
+{
+	assert(f != NULL);
+
+	/* Create future for the result */
+	future_t *fp = new_future(size);
+	if (!fp)
+		goto exit_null;
+
+	/* Create thread for executing the task */
+	thread_t *tp = new_thread(task_type);
+	if (!tp)
+		goto exit_future;
+
+	/* Bind task to thread */
+	struct task_thread *ttp = (struct task_thread*) tp;
+	ttp->future = fp;
+	ttp->f = f;
+	ttp->arg = arg;
+
+	/*
+	 * Save thread before starting it: in single-threaded mode the task
+	 * completes before start_thread returns.
+	 */
+	fp->thread = tp;
+	if (!start_thread(tp))
+		goto exit_thread;
+
+	/* Success */
+	return fp;
+
+exit_thread:
+	fp->thread = NULL;
+	delete_thread(tp);
+exit_future:
+	release_future(fp);
+exit_null:
+	return NULL;
+}
+
+
+/* Chain continuation to future */
+future_t *then_future(
+	future_t *fp, continuation_function *f, void *arg, size_t size)
+{
+	assert(fp != NULL);
+	assert(f != NULL);
+
+	/* Create future for the result of continuation */
+	future_t *dest = new_future(size);
+	if (!dest)
+		return NULL;
+
+	/* Create link from source to destination */
+	struct future_link *lp = new_link(notify_then, dest);
+	if (!lp) {
+		release_future(dest);
+		return NULL;
+	}
+	lp->f = f;
+	lp->arg = arg;
+
+	/* Execute continuation when the source completes */
+	add_link(fp, lp);
+	return dest;
+}
+
+
+/* Complete when all futures complete */
+future_t *when_all(future_t **futures, size_t n)
+{
+	assert(futures != NULL || n == 0);
+
+	/* Create combined future without result */
+	future_t *dest = new_future(0);
+	if (!dest)
+		goto exit_null;
+
+	/* Complete immediately if there is nothing to wait for */
+	if (n == 0) {
+		complete_future(dest, FUTURE_READY);
+		return dest;
+	}
+
+	/*
+	 * Allocate all links before attaching any of them so that the
+	 * sources are left untouched if we run out of memory.
+	 */
+	struct future_link *first = NULL;
+	for (size_t i = n; i > 0; i--) {
+		struct future_link *lp = new_link(notify_all, dest);
+		if (!lp)
+			goto exit_links;
+		lp->index = i - 1;
+		lp->next = first;
+		first = lp;
+	}
+
+	/* Attach links to source futures */
+	dest->pending = n;
+	while (first) {
+		struct future_link *lp = first;
+		first = lp->next;
+		add_link(futures[lp->index], lp);
+	}
+	return dest;
+
+exit_links:
+	while (first) {
+		struct future_link *lp = first;
+		first = lp->next;
+		release_future(lp->target);
+		free_memory(lp);
+	}
+	release_future(dest);
+exit_null:
+	return NULL;
+}
+
+
+/* Complete when first future completes */
+future_t *when_any(future_t **futures, size_t n)
+{
+	assert(futures != NULL || n == 0);
+
+	/* Create combined future with index as a result */
+	future_t *dest = new_future(sizeof(size_t));
+	if (!dest)
+		goto exit_null;
+
+	/* No future will ever complete */
+	if (n == 0) {
+		complete_future(dest, FUTURE_FAILED);
+		return dest;
+	}
+
+	/* Allocate all links before attaching any of them */
+	struct future_link *first = NULL;
+	for (size_t i = n; i > 0; i--) {
+		struct future_link *lp = new_link(notify_any, dest);
+		if (!lp)
+			goto exit_links;
+		lp->index = i - 1;
+		lp->next = first;
+		first = lp;
+	}
+
+	/* Attach links to source futures */
+	dest->pending = 1;
+	while (first) {
+		struct future_link *lp = first;
+		first = lp->next;
+		add_link(futures[lp->index], lp);
+	}
+	return dest;
+
+exit_links:
+	while (first) {
+		struct future_link *lp = first;
+		first = lp->next;
+		release_future(lp->target);
+		free_memory(lp);
+	}
+	release_future(dest);
+exit_null:
+	return NULL;
+}
+
+
+/* Wait for future to complete */
+future_state_t wait_future(future_t *fp)
+{
+	assert(fp != NULL);
+
+#if defined(T7_DISABLE_THREADS)
+	/* Tasks are run to completion when they are started */
+	if (fp->state == FUTURE_PENDING)
+		terminate("Future can never complete");
+	return fp->state;
+#elif !defined(_WIN32)
+	lock_future(fp);
+	while (fp->state == FUTURE_PENDING) {
+		if (pthread_cond_wait(&fp->cond, &fp->mutex) != /*OK*/0)
+			terminate("Cannot wait for future");
+	}
+	future_state_t state = fp->state;
+	unlock_future(fp);
+	return state;
+#else
+	terminate("Futures not implemented yet");
+	return FUTURE_FAILED;
+#endif
+}
+
+
+/* Wait for future to complete or timeout to expire */
+future_state_t wait_future_for(future_t *fp, unsigned long ms)
+{
+	assert(fp != NULL);
+
+#if defined(T7_DISABLE_THREADS)
+	/* Nothing can change the state while we wait */
+	(void) ms;
+	return fp->state;
+#elif !defined(_WIN32)
+	/* Compute absolute deadline on the clock of condition variable */
+	struct timespec deadline;
+	if (clock_gettime(WAIT_CLOCK, &deadline) != /*OK*/0)
+		terminate("Cannot read clock");
+	deadline.tv_sec += (time_t) (ms / 1000);
+	deadline.tv_nsec += (long) (ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	/* Wait until future completes or deadline passes */
+	lock_future(fp);
+	while (fp->state == FUTURE_PENDING) {
+		int rc = pthread_cond_timedwait(
+			&fp->cond, &fp->mutex, &deadline);
+		if (rc == ETIMEDOUT)
+			break;
+		if (rc != /*OK*/0)
+			terminate("Cannot wait for future");
+	}
+	future_state_t state = fp->state;
+	unlock_future(fp);
+	return state;
+#else
+	terminate("Futures not implemented yet");
+	return FUTURE_FAILED;
+#endif
+}
+
+
+/* Returns true if future has completed */
+int is_future_ready(future_t *fp)
+{
+	assert(fp != NULL);
+
+	lock_future(fp);
+	int ready = (fp->state != FUTURE_PENDING);
+	unlock_future(fp);
+	return ready;
+}
+
+
+/* Get pointer to result */
+void *get_future_result(future_t *fp)
+{
+	assert(fp != NULL);
+	return fp->result;
+}
+
+
+/* Release future */
+void delete_future(future_t *fp)
+{
+	if (!fp)
+		return;
+
+	/* Wait for task thread to finish and release it */
+	if (fp->thread) {
+		join_thread(fp->thread);
+		delete_thread(fp->thread);
+		fp->thread = NULL;
+	}
+
+	/* Release caller's reference */
+	release_future(fp);
+}
+
+
+/* Allocate new pending future with room for result */
+static future_t *new_future(size_t size)
+{
+	/* Place result after the structure at 16-byte boundary */
+	size_t offset = (sizeof(future_t) + 15u) & ~(size_t) 15u;
+
+	/* Allocate room for future and result */
+	future_t *fp = allocate_memory(offset + size);
+	if (!fp)
+		return NULL;
+
+	/* Initialize fields */
+	fp->refs = 1;
+	fp->state = FUTURE_PENDING;
+	fp->links = NULL;
+	fp->thread = NULL;
+	fp->pending = 0;
+	fp->failed = 0;
+	fp->result = size ? ((char*) fp) + offset : NULL;
+
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+	/* Initialize synchronization objects */
+	if (pthread_mutex_init(&fp->mutex, NULL) != /*OK*/0)
+		goto exit_free;
+	if (!init_condition(&fp->cond))
+		goto exit_mutex;
+#endif
+	return fp;
+
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+exit_mutex:
+	pthread_mutex_destroy(&fp->mutex);
+exit_free:
+	free_memory(fp);
+	return NULL;
+#endif
+}
+
+
+/* Add reference to future */
+static void retain_future(future_t *fp)
+{
+	lock_future(fp);
+	fp->refs++;
+	unlock_future(fp);
+}
+
+
+/* Remove reference and release future when the last reference is gone */
+static void release_future(future_t *fp)
+{
+	lock_future(fp);
+	assert(fp->refs > 0);
+	size_t refs = --fp->refs;
+	unlock_future(fp);
+	if (refs)
+		return;
+
+	/* No links may be left as each link holds a reference */
+	assert(fp->thread == NULL);
+
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+	pthread_cond_destroy(&fp->cond);
+	pthread_mutex_destroy(&fp->mutex);
+#endif
+	free_memory(fp);
+}
+
+
+/* Mark future completed and notify dependents */
+static void complete_future(future_t *fp, future_state_t state)
+{
+	assert(state == FUTURE_READY || state == FUTURE_FAILED);
+
+	/* Publish state and detach list of dependents */
+	lock_future(fp);
+	assert(fp->state == FUTURE_PENDING);
+	fp->state = state;
+	struct future_link *lp = fp->links;
+	fp->links = NULL;
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+	if (pthread_cond_broadcast(&fp->cond) != /*OK*/0)
+		terminate("Cannot signal future");
+#endif
+	unlock_future(fp);
+
+	/* Reverse the list to notify dependents in order of registration */
+	struct future_link *first = NULL;
+	while (lp) {
+		struct future_link *next = lp->next;
+		lp->next = first;
+		first = lp;
+		lp = next;
+	}
+
+	/* Notify dependents outside of lock */
+	while (first) {
+		struct future_link *next = first->next;
+		first->notify(first, fp);
+		free_memory(first);
+		first = next;
+	}
+}
+
+
+/* Create link which holds a reference to target */
+static struct future_link *new_link(notify_function *notify, future_t *target)
+{
+	struct future_link *lp = allocate_memory(sizeof(struct future_link));
+	if (!lp)
+		return NULL;
+
+	lp->next = NULL;
+	lp->notify = notify;
+	lp->target = target;
+	lp->f = NULL;
+	lp->arg = NULL;
+	lp->index = 0;
+	retain_future(target);
+	return lp;
+}
+
+
+/* Notify link when future completes or immediately if already completed */
+static void add_link(future_t *fp, struct future_link *lp)
+{
+	lock_future(fp);
+	if (fp->state == FUTURE_PENDING) {
+		/* Notify later */
+		lp->next = fp->links;
+		fp->links = lp;
+		unlock_future(fp);
+		return;
+	}
+	unlock_future(fp);
+
+	/* Source already completed */
+	lp->notify(lp, fp);
+	free_memory(lp);
+}
+
+
+/* Execute continuation */
+static void notify_then(struct future_link *lp, future_t *src)
+{
+	future_t *dest = lp->target;
+
+	/* Execute continuation only if the source succeeded */
+	future_state_t state = FUTURE_FAILED;
+	if (src->state == FUTURE_READY) {
+		if (lp->f(lp->arg, src->result, dest->result))
+			state = FUTURE_READY;
+	}
+
+	complete_future(dest, state);
+	release_future(dest);
+}
+
+
+/* Count down completed futures */
+static void notify_all(struct future_link *lp, future_t *src)
+{
+	future_t *dest = lp->target;
+
+	lock_future(dest);
+	if (src->state != FUTURE_READY)
+		dest->failed = 1;
+	assert(dest->pending > 0);
+	int done = (--dest->pending == 0);
+	int failed = dest->failed;
+	unlock_future(dest);
+
+	if (done)
+		complete_future(dest, failed ? FUTURE_FAILED : FUTURE_READY);
+	release_future(dest);
+}
+
+
+/* Complete on first completed future */
+static void notify_any(struct future_link *lp, future_t *src)
+{
+	future_t *dest = lp->target;
+
+	/* Only the first completed source may complete the destination */
+	lock_future(dest);
+	int first = (dest->pending != 0);
+	if (first) {
+		dest->pending = 0;
+		*(size_t*) dest->result = lp->index;
+	}
+	unlock_future(dest);
+
+	if (first)
+		complete_future(dest, src->state);
+	release_future(dest);
+}
+
+
+/* Initialize condition variable which waits on WAIT_CLOCK */
+#if !defined(T7_DISABLE_THREADS) && !defined(_WIN32)
+static int init_condition(pthread_cond_t *cp)
+{
+#if defined(HAVE_PTHREAD_CONDATTR_SETCLOCK)
+	pthread_condattr_t attr;
+	if (pthread_condattr_init(&attr) != /*OK*/0)
+		return /*error*/ 0;
+	int ok = pthread_condattr_setclock(&attr, WAIT_CLOCK) == /*OK*/0
+		&& pthread_cond_init(cp, &attr) == /*OK*/0;
+	pthread_condattr_destroy(&attr);
+	return ok;
+#else
+	return pthread_cond_init(cp, NULL) == /*OK*/0;
+#endif
+}
+#endif
+
+
+/* Lock future */
+static void lock_future(future_t *fp)
+{
+#if defined(T7_DISABLE_THREADS)
+	(void) fp;
+#elif !defined(_WIN32)
+	if (pthread_mutex_lock(&fp->mutex) != /*OK*/0)
+		terminate("Cannot acquire mutex");
+#else
+	(void) fp;
+	terminate("Futures not implemented yet");
+#endif
+}
+
+
+/* Unlock future */
+static void unlock_future(future_t *fp)
+{
+#if defined(T7_DISABLE_THREADS)
+	(void) fp;
+#elif !defined(_WIN32)
+	if (pthread_mutex_unlock(&fp->mutex) != /*OK*/0)
+		terminate("Cannot release mutex");
+#else
+	(void) fp;
+	terminate("Futures not implemented yet");
+#endif
+}
+
+
+/* Allocate memory for task thread */
+static thread_t *allocate_task_thread(void)
+{
+	return allocate_memory(sizeof(struct task_thread));
+}
+
+
+/* Execute task and complete its future */
+static int run_task_thread(thread_t *tp)
+{
+	struct task_thread *ttp = (struct task_thread*) tp;
+	future_t *fp = ttp->future;
+
+	/* Execute task */
+	int ok = ttp->f(ttp->arg, fp->result);
+
+	/* Publish result and run continuations in this thread */
+	complete_future(fp, ok ? FUTURE_READY : FUTURE_FAILED);
+	return ok;
+}
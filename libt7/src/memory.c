@@ -8,13 +8,17 @@
 #include "t7/types.h"
 #include "t7/memory.h"
 #include "t7/allocator.h"
+#include "t7/simulate-failure.h"
 
 
 /* Allocate n bytes of memory */
 void *allocate_memory(size_t n)
 {
 	struct allocator *ap = get_default_allocator();
-	return allocator_allocate_memory(ap, n);
+	int entered = enter_failure_site(T7_CALLER_ADDRESS);
+	void *p = allocator_allocate_memory(ap, n);
+	leave_failure_site(entered);
+	return p;
 }
 
 
@@ -30,7 +34,10 @@ void free_memory(void *p)
 void *resize_memory(void *p, size_t n)
 {
 	struct allocator *ap = get_default_allocator();
-	return allocator_resize_memory(ap, p, n);
+	int entered = enter_failure_site(T7_CALLER_ADDRESS);
+	void *q = allocator_resize_memory(ap, p, n);
+	leave_failure_site(entered);
+	return q;
 }
 
 
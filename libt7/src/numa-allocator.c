@@ -0,0 +1,306 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/numa-allocator.h"
+#include "t7/static-allocator.h"
+#include "t7/memory.h"
+#include "t7/thread.h"
+#include <stdint.h>
+
+
+/*
+ * Each memory block starts with a header telling which allocator owns the
+ * block.  Header is 16 bytes long to keep the alignment of backing
+ * allocator.
+ */
+#define HEADER_SIZE 16
+
+/*
+ * Requests of this size or larger go to the default allocator, whose large
+ * blocks are mapped from the system and placed on the node of the thread
+ * which first touches them.  Smaller requests always fit in a new arena.
+ */
+#define LARGE_SIZE (256 * 1024)
+
+
+/* Header in front of each memory block */
+struct numa_header {
+	/* Allocator which owns the block */
+	struct allocator *owner;
+
+	/* Size of block without header */
+	size_t size;
+};
+
+
+/* Backing allocator of one node */
+struct numa_arena {
+	/* Allocator created on the node */
+	struct allocator *allocator;
+
+	/* Arena created before this one */
+	struct numa_arena *next;
+};
+
+
+/* Internal functions */
+static struct numa_arena *add_arena(
+	struct numa_allocator *np, struct numa_arena **slot,
+	struct numa_arena *seen);
+
+static void *grab_large(size_t n);
+
+static void *finish_block(
+	struct allocator *owner, char *block, size_t n);
+
+
+/* Allocator type */
+static struct allocator_vtable def1 = {
+	allocate_numa_allocator,
+	free_numa_allocator,
+	create_numa_allocator,
+	destroy_numa_allocator,
+	numa_grab_memory,
+	numa_release_memory,
+	numa_resize_memory,
+};
+const struct allocator_vtable *numa_allocator = &def1;
+
+
+/* Create NUMA allocator with backing allocators of given type */
+struct allocator *new_numa_allocator(const struct allocator_vtable *backing)
+{
+	assert(backing != NULL);
+
+	/* Allocate memory for allocator */
+	struct allocator *ap = allocate_numa_allocator();
+	if (!ap)
+		return NULL;
+
+	/* Initialize allocator with backing */
+	if (!create_numa_allocator_with_backing(ap, numa_allocator, backing)) {
+		free_numa_allocator(ap);
+		return NULL;
+	}
+	return ap;
+}
+
+
+/* Allocate room for NUMA allocator object */
+struct allocator *allocate_numa_allocator(void)
+{
+	return system_allocate_memory(sizeof(struct numa_allocator));
+}
+
+
+/* Release NUMA allocator object */
+void free_numa_allocator(struct allocator *ap)
+{
+	system_free_memory(ap);
+}
+
+
+/* Initialize NUMA allocator without backing allocators */
+int create_numa_allocator_with_backing(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	const struct allocator_vtable *backing)
+{
+	assert(backing != NULL);
+	assert(sizeof(struct numa_header) <= HEADER_SIZE);
+
+	/* Initialize standard fields */
+	if (!create_allocator(ap, vtable))
+		return /*error*/0;
+
+	/* Arenas are created when nodes first need them */
+	struct numa_allocator *np = (struct numa_allocator*) ap;
+	np->backing = backing;
+	for (size_t i = 0; i < T7_MAX_NUMA_NODES; i++)
+		np->nodes[i] = NULL;
+	return /*success*/1;
+}
+
+
+/* Initialize NUMA allocator on top of mapped static allocators */
+int create_numa_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable)
+{
+	return create_numa_allocator_with_backing(
+		ap, vtable, mapped_static_allocator);
+}
+
+
+/* Un-initialize NUMA allocator and its backing allocators */
+void destroy_numa_allocator(struct allocator *ap)
+{
+	struct numa_allocator *np = (struct numa_allocator*) ap;
+	for (size_t i = 0; i < T7_MAX_NUMA_NODES; i++) {
+		struct numa_arena *arena = np->nodes[i];
+		while (arena) {
+			struct numa_arena *next = arena->next;
+			delete_allocator(arena->allocator);
+			system_free_memory(arena);
+			arena = next;
+		}
+	}
+	destroy_allocator(ap);
+}
+
+
+/* Get first backing allocator of node */
+struct allocator *get_node_allocator(struct allocator *ap, int node)
+{
+	struct numa_allocator *np = (struct numa_allocator*) ap;
+	assert(node >= 0);
+
+	/* Nodes beyond the limit share allocators */
+	struct numa_arena **slot = &np->nodes[(size_t) node % T7_MAX_NUMA_NODES];
+	struct numa_arena *arena = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (!arena) {
+		arena = add_arena(np, slot, NULL);
+		if (!arena)
+			return NULL;
+	}
+
+	/* Arenas are listed from newest to oldest */
+	while (arena->next)
+		arena = arena->next;
+	return arena->allocator;
+}
+
+
+/* Allocate memory from node of calling thread */
+void *numa_grab_memory(struct allocator *ap, size_t n)
+{
+	struct numa_allocator *np = (struct numa_allocator*) ap;
+	if (n > SIZE_MAX - HEADER_SIZE)
+		return NULL;
+
+	/* Large blocks do not fit in arenas */
+	if (n >= LARGE_SIZE)
+		return grab_large(n);
+
+	/* Try arenas of current node from newest to oldest */
+	size_t node = (size_t) get_current_node() % T7_MAX_NUMA_NODES;
+	struct numa_arena **slot = &np->nodes[node];
+	struct numa_arena *head = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	for (struct numa_arena *arena = head; arena; arena = arena->next) {
+		char *p = allocator_allocate_memory(arena->allocator, n + HEADER_SIZE);
+		if (p)
+			return finish_block(arena->allocator, p, n);
+	}
+
+	/* All arenas are full, so add one on this node */
+	struct numa_arena *arena = add_arena(np, slot, head);
+	if (arena) {
+		char *p = allocator_allocate_memory(arena->allocator, n + HEADER_SIZE);
+		if (p)
+			return finish_block(arena->allocator, p, n);
+	}
+
+	/* Arena cannot serve request, fall back to default allocator */
+	return grab_large(n);
+}
+
+
+/* Release memory back to allocator which owns it */
+void numa_release_memory(struct allocator *ap, void *p)
+{
+	(void) ap;
+
+	char *block = (char*) p - HEADER_SIZE;
+	struct numa_header *hp = (struct numa_header*) block;
+	assert(hp->owner != NULL);
+	allocator_free_memory(hp->owner, block);
+}
+
+
+/* Resize memory within allocator which owns it */
+void *numa_resize_memory(struct allocator *ap, void *p, size_t n)
+{
+	if (n > SIZE_MAX - HEADER_SIZE)
+		return NULL;
+
+	/* Header moves along with the block */
+	char *block = (char*) p - HEADER_SIZE;
+	struct numa_header *hp = (struct numa_header*) block;
+	struct allocator *owner = hp->owner;
+	size_t size = hp->size;
+	assert(owner != NULL);
+	char *q = allocator_resize_memory(owner, block, n + HEADER_SIZE);
+	if (q)
+		return finish_block(owner, q, n);
+
+	/* Arena of block is full, so move block */
+	char *r = numa_grab_memory(ap, n);
+	if (!r)
+		return NULL;
+	copy_memory(r, p, size < n ? size : n);
+	numa_release_memory(ap, p);
+	return r;
+}
+
+
+/*
+ * Add arena to node unless another thread added one after the caller saw
+ * SEEN at the head of list.  Returns the newest arena or NULL on error.
+ */
+static struct numa_arena *add_arena(
+	struct numa_allocator *np, struct numa_arena **slot,
+	struct numa_arena *seen)
+{
+	/*
+	 * Create allocator in the calling thread so that its memory is placed
+	 * on the node.
+	 */
+	struct numa_arena *arena = system_allocate_memory(sizeof(*arena));
+	if (!arena)
+		return NULL;
+	arena->allocator = new_allocator(np->backing);
+	if (!arena->allocator)
+		goto exit_arena;
+
+	/* Use arena of another thread if it got there first */
+	arena->next = seen;
+	struct numa_arena *head = seen;
+	if (!__atomic_compare_exchange_n(slot, &head, arena, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		delete_allocator(arena->allocator);
+		system_free_memory(arena);
+		return head;
+	}
+	return arena;
+
+exit_arena:
+	system_free_memory(arena);
+	return NULL;
+}
+
+
+/* Allocate block from default allocator */
+static void *grab_large(size_t n)
+{
+	struct allocator *dp = get_allocator(default_allocator);
+	if (!dp)
+		return NULL;
+
+	char *p = allocator_allocate_memory(dp, n + HEADER_SIZE);
+	if (!p)
+		return NULL;
+	return finish_block(dp, p, n);
+}
+
+
+/* Fill in header of block and return pointer past it */
+static void *finish_block(struct allocator *owner, char *block, size_t n)
+{
+	struct numa_header *hp = (struct numa_header*) block;
+	hp->owner = owner;
+	hp->size = n;
+	return block + HEADER_SIZE;
+}
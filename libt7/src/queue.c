@@ -0,0 +1,401 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/queue.h"
+#include "t7/allocator.h"
+#include "t7/thread.h"
+#include "t7/terminate.h"
+#include <stdatomic.h>
+#include <limits.h>
+#include <stddef.h>
+
+#if !defined(T7_DISABLE_THREADS) && defined(HAVE_LINUX_FUTEX_H)
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+
+/* Slot in queue */
+struct cell {
+	/* Round number of the slot, see try_push_queue */
+	atomic_size_t sequence;
+
+	/* Item stored in slot */
+	void *data;
+};
+
+/* Counter padded to fill a whole cache line */
+union padded_position {
+	atomic_size_t value;
+	char pad[T7_CACHE_LINE_SIZE];
+};
+
+/* Futex word padded to fill a whole cache line */
+struct padded_event {
+	/* Incremented whenever the condition may have changed */
+	atomic_uint sequence;
+
+	/* Number of threads sleeping on sequence */
+	atomic_uint waiters;
+
+	char pad[T7_CACHE_LINE_SIZE - 2 * sizeof(atomic_uint)];
+};
+
+/* Queue */
+struct queue {
+	/* Allocator which owns the queue */
+	struct allocator *allocator;
+
+	/* Array of slots */
+	struct cell *buffer;
+
+	/* Number of slots minus one */
+	size_t mask;
+
+	/* Keep producers and consumers on separate cache lines */
+	char pad[T7_CACHE_LINE_SIZE];
+	union padded_position enqueue;
+	union padded_position dequeue;
+
+	/* Events for blocked producers and consumers */
+	struct padded_event not_full;
+	struct padded_event not_empty;
+};
+
+
+/* Local functions */
+static void wait_event(struct padded_event *ep, unsigned sequence);
+static void signal_event(struct padded_event *ep);
+
+
+/* Create queue */
+queue_t *new_queue(struct allocator *ap, size_t capacity)
+{
+	if (!ap)
+		ap = get_default_allocator();
+	if (!ap)
+		goto exit_null;
+
+	/* Round capacity up to power of two */
+	size_t size = 2;
+	while (size < capacity) {
+		if (size > ((size_t) -1) / 2 / sizeof(struct cell))
+			goto exit_null;
+		size *= 2;
+	}
+
+	/* Allocate queue structure */
+	queue_t *qp = allocator_allocate_memory(ap, sizeof(queue_t));
+	if (!qp)
+		goto exit_null;
+
+	/* Allocate slots */
+	qp->buffer = allocator_allocate_memory(ap, size * sizeof(struct cell));
+	if (!qp->buffer)
+		goto exit_queue;
+
+	/* Slot i is free for the producer of round i */
+	for (size_t i = 0; i < size; i++) {
+		atomic_init(&qp->buffer[i].sequence, i);
+		qp->buffer[i].data = NULL;
+	}
+	qp->allocator = ap;
+	qp->mask = size - 1;
+	atomic_init(&qp->enqueue.value, 0);
+	atomic_init(&qp->dequeue.value, 0);
+	atomic_init(&qp->not_full.sequence, 0);
+	atomic_init(&qp->not_full.waiters, 0);
+	atomic_init(&qp->not_empty.sequence, 0);
+	atomic_init(&qp->not_empty.waiters, 0);
+	return qp;
+
+exit_queue:
+	allocator_free_memory(ap, qp);
+exit_null:
+	return NULL;
+}
+
+
+/* Release queue */
+void delete_queue(queue_t *qp)
+{
+	if (!qp)
+		return;
+
+	struct allocator *ap = qp->allocator;
+	allocator_free_memory(ap, qp->buffer);
+	allocator_free_memory(ap, qp);
+}
+
+
+/*
+ * Add item to queue without blocking.
+ *
+ * Every slot carries a sequence number which tells whose turn it is to use
+ * the slot.  When the sequence number of a slot equals the enqueue
+ * position, the slot is free and a producer may claim it by advancing the
+ * enqueue position.  After storing the item, the producer sets the sequence
+ * number to position + 1 which hands the slot over to the consumer of the
+ * same round.  The consumer in turn sets the sequence number to
+ * position + size which hands the slot back to the producer of the next
+ * round.
+ */
+int try_push_queue(queue_t *qp, void *item)
+{
+	assert(qp != NULL);
+
+	size_t pos = atomic_load_explicit(
+		&qp->enqueue.value, memory_order_relaxed);
+	struct cell *cp;
+	while (1) {
+		cp = &qp->buffer[pos & qp->mask];
+		size_t seq = atomic_load_explicit(
+			&cp->sequence, memory_order_acquire);
+		if (seq == pos) {
+			/* Slot is free, try to claim it */
+			if (atomic_compare_exchange_weak_explicit(
+				&qp->enqueue.value, &pos, pos + 1,
+				memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if ((ptrdiff_t) (seq - pos) < 0) {
+			/* Slot still holds an item from previous round */
+			return /*full*/ 0;
+		} else {
+			/* Another producer claimed the slot */
+			pos = atomic_load_explicit(
+				&qp->enqueue.value, memory_order_relaxed);
+		}
+	}
+
+	/* Store item and hand slot over to consumer */
+	cp->data = item;
+	atomic_store_explicit(&cp->sequence, pos + 1, memory_order_release);
+	signal_event(&qp->not_empty);
+	return /*success*/ 1;
+}
+
+
+/* Remove item from queue without blocking */
+int try_pop_queue(queue_t *qp, void **item)
+{
+	assert(qp != NULL);
+	assert(item != NULL);
+
+	size_t pos = atomic_load_explicit(
+		&qp->dequeue.value, memory_order_relaxed);
+	struct cell *cp;
+	while (1) {
+		cp = &qp->buffer[pos & qp->mask];
+		size_t seq = atomic_load_explicit(
+			&cp->sequence, memory_order_acquire);
+		if (seq == pos + 1) {
+			/* Slot is filled, try to claim it */
+			if (atomic_compare_exchange_weak_explicit(
+				&qp->dequeue.value, &pos, pos + 1,
+				memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if ((ptrdiff_t) (seq - (pos + 1)) < 0) {
+			/* Producer has not filled the slot yet */
+			return /*empty*/ 0;
+		} else {
+			/* Another consumer claimed the slot */
+			pos = atomic_load_explicit(
+				&qp->dequeue.value, memory_order_relaxed);
+		}
+	}
+
+	/* Retrieve item and hand slot over to producer of next round */
+	*item = cp->data;
+	atomic_store_explicit(
+		&cp->sequence, pos + qp->mask + 1, memory_order_release);
+	signal_event(&qp->not_full);
+	return /*success*/ 1;
+}
+
+
+/* Add item to queue, wait if the queue is full */
+void push_queue(queue_t *qp, void *item)
+{
+	while (!try_push_queue(qp, item)) {
+		/* Announce waiter and try again before going to sleep */
+		struct padded_event *ep = &qp->not_full;
+		unsigned seq = atomic_load(&ep->sequence);
+		atomic_fetch_add(&ep->waiters, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		int ok = try_push_queue(qp, item);
+		if (!ok)
+			wait_event(ep, seq);
+		atomic_fetch_sub(&ep->waiters, 1);
+		if (ok)
+			break;
+	}
+}
+
+
+/* Remove item from queue, wait if the queue is empty */
+void *pop_queue(queue_t *qp)
+{
+	void *item;
+	while (!try_pop_queue(qp, &item)) {
+		struct padded_event *ep = &qp->not_empty;
+		unsigned seq = atomic_load(&ep->sequence);
+		atomic_fetch_add(&ep->waiters, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		int ok = try_pop_queue(qp, &item);
+		if (!ok)
+			wait_event(ep, seq);
+		atomic_fetch_sub(&ep->waiters, 1);
+		if (ok)
+			break;
+	}
+	return item;
+}
+
+
+/* Add contiguous run of items */
+size_t push_queue_batch(queue_t *qp, void *const *items, size_t n)
+{
+	assert(qp != NULL);
+	assert(items != NULL || n == 0);
+
+	size_t pos = atomic_load_explicit(
+		&qp->enqueue.value, memory_order_relaxed);
+	size_t count;
+	while (1) {
+		/* Count free slots starting from pos */
+		count = 0;
+		while (count < n && count <= qp->mask) {
+			struct cell *cp = &qp->buffer[(pos + count) & qp->mask];
+			size_t seq = atomic_load_explicit(
+				&cp->sequence, memory_order_acquire);
+			if (seq != pos + count)
+				break;
+			count++;
+		}
+		if (count == 0) {
+			/* Queue full or another producer got ahead of us */
+			size_t now = atomic_load_explicit(
+				&qp->enqueue.value, memory_order_relaxed);
+			if (now == pos)
+				return 0;
+			pos = now;
+			continue;
+		}
+
+		/* Claim all free slots at once */
+		if (atomic_compare_exchange_weak_explicit(
+			&qp->enqueue.value, &pos, pos + count,
+			memory_order_relaxed, memory_order_relaxed))
+			break;
+	}
+
+	/* Fill claimed slots */
+	for (size_t i = 0; i < count; i++) {
+		struct cell *cp = &qp->buffer[(pos + i) & qp->mask];
+		cp->data = items[i];
+		atomic_store_explicit(
+			&cp->sequence, pos + i + 1, memory_order_release);
+	}
+	signal_event(&qp->not_empty);
+	return count;
+}
+
+
+/* Remove contiguous run of items */
+size_t pop_queue_batch(queue_t *qp, void **items, size_t n)
+{
+	assert(qp != NULL);
+	assert(items != NULL || n == 0);
+
+	size_t pos = atomic_load_explicit(
+		&qp->dequeue.value, memory_order_relaxed);
+	size_t count;
+	while (1) {
+		/* Count filled slots starting from pos */
+		count = 0;
+		while (count < n && count <= qp->mask) {
+			struct cell *cp = &qp->buffer[(pos + count) & qp->mask];
+			size_t seq = atomic_load_explicit(
+				&cp->sequence, memory_order_acquire);
+			if (seq != pos + count + 1)
+				break;
+			count++;
+		}
+		if (count == 0) {
+			size_t now = atomic_load_explicit(
+				&qp->dequeue.value, memory_order_relaxed);
+			if (now == pos)
+				return 0;
+			pos = now;
+			continue;
+		}
+
+		/* Claim all filled slots at once */
+		if (atomic_compare_exchange_weak_explicit(
+			&qp->dequeue.value, &pos, pos + count,
+			memory_order_relaxed, memory_order_relaxed))
+			break;
+	}
+
+	/* Empty claimed slots */
+	for (size_t i = 0; i < count; i++) {
+		struct cell *cp = &qp->buffer[(pos + i) & qp->mask];
+		items[i] = cp->data;
+		atomic_store_explicit(&cp->sequence,
+			pos + i + qp->mask + 1, memory_order_release);
+	}
+	signal_event(&qp->not_full);
+	return count;
+}
+
+
+/* Sleep until event has been signaled after sequence was read */
+static void wait_event(struct padded_event *ep, unsigned sequence)
+{
+#if defined(T7_DISABLE_THREADS)
+	/* No other thread can ever change the queue */
+	(void) ep;
+	(void) sequence;
+	terminate("Queue would block forever");
+#elif defined(HAVE_LINUX_FUTEX_H)
+	/*
+	 * If the event was signaled after the sequence number was read, then
+	 * the kernel returns immediately because the sequence number no
+	 * longer matches.
+	 */
+	syscall(SYS_futex, &ep->sequence, FUTEX_WAIT_PRIVATE,
+		sequence, NULL, NULL, 0);
+#else
+	/* Poll until the condition changes */
+	while (atomic_load(&ep->sequence) == sequence) {
+		yield();
+	}
+#endif
+}
+
+
+/*
+ * Wake up threads sleeping on event.
+ *
+ * The fence pairs with the fence in push_queue and pop_queue: either the
+ * waiter sees the item we just stored or we see the waiter.  This keeps
+ * the common case free of writes to shared cache lines.
+ */
+static void signal_event(struct padded_event *ep)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&ep->waiters, memory_order_relaxed) == 0)
+		return;
+
+	atomic_fetch_add(&ep->sequence, 1);
+#if !defined(T7_DISABLE_THREADS) && defined(HAVE_LINUX_FUTEX_H)
+	syscall(SYS_futex, &ep->sequence,
+		FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
@@ -0,0 +1,256 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#define _GNU_SOURCE
+#include "t7/types.h"
+#include "t7/ring.h"
+#include "t7/allocator.h"
+#include <stdatomic.h>
+
+#if defined(HAVE_MEMFD_CREATE)
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+
+/* Ring buffer */
+struct ring {
+	/* Allocator which owns the ring */
+	struct allocator *allocator;
+
+	/* Start of storage */
+	char *buffer;
+
+	/* Size of storage minus one */
+	size_t mask;
+
+	/* RING_MIRROR if storage is mapped twice */
+	int flags;
+
+	/*
+	 * Producer side.  The producer keeps a private copy of the consumer's
+	 * position and only reads the shared position when the copy says that
+	 * the ring is full.
+	 */
+	char pad1[T7_CACHE_LINE_SIZE];
+	atomic_size_t tail;
+	size_t cached_head;
+
+	/* Consumer side, see above */
+	char pad2[T7_CACHE_LINE_SIZE];
+	atomic_size_t head;
+	size_t cached_tail;
+	char pad3[T7_CACHE_LINE_SIZE];
+};
+
+
+/* Local functions */
+static char *map_mirror(size_t size);
+static void unmap_mirror(char *buffer, size_t size);
+
+
+/* Create ring */
+ring_t *new_ring(struct allocator *ap, size_t size, int flags)
+{
+	if (!ap)
+		ap = get_default_allocator();
+	if (!ap)
+		goto exit_null;
+
+	/* Mirrored storage must be a multiple of page size */
+	size_t n = 1;
+#if defined(HAVE_MEMFD_CREATE)
+	if ((flags & RING_MIRROR)) {
+		long page = sysconf(_SC_PAGESIZE);
+		if (page > 0)
+			n = (size_t) page;
+	}
+#endif
+
+	/* Round size up to power of two */
+	while (n < size) {
+		if (n > ((size_t) -1) / 4)
+			goto exit_null;
+		n *= 2;
+	}
+
+	/* Allocate control structure */
+	ring_t *rp = allocator_allocate_memory(ap, sizeof(ring_t));
+	if (!rp)
+		goto exit_null;
+
+	/* Allocate storage */
+	if ((flags & RING_MIRROR))
+		rp->buffer = map_mirror(n);
+	else
+		rp->buffer = allocator_allocate_memory(ap, n);
+	if (!rp->buffer)
+		goto exit_ring;
+
+	rp->allocator = ap;
+	rp->mask = n - 1;
+	rp->flags = flags;
+	atomic_init(&rp->tail, 0);
+	rp->cached_head = 0;
+	atomic_init(&rp->head, 0);
+	rp->cached_tail = 0;
+	return rp;
+
+exit_ring:
+	allocator_free_memory(ap, rp);
+exit_null:
+	return NULL;
+}
+
+
+/* Release ring */
+void delete_ring(ring_t *rp)
+{
+	if (!rp)
+		return;
+
+	struct allocator *ap = rp->allocator;
+	if ((rp->flags & RING_MIRROR))
+		unmap_mirror(rp->buffer, rp->mask + 1);
+	else
+		allocator_free_memory(ap, rp->buffer);
+	allocator_free_memory(ap, rp);
+}
+
+
+/* Get writable span */
+struct ring_span reserve_ring(ring_t *rp, size_t n)
+{
+	assert(rp != NULL);
+
+	/* Only producer writes tail so relaxed read is enough */
+	size_t tail = atomic_load_explicit(&rp->tail, memory_order_relaxed);
+	size_t size = rp->mask + 1;
+	size_t space = size - (tail - rp->cached_head);
+	if (space < n) {
+		/* Refresh copy of consumer's position */
+		rp->cached_head = atomic_load_explicit(
+			&rp->head, memory_order_acquire);
+		space = size - (tail - rp->cached_head);
+		if (space < n) {
+			struct ring_span empty = { NULL, 0 };
+			return empty;
+		}
+	}
+
+	/* Without mirror, span stops at the end of buffer */
+	size_t offset = tail & rp->mask;
+	if (!(rp->flags & RING_MIRROR) && space > size - offset)
+		space = size - offset;
+
+	struct ring_span span = { rp->buffer + offset, space };
+	return span;
+}
+
+
+/* Publish data */
+void commit_ring(ring_t *rp, size_t n)
+{
+	assert(rp != NULL);
+
+	size_t tail = atomic_load_explicit(&rp->tail, memory_order_relaxed);
+	assert(n <= rp->mask + 1 - (tail - rp->cached_head));
+	atomic_store_explicit(&rp->tail, tail + n, memory_order_release);
+}
+
+
+/* Get readable span */
+struct ring_span peek_ring(ring_t *rp)
+{
+	assert(rp != NULL);
+
+	size_t head = atomic_load_explicit(&rp->head, memory_order_relaxed);
+	size_t used = rp->cached_tail - head;
+	if (used == 0) {
+		/* Refresh copy of producer's position */
+		rp->cached_tail = atomic_load_explicit(
+			&rp->tail, memory_order_acquire);
+		used = rp->cached_tail - head;
+	}
+
+	/* Without mirror, span stops at the end of buffer */
+	size_t offset = head & rp->mask;
+	size_t size = rp->mask + 1;
+	if (!(rp->flags & RING_MIRROR) && used > size - offset)
+		used = size - offset;
+
+	struct ring_span span = { used ? rp->buffer + offset : NULL, used };
+	return span;
+}
+
+
+/* Free consumed data */
+void release_ring(ring_t *rp, size_t n)
+{
+	assert(rp != NULL);
+
+	size_t head = atomic_load_explicit(&rp->head, memory_order_relaxed);
+	assert(n <= rp->cached_tail - head);
+	atomic_store_explicit(&rp->head, head + n, memory_order_release);
+}
+
+
+/* Map SIZE bytes of memory twice to consecutive addresses */
+static char *map_mirror(size_t size)
+{
+#if defined(HAVE_MEMFD_CREATE)
+	/* Create anonymous file for backing the storage */
+	int fd = memfd_create("t7-ring", MFD_CLOEXEC);
+	if (fd == -1)
+		goto exit_null;
+	if (ftruncate(fd, (off_t) size) != /*OK*/0)
+		goto exit_file;
+
+	/* Reserve address space for both copies */
+	char *base = mmap(NULL, 2 * size, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		goto exit_file;
+
+	/* Map the file over the reservation twice */
+	void *first = mmap(base, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, 0);
+	if (first == MAP_FAILED)
+		goto exit_map;
+	void *second = mmap(base + size, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, fd, 0);
+	if (second == MAP_FAILED)
+		goto exit_map;
+
+	/* Mappings keep the file alive */
+	close(fd);
+	return base;
+
+exit_map:
+	munmap(base, 2 * size);
+exit_file:
+	close(fd);
+exit_null:
+	return NULL;
+#else
+	/* FIXME: mirroring not implemented */
+	(void) size;
+	return NULL;
+#endif
+}
+
+
+/* Release memory mapped by map_mirror */
+static void unmap_mirror(char *buffer, size_t size)
+{
+#if defined(HAVE_MEMFD_CREATE)
+	munmap(buffer, 2 * size);
+#else
+	(void) buffer;
+	(void) size;
+#endif
+}
@@ -8,36 +8,275 @@
 #include "t7/types.h"
 #include "t7/simulate-failure.h"
 #include "t7/terminate.h"
+#include "t7/memory.h"
+#include "t7/thread.h"
+#include "t7/critical-section.h"
+#include "t7/exit-handler.h"
+#include <stdint.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#   include <unistd.h>
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#   include <errno.h>
+#endif
 
 
-/* Maximum depth of recursion, should be divisable by 8 */
-#define MAX_RECURSION 1024
-
 /* Forward-decl */
 struct test_frame;
+struct parallel_job;
+struct fork_state;
+struct sampler;
+struct sampling;
+struct failure_site;
 typedef struct test_frame test_frame_t;
 
 /* Local functions */
 static test_frame_t *get_frame (void);
 static void set_frame (test_frame_t *fp);
-static int _getbit (test_frame_t *fp, unsigned int i);
-static void _setbit (test_frame_t *fp, unsigned int i, unsigned int value);
+static void init_frame (test_frame_t *fp, size_t fail_at);
+static void push_success (test_frame_t *fp, size_t i);
+static void run_jobs (struct parallel_job *jp);
+static thread_t *allocate_test_thread (void);
+static int run_test_thread (thread_t *tp);
+static int fork_failure (test_frame_t *fp);
+static void collect_child (struct fork_state *sp, size_t i);
+static int sample_failure (const struct sampling *cp);
+static int get_sampling (struct sampling *cp);
+static void set_sampling (const struct sampling *cp);
+static struct sampler *get_sampler (void);
+static int simulate (const void *site, const char *name);
+static void record_site (test_frame_t *fp, const void *site, const char *name, int failed);
+static void print_report (FILE *out, test_frame_t *fp);
+static int compare_sites (const void *a, const void *b);
+static double now (void);
 
 
-/* Parameters for the active failure simulation */
+/*
+ * Parameters for the active failure simulation.
+ *
+ * The simulation vector tells whether the ith call to simulate_failure
+ * fails in the current iteration.  The vector consists mostly of ones, so
+ * it is stored as a sorted list of positions where the vector is zero, i.e.
+ * where the call is allowed to succeed.  Since the calls are numbered in
+ * increasing order within an iteration, the list can be scanned with a
+ * cursor which only moves forward.
+ */
 struct test_frame {
 
     /* Whether an error was triggered */
     int triggered;
 
     /* Number of times simulate_failure() has been called in this iteration */
-    unsigned int count;
+    size_t count;
+
+    /* Positions of zero bits in increasing order */
+    size_t *successes;
+
+    /* Number of positions in array successes */
+    size_t size;
+
+    /* Room allocated for array successes */
+    size_t capacity;
+
+    /* Index of first position greater than or equal to count */
+    size_t cursor;
+
+    /*
+     * Position of the only failure in parallel mode, or NO_FAILURE.  Frames
+     * used by repeat_test have FAIL_AT set to EXHAUSTIVE.
+     */
+    size_t fail_at;
+
+    /* Child processes in forked mode */
+    struct fork_state *forks;
+
+    /* Hash table of call sites, or NULL if no report is requested */
+    struct failure_site *sites;
+
+    /* Site given to enter_failure_site, or NULL */
+    const void *caller;
 
-    /* Bit vector of simulated failures */
-    unsigned char simulate[MAX_RECURSION / 8 + 1];
+    /* Size of hash table minus one */
+    size_t site_mask;
+
+    /* Number of call sites in hash table */
+    size_t site_count;
+
+    /* Number of iterations executed */
+    size_t iterations;
+
+    /* Total and longest wall time of iterations in seconds */
+    double total_time;
+    double max_time;
+
+};
+
+/* Statistics of one call site */
+struct failure_site {
+
+    /* Return address or site name, NULL if the slot is free */
+    const void *key;
+
+    /* Name given to simulate_failure_at, or NULL */
+    const char *name;
+
+    /* Number of calls from this site over all iterations */
+    size_t hits;
+
+    /* Number of simulated failures at this site */
+    size_t failures;
 
 };
 
+/* Initial size of hash table of call sites, must be a power of two */
+#define SITE_TABLE_SIZE 64
+
+/* Where to print report at the end of repeat_test, or NULL */
+static FILE *report = NULL;
+
+/* Site of calls which cannot be attributed to a caller */
+#if !defined(__GNUC__)
+static const char unknown_site[] = "unknown";
+#endif
+
+/* Special values for fail_at */
+#define EXHAUSTIVE ((size_t) -1)
+#define NO_FAILURE ((size_t) -2)
+#define FORKED ((size_t) -3)
+
+
+/* Child process exploring one failure in repeat_test_forked */
+#if !defined(_WIN32)
+struct fork_child {
+
+    /* Process id of child */
+    pid_t pid;
+
+    /* Read end of pipe for receiving the result */
+    int fd;
+
+    /* Failure point explored by child */
+    size_t k;
+
+};
+#endif
+
+/* Child processes of repeat_test_forked */
+struct fork_state {
+
+#if !defined(_WIN32)
+    /* Process which started the test */
+    pid_t root;
+
+    /* Write end of result pipe in child process */
+    int fd;
+
+    /* Running children in the order of creation */
+    struct fork_child *children;
+    size_t first;
+    size_t count;
+    size_t capacity;
+#endif
+
+    /* First failure point where the test failed */
+    size_t failed_at;
+
+};
+
+/* Result sent from child process */
+struct fork_result {
+    int ok;
+};
+
+
+/*
+ * Configuration of sampled failures.  The active configuration lives in a
+ * single slot protected by a sequence lock, so threads copy it with
+ * get_sampling and replacing it allocates no memory.
+ */
+struct sampling {
+
+    /* True if calls are failed */
+    int enabled;
+
+    /* Fail when upper 32 bits of random number are below threshold */
+    uint64_t threshold;
+
+    /* Fail every Nth call in each thread, or zero */
+    size_t interval;
+
+    /* Seed given to enable_sampled_failures */
+    uint64_t seed;
+
+    /* Incremented at every call to enable_sampled_failures, never zero */
+    unsigned generation;
+
+};
+
+/* Sampled failures of one thread */
+struct sampler {
+
+    /* State of xorshift generator, never zero */
+    uint64_t state;
+
+    /* Number of calls since seeding */
+    size_t count;
+
+    /* Generation of configuration used for seeding, or zero */
+    unsigned generation;
+
+    /* Stream number given to set_failure_stream */
+    unsigned long stream;
+
+};
+
+/* Active configuration of sampled failures, written in critical section */
+static struct sampling sampling;
+
+/* Sequence number of configuration, odd while being written */
+static unsigned sampling_sequence = 0;
+
+
+/* Work shared by threads in repeat_test_parallel */
+struct parallel_job {
+
+    /* Function to test */
+    test_function *f;
+
+    /* Number of fallible calls made by the test function */
+    size_t count;
+
+    /* Next failure point to try */
+    size_t next;
+
+    /* First failure point where the test function failed, or count */
+    size_t failed_at;
+
+};
+
+/* Thread executing parallel jobs */
+struct test_thread {
+
+    /* Base thread, must be the first member of the structure */
+    thread_t base;
+
+    /* Shared work */
+    struct parallel_job *job;
+
+};
+
+/* Thread type for executing parallel jobs */
+static thread_type_t def1 = {
+    allocate_test_thread,
+    free_thread,
+    create_thread,
+    destroy_thread,
+    run_test_thread
+};
+static thread_type_t *test_thread = &def1;
+
 
 /* Operating system specific variables */
 #if defined(T7_DISABLE_THREADS)
@@ -68,37 +307,155 @@ struct test_frame {
 
 #endif
 
+/* Storage for samplers of threads */
+#if defined(T7_DISABLE_THREADS)
+
+    /* Sampler of the only thread */
+    static struct sampler global_sampler;
+
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+
+    /* Sampler of each thread */
+    static _Thread_local struct sampler thread_sampler;
+
+#elif !defined(_WIN32)
+
+    /* Release sampler of thread */
+    static void done_sampler (void *p);
+
+    /* Release sampler of main thread */
+    static void sampler_exit (void);
+
+    /* Pthread key for samplers */
+    static pthread_key_t sampler_key;
+
+#else
+
+    /* FIXME: */
+
+#endif
+
 
 /* Returns true when failure should be simulated */
 int simulate_failure (void) {
+#if defined(__GNUC__)
+    /* Attribute call to the caller */
+    return simulate (__builtin_return_address (0), NULL);
+#else
+    /* Caller is not known => lump calls together */
+    return simulate (unknown_site, unknown_site);
+#endif
+}
+
+
+/* Returns true when failure should be simulated at named site */
+int
+simulate_failure_at (const char *site)
+{
+    return simulate (site, site);
+}
+
+
+/* Print report of call sites at the end of repeat_test */
+void
+set_failure_report (FILE *out)
+{
+    __atomic_store_n (&report, out, __ATOMIC_RELAXED);
+}
+
+
+/* Attribute nested calls to call site */
+int
+enter_failure_site (const void *site)
+{
+    test_frame_t *fp;
+
+    /* Sites are only needed for report */
+    if (!site  ||  !__atomic_load_n (&report, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    /* Outermost site wins */
+    fp = get_frame ();
+    if (!fp  ||  !fp->sites  ||  fp->caller) {
+        return 0;
+    }
+    fp->caller = site;
+    return 1;
+}
+
+
+/* Stop attributing calls to call site */
+void
+leave_failure_site (int entered)
+{
+    if (entered) {
+        get_frame ()->caller = NULL;
+    }
+}
+
+
+/* Decide whether to simulate failure at call site SITE */
+static int
+simulate (const void *site, const char *name)
+{
     int ok;
     test_frame_t *fp;
+    struct sampling config;
+    size_t i;
 
     /* Get pointer to active test frame */
     fp = get_frame ();
-    if (fp) {
+    if (fp  &&  fp->fail_at == FORKED) {
 
-        /* Simulation is active */
-        if (fp->count < MAX_RECURSION) {
+        /* Let child process explore the failure */
+        ok = fork_failure (fp);
 
-            /* Test whether to simulate failure at this time */
-            if (_getbit (fp, fp->count++)) {
+    } else if (fp  &&  fp->fail_at != EXHAUSTIVE) {
+
+        /* Fail exactly once at the selected position */
+        if (fp->count++ == fp->fail_at) {
+            fp->triggered = 1;
+            ok = 1;
+        } else {
+            ok = 0;
+        }
 
-                /* Simulate failure */
-                fp->triggered = 1;
-                ok = 1;
+    } else if (fp) {
 
-            } else {
+        /* Skip positions of previous calls */
+        i = fp->count++;
+        while (fp->cursor < fp->size  &&  fp->successes[fp->cursor] < i) {
+            fp->cursor++;
+        }
 
-                /* Do not simulate failure at this time */
-                ok = 0;
+        /* Test whether to simulate failure at this time */
+        if (fp->cursor < fp->size  &&  fp->successes[fp->cursor] == i) {
 
-            }
+            /* Do not simulate failure at this time */
+            ok = 0;
 
         } else {
-            terminate ("Too many allocation requests at simulate_failure");
+
+            /* Simulate failure */
+            fp->triggered = 1;
+            ok = 1;
+
+        }
+
+        /* Attribute call to site if report was requested */
+        if (fp->sites) {
+            if (!name  &&  fp->caller) {
+                site = fp->caller;
+            }
+            record_site (fp, site, name, ok);
         }
 
+    } else if (get_sampling (&config)) {
+
+        /* Soak run => fail randomly */
+        ok = sample_failure (&config);
+
     } else {
 
         /* Testing is not under way => do not simulate failure */
@@ -109,24 +466,398 @@ int simulate_failure (void) {
 }
 
 
+/* Update statistics of call site */
+static void
+record_site (test_frame_t *fp, const void *site, const char *name, int failed)
+{
+    struct failure_site *table;
+    struct failure_site *sp;
+    size_t mask;
+    size_t i;
+    size_t j;
+
+    /* Grow table when it becomes half full */
+    if (2 * (fp->site_count + 1) > fp->site_mask + 1) {
+
+        /* Allocate table of double size */
+        mask = 2 * fp->site_mask + 1;
+        table = system_allocate_memory ((mask + 1) * sizeof (struct failure_site));
+        if (!table) {
+            terminate ("Cannot allocate memory for failure report");
+        }
+        zero_memory (table, (mask + 1) * sizeof (struct failure_site));
+
+        /* Move sites to new table */
+        for (i = 0; i <= fp->site_mask; i++) {
+            if (fp->sites[i].key) {
+                j = ((size_t) fp->sites[i].key >> 4) & mask;
+                while (table[j].key) {
+                    j = (j + 1) & mask;
+                }
+                table[j] = fp->sites[i];
+            }
+        }
+        system_free_memory (fp->sites);
+        fp->sites = table;
+        fp->site_mask = mask;
+
+    }
+
+    /* Find site by linear probing */
+    i = ((size_t) site >> 4) & fp->site_mask;
+    while (fp->sites[i].key  &&  fp->sites[i].key != site) {
+        i = (i + 1) & fp->site_mask;
+    }
+    sp = &fp->sites[i];
+    if (!sp->key) {
+
+        /* New site */
+        sp->key = site;
+        sp->name = name;
+        fp->site_count++;
+
+    }
+
+    /* Update counters */
+    sp->hits++;
+    if (failed) {
+        sp->failures++;
+    }
+}
+
+
+/* Print statistics of test frame */
+static void
+print_report (FILE *out, test_frame_t *fp)
+{
+    struct failure_site *sp;
+    size_t n;
+    size_t i;
+
+    /* Move sites to the start of table */
+    n = 0;
+    for (i = 0; i <= fp->site_mask; i++) {
+        if (fp->sites[i].key) {
+            fp->sites[n++] = fp->sites[i];
+        }
+    }
+    assert (n == fp->site_count);
+
+    /* Sort sites by number of hits, most expensive first */
+    qsort (fp->sites, n, sizeof (struct failure_site), compare_sites);
+
+    /* Print summary of iterations */
+    fprintf (
+        out, "repeat_test: %lu iterations, %.6f s total, %.6f s max\n",
+        (unsigned long) fp->iterations, fp->total_time, fp->max_time);
+
+    /* Print sites, sites which never failed are untested error paths */
+    fprintf (out, "%-24s %12s %12s\n", "site", "hits", "failures");
+    for (i = 0; i < n; i++) {
+        sp = &fp->sites[i];
+        if (sp->name) {
+            fprintf (out, "%-24s", sp->name);
+        } else {
+            fprintf (out, "%-24p", (void*) (uintptr_t) sp->key);
+        }
+        fprintf (
+            out, " %12lu %12lu%s\n",
+            (unsigned long) sp->hits, (unsigned long) sp->failures,
+            sp->failures == 0 ? "  never failed" : "");
+    }
+    fflush (out);
+}
+
+
+/* Order call sites by decreasing number of hits */
+static int
+compare_sites (const void *a, const void *b)
+{
+    const struct failure_site *sa = (const struct failure_site*) a;
+    const struct failure_site *sb = (const struct failure_site*) b;
+    int result;
+
+    if (sa->hits > sb->hits) {
+        result = -1;
+    } else if (sa->hits < sb->hits) {
+        result = 1;
+    } else if (sa->failures > sb->failures) {
+        result = -1;
+    } else if (sa->failures < sb->failures) {
+        result = 1;
+    } else {
+        result = 0;
+    }
+    return result;
+}
+
+
+/* Get wall time in seconds */
+static double
+now (void)
+{
+#if !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#else
+    /* FIXME: */
+    return 0.0;
+#endif
+}
+
+
+/* Fail calls to simulate_failure randomly */
+void
+enable_sampled_failures (double probability, size_t interval, unsigned long seed)
+{
+    struct sampling config;
+
+    /* Keep probability within range, NaN means zero */
+    if (!(probability >= 0.0)) {
+        probability = 0.0;
+    } else if (probability > 1.0) {
+        probability = 1.0;
+    }
+    config.enabled = 1;
+    config.threshold = (uint64_t) (probability * 4294967296.0);
+    config.interval = interval;
+    config.seed = (uint64_t) seed;
+
+    /* Publish configuration and let threads seed their generators again */
+    enter_critical ();
+    config.generation = sampling.generation + 1;
+    if (config.generation == 0) {
+        config.generation = 1;
+    }
+    set_sampling (&config);
+    leave_critical ();
+}
+
+
+/* Stop failing calls randomly */
+void
+disable_sampled_failures (void)
+{
+    struct sampling config;
+
+    enter_critical ();
+    config = sampling;
+    config.enabled = 0;
+    set_sampling (&config);
+    leave_critical ();
+}
+
+
+/* Select random number stream of current thread */
+void
+set_failure_stream (unsigned long stream)
+{
+    struct sampler *sp;
+
+    /* Seed generator again at next call */
+    sp = get_sampler ();
+    sp->stream = stream;
+    sp->generation = 0;
+}
+
+
+/* Copy active configuration to CP, returns false if disabled */
+static int
+get_sampling (struct sampling *cp)
+{
+    unsigned sequence;
+
+    while (1) {
+        sequence = __atomic_load_n (&sampling_sequence, __ATOMIC_ACQUIRE);
+        if (sequence % 2 == 0) {
+
+            /*
+             * Copy is consistent if no writer got in between.  Acquiring
+             * the fields keeps the second read of the sequence number
+             * after them.  Disabled flag alone needs no consistent copy.
+             */
+            cp->enabled = __atomic_load_n (&sampling.enabled, __ATOMIC_ACQUIRE);
+            if (!cp->enabled) {
+                return 0;
+            }
+            cp->threshold = __atomic_load_n (
+                &sampling.threshold, __ATOMIC_ACQUIRE);
+            cp->interval = __atomic_load_n (
+                &sampling.interval, __ATOMIC_ACQUIRE);
+            cp->seed = __atomic_load_n (&sampling.seed, __ATOMIC_ACQUIRE);
+            cp->generation = __atomic_load_n (
+                &sampling.generation, __ATOMIC_ACQUIRE);
+            if (__atomic_load_n (&sampling_sequence, __ATOMIC_RELAXED)
+                == sequence) {
+                break;
+            }
+
+        }
+
+        /* Let writer finish */
+        yield ();
+    }
+    return 1;
+}
+
+
+/* Replace active configuration, must be called in critical section */
+static void
+set_sampling (const struct sampling *cp)
+{
+    unsigned sequence;
+
+    /*
+     * Odd sequence number keeps readers away while fields change.  Fields
+     * are released so that a reader seeing any new field also sees the odd
+     * sequence number.
+     */
+    sequence = __atomic_load_n (&sampling_sequence, __ATOMIC_RELAXED);
+    __atomic_store_n (&sampling_sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_store_n (&sampling.enabled, cp->enabled, __ATOMIC_RELEASE);
+    __atomic_store_n (&sampling.threshold, cp->threshold, __ATOMIC_RELEASE);
+    __atomic_store_n (&sampling.interval, cp->interval, __ATOMIC_RELEASE);
+    __atomic_store_n (&sampling.seed, cp->seed, __ATOMIC_RELEASE);
+    __atomic_store_n (
+        &sampling.generation, cp->generation, __ATOMIC_RELEASE);
+    __atomic_store_n (&sampling_sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+/* Decide whether to fail this call in sampled mode */
+static int
+sample_failure (const struct sampling *cp)
+{
+    struct sampler *sp;
+    uint64_t x;
+    int ok;
+
+    /* Seed generator of thread after configuration changed */
+    sp = get_sampler ();
+    if (sp->generation != cp->generation) {
+
+        /*
+         * Give each thread a stream of its own.  Streams are numbered by
+         * set_failure_stream, so runs with the same seed and stream numbers
+         * repeat the same failures regardless of thread schedule.
+         */
+        x = (uint64_t) sp->stream + 1;
+        x = cp->seed + UINT64_C (0x9E3779B97F4A7C15) * x;
+        x = (x ^ (x >> 30)) * UINT64_C (0xBF58476D1CE4E5B9);
+        x = (x ^ (x >> 27)) * UINT64_C (0x94D049BB133111EB);
+        x ^= x >> 31;
+        sp->state = x ? x : 1;
+        sp->count = 0;
+        sp->generation = cp->generation;
+
+    }
+    sp->count++;
+
+    /* Fail every Nth call */
+    ok = cp->interval > 0  &&  sp->count % cp->interval == 0;
+
+    /* Fail with given probability */
+    if (cp->threshold > 0) {
+        x = sp->state;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sp->state = x;
+        if ((x >> 32) < cp->threshold) {
+            ok = 1;
+        }
+    }
+    return ok;
+}
+
+
+/* Get sampler of current thread */
+static struct sampler *
+get_sampler (void)
+{
+    struct sampler *sp;
+
+#if defined(T7_DISABLE_THREADS)
+
+    /****** Single Threaded ******/
+
+    sp = &global_sampler;
+
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+
+    /****** Linux/Unix with thread local variables ******/
+
+    sp = &thread_sampler;
+
+#elif !defined(_WIN32)
+
+    /****** Linux/Unix ******/
+
+    /* Initialize thread local keys */
+    if (pthread_once (&key_once, init_pthread) != /*OK*/0) {
+        terminate ("Cannot initialize failure simulation");
+    }
+
+    /* Create sampler on first call */
+    sp = (struct sampler*) pthread_getspecific (sampler_key);
+    if (sp == NULL) {
+
+        sp = system_allocate_memory (sizeof (struct sampler));
+        if (!sp) {
+            terminate ("Cannot allocate memory for failure simulation");
+        }
+        sp->state = 1;
+        sp->count = 0;
+        sp->generation = 0;
+        sp->stream = 0;
+        if (pthread_setspecific (sampler_key, sp) != /*OK*/0) {
+            terminate ("Cannot set sampler");
+        }
+
+    }
+
+#else
+
+    /****** Microsoft Windows ******/
+
+    terminate ("Failure simulation not implemented yet");
+    sp = NULL;
+
+#endif
+    return sp;
+}
+
+
 /* Branch and execute test */
 int
 repeat_test (test_function *f)
 {
     test_frame_t *old;
     test_frame_t frame;
-    unsigned int i;
+    FILE *out;
+    double start;
+    double elapsed;
+    size_t i;
     int ok;
 
     /*
-     * Initialize test frame by setting every bit in the simulation vector to
-     * 1.  This will cause simulate_failure() to return true every time thus
-     * simulating total failure where nothing works.
+     * Initialize test frame with empty list of successes.  This will cause
+     * simulate_failure() to return true every time thus simulating total
+     * failure where nothing works.
      */
-    frame.triggered = 0;
-    frame.count = 0;
-    for (i = 0; i < sizeof (frame.simulate); i++) {
-        frame.simulate[i] = 0xff;
+    init_frame (&frame, EXHAUSTIVE);
+
+    /* Collect statistics of call sites if report was requested */
+    out = __atomic_load_n (&report, __ATOMIC_RELAXED);
+    if (out) {
+        frame.sites = system_allocate_memory (
+            SITE_TABLE_SIZE * sizeof (struct failure_site));
+        if (!frame.sites) {
+            terminate ("Cannot allocate memory for failure report");
+        }
+        zero_memory (frame.sites, SITE_TABLE_SIZE * sizeof (struct failure_site));
+        frame.site_mask = SITE_TABLE_SIZE - 1;
     }
 
     /* Publish new test frame */
@@ -139,43 +870,61 @@ repeat_test (test_function *f)
         /* Initialize frame for new iteration */
         frame.triggered = 0;
         frame.count = 0;
+        frame.cursor = 0;
 
         /* Execute test function with current simulation vector */
-        ok = f ();
+        if (out) {
+
+            /* Measure time of iteration */
+            start = now ();
+            ok = f ();
+            elapsed = now () - start;
+            frame.iterations++;
+            frame.total_time += elapsed;
+            if (elapsed > frame.max_time) {
+                frame.max_time = elapsed;
+            }
+
+        } else {
+
+            /* No report */
+            ok = f ();
+
+        }
 
         /* Did the test function trigger a simulated failure? */
         if (frame.triggered) {
 
             /*
-             * Yes, failure was triggered.  Find the last resource allocation
-             * where failure was simulated.
+             * Yes, failure was triggered.  Find the last call where failure
+             * was simulated, i.e. the last position before count which is
+             * not on the list of successes.
              *
-             * Since failure was simulated, we can be sure that there is at
-             * least one bit set in the simulation vector.  Thus, we don't
-             * need to check for index bounds, i.e. variable i will be zero or
-             * greater at all times.
+             * Positions after the last failure are going to be removed from
+             * the list anyway, so we pop them while searching.  Every
+             * position is pushed and popped at most once per iteration
+             * which makes the search O(1) amortized.  Since failure was
+             * simulated, there is at least one position missing from the
+             * list and the loop cannot run below zero.
              */
             i = frame.count - 1;
-            while (_getbit (&frame, i) == 0) {
+            while (frame.size > 0  &&  frame.successes[frame.size - 1] > i) {
+                frame.size--;
+            }
+            while (frame.size > 0  &&  frame.successes[frame.size - 1] == i) {
+                assert (i > 0);
+                frame.size--;
                 i--;
             }
 
             /*
-             * Change the simulation vector such that the previously failed
-             * allocation request can succeed in the next iteration.  By
-             * removing one bit from the array every time we also make sure
-             * that this function exits eventually.
+             * Let the previously failed call succeed in the next iteration.
+             * All further calls fail by default since positions after i were
+             * removed from the list.  Adding one success before the end of
+             * the previous iteration makes sure that this function exits
+             * eventually.
              */
-            assert (_getbit (&frame, i) == 1);
-            _setbit (&frame, i++, 0);
-
-            /*
-             * If the program continues resource allocation, then all the
-             * further allocations must fail by default.
-             */
-            while (i < MAX_RECURSION) {
-                _setbit (&frame, i++, 1);
-            }
+            push_success (&frame, i);
 
         } else {
 
@@ -192,72 +941,411 @@ repeat_test (test_function *f)
 
     /* Restore old test frame */
     set_frame (old);
+    system_free_memory (frame.successes);
+
+    /* Print report */
+    if (out) {
+        print_report (out, &frame);
+        system_free_memory (frame.sites);
+    }
+
+    return ok;
+}
+
+
+/* Execute test function with one failure at a time in multiple threads */
+int
+repeat_test_parallel (test_function *f, size_t threads, size_t *failed_at)
+{
+    struct parallel_job job;
+    thread_t *pool[T7_MAX_THREADS];
+    test_frame_t *old;
+    test_frame_t frame;
+    size_t n;
+    size_t i;
+    int ok;
+
+    /* Count fallible calls in a run without failures */
+    init_frame (&frame, NO_FAILURE);
+    old = get_frame ();
+    set_frame (&frame);
+    ok = f ();
+    set_frame (old);
+    if (!ok) {
+        /* Test fails even without simulated failures */
+        if (failed_at) {
+            *failed_at = NO_FAILURE;
+        }
+        return 0;
+    }
+
+    /* Prepare jobs "fail at k" for k = 0 ... count - 1 */
+    job.f = f;
+    job.count = frame.count;
+    job.next = 0;
+    job.failed_at = frame.count;
+
+    /* Start helper threads, the current thread works as well */
+    n = 0;
+    if (has_threads ()) {
+        while (n + 1 < threads  &&  n + 1 < job.count  &&  n < T7_MAX_THREADS) {
+            thread_t *tp = new_thread (test_thread);
+            if (!tp) {
+                break;
+            }
+            ((struct test_thread*) tp)->job = &job;
+            if (!start_thread (tp)) {
+                delete_thread (tp);
+                break;
+            }
+            pool[n++] = tp;
+        }
+    }
+
+    /* Execute jobs in current thread */
+    run_jobs (&job);
+
+    /* Wait for helper threads */
+    for (i = 0; i < n; i++) {
+        join_thread (pool[i]);
+        delete_thread (pool[i]);
+    }
 
+    /* Report first failure point where test failed */
+    if (job.failed_at < job.count) {
+        if (failed_at) {
+            *failed_at = job.failed_at;
+        }
+        ok = 0;
+    } else {
+        ok = 1;
+    }
     return ok;
 }
 
 
-/* Get ith bit */
+/* Execute test function once, fork a process for exploring each failure */
+int
+repeat_test_forked (test_function *f, size_t max_children, size_t *failed_at)
+{
+#if !defined(_WIN32)
+    struct fork_state state;
+    test_frame_t *old;
+    test_frame_t frame;
+    int ok;
+
+    /* Allocate room for children */
+    state.root = getpid ();
+    state.fd = -1;
+    state.first = 0;
+    state.count = 0;
+    state.capacity = max_children > 0 ? max_children : 1;
+    state.failed_at = (size_t) -1;
+    state.children = system_allocate_memory (
+        state.capacity * sizeof (struct fork_child));
+    if (!state.children) {
+        terminate ("Cannot allocate memory for failure simulation");
+    }
+
+    /* Run test function, forking at every call to simulate_failure */
+    init_frame (&frame, FORKED);
+    frame.forks = &state;
+    old = get_frame ();
+    set_frame (&frame);
+    ok = f ();
+    set_frame (old);
+
+    /* Is this a child process? */
+    if (getpid () != state.root) {
+
+        /* Yes, report result to parent and exit without cleaning up */
+        struct fork_result result;
+        result.ok = ok;
+        if (write (state.fd, &result, sizeof (result)) != sizeof (result)) {
+            /* Parent treats missing result as failure */
+            /*NOP*/;
+        }
+        fflush (NULL);
+        _exit (0);
+
+    }
+
+    /* Wait for remaining children */
+    while (state.count > 0) {
+        collect_child (&state, state.first);
+    }
+    system_free_memory (state.children);
+
+    /* Report results */
+    if (!ok) {
+
+        /* Test fails even without simulated failures */
+        if (failed_at) {
+            *failed_at = NO_FAILURE;
+        }
+
+    } else if (state.failed_at != (size_t) -1) {
+
+        /* Failure was not handled */
+        if (failed_at) {
+            *failed_at = state.failed_at;
+        }
+        ok = 0;
+
+    }
+    return ok;
+#else
+    /* FIXME: */
+    (void) f;
+    (void) max_children;
+    (void) failed_at;
+    terminate ("Forked failure simulation not implemented yet");
+    return 0;
+#endif
+}
+
+
+/* Fork child process which fails at this call */
 static int
-_getbit (test_frame_t *fp, unsigned int i)
+fork_failure (test_frame_t *fp)
 {
-    unsigned int offset;
-    unsigned char shift;
+#if !defined(_WIN32)
+    struct fork_state *sp = fp->forks;
+    struct fork_child *cp;
+    size_t k;
+    pid_t pid;
+    int fds[2];
+    size_t i;
+
+    /* Number of this call */
+    k = fp->count++;
+
+    /* Wait for the oldest child if too many children are running */
+    if (sp->count >= sp->capacity) {
+        collect_child (sp, sp->first);
+    }
 
-    /* Preconditions */
-    assert (fp != NULL);
-    assert (i < MAX_RECURSION);
+    /* Create pipe for the result */
+    if (pipe (fds) != /*OK*/0) {
+        terminate ("Cannot create pipe for failure simulation");
+    }
 
-    /* Compute the number of byte where ith bit resides */
-    offset = i / 8;
+    /* Do not duplicate buffered output in child */
+    fflush (NULL);
 
-    /*
-     * Compute the number of bits we need to shift in order to transfer ith
-     * bit to the position zero.
-     */
-    shift = i & 7;
+    pid = fork ();
+    if (pid == 0) {
+
+        /*
+         * Child process takes the failure branch and lets the remaining
+         * calls succeed.  Pipes of other children are not needed here.
+         */
+        close (fds[0]);
+        for (i = 0; i < sp->count; i++) {
+            close (sp->children[(sp->first + i) % sp->capacity].fd);
+        }
+        sp->count = 0;
+        sp->fd = fds[1];
+        fp->fail_at = NO_FAILURE;
+        fp->forks = NULL;
+        fp->triggered = 1;
+        return 1;
+
+    } else if (pid > 0) {
+
+        /* Parent remembers the child and continues down the success branch */
+        close (fds[1]);
+        cp = &sp->children[(sp->first + sp->count) % sp->capacity];
+        cp->pid = pid;
+        cp->fd = fds[0];
+        cp->k = k;
+        sp->count++;
+        return 0;
+
+    } else {
+
+        /* Cannot create process */
+        terminate ("Cannot fork process for failure simulation");
+        return 0;
+
+    }
+#else
+    (void) fp;
+    return 0;
+#endif
+}
+
+
+/* Wait for child process and record its result */
+static void
+collect_child (struct fork_state *sp, size_t i)
+{
+#if !defined(_WIN32)
+    struct fork_result result;
+    struct fork_child *cp;
+    ssize_t n;
+    int status;
+    int ok;
+
+    /* Only the oldest child may be collected */
+    assert (sp->count > 0);
+    assert (i == sp->first);
+    cp = &sp->children[i];
+
+    /* Read result, child may have crashed before sending one */
+    do {
+        n = read (cp->fd, &result, sizeof (result));
+    } while (n == -1  &&  errno == EINTR);
+    ok = (n == (ssize_t) sizeof (result)  &&  result.ok);
+    close (cp->fd);
+
+    /* Wait for the child to exit */
+    while (waitpid (cp->pid, &status, 0) == -1  &&  errno == EINTR) {
+        /*NOP*/;
+    }
+    if (!WIFEXITED (status)  ||  WEXITSTATUS (status) != 0) {
+        ok = 0;
+    }
+
+    /* Remember first failure point */
+    if (!ok  &&  cp->k < sp->failed_at) {
+        sp->failed_at = cp->k;
+    }
+
+    /* Remove child from queue */
+    sp->first = (sp->first + 1) % sp->capacity;
+    sp->count--;
+#else
+    (void) sp;
+    (void) i;
+#endif
+}
+
+
+/* Execute jobs until there are no more or a failure has been found */
+static void
+run_jobs (struct parallel_job *jp)
+{
+    test_frame_t *old;
+    test_frame_t frame;
+    size_t k;
+    int ok;
+    int done;
+
+    /* Use private frame in this thread */
+    init_frame (&frame, NO_FAILURE);
+    old = get_frame ();
+    set_frame (&frame);
 
-    /* Get value of ith bit */
-    return (fp->simulate[offset] >> shift) & 1;
+    while (1) {
+
+        /* Take next job unless an earlier failure point has been found */
+        enter_critical ();
+        k = jp->next;
+        done = (k >= jp->failed_at);
+        if (!done) {
+            jp->next++;
+        }
+        leave_critical ();
+        if (done) {
+            break;
+        }
+
+        /* Run test with failure at k */
+        frame.triggered = 0;
+        frame.count = 0;
+        frame.fail_at = k;
+        ok = jp->f ();
+
+        /* Remember the first failure point */
+        if (!ok) {
+            enter_critical ();
+            if (k < jp->failed_at) {
+                jp->failed_at = k;
+            }
+            leave_critical ();
+        }
+
+    }
+
+    /* Restore frame */
+    set_frame (old);
+}
+
+
+/* Allocate memory for test thread */
+static thread_t *
+allocate_test_thread (void)
+{
+    return allocate_memory (sizeof (struct test_thread));
+}
+
+
+/* Thread main function for repeat_test_parallel */
+static int
+run_test_thread (thread_t *tp)
+{
+    run_jobs (((struct test_thread*) tp)->job);
+    return 1;
 }
 
 
-/* Set ith bit in test frame */
+/* Initialize test frame */
 static void
-_setbit (test_frame_t *fp, unsigned int i, unsigned int value)
+init_frame (test_frame_t *fp, size_t fail_at)
 {
-    unsigned int offset;
-    unsigned char mask;
-    unsigned char shift;
+    fp->triggered = 0;
+    fp->count = 0;
+    fp->successes = NULL;
+    fp->size = 0;
+    fp->capacity = 0;
+    fp->cursor = 0;
+    fp->fail_at = fail_at;
+    fp->forks = NULL;
+    fp->sites = NULL;
+    fp->caller = NULL;
+    fp->site_mask = 0;
+    fp->site_count = 0;
+    fp->iterations = 0;
+    fp->total_time = 0.0;
+    fp->max_time = 0.0;
+}
+
+
+/* Add position to the end of list of successes */
+static void
+push_success (test_frame_t *fp, size_t i)
+{
+    size_t *p;
+    size_t n;
 
     /* Preconditions */
     assert (fp != NULL);
-    assert (value == 0  || value == 1);
-    assert (i < MAX_RECURSION);
+    assert (fp->size == 0  ||  fp->successes[fp->size - 1] < i);
 
-    /* Compute the number of byte where ith bit resides */
-    offset = i / 8;
+    /* Grow array if needed */
+    if (fp->size >= fp->capacity) {
 
-    /*
-     * Compute the number of bits we need to shift the value in order to set
-     * the ith bit.
-     */
-    shift = i & 7;
+        /*
+         * Allocate memory directly from system as the allocator of the
+         * current fixture may call simulate_failure.
+         */
+        n = fp->capacity ? fp->capacity * 2 : 256;
+        if (fp->successes) {
+            p = system_resize_memory (fp->successes, n * sizeof (size_t));
+        } else {
+            p = system_allocate_memory (n * sizeof (size_t));
+        }
+        if (!p) {
+            terminate ("Cannot allocate memory for failure simulation");
+        }
+        fp->successes = p;
+        fp->capacity = n;
 
-    /*
-     * Compute the bit mask that zeroes the ith bit.  For example, if we are
-     * setting the bit number 3, then the mask will be:
-     *
-     *     bit  | 7 6 5 4 3 2 1 0
-     *     -----+----------------
-     *     mask | 1 1 1 1 0 1 1 1
-     *
-     * or 0xf7 in hexadecimal.
-     */
-    mask = ~(1 << shift);
+    }
 
-    /* Set or clear value of ith bit */
-    fp->simulate[offset] = (fp->simulate[offset] & mask) | (value << shift);
+    /* Append position */
+    fp->successes[fp->size++] = i;
 }
 
 
@@ -368,6 +1456,44 @@ init_pthread (void)
         terminate ("Cannot initialize failure simulation");
 
     }
+
+#if !defined(HAVE_THREAD_LOCAL)
+    /* Samplers are released when threads exit */
+    if (pthread_key_create (&sampler_key, done_sampler) != /*OK*/0) {
+        terminate ("Cannot initialize failure simulation");
+    }
+
+    /* Destructor is not called for main thread */
+    if (!exit_handler (sampler_exit, 30)) {
+        terminate ("Cannot register exit handler");
+    }
+#endif
+}
+#endif
+
+
+/* Release sampler when thread exits */
+#if !defined(T7_DISABLE_THREADS)  &&  !defined(HAVE_THREAD_LOCAL)  \
+    &&  !defined(_WIN32)
+static void
+done_sampler (void *p)
+{
+    system_free_memory (p);
+}
+#endif
+
+
+/* Release sampler of main thread */
+#if !defined(T7_DISABLE_THREADS)  &&  !defined(HAVE_THREAD_LOCAL)  \
+    &&  !defined(_WIN32)
+static void
+sampler_exit (void)
+{
+    void *p = pthread_getspecific (sampler_key);
+    if (p) {
+        pthread_setspecific (sampler_key, NULL);
+        system_free_memory (p);
+    }
 }
 #endif
 
@@ -5,11 +5,25 @@
  * This file is part of T7.  T7 may be freely distributed under the MIT
  * license.  For more information, see https://github.com/tronkko/t7
  */
+#define _GNU_SOURCE
 #include "t7/types.h"
 #include "t7/allocator.h"
 #include "t7/memory.h"
 #include "t7/static-allocator.h"
-#include "t7/critical-section.h"
+#include "t7/thread.h"
+
+#if defined(HAVE_MMAP)
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+#if defined(HAVE_SYS_MBIND) && defined(HAVE_LINUX_MEMPOLICY_H)
+#   include <sys/syscall.h>
+#   include <linux/mempolicy.h>
+#endif
+
+
+/* Size of buffer of mapped static allocator */
+#define MAPPED_SIZE (2 * 1024 * 1024)
 
 
 /* Internal functions */
@@ -28,7 +42,24 @@ static void *allocate_node(
 	size_t new_size);
 
 static void *relocate_node(
-	struct allocator *ap, struct static_node *node, size_t n);
+	struct static_allocator *map, struct static_node *node, size_t n);
+
+static void *grab_locked(struct static_allocator *map, size_t n);
+
+static void release_locked(struct static_allocator *map, void *p);
+
+static void lock_allocator(struct static_allocator *map);
+
+static void unlock_allocator(struct static_allocator *map);
+
+static int create_mapped_static_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable);
+
+static char *map_buffer(size_t *sizep, int options);
+
+static void bind_local_node(char *buffer, size_t size);
+
+static size_t get_huge_page_size(void);
 
 
 /* Virtual table for allocator having dynamically allocated buffer */
@@ -44,6 +75,19 @@ static struct allocator_vtable def1 = {
 const struct allocator_vtable *static_allocator = &def1;
 
 
+/* Virtual table for allocator having mapped buffer */
+static struct allocator_vtable def2 = {
+	allocate_static_allocator,
+	free_static_allocator,
+	create_mapped_static_allocator,
+	destroy_static_allocator,
+	static_grab_memory,
+	static_release_memory,
+	static_resize_memory
+};
+const struct allocator_vtable *mapped_static_allocator = &def2;
+
+
 /* Allocate room for static allocator object */
 struct allocator *allocate_static_allocator(void)
 {
@@ -82,6 +126,8 @@ int create_static_allocator_with_buffer(
 	/* Save buffer data */
 	map->buffer = buffer;
 	map->size = size;
+	map->mapped = 0;
+	map->lock = 0;
 
 	/* Reset memory buffer (for debugging) */
 #ifndef NDEBUG
@@ -120,6 +166,8 @@ int create_static_allocator(
 	/* Save buffer */
 	map->buffer = buffer;
 	map->size = size;
+	map->mapped = 0;
+	map->lock = 0;
 
 	/* Reset memory buffer (for debugging) */
 #ifndef NDEBUG
@@ -141,6 +189,75 @@ exit_clean:
 }
 
 
+/* Initialize static allocator with buffer mapped from system */
+int create_static_allocator_with_map(
+	struct allocator *ap, const struct allocator_vtable *vtable,
+	size_t size, int options)
+{
+	/* Size must be multiple of 16 to ensure that all nodes are valid */
+	assert(size > 0 && (size & 0xf) == 0);
+
+	/* Map buffer, rounding size up to whole pages */
+	char *buffer = map_buffer(&size, options);
+	int mapped = (buffer != NULL);
+	if (!buffer) {
+		/* Fall back to heap if memory cannot be mapped */
+		buffer = system_allocate_memory(size);
+		if (!buffer)
+			return /*error*/ 0;
+	}
+
+	/* Initialize standard fields */
+	if (!create_allocator(ap, vtable))
+		goto exit_clean;
+
+	/* Initialize static allocator */
+	struct static_allocator *map = (struct static_allocator*) ap;
+
+	/* Save buffer */
+	map->buffer = buffer;
+	map->size = size;
+	map->mapped = mapped;
+	map->lock = 0;
+
+	/* Reset memory buffer (for debugging) */
+#ifndef NDEBUG
+	fill_memory(buffer, 0xCC, size);
+#endif
+
+	/* Create a free memory node at the beginning of the buffer */
+	struct static_node *node = (struct static_node*) buffer;
+	node->size = size;
+
+	/* Start with the initialized node */
+	map->start = node;
+	return /*success*/ 1;
+
+exit_clean:
+	/* Release buffer */
+#if defined(HAVE_MMAP)
+	if (mapped) {
+		munmap(buffer, size);
+	} else {
+		system_free_memory(buffer);
+	}
+#else
+	system_free_memory(buffer);
+#endif
+	return /*error*/ 0;
+}
+
+
+/* Initialize static allocator with huge page on local node */
+static int create_mapped_static_allocator(
+	struct allocator *ap, const struct allocator_vtable *vtable)
+{
+	return create_static_allocator_with_map(
+		ap, vtable, MAPPED_SIZE,
+		STATIC_HUGE_PAGES | STATIC_LOCAL_NODE);
+}
+
+
 /* Un-initialize static allocator having dynamically allocated buffer */
 void destroy_static_allocator(struct allocator *ap)
 {
@@ -155,7 +272,15 @@ void destroy_static_allocator(struct allocator *ap)
 #endif
 
 		/* Release buffer */
+#if defined(HAVE_MMAP)
+		if (map->mapped) {
+			munmap(map->buffer, map->size);
+		} else {
+			system_free_memory(map->buffer);
+		}
+#else
 		system_free_memory(map->buffer);
+#endif
 	}
 
 	/* Reset fields */
@@ -170,15 +295,34 @@ void destroy_static_allocator(struct allocator *ap)
 /* Allocate memory from static allocator */
 void *static_grab_memory(struct allocator *ap, size_t n)
 {
-	/* Round the size up to ensure proper alignment of data types */
-	size_t new_size = roundup(n);
+	struct static_allocator *map = (struct static_allocator*) ap;
 
-	/* Lock out other threads */
-	enter_critical();
+	/* Lock out other threads using the same allocator */
+	lock_allocator(map);
+	void *result = grab_locked(map, n);
+	unlock_allocator(map);
+	return result;
+}
 
-	/* Convert allocator to static allocator */
+
+/* Release memory back to static allocator */
+void static_release_memory(struct allocator *ap, void *p)
+{
 	struct static_allocator *map = (struct static_allocator*) ap;
 
+	/* Lock out other threads using the same allocator */
+	lock_allocator(map);
+	release_locked(map, p);
+	unlock_allocator(map);
+}
+
+
+/* Allocate memory while holding lock of allocator */
+static void *grab_locked(struct static_allocator *map, size_t n)
+{
+	/* Round the size up to ensure proper alignment of data types */
+	size_t new_size = roundup(n);
+
 	/* Get pointer to a memory node */
 	struct static_node *node = map->start;
 
@@ -199,22 +343,15 @@ void *static_grab_memory(struct allocator *ap, size_t n)
 		node = get_successor(map, node);
 	} while (node != map->start);
 
-	leave_critical();
 	return result;
 }
 
 
-/* Release memory back to static allocator */
-void static_release_memory(struct allocator *ap, void *p)
+/* Release memory while holding lock of allocator */
+static void release_locked(struct static_allocator *map, void *p)
 {
 	assert(p != NULL);
 
-	/* Lock out other threads */
-	enter_critical();
-
-	/* Convert allocator to static allocator */
-	struct static_allocator *map = (struct static_allocator*) ap;
-
 	/* Construct pointer to memory node */
 	struct static_node *node = &((struct static_node*) p)[-1];
 
@@ -239,8 +376,6 @@ void static_release_memory(struct allocator *ap, void *p)
 	if (node < map->start) {
 		map->start = node;
 	}
-
-	leave_critical();
 }
 
 
@@ -252,11 +387,9 @@ void *static_resize_memory(struct allocator *ap, void *p, size_t n)
 	/* Round the size up to ensure proper alignment of data types */
 	size_t new_size = roundup(n);
 
-	/* Lock out other threads */
-	enter_critical();
-
-	/* Convert pointer to static allocator */
+	/* Lock out other threads using the same allocator */
 	struct static_allocator *map = (struct static_allocator*) ap;
+	lock_allocator(map);
 
 	/* Construct pointer to memory node in question */
 	struct static_node *node = &((struct static_node*) p)[-1];
@@ -299,10 +432,10 @@ void *static_resize_memory(struct allocator *ap, void *p, size_t n)
 		 * The combined memory node cannot satisfy the request and we
 		 * must relocate the memory area to another address.
 		 */
-		result = relocate_node(ap, node, n);
+		result = relocate_node(map, node, n);
 	}
 
-	leave_critical();
+	unlock_allocator(map);
 	return result;
 }
 
@@ -486,7 +619,7 @@ static void *allocate_node(
 
 /* Move node to another area */
 static void *relocate_node(
-	struct allocator *ap, struct static_node *node, size_t n)
+	struct static_allocator *map, struct static_node *node, size_t n)
 {
 	/* Compute the size of payload in current node */
 	size_t size = (node->size & ~1u) - sizeof(struct static_node);
@@ -496,7 +629,7 @@ static void *relocate_node(
 	void *p = &node[1];
 
 	/* Allocate a fresh memory area for the enlarged data */
-	void *q = ap->vtable->grab(ap, n);
+	void *q = grab_locked(map, n);
 	if (!q)
 		return NULL;
 
@@ -504,15 +637,159 @@ static void *relocate_node(
 	copy_memory(q, p, size);
 
 	/* Release the old memory area */
-	ap->vtable->release(ap, p);
+	release_locked(map, p);
 
 	/* Return pointer to the new memory area */
 	return q;
 }
 
 
+/* Lock out other threads using the same allocator */
+static void lock_allocator(struct static_allocator *map)
+{
+#if !defined(T7_DISABLE_THREADS)
+	/* Spin on plain load to keep cache line shared while lock is taken */
+	while (__atomic_exchange_n(&map->lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&map->lock, __ATOMIC_RELAXED))
+			yield();
+	}
+#else
+	(void) map;
+#endif
+}
+
+
+/* Let other threads use the allocator */
+static void unlock_allocator(struct static_allocator *map)
+{
+#if !defined(T7_DISABLE_THREADS)
+	__atomic_store_n(&map->lock, 0, __ATOMIC_RELEASE);
+#else
+	(void) map;
+#endif
+}
+
+
 /* Returns true if node is free */
 static int is_free(struct static_node *node)
 {
 	return (node->size & 1u) == 0;
 }
+
+
+/* Map buffer of at least *SIZEP bytes and store actual size to *SIZEP */
+static char *map_buffer(size_t *sizep, int options)
+{
+#if defined(HAVE_MMAP)
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *buffer = MAP_FAILED;
+	size_t size;
+
+	/* Fault pages in right away unless they need to be bound first */
+#if defined(MAP_POPULATE)
+	if ((options & STATIC_POPULATE) && !(options & STATIC_LOCAL_NODE))
+		flags |= MAP_POPULATE;
+#endif
+
+	/*
+	 * Try pages reserved for huge pages first unless the buffer is smaller
+	 * than one such page, which may be as large as 1 GiB.
+	 */
+#if defined(MAP_HUGETLB)
+	size_t huge = get_huge_page_size();
+	if ((options & STATIC_HUGE_PAGES) && huge > 0 && *sizep >= huge) {
+		size = (*sizep + huge - 1) & ~(huge - 1);
+		buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			flags | MAP_HUGETLB, -1, 0);
+	}
+#endif
+
+	/* Fall back to normal pages */
+	if (buffer == MAP_FAILED) {
+		size_t page = (size_t) sysconf(_SC_PAGESIZE);
+		size = (*sizep + page - 1) & ~(page - 1);
+		buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (buffer == MAP_FAILED)
+			return NULL;
+
+		/* Let kernel back buffer with transparent huge pages */
+#if defined(MADV_HUGEPAGE)
+		if (options & STATIC_HUGE_PAGES)
+			madvise(buffer, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	/* Place pages on node of calling thread as they are faulted in */
+	if (options & STATIC_LOCAL_NODE) {
+		bind_local_node(buffer, size);
+
+		/* Fault pages in now that they land on the right node */
+		if (options & STATIC_POPULATE) {
+			size_t page = (size_t) sysconf(_SC_PAGESIZE);
+			for (size_t i = 0; i < size; i += page)
+				((volatile char*) buffer)[i] = 0;
+		}
+	}
+
+	*sizep = size;
+	return buffer;
+#else
+	/* FIXME: mapping not implemented */
+	(void) sizep;
+	(void) options;
+	return NULL;
+#endif
+}
+
+
+/* Prefer node of calling thread for memory area */
+static void bind_local_node(char *buffer, size_t size)
+{
+#if defined(HAVE_SYS_MBIND) && defined(HAVE_LINUX_MEMPOLICY_H)
+	/* Policy is a hint, so ignore errors such as missing NUMA support */
+	int node = get_current_node();
+	if ((size_t) node < 8 * sizeof(unsigned long)) {
+		unsigned long mask = 1ul << node;
+		syscall(SYS_mbind, buffer, size, MPOL_PREFERRED, &mask,
+			8 * sizeof(mask) + 1, 0);
+	}
+#else
+	(void) buffer;
+	(void) size;
+#endif
+}
+
+
+/* Get default size of reserved huge pages or zero if unknown */
+static size_t get_huge_page_size(void)
+{
+#if defined(HAVE_MMAP) && defined(MAP_HUGETLB)
+	/* Size read earlier, or -1 if unknown */
+	static size_t cached = 0;
+	size_t size = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+	if (size)
+		return size != (size_t) -1 ? size : 0;
+
+	/* MAP_HUGETLB uses pages of size reported as Hugepagesize */
+	size = (size_t) -1;
+	FILE *fp = fopen("/proc/meminfo", "r");
+	if (fp) {
+		char line[128];
+		unsigned long kb;
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+				/* Size must be power of two for rounding */
+				size_t n = (size_t) kb * 1024;
+				if (n > 0 && (n & (n - 1)) == 0)
+					size = n;
+				break;
+			}
+		}
+		fclose(fp);
+	}
+	__atomic_store_n(&cached, size, __ATOMIC_RELAXED);
+	return size != (size_t) -1 ? size : 0;
+#else
+	return 0;
+#endif
+}
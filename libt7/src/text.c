@@ -0,0 +1,484 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/text.h"
+#include "t7/transcoder.h"
+#include "t7/allocator.h"
+#include <stdint.h>
+
+
+/* Size of the first chunk */
+#define MIN_CHUNK 256
+
+/* Chunks grow up to this size before new chunks are linked */
+#define MAX_CHUNK (64 * 1024)
+
+/* Longest sequence of any character set in bytes */
+#define MAX_SEQUENCE 4
+
+/* Fragment of text in chunk */
+struct piece {
+	/* Text outside of builder or NULL if the text follows the piece */
+	const char *ref;
+
+	/* Length of text in bytes */
+	size_t len;
+
+	/* Resolved character set of text */
+	charset_t charset;
+};
+
+/* Memory block of pieces, followed by SIZE bytes of data */
+struct chunk {
+	/* Next chunk or NULL */
+	struct chunk *next;
+
+	/* Number of bytes of data allocated and used */
+	size_t size;
+	size_t used;
+
+	/* Offset of the last piece in data */
+	size_t last;
+};
+
+/* Text builder */
+struct text_builder {
+	/* Allocator which owns the builder and its chunks */
+	struct allocator *allocator;
+
+	/* Resolved character set of result */
+	charset_t charset;
+
+	/* Chunks in order */
+	struct chunk *head;
+
+	/* Last chunk and the pointer which points to it */
+	struct chunk *tail;
+	struct chunk **link;
+
+	/* Number of pieces and their total length in bytes */
+	size_t count;
+	size_t total;
+};
+
+
+/* Local functions */
+static char *chunk_data(struct chunk *cp);
+static struct piece *last_piece(struct text_builder *bp);
+static size_t align_piece(size_t n);
+static int grow_tail(struct text_builder *bp, size_t n, size_t limit);
+static int add_chunk(struct text_builder *bp, size_t n);
+static int add_piece(struct text_builder *bp, text_view_t v, int copy);
+static struct chunk *join_pieces(struct text_builder *bp);
+static int reserve_output(
+	struct allocator *ap, struct chunk **out, size_t n);
+static void free_chunks(struct allocator *ap, struct chunk *cp);
+
+
+/* Refer to text */
+text_view_t make_text_view(const void *p, size_t n, charset_t charset)
+{
+	assert(p != NULL || n == 0);
+
+	text_view_t v;
+	v.data = (const char*) p;
+	v.len = n;
+	v.charset = charset;
+	return v;
+}
+
+
+/* Refer to zero-terminated string */
+text_view_t make_string_view(const char *s, charset_t charset)
+{
+	assert(s != NULL);
+	return make_text_view(s, strlen(s), charset);
+}
+
+
+/* Create empty text builder */
+text_builder_t *new_text_builder(struct allocator *ap, charset_t charset)
+{
+	if (!ap)
+		ap = get_default_allocator();
+
+	/* Result must be in a concrete character set */
+	charset = resolve_charset(charset);
+	if (charset == INVALID_CHARSET)
+		goto exit_null;
+
+	struct text_builder *bp =
+		allocator_allocate_memory(ap, sizeof(struct text_builder));
+	if (!bp)
+		goto exit_null;
+
+	bp->allocator = ap;
+	bp->charset = charset;
+	bp->head = NULL;
+	bp->tail = NULL;
+	bp->link = &bp->head;
+	bp->count = 0;
+	bp->total = 0;
+	return bp;
+
+exit_null:
+	return NULL;
+}
+
+
+/* Release text builder */
+void delete_text_builder(text_builder_t *bp)
+{
+	if (!bp)
+		return;
+
+	struct allocator *ap = bp->allocator;
+	free_chunks(ap, bp->head);
+	allocator_free_memory(ap, bp);
+}
+
+
+/* Copy text to end of builder */
+int append_text(text_builder_t *bp, text_view_t v)
+{
+	assert(bp != NULL);
+	assert(v.data != NULL || v.len == 0);
+
+	v.charset = resolve_charset(v.charset);
+	if (v.charset == INVALID_CHARSET)
+		return 0;
+	if (v.len == 0)
+		return 1;
+
+	/*
+	 * Extend the last piece if it holds text in the same character set.
+	 * Chunk with the only piece grows without limit so that get_text can
+	 * return the text without joining.
+	 */
+	struct piece *pp = last_piece(bp);
+	size_t limit = bp->count > 1 ? MAX_CHUNK : SIZE_MAX / 2;
+	if (pp && !pp->ref && pp->charset == v.charset
+		&& grow_tail(bp, v.len, limit)) {
+		/* Growing may have moved the chunk */
+		struct chunk *cp = bp->tail;
+		pp = last_piece(bp);
+		memcpy(chunk_data(cp) + cp->used, v.data, v.len);
+		cp->used += v.len;
+		pp->len += v.len;
+		bp->total += v.len;
+		return 1;
+	}
+
+	return add_piece(bp, v, 1);
+}
+
+
+/* Add text to end of builder without copying */
+int append_text_ref(text_builder_t *bp, text_view_t v)
+{
+	assert(bp != NULL);
+	assert(v.data != NULL || v.len == 0);
+
+	v.charset = resolve_charset(v.charset);
+	if (v.charset == INVALID_CHARSET)
+		return 0;
+	if (v.len == 0)
+		return 1;
+
+	return add_piece(bp, v, 0);
+}
+
+
+/* Get contents of builder */
+int get_text(text_builder_t *bp, text_view_t *vp)
+{
+	assert(bp != NULL);
+	assert(vp != NULL);
+
+	/* Empty text */
+	if (bp->count == 0) {
+		*vp = make_text_view("", 0, bp->charset);
+		return 1;
+	}
+
+	/* Join pieces unless there is one in the right character set */
+	struct piece *pp = last_piece(bp);
+	if (bp->count > 1 || pp->charset != bp->charset) {
+		struct chunk *out = join_pieces(bp);
+		if (!out)
+			return 0;
+
+		/* Joined text replaces the pieces */
+		free_chunks(bp->allocator, bp->head);
+		bp->head = out;
+		bp->tail = out;
+		bp->link = &bp->head;
+		bp->count = 1;
+		pp = last_piece(bp);
+		bp->total = pp->len;
+	}
+
+	/* Return view to the only piece */
+	*vp = make_text_view(
+		pp->ref ? pp->ref : (const char*) (pp + 1), pp->len,
+		bp->charset);
+	return 1;
+}
+
+
+/* Get pointer to data of chunk */
+static char *chunk_data(struct chunk *cp)
+{
+	return (char*) (cp + 1);
+}
+
+
+/* Get last piece or NULL if builder is empty */
+static struct piece *last_piece(struct text_builder *bp)
+{
+	if (!bp->tail)
+		return NULL;
+	return (struct piece*) (chunk_data(bp->tail) + bp->tail->last);
+}
+
+
+/* Round offset up to alignment of piece */
+static size_t align_piece(size_t n)
+{
+	const size_t align = _Alignof(struct piece);
+	return (n + align - 1) & ~(align - 1);
+}
+
+
+/* Make room for N more bytes in the last chunk of at most LIMIT bytes */
+static int grow_tail(struct text_builder *bp, size_t n, size_t limit)
+{
+	struct chunk *cp = bp->tail;
+	if (!cp)
+		return 0;
+	if (cp->size - cp->used >= n)
+		return 1;
+
+	/* Large chunks are not copied around */
+	if (cp->used > limit || n > limit - cp->used)
+		return 0;
+
+	/* Double the size, in place if the allocator can */
+	size_t size = 2 * cp->size;
+	if (size < cp->used + n)
+		size = cp->used + n;
+	if (size > limit)
+		size = limit;
+	cp = allocator_resize_memory(
+		bp->allocator, cp, sizeof(struct chunk) + size);
+	if (!cp)
+		return 0;
+
+	cp->size = size;
+	*bp->link = cp;
+	bp->tail = cp;
+	return 1;
+}
+
+
+/* Link new chunk with room for at least N bytes */
+static int add_chunk(struct text_builder *bp, size_t n)
+{
+	/* Start small but use large chunks once the text is large */
+	size_t size = bp->tail ? MAX_CHUNK : MIN_CHUNK;
+	if (size < n)
+		size = n;
+	if (size > SIZE_MAX - sizeof(struct chunk))
+		return 0;
+
+	struct chunk *cp = allocator_allocate_memory(
+		bp->allocator, sizeof(struct chunk) + size);
+	if (!cp)
+		return 0;
+
+	cp->next = NULL;
+	cp->size = size;
+	cp->used = 0;
+	cp->last = 0;
+	if (bp->tail)
+		bp->link = &bp->tail->next;
+	*bp->link = cp;
+	bp->tail = cp;
+	return 1;
+}
+
+
+/* Add piece for view, copying the text if COPY is true */
+static int add_piece(struct text_builder *bp, text_view_t v, int copy)
+{
+	size_t text = copy ? v.len : 0;
+	if (text > SIZE_MAX - sizeof(struct piece) - MAX_CHUNK)
+		return 0;
+	size_t n = sizeof(struct piece) + text;
+
+	/* Use the last chunk if it has or can get room for piece */
+	size_t pad = 0;
+	if (bp->tail)
+		pad = align_piece(bp->tail->used) - bp->tail->used;
+	if (!grow_tail(bp, pad + n, MAX_CHUNK)) {
+		if (!add_chunk(bp, n))
+			return 0;
+		pad = 0;
+	}
+
+	/* Store piece and its text */
+	struct chunk *cp = bp->tail;
+	size_t at = cp->used + pad;
+	struct piece *pp = (struct piece*) (chunk_data(cp) + at);
+	pp->ref = copy ? NULL : v.data;
+	pp->len = v.len;
+	pp->charset = v.charset;
+	if (copy)
+		memcpy(pp + 1, v.data, v.len);
+	cp->last = at;
+	cp->used = at + n;
+
+	bp->count++;
+	bp->total += v.len;
+	return 1;
+}
+
+
+/* Transcode all pieces into one chunk holding one piece */
+static struct chunk *join_pieces(struct text_builder *bp)
+{
+	struct allocator *ap = bp->allocator;
+	transcoder_t *tp = NULL;
+	charset_t from = INVALID_CHARSET;
+	size_t k;
+	size_t m;
+
+	/* Start with room for text of the same size */
+	if (bp->total > SIZE_MAX / 2 - sizeof(struct chunk))
+		goto exit_null;
+	struct chunk *out = NULL;
+	if (!reserve_output(ap, &out, sizeof(struct piece) + bp->total))
+		goto exit_null;
+	size_t used = sizeof(struct piece);
+
+	for (struct chunk *cp = bp->head; cp; cp = cp->next) {
+		size_t at = 0;
+		while (at < cp->used) {
+			struct piece *pp = (struct piece*) (chunk_data(cp) + at);
+			const char *src = pp->ref ? pp->ref : (const char*) (pp + 1);
+			at = sizeof(struct piece) + (pp->ref ? 0 : pp->len) + at;
+			at = align_piece(at);
+
+			/*
+			 * Finish previous character set.  Sequences may continue
+			 * from one piece to the next as long as the character set
+			 * stays the same.
+			 */
+			if (pp->charset != from) {
+				if (tp) {
+					if (!transcode(tp, NULL, 0, NULL, 0, &k, &m))
+						goto exit_free;
+					close_transcoder(tp);
+					tp = NULL;
+				}
+				from = pp->charset;
+				if (from != bp->charset) {
+					tp = new_transcoder(ap, from, bp->charset);
+					if (!tp)
+						goto exit_free;
+				}
+			}
+
+			/* Text in the right character set is copied as is */
+			if (!tp) {
+				if (!reserve_output(ap, &out, used + pp->len))
+					goto exit_free;
+				memcpy(chunk_data(out) + used, src, pp->len);
+				used += pp->len;
+				continue;
+			}
+
+			/* Convert text, growing output as needed */
+			size_t i = 0;
+			while (1) {
+				if (!reserve_output(ap, &out, used + MAX_SEQUENCE))
+					goto exit_free;
+				if (!transcode(
+					tp, src + i, pp->len - i, chunk_data(out) + used,
+					out->size - used, &k, &m))
+					goto exit_free;
+				i += k;
+				used += m;
+				if (i >= pp->len)
+					break;
+
+				/* Output is full */
+				if (!reserve_output(ap, &out, 2 * out->size))
+					goto exit_free;
+			}
+		}
+	}
+
+	/* Text must not end in the middle of sequence */
+	if (tp) {
+		if (!transcode(tp, NULL, 0, NULL, 0, &k, &m))
+			goto exit_free;
+		close_transcoder(tp);
+	}
+
+	/* Describe the text with a piece at the start of chunk */
+	struct piece *pp = (struct piece*) chunk_data(out);
+	pp->ref = NULL;
+	pp->len = used - sizeof(struct piece);
+	pp->charset = bp->charset;
+	out->next = NULL;
+	out->used = used;
+	out->last = 0;
+	return out;
+
+exit_free:
+	close_transcoder(tp);
+	allocator_free_memory(ap, out);
+exit_null:
+	return NULL;
+}
+
+
+/* Make sure that output chunk has room for N bytes of data */
+static int reserve_output(
+	struct allocator *ap, struct chunk **out, size_t n)
+{
+	struct chunk *cp = *out;
+	if (cp && cp->size >= n)
+		return 1;
+
+	/* Grow geometrically */
+	size_t size = cp ? 2 * cp->size : MIN_CHUNK;
+	if (size < n)
+		size = n;
+	if (size > SIZE_MAX - sizeof(struct chunk))
+		return 0;
+
+	cp = allocator_resize_memory(ap, cp, sizeof(struct chunk) + size);
+	if (!cp)
+		return 0;
+	cp->size = size;
+	*out = cp;
+	return 1;
+}
+
+
+/* Release list of chunks */
+static void free_chunks(struct allocator *ap, struct chunk *cp)
+{
+	while (cp) {
+		struct chunk *next = cp->next;
+		allocator_free_memory(ap, cp);
+		cp = next;
+	}
+}
@@ -5,12 +5,17 @@
  * This file is part of T7.  T7 may be freely distributed under the MIT
  * license.  For more information, see https://github.com/tronkko/t7
  */
+#define _GNU_SOURCE
 #include "t7/types.h"
 #include "t7/thread.h"
 #include "t7/fixture.h"
 #include "t7/memory.h"
 #include "t7/critical-section.h"
 
+#if defined(HAVE_GETCPU)
+#   include <sched.h>
+#endif
+
 
 /* Internal implementation data */
 #if defined(T7_DISABLE_THREADS)
@@ -25,10 +30,14 @@
 
     /****** Linux/Unix ******/
     static void *entry (void *arg);
+#if defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+    static void set_node_affinity (pthread_attr_t *attr, int node);
+#endif
     struct thread_info {
         int running;
         pthread_t id;
-        fixture_t fixture;
+        fixture_t *fixture;
+        struct allocator *allocator;
     };
 
 #else
@@ -197,6 +206,14 @@ destroy_thread (thread_t *tp)
 /* Run a thread */
 int
 start_thread (thread_t *tp)
+{
+    return start_thread_on_node (tp, -1);
+}
+
+
+/* Run a thread on NUMA node, or on any node if NODE is negative */
+int
+start_thread_on_node (thread_t *tp, int node)
 {
     int ok;
     thread_info_t *ip;
@@ -241,16 +258,12 @@ start_thread (thread_t *tp)
 
             /****** Single Threaded ******/
             fixture_t *orig;
-            fixture_t tmp;
 
             /* Take hold of current fixture */
             orig = get_fixture ();
 
-            /* Initialize new temporary fixture */
-            copy_fixture (&tmp, orig);
-            set_fixture (&tmp);
-
             /* Execute the thread function */
+            (void) node;
             ip->retval = tp->type->run (tp);
             ok = 1;
 
@@ -262,12 +275,22 @@ start_thread (thread_t *tp)
             /****** Linux/Unix ******/
             pthread_attr_t attr;
 
-            /* Initialize fixture for the new thread */
-            copy_fixture (&ip->fixture, get_fixture ());
+            /* New thread inherits the fixture of current thread */
+            ip->fixture = get_fixture ();
+            ip->allocator = get_scope_allocator ();
 
             /* Create thread attribute */
             if (pthread_attr_init (&attr) == /*OK*/0) {
 
+                /* Keep thread on processors of node */
+#if defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+                if (node >= 0) {
+                    set_node_affinity (&attr, node);
+                }
+#else
+                (void) node;
+#endif
+
                 /* Start the thread */
                 if (pthread_create (&ip->id, &attr, entry, tp) == /*OK*/0) {
 
@@ -290,6 +313,7 @@ start_thread (thread_t *tp)
             /****** Microsoft Windows ******/
 
             /* FIXME: */
+            (void) node;
             terminate ("Threads not implemented yet");
 
 #endif
@@ -327,7 +351,8 @@ entry (void *arg)
     /* Set up fixture for the current thread */
     ip = (thread_info_t*) tp->impl;
     assert (ip != NULL);
-    set_fixture (&ip->fixture);
+    set_fixture (ip->fixture);
+    set_scope_allocator (ip->allocator);
 
     /* Execute thread function */
     result = tp->type->run (tp);
@@ -338,6 +363,87 @@ entry (void *arg)
 #endif
 
 
+#if !defined(T7_DISABLE_THREADS) && defined(HAVE_PTHREAD_ATTR_SETAFFINITY_NP)
+/* Restrict thread to processors of NUMA node */
+static void
+set_node_affinity (pthread_attr_t *attr, int node)
+{
+    char path[64];
+    char buffer[1024];
+    cpu_set_t allowed;
+    cpu_set_t cpus;
+    size_t first;
+    size_t last;
+    FILE *fp;
+    char *p;
+
+    /* Read list of processors such as "0-3,8-11" */
+    sprintf (path, "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen (path, "r");
+    if (fp == NULL) {
+        return;
+    }
+    p = fgets (buffer, sizeof (buffer), fp);
+    fclose (fp);
+    if (p == NULL) {
+        return;
+    }
+
+    /* Add processors of list to set */
+    CPU_ZERO (&cpus);
+    while (*p >= '0'  &&  *p <= '9') {
+        first = strtoul (p, &p, 10);
+        last = first;
+        if (*p == '-') {
+            last = strtoul (p + 1, &p, 10);
+        }
+        while (first <= last  &&  first < (size_t) CPU_SETSIZE) {
+            CPU_SET (first, &cpus);
+            first++;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    /*
+     * Only use processors which the process may run on.  Otherwise, the
+     * thread could not be started at all.
+     */
+    if (sched_getaffinity (0, sizeof (allowed), &allowed) == /*OK*/0) {
+        CPU_AND (&cpus, &cpus, &allowed);
+    }
+    if (CPU_COUNT (&cpus) > 0) {
+        pthread_attr_setaffinity_np (attr, sizeof (cpus), &cpus);
+    }
+}
+#endif
+
+
+/* Get NUMA node of processor running current thread */
+int
+get_current_node (void)
+{
+    int node;
+
+#if defined(HAVE_GETCPU)
+    unsigned int cpu;
+    unsigned int n;
+
+    /* Use virtual system call where available */
+    if (getcpu (&cpu, &n) == /*OK*/0) {
+        node = (int) n;
+    } else {
+        node = 0;
+    }
+#else
+    node = 0;
+#endif
+
+    return node;
+}
+
+
 /* Wait for thread to finish */
 int
 join_thread (thread_t *tp)
@@ -10,11 +10,45 @@
 #include "t7/memory.h"
 #include "t7/exit-handler.h"
 #include "t7/terminate.h"
+#include "t7/critical-section.h"
+#include <stdint.h>
+
+
+/*
+ * Use compiler-native thread-local variables for looking up variables by
+ * slot number, if available.  In single-threaded mode, plain static
+ * variables serve the same purpose.
+ */
+#if defined(T7_DISABLE_THREADS)
+#   define FAST_TLS
+#   define THREAD_LOCAL
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+#   define FAST_TLS
+#   define THREAD_LOCAL _Thread_local
+#endif
 
 
 /* Declarations */
 struct storage {
+    /* Variables in reverse order of creation */
     tls_variable_t *first;
+
+    /* Open-addressed hash table of variables keyed by type */
+    tls_variable_t **table;
+    size_t mask;
+    size_t count;
+
+    /* Variable found by previous lookup */
+    tls_variable_t *last;
+
+    /* Lookup counters */
+    struct tls_statistics stats;
+
+#if defined(FAST_TLS)
+    /* Variables indexed by slot number minus one */
+    tls_variable_t **slots;
+    size_t size;
+#endif
 };
 typedef struct storage storage_t;
 
@@ -27,6 +61,58 @@ static int create_storage (storage_t *sp);
 static void destroy_storage (storage_t *sp);
 static tls_variable_t *new_tls (const tls_type_t *tp);
 static void delete_tls (tls_variable_t *vp);
+static tls_variable_t *find_tls (storage_t *sp, const tls_type_t *tp);
+static int grow_table (storage_t *sp);
+static void insert_tls (storage_t *sp, tls_variable_t *vp);
+static size_t hash_type (const tls_type_t *tp);
+#if defined(FAST_TLS)
+static size_t get_slot (const tls_type_t *tp);
+static size_t assign_slot (const tls_type_t *tp);
+static int grow_slot_table (void);
+static void remember_tls (storage_t *sp, tls_variable_t *vp);
+static void slot_exit (void);
+#endif
+
+
+#if defined(FAST_TLS)
+
+    /* Slot number assigned to type */
+    struct slot_entry {
+        const tls_type_t *type;
+        size_t slot;
+    };
+    typedef struct slot_entry slot_entry_t;
+
+    /*
+     * Open-addressed hash table of slot numbers keyed by type.  Tables are
+     * only replaced, never modified in place except for filling empty
+     * entries, so other threads may read them without locks.  Replaced
+     * tables are kept as threads may still be reading them.
+     */
+    struct slot_table {
+        slot_entry_t *entries;
+        size_t mask;
+        struct slot_table *previous;
+    };
+    typedef struct slot_table slot_table_t;
+
+    /* Current slot table, published with release store */
+    static slot_table_t *slot_table = NULL;
+
+    /* Number of slots assigned so far */
+    static size_t slot_count = 0;
+
+    /* True if slot tables are released at exit */
+    static int slot_exit_registered = 0;
+
+    /* Copy of the slot array of the current thread's storage */
+    static THREAD_LOCAL tls_variable_t **fast_slots = NULL;
+    static THREAD_LOCAL size_t fast_size = 0;
+
+    /* Number of variables found by slot number in current thread */
+    static THREAD_LOCAL size_t fast_hits = 0;
+
+#endif
 
 
 /* Operating system specific variables */
@@ -75,67 +161,201 @@ get_tls (const tls_type_t *tp)
     storage_t *sp;
     tls_variable_t *vp;
     void *data;
-    int found;
+
+#if defined(FAST_TLS)
+    /*
+     * Find variable by slot number without locating the storage object.
+     * This is the common case once the variable has been created in the
+     * current thread.
+     */
+    size_t slot = get_slot (tp);
+    if (slot > 0  &&  slot <= fast_size) {
+        vp = fast_slots[slot - 1];
+        if (vp != NULL) {
+            assert (vp->type == tp);
+            fast_hits++;
+            return vp->type->get (vp);
+        }
+    }
+#endif
 
     /* Get pointer to current storage object */
     sp = get_storage ();
     if (sp != NULL) {
-        data = NULL;
-        found = 0;
 
-        /* Find variable with type tp from list */
-        vp = sp->first;
-        while (vp != NULL) {
+        /* Find variable with type tp */
+        vp = find_tls (sp, tp);
+        if (vp != NULL) {
 
-            /* Is this the variable we are looking for? */
-            if (vp->type != tp) {
+            /* Value found */
+            assert (vp->type->get != NULL);
+            data = vp->type->get (vp);
+#if defined(FAST_TLS)
+            remember_tls (sp, vp);
+#endif
 
-                /* No, check next variable */
-                vp = vp->next;
+        } else if (grow_table (sp)  &&  (vp = new_tls (tp)) != NULL) {
 
-            } else {
+            /* Add variable to the beginning of list */
+            vp->next = sp->first;
+            sp->first = vp;
+            insert_tls (sp, vp);
+            sp->stats.created++;
+#if defined(FAST_TLS)
+            remember_tls (sp, vp);
+#endif
 
-                /* Yes, value found */
-                assert (vp->type->get != NULL);
-                data = vp->type->get (vp);
-                found = 1;
-                break;
+            /* Return variable data */
+            assert (vp->type->get != NULL);
+            data = vp->type->get (vp);
 
-            }
+        } else {
 
-        }
+            /* Cannot allocate new variable */
+            data = NULL;
 
-        /* Create new variable if type was not registered before */
-        if (!found) {
+        }
 
-            /* Allocate room for variable */
-            vp = new_tls (tp);
-            if (vp) {
+    } else {
 
-                /* Add variable to the beginning of list */
-                vp->next = sp->first;
-                sp->first = vp;
+        /* Cannot initialize storage */
+        data = NULL;
 
-                /* Return variable data */
-                assert (vp->type->get != NULL);
-                data = vp->type->get (vp);
+    }
+    return data;
+}
 
-            } else {
 
-                /* Cannot allocate new variable */
-                data = NULL;
+/* Get lookup counters of current thread */
+int
+get_tls_statistics (struct tls_statistics *stats)
+{
+    storage_t *sp;
+    int ok;
 
-            }
+    /* Get pointer to current storage object */
+    sp = get_storage ();
+    if (sp != NULL) {
 
-        }
+        /* Copy counters */
+        *stats = sp->stats;
+#if defined(FAST_TLS)
+        stats->fast = fast_hits;
+#endif
+        ok = 1;
 
     } else {
 
         /* Cannot initialize storage */
-        data = NULL;
+        ok = 0;
 
     }
-    return data;
+    return ok;
+}
+
+
+/* Find variable of type tp from storage */
+static tls_variable_t *
+find_tls (storage_t *sp, const tls_type_t *tp)
+{
+    tls_variable_t *vp;
+    size_t i;
+
+    /* Same variable as last time? */
+    if (sp->last != NULL  &&  sp->last->type == tp) {
+        sp->stats.cached++;
+        return sp->last;
+    }
+
+    /* Search hash table */
+    if (sp->table != NULL) {
+        i = hash_type (tp) & sp->mask;
+        while ((vp = sp->table[i]) != NULL) {
+            sp->stats.probes++;
+            if (vp->type == tp) {
+                sp->stats.hashed++;
+                sp->last = vp;
+                return vp;
+            }
+            i = (i + 1) & sp->mask;
+        }
+    }
+
+    /* Not found */
+    sp->stats.misses++;
+    return NULL;
+}
+
+
+/* Make room for one more variable in hash table */
+static int
+grow_table (storage_t *sp)
+{
+    tls_variable_t **table;
+    tls_variable_t *vp;
+    size_t n;
+
+    /* Keep table at most half full */
+    n = sp->table ? sp->mask + 1 : 0;
+    if ((sp->count + 1) * 2 <= n) {
+        return 1;
+    }
+
+    /* Allocate larger table */
+    n = n ? n * 2 : 16;
+    table = system_allocate_memory (n * sizeof (table[0]));
+    if (table == NULL) {
+        return 0;
+    }
+    memset (table, 0, n * sizeof (table[0]));
+
+    /* Re-insert existing variables */
+    if (sp->table) {
+        system_free_memory (sp->table);
+    }
+    sp->table = table;
+    sp->mask = n - 1;
+    sp->count = 0;
+    vp = sp->first;
+    while (vp != NULL) {
+        insert_tls (sp, vp);
+        vp = vp->next;
+    }
+    return 1;
+}
+
+
+/* Add variable to hash table */
+static void
+insert_tls (storage_t *sp, tls_variable_t *vp)
+{
+    size_t i;
+
+    /* Find free entry */
+    assert ((sp->count + 1) * 2 <= sp->mask + 1);
+    i = hash_type (vp->type) & sp->mask;
+    while (sp->table[i] != NULL) {
+        i = (i + 1) & sp->mask;
+    }
+
+    /* Save variable */
+    sp->table[i] = vp;
+    sp->count++;
+    sp->last = vp;
+}
+
+
+/* Compute hash code of type pointer */
+static size_t
+hash_type (const tls_type_t *tp)
+{
+    size_t h;
+
+    /* Mix upper bits of address into the lower bits */
+    h = (size_t) ((uintptr_t) tp / sizeof (void*));
+    h *= (size_t) 2654435769u;
+    h ^= h >> 15;
+    return h;
 }
 
 
@@ -158,7 +378,8 @@ get_storage (void)
     } else {
 
         /* No, register cleanup function */
-        if (exit_handler (single_thread_exit, 40)) {
+        if (exit_handler_flags (
+            single_thread_exit, 40, EXIT_RELEASES_MEMORY)) {
 
             /* Initialize global storage */
             global_storage = new_storage ();
@@ -303,6 +524,15 @@ create_storage (storage_t *sp)
 {
     /* Reset storage object */
     sp->first = NULL;
+    sp->table = NULL;
+    sp->mask = 0;
+    sp->count = 0;
+    sp->last = NULL;
+    memset (&sp->stats, 0, sizeof (sp->stats));
+#if defined(FAST_TLS)
+    sp->slots = NULL;
+    sp->size = 0;
+#endif
 
     /* Return true to indicate success */
     return 1;
@@ -315,6 +545,27 @@ destroy_storage (storage_t *sp)
 {
     tls_variable_t *vp;
 
+#if defined(FAST_TLS)
+    /* Stop fast lookups before variables are released */
+    if (fast_slots == sp->slots) {
+        fast_slots = NULL;
+        fast_size = 0;
+    }
+    if (sp->slots) {
+        system_free_memory (sp->slots);
+        sp->slots = NULL;
+        sp->size = 0;
+    }
+#endif
+
+    /* Release hash table */
+    if (sp->table) {
+        system_free_memory (sp->table);
+        sp->table = NULL;
+        sp->count = 0;
+    }
+    sp->last = NULL;
+
     /* Loop through variables and release them */
     vp = sp->first;
     while (vp != NULL) {
@@ -423,6 +674,221 @@ delete_tls (tls_variable_t *vp)
 }
 
 
+/* Get slot number of type or zero if the type has no slot yet */
+#if defined(FAST_TLS)
+static size_t
+get_slot (const tls_type_t *tp)
+{
+    slot_table_t *tab;
+    const tls_type_t *type;
+    size_t i;
+
+    /* Slot number stored by the type? */
+    if (tp->slot != NULL) {
+        return __atomic_load_n (tp->slot, __ATOMIC_RELAXED);
+    }
+
+    /* No slots assigned yet? */
+    tab = __atomic_load_n (&slot_table, __ATOMIC_ACQUIRE);
+    if (tab == NULL) {
+        return 0;
+    }
+
+    /* Search type from table */
+    i = hash_type (tp) & tab->mask;
+    while ((type = __atomic_load_n (
+        &tab->entries[i].type, __ATOMIC_ACQUIRE)) != NULL) {
+        if (type == tp) {
+            return tab->entries[i].slot;
+        }
+        i = (i + 1) & tab->mask;
+    }
+    return 0;
+}
+#endif
+
+
+/* Get slot number of type, assign new slot number if needed */
+#if defined(FAST_TLS)
+static size_t
+assign_slot (const tls_type_t *tp)
+{
+    slot_table_t *tab;
+    size_t slot;
+    size_t i;
+
+    /* Does the type have a slot already? */
+    slot = get_slot (tp);
+    if (slot == 0) {
+
+        /* No, assign next free slot */
+        enter_critical ();
+        slot = get_slot (tp);
+        if (slot == 0  &&  tp->slot != NULL) {
+
+            /* Store slot number to type's own variable */
+            slot = ++slot_count;
+            __atomic_store_n (tp->slot, slot, __ATOMIC_RELAXED);
+
+        } else if (slot == 0  &&  grow_slot_table ()) {
+
+            /*
+             * Fill empty entry.  Slot number is stored before the type so
+             * that threads which find the type also see the slot number.
+             */
+            slot = ++slot_count;
+            tab = slot_table;
+            i = hash_type (tp) & tab->mask;
+            while (tab->entries[i].type != NULL) {
+                i = (i + 1) & tab->mask;
+            }
+            tab->entries[i].slot = slot;
+            __atomic_store_n (&tab->entries[i].type, tp, __ATOMIC_RELEASE);
+
+        }
+        leave_critical ();
+
+    }
+    return slot;
+}
+#endif
+
+
+/* Make room for one more type in slot table, call in critical section */
+#if defined(FAST_TLS)
+static int
+grow_slot_table (void)
+{
+    slot_table_t *old;
+    slot_table_t *tab;
+    size_t n;
+    size_t i;
+    size_t j;
+
+    /* Keep table at most half full */
+    old = slot_table;
+    if (old != NULL  &&  (slot_count + 1) * 2 <= old->mask + 1) {
+        return 1;
+    }
+
+    /* Release tables at exit along with other memory */
+    if (!slot_exit_registered) {
+        if (!exit_handler_flags (
+            slot_exit, 20, EXIT_RELEASES_MEMORY | EXIT_CONCURRENT)) {
+            return 0;
+        }
+        slot_exit_registered = 1;
+    }
+
+    /* Allocate new table */
+    n = old ? (old->mask + 1) * 2 : 64;
+    tab = (slot_table_t*) system_allocate_memory (sizeof (slot_table_t));
+    if (tab == NULL) {
+        return 0;
+    }
+    tab->entries = (slot_entry_t*) system_allocate_memory (
+        n * sizeof (slot_entry_t));
+    if (tab->entries == NULL) {
+        system_free_memory (tab);
+        return 0;
+    }
+    memset (tab->entries, 0, n * sizeof (slot_entry_t));
+    tab->mask = n - 1;
+    tab->previous = old;
+
+    /* Copy slots of old table */
+    if (old != NULL) {
+        for (i = 0; i <= old->mask; i++) {
+            if (old->entries[i].type != NULL) {
+                j = hash_type (old->entries[i].type) & tab->mask;
+                while (tab->entries[j].type != NULL) {
+                    j = (j + 1) & tab->mask;
+                }
+                tab->entries[j] = old->entries[i];
+            }
+        }
+    }
+
+    /* Publish table to other threads */
+    __atomic_store_n (&slot_table, tab, __ATOMIC_RELEASE);
+    return 1;
+}
+#endif
+
+
+/* Store variable to slot array of storage for fast lookup */
+#if defined(FAST_TLS)
+static void
+remember_tls (storage_t *sp, tls_variable_t *vp)
+{
+    size_t slot;
+
+    /* Grow slot array if needed */
+    slot = assign_slot (vp->type);
+    if (slot == 0) {
+
+        /* Out of memory, keep using slow lookup */
+        return;
+
+    }
+    if (slot > sp->size) {
+        tls_variable_t **slots;
+        size_t n;
+
+        /* Allocate room for all slots assigned so far */
+        n = sp->size ? sp->size * 2 : 16;
+        while (n < slot) {
+            n *= 2;
+        }
+        if (sp->slots) {
+            slots = system_resize_memory (sp->slots, n * sizeof (slots[0]));
+        } else {
+            slots = system_allocate_memory (n * sizeof (slots[0]));
+        }
+        if (slots != NULL) {
+
+            /* Clear new slots */
+            memset (slots + sp->size, 0, (n - sp->size) * sizeof (slots[0]));
+            sp->slots = slots;
+            sp->size = n;
+
+        } else {
+
+            /* Out of memory, keep using slow lookup */
+            return;
+
+        }
+
+    }
+
+    /* Save variable and publish slot array to current thread */
+    sp->slots[slot - 1] = vp;
+    fast_slots = sp->slots;
+    fast_size = sp->size;
+}
+#endif
+
+
+/* Release slot tables at exit */
+#if defined(FAST_TLS)
+static void
+slot_exit (void)
+{
+    slot_table_t *tab;
+    slot_table_t *previous;
+
+    /* Variables have been released so no thread reads the tables */
+    tab = __atomic_exchange_n (&slot_table, NULL, __ATOMIC_ACQUIRE);
+    while (tab != NULL) {
+        previous = tab->previous;
+        system_free_memory (tab->entries);
+        system_free_memory (tab);
+        tab = previous;
+    }
+}
+#endif
+
+
 /* Initialize thread local storage */
 #if !defined(T7_DISABLE_THREADS)  &&  !defined(_WIN32)
 static void
@@ -441,7 +907,7 @@ init_pthread (void)
     }
 
     /* Register cleanup function for main thread */
-    if (!exit_handler (multi_thread_exit, 40)) {
+    if (!exit_handler_flags (multi_thread_exit, 40, EXIT_RELEASES_MEMORY)) {
         terminate ("Cannot register exit handler");
     }
 }
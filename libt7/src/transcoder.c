@@ -0,0 +1,1719 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/transcoder.h"
+#include "t7/memory.h"
+#include <stdint.h>
+
+/* SSE2 is always available on x86-64 and processors are little-endian */
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+/* Multi-byte UTF-8 decoder needs SSSE3 and POPCNT checked at run time */
+#if defined(__SSE2__)  &&  (defined(__GNUC__)  ||  defined(__clang__))
+#   define UTF8_SSSE3
+#   include <tmmintrin.h>
+#endif
+
+
+/* Forward-decl */
+struct transcoder;
+
+/*
+ * Decode one character from P which holds N > 0 bytes.  Returns the number
+ * of bytes used, zero if the sequence is incomplete or -1 if the sequence is
+ * invalid.
+ */
+typedef int decode_function(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+
+/*
+ * Encode character CP to P which has room for N bytes.  Returns the number
+ * of bytes written, zero if there is not enough room or ENCODE_ERROR if the
+ * character cannot be represented.
+ */
+typedef size_t encode_function(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+
+/*
+ * Convert leading characters of N bytes at SRC in bulk and store the result
+ * to DEST which has room for CAP bytes.  Returns the number of input bytes
+ * used and stores the number of output bytes to PRODUCED.  Conversion stops
+ * at the first character which needs the decode and encode functions.
+ */
+typedef size_t run_function(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+
+/* Return value of encode function for unrepresentable characters */
+#define ENCODE_ERROR ((size_t) -1)
+
+/* Longest sequence in any supported character set */
+#define MAX_SEQUENCE 4
+
+/* State of converter */
+struct transcoder {
+	/* Allocator of transcoder */
+	struct allocator *allocator;
+
+	/* Conversion functions */
+	decode_function *decode;
+	encode_function *encode;
+
+	/* Tables of single-byte character sets or NULL */
+	const struct charset_table *from_table;
+	const struct charset_table *to_table;
+
+	/* Bulk conversion of simple characters, or NULL */
+	run_function *run;
+
+	/* Size of UTF-16 or UTF-32 code unit in bulk conversion */
+	size_t unit;
+
+	/* Non-zero if code units are big-endian */
+	int big;
+
+	/* Characters below the limit are converted in bulk */
+	unsigned limit;
+
+	/* Incomplete sequence from previous chunk */
+	unsigned char pending[MAX_SEQUENCE];
+	size_t npending;
+};
+
+/* Local functions */
+static int init_transcoder(
+	struct transcoder *tp, charset_t from, charset_t to);
+static void select_run(struct transcoder *tp, charset_t from, charset_t to);
+static unsigned byte_limit(charset_t t, const struct charset_table *table);
+static int is_wide_charset(charset_t t);
+
+/* Bulk conversions */
+static size_t run_copy(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+static size_t run_widen(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+static size_t run_narrow(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+static size_t run_swap16(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+#if defined(UTF8_SSSE3)
+static size_t run_utf8_ssse3(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+static size_t run_latin1_ssse3(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced);
+
+/*
+ * Indices of 16-bit lanes which remain after removing the lanes whose bits
+ * are set in the table index.  Unused entries are zero.
+ */
+static const unsigned char compact_lanes[256][8] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7 }, { 1, 2, 3, 4, 5, 6, 7, 0 },
+	{ 0, 2, 3, 4, 5, 6, 7, 0 }, { 2, 3, 4, 5, 6, 7, 0, 0 },
+	{ 0, 1, 3, 4, 5, 6, 7, 0 }, { 1, 3, 4, 5, 6, 7, 0, 0 },
+	{ 0, 3, 4, 5, 6, 7, 0, 0 }, { 3, 4, 5, 6, 7, 0, 0, 0 },
+	{ 0, 1, 2, 4, 5, 6, 7, 0 }, { 1, 2, 4, 5, 6, 7, 0, 0 },
+	{ 0, 2, 4, 5, 6, 7, 0, 0 }, { 2, 4, 5, 6, 7, 0, 0, 0 },
+	{ 0, 1, 4, 5, 6, 7, 0, 0 }, { 1, 4, 5, 6, 7, 0, 0, 0 },
+	{ 0, 4, 5, 6, 7, 0, 0, 0 }, { 4, 5, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 5, 6, 7, 0 }, { 1, 2, 3, 5, 6, 7, 0, 0 },
+	{ 0, 2, 3, 5, 6, 7, 0, 0 }, { 2, 3, 5, 6, 7, 0, 0, 0 },
+	{ 0, 1, 3, 5, 6, 7, 0, 0 }, { 1, 3, 5, 6, 7, 0, 0, 0 },
+	{ 0, 3, 5, 6, 7, 0, 0, 0 }, { 3, 5, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 2, 5, 6, 7, 0, 0 }, { 1, 2, 5, 6, 7, 0, 0, 0 },
+	{ 0, 2, 5, 6, 7, 0, 0, 0 }, { 2, 5, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 5, 6, 7, 0, 0, 0 }, { 1, 5, 6, 7, 0, 0, 0, 0 },
+	{ 0, 5, 6, 7, 0, 0, 0, 0 }, { 5, 6, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 6, 7, 0 }, { 1, 2, 3, 4, 6, 7, 0, 0 },
+	{ 0, 2, 3, 4, 6, 7, 0, 0 }, { 2, 3, 4, 6, 7, 0, 0, 0 },
+	{ 0, 1, 3, 4, 6, 7, 0, 0 }, { 1, 3, 4, 6, 7, 0, 0, 0 },
+	{ 0, 3, 4, 6, 7, 0, 0, 0 }, { 3, 4, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 6, 7, 0, 0 }, { 1, 2, 4, 6, 7, 0, 0, 0 },
+	{ 0, 2, 4, 6, 7, 0, 0, 0 }, { 2, 4, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 4, 6, 7, 0, 0, 0 }, { 1, 4, 6, 7, 0, 0, 0, 0 },
+	{ 0, 4, 6, 7, 0, 0, 0, 0 }, { 4, 6, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 6, 7, 0, 0 }, { 1, 2, 3, 6, 7, 0, 0, 0 },
+	{ 0, 2, 3, 6, 7, 0, 0, 0 }, { 2, 3, 6, 7, 0, 0, 0, 0 },
+	{ 0, 1, 3, 6, 7, 0, 0, 0 }, { 1, 3, 6, 7, 0, 0, 0, 0 },
+	{ 0, 3, 6, 7, 0, 0, 0, 0 }, { 3, 6, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 6, 7, 0, 0, 0 }, { 1, 2, 6, 7, 0, 0, 0, 0 },
+	{ 0, 2, 6, 7, 0, 0, 0, 0 }, { 2, 6, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 6, 7, 0, 0, 0, 0 }, { 1, 6, 7, 0, 0, 0, 0, 0 },
+	{ 0, 6, 7, 0, 0, 0, 0, 0 }, { 6, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 5, 7, 0 }, { 1, 2, 3, 4, 5, 7, 0, 0 },
+	{ 0, 2, 3, 4, 5, 7, 0, 0 }, { 2, 3, 4, 5, 7, 0, 0, 0 },
+	{ 0, 1, 3, 4, 5, 7, 0, 0 }, { 1, 3, 4, 5, 7, 0, 0, 0 },
+	{ 0, 3, 4, 5, 7, 0, 0, 0 }, { 3, 4, 5, 7, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 5, 7, 0, 0 }, { 1, 2, 4, 5, 7, 0, 0, 0 },
+	{ 0, 2, 4, 5, 7, 0, 0, 0 }, { 2, 4, 5, 7, 0, 0, 0, 0 },
+	{ 0, 1, 4, 5, 7, 0, 0, 0 }, { 1, 4, 5, 7, 0, 0, 0, 0 },
+	{ 0, 4, 5, 7, 0, 0, 0, 0 }, { 4, 5, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 5, 7, 0, 0 }, { 1, 2, 3, 5, 7, 0, 0, 0 },
+	{ 0, 2, 3, 5, 7, 0, 0, 0 }, { 2, 3, 5, 7, 0, 0, 0, 0 },
+	{ 0, 1, 3, 5, 7, 0, 0, 0 }, { 1, 3, 5, 7, 0, 0, 0, 0 },
+	{ 0, 3, 5, 7, 0, 0, 0, 0 }, { 3, 5, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 5, 7, 0, 0, 0 }, { 1, 2, 5, 7, 0, 0, 0, 0 },
+	{ 0, 2, 5, 7, 0, 0, 0, 0 }, { 2, 5, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 5, 7, 0, 0, 0, 0 }, { 1, 5, 7, 0, 0, 0, 0, 0 },
+	{ 0, 5, 7, 0, 0, 0, 0, 0 }, { 5, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 7, 0, 0 }, { 1, 2, 3, 4, 7, 0, 0, 0 },
+	{ 0, 2, 3, 4, 7, 0, 0, 0 }, { 2, 3, 4, 7, 0, 0, 0, 0 },
+	{ 0, 1, 3, 4, 7, 0, 0, 0 }, { 1, 3, 4, 7, 0, 0, 0, 0 },
+	{ 0, 3, 4, 7, 0, 0, 0, 0 }, { 3, 4, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 7, 0, 0, 0 }, { 1, 2, 4, 7, 0, 0, 0, 0 },
+	{ 0, 2, 4, 7, 0, 0, 0, 0 }, { 2, 4, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 4, 7, 0, 0, 0, 0 }, { 1, 4, 7, 0, 0, 0, 0, 0 },
+	{ 0, 4, 7, 0, 0, 0, 0, 0 }, { 4, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 7, 0, 0, 0 }, { 1, 2, 3, 7, 0, 0, 0, 0 },
+	{ 0, 2, 3, 7, 0, 0, 0, 0 }, { 2, 3, 7, 0, 0, 0, 0, 0 },
+	{ 0, 1, 3, 7, 0, 0, 0, 0 }, { 1, 3, 7, 0, 0, 0, 0, 0 },
+	{ 0, 3, 7, 0, 0, 0, 0, 0 }, { 3, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 7, 0, 0, 0, 0 }, { 1, 2, 7, 0, 0, 0, 0, 0 },
+	{ 0, 2, 7, 0, 0, 0, 0, 0 }, { 2, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 7, 0, 0, 0, 0, 0 }, { 1, 7, 0, 0, 0, 0, 0, 0 },
+	{ 0, 7, 0, 0, 0, 0, 0, 0 }, { 7, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 5, 6, 0 }, { 1, 2, 3, 4, 5, 6, 0, 0 },
+	{ 0, 2, 3, 4, 5, 6, 0, 0 }, { 2, 3, 4, 5, 6, 0, 0, 0 },
+	{ 0, 1, 3, 4, 5, 6, 0, 0 }, { 1, 3, 4, 5, 6, 0, 0, 0 },
+	{ 0, 3, 4, 5, 6, 0, 0, 0 }, { 3, 4, 5, 6, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 5, 6, 0, 0 }, { 1, 2, 4, 5, 6, 0, 0, 0 },
+	{ 0, 2, 4, 5, 6, 0, 0, 0 }, { 2, 4, 5, 6, 0, 0, 0, 0 },
+	{ 0, 1, 4, 5, 6, 0, 0, 0 }, { 1, 4, 5, 6, 0, 0, 0, 0 },
+	{ 0, 4, 5, 6, 0, 0, 0, 0 }, { 4, 5, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 5, 6, 0, 0 }, { 1, 2, 3, 5, 6, 0, 0, 0 },
+	{ 0, 2, 3, 5, 6, 0, 0, 0 }, { 2, 3, 5, 6, 0, 0, 0, 0 },
+	{ 0, 1, 3, 5, 6, 0, 0, 0 }, { 1, 3, 5, 6, 0, 0, 0, 0 },
+	{ 0, 3, 5, 6, 0, 0, 0, 0 }, { 3, 5, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 5, 6, 0, 0, 0 }, { 1, 2, 5, 6, 0, 0, 0, 0 },
+	{ 0, 2, 5, 6, 0, 0, 0, 0 }, { 2, 5, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 5, 6, 0, 0, 0, 0 }, { 1, 5, 6, 0, 0, 0, 0, 0 },
+	{ 0, 5, 6, 0, 0, 0, 0, 0 }, { 5, 6, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 6, 0, 0 }, { 1, 2, 3, 4, 6, 0, 0, 0 },
+	{ 0, 2, 3, 4, 6, 0, 0, 0 }, { 2, 3, 4, 6, 0, 0, 0, 0 },
+	{ 0, 1, 3, 4, 6, 0, 0, 0 }, { 1, 3, 4, 6, 0, 0, 0, 0 },
+	{ 0, 3, 4, 6, 0, 0, 0, 0 }, { 3, 4, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 6, 0, 0, 0 }, { 1, 2, 4, 6, 0, 0, 0, 0 },
+	{ 0, 2, 4, 6, 0, 0, 0, 0 }, { 2, 4, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 4, 6, 0, 0, 0, 0 }, { 1, 4, 6, 0, 0, 0, 0, 0 },
+	{ 0, 4, 6, 0, 0, 0, 0, 0 }, { 4, 6, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 6, 0, 0, 0 }, { 1, 2, 3, 6, 0, 0, 0, 0 },
+	{ 0, 2, 3, 6, 0, 0, 0, 0 }, { 2, 3, 6, 0, 0, 0, 0, 0 },
+	{ 0, 1, 3, 6, 0, 0, 0, 0 }, { 1, 3, 6, 0, 0, 0, 0, 0 },
+	{ 0, 3, 6, 0, 0, 0, 0, 0 }, { 3, 6, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 6, 0, 0, 0, 0 }, { 1, 2, 6, 0, 0, 0, 0, 0 },
+	{ 0, 2, 6, 0, 0, 0, 0, 0 }, { 2, 6, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 6, 0, 0, 0, 0, 0 }, { 1, 6, 0, 0, 0, 0, 0, 0 },
+	{ 0, 6, 0, 0, 0, 0, 0, 0 }, { 6, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 5, 0, 0 }, { 1, 2, 3, 4, 5, 0, 0, 0 },
+	{ 0, 2, 3, 4, 5, 0, 0, 0 }, { 2, 3, 4, 5, 0, 0, 0, 0 },
+	{ 0, 1, 3, 4, 5, 0, 0, 0 }, { 1, 3, 4, 5, 0, 0, 0, 0 },
+	{ 0, 3, 4, 5, 0, 0, 0, 0 }, { 3, 4, 5, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 5, 0, 0, 0 }, { 1, 2, 4, 5, 0, 0, 0, 0 },
+	{ 0, 2, 4, 5, 0, 0, 0, 0 }, { 2, 4, 5, 0, 0, 0, 0, 0 },
+	{ 0, 1, 4, 5, 0, 0, 0, 0 }, { 1, 4, 5, 0, 0, 0, 0, 0 },
+	{ 0, 4, 5, 0, 0, 0, 0, 0 }, { 4, 5, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 5, 0, 0, 0 }, { 1, 2, 3, 5, 0, 0, 0, 0 },
+	{ 0, 2, 3, 5, 0, 0, 0, 0 }, { 2, 3, 5, 0, 0, 0, 0, 0 },
+	{ 0, 1, 3, 5, 0, 0, 0, 0 }, { 1, 3, 5, 0, 0, 0, 0, 0 },
+	{ 0, 3, 5, 0, 0, 0, 0, 0 }, { 3, 5, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 5, 0, 0, 0, 0 }, { 1, 2, 5, 0, 0, 0, 0, 0 },
+	{ 0, 2, 5, 0, 0, 0, 0, 0 }, { 2, 5, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 5, 0, 0, 0, 0, 0 }, { 1, 5, 0, 0, 0, 0, 0, 0 },
+	{ 0, 5, 0, 0, 0, 0, 0, 0 }, { 5, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 4, 0, 0, 0 }, { 1, 2, 3, 4, 0, 0, 0, 0 },
+	{ 0, 2, 3, 4, 0, 0, 0, 0 }, { 2, 3, 4, 0, 0, 0, 0, 0 },
+	{ 0, 1, 3, 4, 0, 0, 0, 0 }, { 1, 3, 4, 0, 0, 0, 0, 0 },
+	{ 0, 3, 4, 0, 0, 0, 0, 0 }, { 3, 4, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 4, 0, 0, 0, 0 }, { 1, 2, 4, 0, 0, 0, 0, 0 },
+	{ 0, 2, 4, 0, 0, 0, 0, 0 }, { 2, 4, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 4, 0, 0, 0, 0, 0 }, { 1, 4, 0, 0, 0, 0, 0, 0 },
+	{ 0, 4, 0, 0, 0, 0, 0, 0 }, { 4, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 3, 0, 0, 0, 0 }, { 1, 2, 3, 0, 0, 0, 0, 0 },
+	{ 0, 2, 3, 0, 0, 0, 0, 0 }, { 2, 3, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 3, 0, 0, 0, 0, 0 }, { 1, 3, 0, 0, 0, 0, 0, 0 },
+	{ 0, 3, 0, 0, 0, 0, 0, 0 }, { 3, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 2, 0, 0, 0, 0, 0 }, { 1, 2, 0, 0, 0, 0, 0, 0 },
+	{ 0, 2, 0, 0, 0, 0, 0, 0 }, { 2, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 0, 0, 0, 0, 0, 0 }, { 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+/*
+ * Positions of bytes which remain after the second byte of each 16-bit lane
+ * is removed unless the bit of the lane is set in the table index.  Unused
+ * positions are 128 which makes the shuffle store zero.
+ */
+static const unsigned char expand_lanes[256][16] = {
+	{ 0, 2, 4, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 128, 128 },
+	{ 0, 2, 4, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 128, 128 },
+	{ 0, 2, 4, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 128 },
+	{ 0, 2, 4, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 14, 15, 128 },
+	{ 0, 2, 4, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 13, 14, 15, 128 },
+	{ 0, 2, 4, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 14, 15, 128 },
+	{ 0, 2, 4, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15, 128 },
+	{ 0, 2, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128, 128 },
+	{ 0, 1, 2, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 1, 2, 3, 4, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128 },
+	{ 0, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128, 128 },
+	{ 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128 },
+	{ 0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 128 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }
+};
+#endif
+
+/* Decoders */
+static int decode_table(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+static int decode_utf8(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+static int decode_utf16le(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+static int decode_utf16be(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+static int decode_utf32le(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+static int decode_utf32be(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp);
+
+/* Encoders */
+static size_t encode_table(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+static size_t encode_utf8(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+static size_t encode_utf16le(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+static size_t encode_utf16be(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+static size_t encode_utf32le(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+static size_t encode_utf32be(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n);
+
+
+/* Create converter */
+transcoder_t *open_transcoder(charset_t from, charset_t to)
+{
+	return new_transcoder(NULL, from, to);
+}
+
+
+/* Create converter in memory of allocator */
+transcoder_t *new_transcoder(
+	struct allocator *ap, charset_t from, charset_t to)
+{
+	if (!ap)
+		ap = get_default_allocator();
+
+	struct transcoder *tp =
+		allocator_allocate_memory(ap, sizeof(struct transcoder));
+	if (!tp)
+		goto exit_null;
+
+	tp->allocator = ap;
+	if (!init_transcoder(tp, from, to))
+		goto exit_free;
+
+	return tp;
+
+exit_free:
+	allocator_free_memory(ap, tp);
+exit_null:
+	return NULL;
+}
+
+
+/* Release converter */
+void close_transcoder(transcoder_t *tp)
+{
+	if (!tp)
+		return;
+
+	allocator_free_memory(tp->allocator, tp);
+}
+
+
+/* Discard partial sequence */
+void reset_transcoder(transcoder_t *tp)
+{
+	assert(tp != NULL);
+	tp->npending = 0;
+}
+
+
+/* Convert chunk of text */
+int transcode(
+	transcoder_t *tp, const void *in, size_t in_len,
+	void *out, size_t out_cap, size_t *consumed, size_t *produced)
+{
+	assert(tp != NULL);
+	assert(consumed != NULL);
+	assert(produced != NULL);
+
+	const unsigned char *src = (const unsigned char*) in;
+	unsigned char *dest = (unsigned char*) out;
+	size_t i = 0;
+	size_t o = 0;
+	size_t retry = 0;
+	uint32_t cp;
+	size_t w;
+	int r;
+	int ok = 1;
+
+	/* End of text must not leave incomplete sequence behind */
+	if (!in) {
+		ok = tp->npending == 0;
+		tp->npending = 0;
+		goto exit;
+	}
+
+	/* Complete sequence left over from previous chunk */
+	if (tp->npending > 0) {
+		unsigned char tmp[MAX_SEQUENCE];
+		size_t k = tp->npending;
+		size_t m = MAX_SEQUENCE - k;
+		if (m > in_len)
+			m = in_len;
+		memcpy(tmp, tp->pending, k);
+		memcpy(tmp + k, src, m);
+
+		r = tp->decode(tp, tmp, k + m, &cp);
+		if (r == 0) {
+			/* Still incomplete, keep all input */
+			assert(m == in_len);
+			memcpy(tp->pending + k, src, m);
+			tp->npending += m;
+			i = in_len;
+			goto exit;
+		}
+		if (r < 0) {
+			ok = 0;
+			goto exit;
+		}
+		assert((size_t) r > k);
+
+		w = tp->encode(tp, cp, dest, out_cap);
+		if (w == ENCODE_ERROR) {
+			ok = 0;
+			goto exit;
+		}
+		if (w == 0)
+			goto exit;
+
+		o = w;
+		i = (size_t) r - k;
+		tp->npending = 0;
+	}
+
+	while (i < in_len) {
+		/* Convert run of simple characters in bulk */
+		if (tp->run && i >= retry) {
+			size_t m;
+			size_t k = tp->run(
+				tp, src + i, in_len - i, dest + o, out_cap - o, &m);
+			if (k == 0) {
+				/* Decode a few characters before trying again */
+				retry = i + 16;
+			}
+			i += k;
+			o += m;
+			if (i >= in_len)
+				break;
+		}
+
+		/* Decode one character */
+		r = tp->decode(tp, src + i, in_len - i, &cp);
+		if (r == 0) {
+			/* Keep incomplete sequence for next call */
+			assert(in_len - i < MAX_SEQUENCE);
+			memcpy(tp->pending, src + i, in_len - i);
+			tp->npending = in_len - i;
+			i = in_len;
+			break;
+		}
+		if (r < 0) {
+			ok = 0;
+			break;
+		}
+
+		/* Encode character if there is room */
+		w = tp->encode(tp, cp, dest + o, out_cap - o);
+		if (w == ENCODE_ERROR) {
+			ok = 0;
+			break;
+		}
+		if (w == 0)
+			break;
+
+		i += (size_t) r;
+		o += w;
+	}
+
+exit:
+	*consumed = i;
+	*produced = o;
+	return ok;
+}
+
+
+/* Convert whole text */
+char *transcode_all(
+	charset_t from, charset_t to, const void *in, size_t in_len,
+	size_t *out_len)
+{
+	assert(in != NULL || in_len == 0);
+	assert(out_len != NULL);
+
+	struct transcoder t;
+	if (!init_transcoder(&t, from, to))
+		goto exit_null;
+
+	/* Start with room for the input plus terminator */
+	size_t cap = in_len + 16;
+	char *buffer = allocate_memory(cap);
+	if (!buffer)
+		goto exit_null;
+
+	/* Convert input, leaving room for terminator */
+	const unsigned char *src = (const unsigned char*) in;
+	size_t used = 0;
+	size_t i = 0;
+	while (1) {
+		size_t k;
+		size_t m;
+		if (!transcode(
+			&t, src ? src + i : NULL, in_len - i,
+			buffer + used, cap - used - MAX_SEQUENCE, &k, &m))
+			goto exit_free;
+		i += k;
+		used += m;
+		if (i >= in_len)
+			break;
+
+		/* Output buffer is full, double its size */
+		char *p = resize_memory(buffer, 2 * cap);
+		if (!p)
+			goto exit_free;
+		buffer = p;
+		cap *= 2;
+	}
+
+	/* Input must not end in the middle of sequence */
+	size_t k;
+	size_t m;
+	if (!transcode(&t, NULL, 0, NULL, 0, &k, &m))
+		goto exit_free;
+
+	/* Terminate string */
+	memset(buffer + used, 0, MAX_SEQUENCE);
+	*out_len = used;
+	return buffer;
+
+exit_free:
+	free_memory(buffer);
+exit_null:
+	return NULL;
+}
+
+
+/* Select conversion functions */
+static int init_transcoder(
+	struct transcoder *tp, charset_t from, charset_t to)
+{
+	from = resolve_charset(from);
+	to = resolve_charset(to);
+
+	/* Single-byte character sets are converted through tables */
+	tp->from_table = get_charset_table(from);
+	tp->to_table = get_charset_table(to);
+
+	switch (from) {
+	case UTF8:
+		tp->decode = decode_utf8;
+		break;
+	case UTF16LE:
+		tp->decode = decode_utf16le;
+		break;
+	case UTF16BE:
+		tp->decode = decode_utf16be;
+		break;
+	case UTF32LE:
+		tp->decode = decode_utf32le;
+		break;
+	case UTF32BE:
+		tp->decode = decode_utf32be;
+		break;
+	case ASCII:
+	case ISO8859_1:
+	case UTF16:
+	case UTF32:
+	case WCHAR:
+	case FILESYSTEM_CHARSET:
+	case LOCALE_CHARSET:
+	case INVALID_CHARSET:
+	default:
+		/* Single-byte character set or invalid */
+		if (!tp->from_table)
+			return 0;
+		tp->decode = decode_table;
+	}
+
+	switch (to) {
+	case UTF8:
+		tp->encode = encode_utf8;
+		break;
+	case UTF16LE:
+		tp->encode = encode_utf16le;
+		break;
+	case UTF16BE:
+		tp->encode = encode_utf16be;
+		break;
+	case UTF32LE:
+		tp->encode = encode_utf32le;
+		break;
+	case UTF32BE:
+		tp->encode = encode_utf32be;
+		break;
+	case ASCII:
+	case ISO8859_1:
+	case UTF16:
+	case UTF32:
+	case WCHAR:
+	case FILESYSTEM_CHARSET:
+	case LOCALE_CHARSET:
+	case INVALID_CHARSET:
+	default:
+		if (!tp->to_table)
+			return 0;
+		tp->encode = encode_table;
+	}
+
+	select_run(tp, from, to);
+	tp->npending = 0;
+	return 1;
+}
+
+
+/* Select bulk conversion for pair of resolved character sets */
+static void select_run(struct transcoder *tp, charset_t from, charset_t to)
+{
+	unsigned from_limit = byte_limit(from, tp->from_table);
+	unsigned to_limit = byte_limit(to, tp->to_table);
+	int ssse3 = 0;
+
+#if defined(UTF8_SSSE3)
+	/* Multi-byte sequences are converted with vector instructions */
+	__builtin_cpu_init();
+	ssse3 = __builtin_cpu_supports("ssse3")
+		&& __builtin_cpu_supports("popcnt");
+#endif
+
+	tp->run = NULL;
+	tp->unit = 0;
+	tp->big = 0;
+	tp->limit = 0;
+
+	if (from_limit && to_limit) {
+		/* Copy bytes which mean the same in both character sets */
+		tp->limit = from_limit < to_limit ? from_limit : to_limit;
+		tp->run = run_copy;
+#if defined(UTF8_SSSE3)
+		if (ssse3 && from == UTF8 && to_limit == 0x100) {
+			tp->unit = 1;
+			tp->run = run_utf8_ssse3;
+		} else if (ssse3 && from_limit == 0x100 && to == UTF8) {
+			tp->run = run_latin1_ssse3;
+		}
+#endif
+	} else if (from_limit && is_wide_charset(to)) {
+		/* Widen bytes to UTF-16 or UTF-32 */
+		tp->unit = (to == UTF16LE || to == UTF16BE) ? 2 : 4;
+		tp->big = (to == UTF16BE || to == UTF32BE);
+		tp->limit = from_limit;
+		tp->run = run_widen;
+#if defined(UTF8_SSSE3)
+		if (ssse3 && from == UTF8)
+			tp->run = run_utf8_ssse3;
+#endif
+	} else if (is_wide_charset(from) && to_limit) {
+		/* Narrow UTF-16 or UTF-32 to bytes */
+		tp->unit = (from == UTF16LE || from == UTF16BE) ? 2 : 4;
+		tp->big = (from == UTF16BE || from == UTF32BE);
+		tp->limit = to_limit;
+		tp->run = run_narrow;
+	} else if ((from == UTF16LE && to == UTF16BE)
+		|| (from == UTF16BE && to == UTF16LE)) {
+		/* Swap bytes of characters outside of surrogate range */
+		tp->unit = 2;
+		tp->big = (from == UTF16BE);
+		tp->run = run_swap16;
+	}
+	(void) ssse3;
+}
+
+
+/*
+ * Returns 0x100 if every byte of character set maps to the character of the
+ * same value, 0x80 if ASCII characters do or zero otherwise.
+ */
+static unsigned byte_limit(charset_t t, const struct charset_table *table)
+{
+	if (t == UTF8)
+		return 0x80;
+	if (!table)
+		return 0;
+
+	unsigned i = 0;
+	while (i < 256 && table->decode[i] == i)
+		i++;
+	if (i == 256)
+		return 0x100;
+	if (i >= 128)
+		return 0x80;
+	return 0;
+}
+
+
+/* Returns true for UTF-16 and UTF-32 */
+static int is_wide_charset(charset_t t)
+{
+	return t == UTF16LE || t == UTF16BE || t == UTF32LE || t == UTF32BE;
+}
+
+
+/* Copy bytes below LIMIT */
+static size_t copy_bytes(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced, unsigned limit)
+{
+	size_t end = n < cap ? n : cap;
+	size_t i = 0;
+
+	if (limit > 0xFF) {
+		/* Every byte means the same */
+		memcpy(dest, src, end);
+		*produced = end;
+		return end;
+	}
+
+#if defined(__SSE2__)
+	while (i + 16 <= end) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		if (_mm_movemask_epi8(x) != 0)
+			break;
+		_mm_storeu_si128((__m128i*) (dest + i), x);
+		i += 16;
+	}
+#endif
+
+	while (i < end && src[i] < limit) {
+		dest[i] = src[i];
+		i++;
+	}
+	*produced = i;
+	return i;
+}
+
+
+/* Widen bytes below LIMIT to UTF-16 */
+static size_t widen16(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced,
+	int big, unsigned limit)
+{
+	size_t end = n < cap / 2 ? n : cap / 2;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	/* Interleave bytes with zeros, zero first in big-endian order */
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 16 <= end) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		if (limit <= 0xFF && _mm_movemask_epi8(x) != 0)
+			break;
+		__m128i lo = big
+			? _mm_unpacklo_epi8(zero, x)
+			: _mm_unpacklo_epi8(x, zero);
+		__m128i hi = big
+			? _mm_unpackhi_epi8(zero, x)
+			: _mm_unpackhi_epi8(x, zero);
+		_mm_storeu_si128((__m128i*) (dest + 2 * i), lo);
+		_mm_storeu_si128((__m128i*) (dest + 2 * i + 16), hi);
+		i += 16;
+	}
+#endif
+
+	while (i < end && src[i] < limit) {
+		dest[2 * i + (big ? 0 : 1)] = 0;
+		dest[2 * i + (big ? 1 : 0)] = src[i];
+		i++;
+	}
+	*produced = 2 * i;
+	return i;
+}
+
+
+/* Widen bytes below LIMIT to UTF-32 */
+static size_t widen32(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced,
+	int big, unsigned limit)
+{
+	size_t end = n < cap / 4 ? n : cap / 4;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	/* Interleave twice, zeros first in big-endian order */
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 16 <= end) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		if (limit <= 0xFF && _mm_movemask_epi8(x) != 0)
+			break;
+		__m128i w[2];
+		w[0] = big ? _mm_unpacklo_epi8(zero, x) : _mm_unpacklo_epi8(x, zero);
+		w[1] = big ? _mm_unpackhi_epi8(zero, x) : _mm_unpackhi_epi8(x, zero);
+		for (size_t k = 0; k < 2; k++) {
+			__m128i lo = big
+				? _mm_unpacklo_epi16(zero, w[k])
+				: _mm_unpacklo_epi16(w[k], zero);
+			__m128i hi = big
+				? _mm_unpackhi_epi16(zero, w[k])
+				: _mm_unpackhi_epi16(w[k], zero);
+			_mm_storeu_si128((__m128i*) (dest + 4 * i + 32 * k), lo);
+			_mm_storeu_si128((__m128i*) (dest + 4 * i + 32 * k + 16), hi);
+		}
+		i += 16;
+	}
+#endif
+
+	while (i < end && src[i] < limit) {
+		memset(dest + 4 * i, 0, 4);
+		dest[4 * i + (big ? 3 : 0)] = src[i];
+		i++;
+	}
+	*produced = 4 * i;
+	return i;
+}
+
+
+/* Narrow UTF-16 characters below LIMIT to bytes */
+static size_t narrow16(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced,
+	int big, unsigned limit)
+{
+	size_t end = n / 2 < cap ? n / 2 : cap;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	/* Bits which must be zero in characters below limit */
+	unsigned bits = (0xFFFF & ~(limit - 1));
+	if (big)
+		bits = ((bits >> 8) | (bits << 8)) & 0xFFFF;
+	const __m128i mask = _mm_set1_epi16((short) bits);
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 16 <= end) {
+		__m128i a = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+		__m128i b = _mm_loadu_si128((const __m128i*) (src + 2 * i + 16));
+		__m128i t = _mm_and_si128(_mm_or_si128(a, b), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) != 0xFFFF)
+			break;
+		if (big) {
+			/* Move character to low byte of each unit */
+			a = _mm_srli_epi16(a, 8);
+			b = _mm_srli_epi16(b, 8);
+		}
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_packus_epi16(a, b));
+		i += 16;
+	}
+#endif
+
+	while (i < end) {
+		unsigned char hi = src[2 * i + (big ? 0 : 1)];
+		unsigned char lo = src[2 * i + (big ? 1 : 0)];
+		if (hi != 0 || lo >= limit)
+			break;
+		dest[i++] = lo;
+	}
+	*produced = i;
+	return 2 * i;
+}
+
+
+/* Narrow UTF-32 characters below LIMIT to bytes */
+static size_t narrow32(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced,
+	int big, unsigned limit)
+{
+	size_t end = n / 4 < cap ? n / 4 : cap;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	/* Bits which must be zero in characters below limit */
+	uint32_t bits = ~(uint32_t) (limit - 1);
+	if (big)
+		bits = __builtin_bswap32(bits);
+	const __m128i mask = _mm_set1_epi32((int) bits);
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 16 <= end) {
+		__m128i x[4];
+		__m128i t = zero;
+		for (size_t k = 0; k < 4; k++) {
+			x[k] = _mm_loadu_si128((const __m128i*) (src + 4 * i + 16 * k));
+			t = _mm_or_si128(t, x[k]);
+		}
+		t = _mm_and_si128(t, mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) != 0xFFFF)
+			break;
+		if (big) {
+			/* Move character to low byte of each unit */
+			for (size_t k = 0; k < 4; k++)
+				x[k] = _mm_srli_epi32(x[k], 24);
+		}
+		__m128i lo = _mm_packs_epi32(x[0], x[1]);
+		__m128i hi = _mm_packs_epi32(x[2], x[3]);
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_packus_epi16(lo, hi));
+		i += 16;
+	}
+#endif
+
+	while (i < end) {
+		const unsigned char *p = src + 4 * i;
+		unsigned char c = big ? p[3] : p[0];
+		unsigned char z = big ? (p[0] | p[1] | p[2]) : (p[1] | p[2] | p[3]);
+		if (z != 0 || c >= limit)
+			break;
+		dest[i++] = c;
+	}
+	*produced = i;
+	return 4 * i;
+}
+
+
+/*
+ * Swap bytes of UTF-16 characters.  Surrogates are left for the decoder
+ * which checks that they come in pairs.
+ */
+static size_t swap16(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced, int big)
+{
+	size_t end = n < cap ? n / 2 : cap / 2;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i himask = _mm_set1_epi16((short) 0xF800);
+	const __m128i surrogate = _mm_set1_epi16((short) 0xD800);
+	while (i + 8 <= end) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+		__m128i y = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+
+		/* Stop at surrogates of source byte order */
+		__m128i t = _mm_and_si128(big ? y : x, himask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(t, surrogate)) != 0)
+			break;
+		_mm_storeu_si128((__m128i*) (dest + 2 * i), y);
+		i += 8;
+	}
+#endif
+
+	while (i < end) {
+		unsigned char hi = src[2 * i + (big ? 0 : 1)];
+		if ((hi & 0xF8) == 0xD8)
+			break;
+		dest[2 * i] = src[2 * i + 1];
+		dest[2 * i + 1] = src[2 * i];
+		i++;
+	}
+	*produced = 2 * i;
+	return 2 * i;
+}
+
+
+/* Copy bytes which mean the same in both character sets */
+static size_t run_copy(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	return copy_bytes(src, n, dest, cap, produced, tp->limit);
+}
+
+
+/* Widen bytes to UTF-16 or UTF-32 */
+static size_t run_widen(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	if (tp->unit == 2)
+		return widen16(src, n, dest, cap, produced, tp->big, tp->limit);
+	return widen32(src, n, dest, cap, produced, tp->big, tp->limit);
+}
+
+
+/* Narrow UTF-16 or UTF-32 to bytes */
+static size_t run_narrow(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	if (tp->unit == 2)
+		return narrow16(src, n, dest, cap, produced, tp->big, tp->limit);
+	return narrow32(src, n, dest, cap, produced, tp->big, tp->limit);
+}
+
+
+/* Swap bytes of UTF-16 */
+static size_t run_swap16(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	return swap16(src, n, dest, cap, produced, tp->big);
+}
+
+
+/* Convert ASCII characters to code units of SIZE bytes */
+#if defined(UTF8_SSSE3)
+static size_t widen_ascii(
+	const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced,
+	size_t size, int big)
+{
+	if (size == 1)
+		return copy_bytes(src, n, dest, cap, produced, 0x80);
+	if (size == 2)
+		return widen16(src, n, dest, cap, produced, big, 0x80);
+	return widen32(src, n, dest, cap, produced, big, 0x80);
+}
+#endif
+
+
+/*
+ * Decode UTF-8 16 bytes at a time to ISO 8859-1, UTF-16 or UTF-32.  Each
+ * block may contain ASCII characters and two-byte sequences which are
+ * complete within the block.  Other blocks are left for the decoder which
+ * also reports errors.
+ */
+#if defined(UTF8_SSSE3)
+__attribute__ ((target ("ssse3,popcnt")))
+static size_t run_utf8_ssse3(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const size_t size = tp->unit;
+	const int big = tp->big;
+	size_t i = 0;
+	size_t o = 0;
+	size_t m;
+
+	/* ISO 8859-1 only takes two-byte sequences up to U+00FF */
+	const __m128i lead_end = _mm_set1_epi8((char) (size == 1 ? 0xC4 : 0xE0));
+
+	while (i + 16 <= n && o + 16 * size <= cap) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		int high = _mm_movemask_epi8(x);
+		if (high == 0) {
+			/* Widen run of ASCII characters */
+			i += widen_ascii(src + i, n - i, dest + o, cap - o, &m, size, big);
+			o += m;
+			continue;
+		}
+
+		/* Bytes 0x80-0xBF are continuation bytes and 0xC2-0xDF leads */
+		__m128i cont = _mm_cmplt_epi8(x, _mm_set1_epi8((char) 0xC0));
+		__m128i lead = _mm_and_si128(
+			_mm_cmpgt_epi8(x, _mm_set1_epi8((char) 0xC1)),
+			_mm_cmplt_epi8(x, lead_end));
+		int c = _mm_movemask_epi8(cont);
+		int l = _mm_movemask_epi8(lead);
+
+		/* Each lead is followed by exactly one continuation byte */
+		if ((c | l) != high || (l << 1) != c)
+			break;
+
+		/* Combine lead with the following byte in 16-bit lanes */
+		__m128i next = _mm_srli_si128(x, 1);
+		__m128i half[2];
+		half[0] = _mm_unpacklo_epi8(x, zero);
+		half[1] = _mm_unpackhi_epi8(x, zero);
+		__m128i nw[2];
+		nw[0] = _mm_unpacklo_epi8(next, zero);
+		nw[1] = _mm_unpackhi_epi8(next, zero);
+		__m128i lw[2];
+		lw[0] = _mm_unpacklo_epi8(lead, lead);
+		lw[1] = _mm_unpackhi_epi8(lead, lead);
+
+		for (size_t k = 0; k < 2; k++) {
+			__m128i two = _mm_or_si128(
+				_mm_slli_epi16(_mm_and_si128(half[k], _mm_set1_epi16(0x1F)), 6),
+				_mm_and_si128(nw[k], _mm_set1_epi16(0x3F)));
+			__m128i v = _mm_or_si128(
+				_mm_and_si128(lw[k], two), _mm_andnot_si128(lw[k], half[k]));
+
+			/* Drop lanes of continuation bytes with byte shuffle */
+			unsigned mask = ((unsigned) c >> (8 * k)) & 0xFF;
+			__m128i idx = _mm_loadl_epi64((const __m128i*) compact_lanes[mask]);
+			idx = _mm_unpacklo_epi8(idx, idx);
+			idx = _mm_add_epi8(
+				_mm_add_epi8(idx, idx), _mm_set1_epi16(0x0100));
+			v = _mm_shuffle_epi8(v, idx);
+			size_t count = 8 - (size_t) __builtin_popcount(mask);
+
+			/* Store characters in byte order of target */
+			if (big) {
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			}
+			if (size == 1) {
+				_mm_storel_epi64((__m128i*) (dest + o), _mm_packus_epi16(v, v));
+			} else if (size == 2) {
+				_mm_storeu_si128((__m128i*) (dest + o), v);
+			} else {
+				__m128i lo = big
+					? _mm_unpacklo_epi16(zero, v)
+					: _mm_unpacklo_epi16(v, zero);
+				__m128i hi = big
+					? _mm_unpackhi_epi16(zero, v)
+					: _mm_unpackhi_epi16(v, zero);
+				_mm_storeu_si128((__m128i*) (dest + o), lo);
+				_mm_storeu_si128((__m128i*) (dest + o + 16), hi);
+			}
+			o += count * size;
+		}
+		i += 16;
+	}
+
+	/* Widen remaining ASCII characters */
+	i += widen_ascii(src + i, n - i, dest + o, cap - o, &m, size, big);
+	*produced = o + m;
+	return i;
+}
+#endif
+
+
+/*
+ * Encode ISO 8859-1 to UTF-8 16 bytes at a time.  Characters from U+0080
+ * to U+00FF take two bytes which are formed in 16-bit lanes, and the second
+ * byte of ASCII characters is dropped with byte shuffle.
+ */
+#if defined(UTF8_SSSE3)
+__attribute__ ((target ("ssse3,popcnt")))
+static size_t run_latin1_ssse3(
+	const struct transcoder *tp, const unsigned char *src, size_t n,
+	unsigned char *dest, size_t cap, size_t *produced)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	size_t o = 0;
+	size_t m;
+
+	(void) tp;
+	while (i + 16 <= n && o + 32 <= cap) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		int high = _mm_movemask_epi8(x);
+		if (high == 0) {
+			/* Copy run of ASCII characters */
+			i += copy_bytes(src + i, n - i, dest + o, cap - o, &m, 0x80);
+			o += m;
+			continue;
+		}
+
+		for (size_t k = 0; k < 2; k++) {
+			__m128i b = k
+				? _mm_unpackhi_epi8(x, zero)
+				: _mm_unpacklo_epi8(x, zero);
+
+			/* Lead byte 0xC0 | b >> 6 followed by 0x80 | (b & 0x3F) */
+			__m128i lead = _mm_or_si128(
+				_mm_srli_epi16(b, 6), _mm_set1_epi16(0xC0));
+			__m128i cont = _mm_or_si128(
+				_mm_and_si128(b, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+			__m128i two = _mm_or_si128(lead, _mm_slli_epi16(cont, 8));
+			__m128i wide = _mm_cmpgt_epi16(b, _mm_set1_epi16(0x7F));
+			__m128i v = _mm_or_si128(
+				_mm_and_si128(wide, two), _mm_andnot_si128(wide, b));
+
+			/* Keep second byte of two-byte sequences only */
+			unsigned mask = ((unsigned) high >> (8 * k)) & 0xFF;
+			v = _mm_shuffle_epi8(
+				v, _mm_loadu_si128((const __m128i*) expand_lanes[mask]));
+			_mm_storeu_si128((__m128i*) (dest + o), v);
+			o += 8 + (size_t) __builtin_popcount(mask);
+		}
+		i += 16;
+	}
+
+	/* Copy remaining ASCII characters */
+	i += copy_bytes(src + i, n - i, dest + o, cap - o, &m, 0x80);
+	*produced = o + m;
+	return i;
+}
+#endif
+
+
+/* Decode single-byte character set */
+static int decode_table(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) n;
+	uint32_t v = tp->from_table->decode[p[0]];
+	if (v == CHARSET_UNMAPPED)
+		return -1;
+	*cp = v;
+	return 1;
+}
+
+
+/* Encode single-byte character set */
+static size_t encode_table(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	const struct charset_table *t = tp->to_table;
+	if (cp > 0xFFFF)
+		return ENCODE_ERROR;
+
+	/* Character is mapped if the byte found decodes back to it */
+	unsigned char b = t->encode[t->page[cp >> 8]][cp & 0xFF];
+	if (t->decode[b] != cp)
+		return ENCODE_ERROR;
+	if (n < 1)
+		return 0;
+	p[0] = b;
+	return 1;
+}
+
+
+/* Decode UTF-8 rejecting overlong forms, surrogates and values > U+10FFFF */
+static int decode_utf8(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) tp;
+	unsigned char c = p[0];
+	size_t len;
+	uint32_t v;
+	unsigned char lo = 0x80;
+	unsigned char hi = 0xBF;
+
+	if (c < 0x80) {
+		*cp = c;
+		return 1;
+	} else if (c < 0xC2) {
+		/* Continuation byte or overlong two-byte sequence */
+		return -1;
+	} else if (c < 0xE0) {
+		len = 2;
+		v = c & 0x1F;
+	} else if (c < 0xF0) {
+		len = 3;
+		v = c & 0x0F;
+		if (c == 0xE0)
+			lo = 0xA0;
+		else if (c == 0xED)
+			hi = 0x9F;
+	} else if (c < 0xF5) {
+		len = 4;
+		v = c & 0x07;
+		if (c == 0xF0)
+			lo = 0x90;
+		else if (c == 0xF4)
+			hi = 0x8F;
+	} else {
+		return -1;
+	}
+
+	/* Validate continuation bytes available so far */
+	size_t avail = n < len ? n : len;
+	for (size_t i = 1; i < avail; i++) {
+		c = p[i];
+		if (i == 1 ? (c < lo || c > hi) : (c < 0x80 || c > 0xBF))
+			return -1;
+		v = (v << 6) | (c & 0x3F);
+	}
+	if (n < len)
+		return 0;
+
+	*cp = v;
+	return (int) len;
+}
+
+
+/* Decode little-endian UTF-16 code unit */
+static uint32_t get16le(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8);
+}
+
+
+/* Decode big-endian UTF-16 code unit */
+static uint32_t get16be(const unsigned char *p)
+{
+	return ((uint32_t) p[0] << 8) | (uint32_t) p[1];
+}
+
+
+/* Combine surrogate pairs of UTF-16 */
+static int decode_utf16(
+	const unsigned char *p, size_t n, uint32_t *cp,
+	uint32_t (*get)(const unsigned char*))
+{
+	if (n < 2)
+		return 0;
+
+	uint32_t u = get(p);
+	if (u < 0xD800 || u > 0xDFFF) {
+		*cp = u;
+		return 2;
+	}
+
+	/* Low surrogate without high surrogate */
+	if (u >= 0xDC00)
+		return -1;
+
+	if (n < 4)
+		return 0;
+
+	/* High surrogate must be followed by low surrogate */
+	uint32_t u2 = get(p + 2);
+	if (u2 < 0xDC00 || u2 > 0xDFFF)
+		return -1;
+
+	*cp = 0x10000 + ((u - 0xD800) << 10) + (u2 - 0xDC00);
+	return 4;
+}
+
+
+/* Decode UTF-16LE */
+static int decode_utf16le(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) tp;
+	return decode_utf16(p, n, cp, get16le);
+}
+
+
+/* Decode UTF-16BE */
+static int decode_utf16be(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) tp;
+	return decode_utf16(p, n, cp, get16be);
+}
+
+
+/* Accept valid Unicode scalar value */
+static int check_utf32(uint32_t v, uint32_t *cp)
+{
+	if (v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF))
+		return -1;
+	*cp = v;
+	return 4;
+}
+
+
+/* Decode UTF-32LE */
+static int decode_utf32le(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) tp;
+	if (n < 4)
+		return 0;
+	return check_utf32(
+		(uint32_t) p[0] | ((uint32_t) p[1] << 8)
+		| ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24), cp);
+}
+
+
+/* Decode UTF-32BE */
+static int decode_utf32be(
+	const struct transcoder *tp, const unsigned char *p, size_t n,
+	uint32_t *cp)
+{
+	(void) tp;
+	if (n < 4)
+		return 0;
+	return check_utf32(
+		((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+		| ((uint32_t) p[2] << 8) | (uint32_t) p[3], cp);
+}
+
+
+/* Encode UTF-8 */
+static size_t encode_utf8(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	(void) tp;
+	if (cp < 0x80) {
+		if (n < 1)
+			return 0;
+		p[0] = (unsigned char) cp;
+		return 1;
+	} else if (cp < 0x800) {
+		if (n < 2)
+			return 0;
+		p[0] = (unsigned char) (0xC0 | (cp >> 6));
+		p[1] = (unsigned char) (0x80 | (cp & 0x3F));
+		return 2;
+	} else if (cp < 0x10000) {
+		if (n < 3)
+			return 0;
+		p[0] = (unsigned char) (0xE0 | (cp >> 12));
+		p[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+		p[2] = (unsigned char) (0x80 | (cp & 0x3F));
+		return 3;
+	} else {
+		if (n < 4)
+			return 0;
+		p[0] = (unsigned char) (0xF0 | (cp >> 18));
+		p[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+		p[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+		p[3] = (unsigned char) (0x80 | (cp & 0x3F));
+		return 4;
+	}
+}
+
+
+/* Store little-endian UTF-16 code unit */
+static void put16le(unsigned char *p, uint32_t u)
+{
+	p[0] = (unsigned char) (u & 0xFF);
+	p[1] = (unsigned char) (u >> 8);
+}
+
+
+/* Store big-endian UTF-16 code unit */
+static void put16be(unsigned char *p, uint32_t u)
+{
+	p[0] = (unsigned char) (u >> 8);
+	p[1] = (unsigned char) (u & 0xFF);
+}
+
+
+/* Encode UTF-16 with surrogate pairs */
+static size_t encode_utf16(
+	uint32_t cp, unsigned char *p, size_t n,
+	void (*put)(unsigned char*, uint32_t))
+{
+	if (cp < 0x10000) {
+		if (n < 2)
+			return 0;
+		put(p, cp);
+		return 2;
+	}
+	if (n < 4)
+		return 0;
+	cp -= 0x10000;
+	put(p, 0xD800 + (cp >> 10));
+	put(p + 2, 0xDC00 + (cp & 0x3FF));
+	return 4;
+}
+
+
+/* Encode UTF-16LE */
+static size_t encode_utf16le(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	(void) tp;
+	return encode_utf16(cp, p, n, put16le);
+}
+
+
+/* Encode UTF-16BE */
+static size_t encode_utf16be(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	(void) tp;
+	return encode_utf16(cp, p, n, put16be);
+}
+
+
+/* Encode UTF-32LE */
+static size_t encode_utf32le(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	(void) tp;
+	if (n < 4)
+		return 0;
+	p[0] = (unsigned char) (cp & 0xFF);
+	p[1] = (unsigned char) ((cp >> 8) & 0xFF);
+	p[2] = (unsigned char) ((cp >> 16) & 0xFF);
+	p[3] = (unsigned char) (cp >> 24);
+	return 4;
+}
+
+
+/* Encode UTF-32BE */
+static size_t encode_utf32be(
+	const struct transcoder *tp, uint32_t cp, unsigned char *p, size_t n)
+{
+	(void) tp;
+	if (n < 4)
+		return 0;
+	p[0] = (unsigned char) (cp >> 24);
+	p[1] = (unsigned char) ((cp >> 16) & 0xFF);
+	p[2] = (unsigned char) ((cp >> 8) & 0xFF);
+	p[3] = (unsigned char) (cp & 0xFF);
+	return 4;
+}
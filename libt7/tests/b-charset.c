@@ -0,0 +1,741 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/charset.h"
+#include "t7/terminate.h"
+#include <time.h>
+
+
+/* Size of text and number of passes over it */
+#define SIZE (1024 * 1024)
+#define ROUNDS 1000
+
+/* Number of passes over character set names */
+#define NAME_ROUNDS 1000000
+
+
+/* Benchmark functions */
+static void bench_validate(const char *name, const char *text);
+static void bench_count(const char *name, const char *text);
+static void bench_parse(
+	const char *name, charset_t (*parse)(const char *p));
+static charset_t legacy_parse_charset(const char *p);
+static double now(void);
+
+/* Prevent compiler from optimizing loops away */
+static volatile size_t sink;
+
+/* Names as they appear in HTTP headers and file metadata */
+static const char *names[] = {
+	"UTF-8",
+	"utf-8",
+	"ISO-8859-1",
+	"iso-8859-1",
+	"utf-16le",
+	"UTF-16BE",
+	"Latin1",
+	"ascii",
+	"UTF-32",
+	" utf8 "
+};
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+/* Text to process */
+static char ascii[SIZE];
+static char mixed[SIZE];
+
+
+int main(void)
+{
+	/* Plain ASCII text */
+	for (size_t i = 0; i < SIZE; i++) {
+		ascii[i] = (char) ('a' + i % 26);
+	}
+
+	/* Text with mostly two and three-byte characters */
+	static const char pattern[] = "a\xC3\xA4\xE2\x82\xAC\xD0\xB6";
+	for (size_t i = 0; i < SIZE; i++) {
+		mixed[i] = pattern[i % (sizeof(pattern) - 1)];
+	}
+
+	bench_validate("ascii", ascii);
+	bench_validate("mixed", mixed);
+	bench_count("ascii", ascii);
+	bench_count("mixed", mixed);
+
+	/* Both parsers agree on names known to the old one */
+	for (size_t i = 0; i < NUM_NAMES; i++) {
+		if (parse_charset(names[i]) != legacy_parse_charset(names[i]))
+			terminate("Parsers disagree");
+	}
+	bench_parse("legacy", legacy_parse_charset);
+	bench_parse("alias", parse_charset);
+	return 0;
+}
+
+
+/* Validate text repeatedly */
+static void bench_validate(const char *name, const char *text)
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		x += (size_t) validate_utf8(text, SIZE - 8);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("validate_utf8 %s: %.2f GB/s\n",
+		name, (double) SIZE * ROUNDS / elapsed * 1e-9);
+}
+
+
+/* Count characters repeatedly */
+static void bench_count(const char *name, const char *text)
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		x += count_utf8_codepoints(text, SIZE - 8);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("count_utf8_codepoints %s: %.2f GB/s\n",
+		name, (double) SIZE * ROUNDS / elapsed * 1e-9);
+}
+
+
+/* Parse character set names repeatedly */
+static void bench_parse(
+	const char *name, charset_t (*parse)(const char *p))
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < NAME_ROUNDS; i++) {
+		x += (size_t) parse(names[i % NUM_NAMES]);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("parse_charset %s: %.1f ns/name\n",
+		name, elapsed / NAME_ROUNDS * 1e9);
+}
+
+
+/* Parser modes for legacy_parse_charset() */
+enum parse_mode {
+	PARSE_INIT = 0,
+	PARSE_A = 1,
+	PARSE_AS = 2,
+	PARSE_ASC = 3,
+	PARSE_ASCI = 4,
+	PARSE_I = 5,
+	PARSE_IS = 6,
+	PARSE_ISO = 7,
+	PARSE_ISO8 = 8,
+	PARSE_ISO88 = 9,
+	PARSE_ISO885 = 10,
+	PARSE_ISO8859 = 11,
+	PARSE_ISO8859DASH = 12,
+	PARSE_L = 14,
+	PARSE_LA = 15,
+	PARSE_LAT = 16,
+	PARSE_LATI = 17,
+	PARSE_LATIN = 18,
+	PARSE_U = 19,
+	PARSE_UT = 20,
+	PARSE_UTF = 21,
+	PARSE_UTF1 = 22,
+	PARSE_UTF16 = 23,
+	PARSE_UTF16B = 24,
+	PARSE_UTF16L = 25,
+	PARSE_UTF3 = 26,
+	PARSE_UTF32 = 27,
+	PARSE_UTF32L = 28,
+	PARSE_UTF32B = 29,
+	PARSE_EXIT = 30,
+	PARSE_ERROR = 31
+};
+typedef enum parse_mode parse_mode_t;
+
+
+/* State machine which parse_charset() used before the alias table */
+static charset_t legacy_parse_charset(const char *p)
+{
+	unsigned i = 0;
+	parse_mode_t mode = PARSE_INIT;
+	int done = 0;
+	charset_t result = INVALID_CHARSET;
+
+	while (!done) {
+
+		/* Get next character from string */
+		char c = p[i];
+
+		/* Parse character according to current mode */
+		switch (mode) {
+		case PARSE_INIT:
+			/* Initial mode */
+			switch (c) {
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				/* Ignore void space */
+				i++;
+				break;
+
+			case 'a':
+			case 'A':
+				i++;
+				mode = PARSE_A;
+				break;
+
+			case 'i':
+			case 'I':
+				i++;
+				mode = PARSE_I;
+				break;
+
+			case 'l':
+			case 'L':
+				i++;
+				mode = PARSE_L;
+				break;
+
+			case 'u':
+			case 'U':
+				i++;
+				mode = PARSE_U;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_A:
+			/* After A */
+			switch (c) {
+			case 's':
+			case 'S':
+				i++;
+				mode = PARSE_AS;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_AS:
+			/* After AS */
+			switch (c) {
+			case 'c':
+			case 'C':
+				i++;
+				mode = PARSE_ASC;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ASC:
+			/* After ASC */
+			switch (c) {
+			case 'i':
+			case 'I':
+				i++;
+				mode = PARSE_ASCI;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ASCI:
+			/* After ASCI */
+			switch (c) {
+			case 'i':
+			case 'I':
+				i++;
+				mode = PARSE_EXIT;
+				result = ASCII;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_I:
+			/* After I */
+			switch (c) {
+			case 's':
+			case 'S':
+				i++;
+				mode = PARSE_IS;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_IS:
+			/* After IS */
+			switch (c) {
+			case 'o':
+			case 'O':
+				i++;
+				mode = PARSE_ISO;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO:
+			/* After ISO */
+			switch (c) {
+			case ' ':
+			case '-':
+				/* Ignore space or dash */
+				i++;
+				break;
+
+			case '8':
+				i++;
+				mode = PARSE_ISO8;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO8:
+			/* After ISO8 */
+			switch (c) {
+			case '8':
+				i++;
+				mode = PARSE_ISO88;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO88:
+			/* After ISO88 */
+			switch (c) {
+			case '5':
+				i++;
+				mode = PARSE_ISO885;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO885:
+			/* After ISO885 */
+			switch (c) {
+			case '9':
+				i++;
+				mode = PARSE_ISO8859;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO8859:
+			/* After ISO8859 */
+			switch (c) {
+			case '-':
+				i++;
+				mode = PARSE_ISO8859DASH;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ISO8859DASH:
+			/* After ISO8859 */
+			switch (c) {
+			case '1':
+				i++;
+				mode = PARSE_EXIT;
+				result = ISO8859_1;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_L:
+			/* After L */
+			switch (c) {
+			case 'a':
+			case 'A':
+				i++;
+				mode = PARSE_LA;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_LA:
+			/* After LA */
+			switch (c) {
+			case 't':
+			case 'T':
+				i++;
+				mode = PARSE_LAT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_LAT:
+			/* After LAT */
+			switch (c) {
+			case 'i':
+			case 'I':
+				i++;
+				mode = PARSE_LATI;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_LATI:
+			/* After LATI */
+			switch (c) {
+			case 'n':
+			case 'N':
+				i++;
+				mode = PARSE_LATIN;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_LATIN:
+			/* After LA */
+			switch (c) {
+			case ' ':
+			case '-':
+				/* Ignore space and dash */
+				i++;
+				break;
+
+			case '1':
+				i++;
+				mode = PARSE_EXIT;
+				result = ISO8859_1;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_U:
+			/* After U */
+			switch (c) {
+			case 't':
+			case 'T':
+				i++;
+				mode = PARSE_UT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UT:
+			/* After UT */
+			switch (c) {
+			case 'f':
+			case 'F':
+				i++;
+				mode = PARSE_UTF;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF:
+			/* After UTF */
+			switch (c) {
+			case ' ':
+			case '-':
+				/* Ignore space or dash */
+				i++;
+				break;
+
+			case '1':
+				i++;
+				mode = PARSE_UTF1;
+				break;
+
+			case '3':
+				i++;
+				mode = PARSE_UTF3;
+				break;
+
+			case '8':
+				i++;
+				mode = PARSE_EXIT;
+				result = UTF8;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF1:
+			/* After UTF1 */
+			switch (c) {
+			case '6':
+				i++;
+				mode = PARSE_UTF16;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF16:
+			/* After UTF16 */
+			switch (c) {
+			case ' ':
+				/* Ignore space */
+				i++;
+				break;
+
+			case 'b':
+			case 'B':
+				i++;
+				mode = PARSE_UTF16B;
+				break;
+
+			case 'l':
+			case 'L':
+				i++;
+				mode = PARSE_UTF16L;
+				break;
+
+			default:
+				/* Other character */
+				result = UTF16;
+				mode = PARSE_EXIT;
+			}
+			break;
+
+		case PARSE_UTF16B:
+			/* After UTF16B */
+			switch (c) {
+			case 'e':
+			case 'E':
+				i++;
+				result = UTF16BE;
+				mode = PARSE_EXIT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF16L:
+			/* After UTF16L */
+			switch (c) {
+			case 'e':
+			case 'E':
+				i++;
+				result = UTF16LE;
+				mode = PARSE_EXIT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF3:
+			/* After UTF3 */
+			switch (c) {
+			case '2':
+				i++;
+				mode = PARSE_UTF32;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF32:
+			/* After UTF32 */
+			switch (c) {
+			case ' ':
+				/* Ignore space */
+				i++;
+				break;
+
+			case 'b':
+			case 'B':
+				i++;
+				mode = PARSE_UTF32B;
+				break;
+
+			case 'l':
+			case 'L':
+				i++;
+				mode = PARSE_UTF32L;
+				break;
+
+			default:
+				/* Other character */
+				result = UTF32;
+				mode = PARSE_EXIT;
+			}
+			break;
+
+		case PARSE_UTF32B:
+			/* After UTF32B */
+			switch (c) {
+			case 'e':
+			case 'E':
+				i++;
+				result = UTF32BE;
+				mode = PARSE_EXIT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_UTF32L:
+			/* After UTF32L */
+			switch (c) {
+			case 'e':
+			case 'E':
+				i++;
+				result = UTF32LE;
+				mode = PARSE_EXIT;
+				break;
+
+			default:
+				/* Invalid character */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_EXIT:
+			/* End of string */
+			switch (c) {
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				/* Ignore void space after character set */
+				i++;
+				break;
+
+			case '\0':
+				/* End of string => character set successfully parsed */
+				done = 1;
+				break;
+
+			default:
+				/* Illegal characters after character set */
+				mode = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_ERROR:
+			/* Not a built-in character set */
+			done = 1;
+			result = INVALID_CHARSET;
+			break;
+
+		default:
+			/* Invalid mode */
+			terminate("Invalid mode");
+		}
+
+	}
+	return result;
+}
+
+
+/* Get current time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
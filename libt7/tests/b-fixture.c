@@ -0,0 +1,79 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/fixture.h"
+#include "t7/memory.h"
+#include <time.h>
+
+
+/* Number of iterations in each benchmark */
+#define ROUNDS 10000000
+
+
+/* Benchmark functions */
+static void bench_get_fixture(void);
+static void bench_allocate(void);
+static double now(void);
+
+/* Prevent compiler from optimizing loops away */
+static volatile size_t sink;
+
+
+int main(void)
+{
+	bench_get_fixture();
+	bench_allocate();
+	return 0;
+}
+
+
+/* Retrieve current fixture */
+static void bench_get_fixture(void)
+{
+	size_t x = 0;
+
+	/* Warm up */
+	x ^= (size_t) get_fixture();
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		x ^= (size_t) get_fixture() + i;
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("get_fixture: %.2f ns/call\n", elapsed * 1e9 / ROUNDS);
+}
+
+
+/* Allocate and release small blocks through current fixture */
+static void bench_allocate(void)
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		void *p = allocate_memory(16);
+		x ^= (size_t) p;
+		free_memory(p);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("allocate_memory+free_memory: %.2f ns/pair\n",
+		elapsed * 1e9 / ROUNDS);
+}
+
+
+/* Get current time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
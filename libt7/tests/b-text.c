@@ -0,0 +1,110 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/text.h"
+#include "t7/memory.h"
+#include "t7/terminate.h"
+#include <time.h>
+
+
+/* Size of text and number of texts built */
+#define SIZE (4 * 1024 * 1024)
+#define ROUNDS 20
+
+
+/* Benchmark functions */
+static void bench_resize(size_t fragment);
+static void bench_builder(size_t fragment);
+static double now(void);
+
+/* Prevent compiler from optimizing loops away */
+static volatile size_t sink;
+
+/* Fragment to append */
+static char text[256];
+
+
+int main(void)
+{
+	for (size_t i = 0; i < sizeof(text); i++) {
+		text[i] = (char) ('a' + i % 26);
+	}
+
+	bench_resize(16);
+	bench_builder(16);
+	bench_resize(200);
+	bench_builder(200);
+	return 0;
+}
+
+
+/* Grow one buffer to fit each fragment */
+static void bench_resize(size_t fragment)
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		char *p = NULL;
+		size_t n = 0;
+		while (n < SIZE) {
+			char *q = resize_memory(p, n + fragment);
+			if (!q)
+				terminate("Out of memory");
+			p = q;
+			memcpy(p + n, text, fragment);
+			n += fragment;
+		}
+		x += (size_t) p[n - 1];
+		free_memory(p);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("resize_memory %zu-byte fragments: %.2f GB/s\n",
+		fragment, (double) SIZE * ROUNDS / elapsed * 1e-9);
+}
+
+
+/* Append fragments to text builder */
+static void bench_builder(size_t fragment)
+{
+	size_t x = 0;
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		text_builder_t *bp = new_text_builder(NULL, UTF8);
+		if (!bp)
+			terminate("Out of memory");
+		size_t n = 0;
+		while (n < SIZE) {
+			if (!append_text(bp, make_text_view(text, fragment, UTF8)))
+				terminate("Out of memory");
+			n += fragment;
+		}
+		text_view_t v;
+		if (!get_text(bp, &v))
+			terminate("Cannot get text");
+		x += v.len;
+		delete_text_builder(bp);
+	}
+	double elapsed = now() - start;
+	sink = x;
+
+	printf("text builder %zu-byte fragments: %.2f GB/s\n",
+		fragment, (double) SIZE * ROUNDS / elapsed * 1e-9);
+}
+
+
+/* Get current time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,119 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/transcoder.h"
+#include "t7/terminate.h"
+#include "t7/memory.h"
+#include <time.h>
+
+
+/* Size of text and number of passes over it */
+#define SIZE (1024 * 1024)
+#define ROUNDS 200
+
+
+/* Benchmark functions */
+static void bench(
+	const char *name, charset_t from, charset_t to,
+	const char *text, size_t n);
+static size_t fill(const char *pattern, char *text);
+static double now(void);
+
+/* Text to process */
+static char ascii[SIZE];
+static char latin[SIZE];
+static char mixed[SIZE];
+static char latin1[SIZE];
+
+/* Output buffer */
+static char out[4 * SIZE];
+
+
+int main(void)
+{
+	/* Plain ASCII text */
+	size_t n_ascii = fill("abcdefghijklmnopqrstuvwxyz", ascii);
+
+	/* European text with occasional two-byte characters */
+	size_t n_latin = fill("K\xC3\xA4yt\xC3\xA4 \xD0\xB6 kielt\xC3\xA4 ", latin);
+
+	/* Text with mostly two and three-byte characters */
+	size_t n_mixed = fill("a\xC3\xA4\xE2\x82\xAC\xD0\xB6", mixed);
+
+	/* European text in ISO 8859-1 */
+	size_t n_latin1 = fill("K\xE4yt\xE4 kielt\xE4 ja \xF6ljy\xE4. ", latin1);
+
+	bench("utf8 -> utf16le ascii", UTF8, UTF16LE, ascii, n_ascii);
+	bench("utf8 -> utf16le latin", UTF8, UTF16LE, latin, n_latin);
+	bench("utf8 -> utf16le mixed", UTF8, UTF16LE, mixed, n_mixed);
+	bench("utf8 -> utf32be latin", UTF8, UTF32BE, latin, n_latin);
+
+	/* ISO 8859-1 feed */
+	bench("latin1 -> utf8 latin", ISO8859_1, UTF8, latin1, n_latin1);
+	bench("latin1 -> utf16le latin", ISO8859_1, UTF16LE, latin1, n_latin1);
+	size_t n;
+	char *q = transcode_all(ISO8859_1, UTF8, latin1, n_latin1, &n);
+	if (!q)
+		terminate("Cannot convert text");
+	bench("utf8 -> latin1 latin", UTF8, ISO8859_1, q, n);
+	free_memory(q);
+
+	/* Convert back from UTF-16 */
+	char *p = transcode_all(UTF8, UTF16LE, ascii, n_ascii, &n);
+	if (!p)
+		terminate("Cannot convert text");
+	bench("utf16le -> utf8 ascii", UTF16LE, UTF8, p, n);
+	bench("utf16le -> utf16be ascii", UTF16LE, UTF16BE, p, n);
+	free_memory(p);
+	return 0;
+}
+
+
+/* Convert text repeatedly */
+static void bench(
+	const char *name, charset_t from, charset_t to,
+	const char *text, size_t n)
+{
+	transcoder_t *tp = open_transcoder(from, to);
+	if (!tp)
+		terminate("Cannot open transcoder");
+
+	double start = now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		size_t k;
+		size_t m;
+		if (!transcode(tp, text, n, out, sizeof(out), &k, &m) || k != n)
+			terminate("Conversion failed");
+	}
+	double elapsed = now() - start;
+	close_transcoder(tp);
+
+	printf("%s: %.2f GB/s\n", name, (double) n * ROUNDS / elapsed * 1e-9);
+}
+
+
+/* Repeat pattern up to whole characters and return length of text */
+static size_t fill(const char *pattern, char *text)
+{
+	size_t len = strlen(pattern);
+	size_t n = 0;
+	while (n + len <= SIZE) {
+		memcpy(text + n, pattern, len);
+		n += len;
+	}
+	return n;
+}
+
+
+/* Get current time in seconds */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
@@ -12,10 +12,23 @@
 #include <assert.h>
 
 
+/* Local functions */
+static void test_validate (void);
+static void test_fuzz (void);
+static void test_aliases (void);
+static void test_tables (void);
+static void test_locale (void);
+static int reference_validate (const unsigned char *p, size_t n);
+static size_t reference_count (const unsigned char *p, size_t n);
+static unsigned random_number (void);
+
+
 int
 main (void)
 {
     charset_t t;
+    int kernels = 0;
+    int k;
 
     /* Empty string is not a valid character set */
     t = parse_charset ("");
@@ -102,6 +115,18 @@ main (void)
     t = parse_charset ("latin-1");
     assert (t == ISO8859_1);
 
+    /* IANA aliases are accepted */
+    test_aliases ();
+
+    /* Punctuation is ignored but other characters are not */
+    assert (parse_charset ("utf_8") == UTF8);
+    assert (parse_charset ("utf.8") == UTF8);
+    assert (parse_charset ("utf\x01" "8") == INVALID_CHARSET);
+    assert (parse_charset ("utf\xC3\xA4" "8") == INVALID_CHARSET);
+    assert (parse_charset ("utf-88") == INVALID_CHARSET);
+    assert (parse_charset ("iso-8859-1-utf-8") == INVALID_CHARSET);
+    assert (parse_charset ("us-ascii-us-ascii-us-ascii") == INVALID_CHARSET);
+
     /* UTF16 may only be mapped to UTF16LE or UTF16BE */
     t = resolve_charset (UTF16);
     assert (t == UTF16LE  ||  t == UTF16BE);
@@ -114,6 +139,453 @@ main (void)
     t = resolve_charset (WCHAR);
     assert (t == UTF16LE || t == UTF16BE || t == UTF32LE || t == UTF32BE);
 
+    /* Validate UTF-8 strings with every kernel the processor supports */
+    for (k = UTF8_SCALAR; k <= UTF8_AVX2; k++) {
+        if (force_utf8_kernel ((enum utf8_kernel) k)) {
+            test_validate ();
+            test_fuzz ();
+            kernels++;
+        }
+    }
+    assert (kernels >= 1);
+    assert (!force_utf8_kernel ((enum utf8_kernel) (UTF8_AVX2 + 1)));
+    assert (force_utf8_kernel (UTF8_AUTOMATIC));
+    test_validate ();
+
+    /* Single-byte character sets */
+    test_tables ();
+
+    /* Character sets of locale and file system */
+    test_locale ();
+
     return 0;
 }
 
+
+/* Parse every alias of built-in character sets */
+static void
+test_aliases (void)
+{
+    static const struct {
+        const char *name;
+        charset_t charset;
+    } names[] = {
+        { "UTF-8", UTF8 },
+        { "csUTF8", UTF8 },
+        { "ISO-8859-1", ISO8859_1 },
+        { "ISO_8859-1:1987", ISO8859_1 },
+        { "iso-ir-100", ISO8859_1 },
+        { "latin1", ISO8859_1 },
+        { "l1", ISO8859_1 },
+        { "IBM819", ISO8859_1 },
+        { "CP819", ISO8859_1 },
+        { "csISOLatin1", ISO8859_1 },
+        { "ASCII", ASCII },
+        { "US-ASCII", ASCII },
+        { "ANSI_X3.4-1968", ASCII },
+        { "ANSI_X3.4-1986", ASCII },
+        { "ISO646-US", ASCII },
+        { "ISO_646.irv:1991", ASCII },
+        { "iso-ir-6", ASCII },
+        { "us", ASCII },
+        { "IBM367", ASCII },
+        { "cp367", ASCII },
+        { "csASCII", ASCII },
+        { "UTF-16", UTF16 },
+        { "csUTF16", UTF16 },
+        { "UCS-2", UTF16 },
+        { "UTF-16LE", UTF16LE },
+        { "csUTF16LE", UTF16LE },
+        { "UCS-2LE", UTF16LE },
+        { "UTF-16BE", UTF16BE },
+        { "csUTF16BE", UTF16BE },
+        { "UCS-2BE", UTF16BE },
+        { "UTF-32", UTF32 },
+        { "csUTF32", UTF32 },
+        { "UCS-4", UTF32 },
+        { "UTF-32LE", UTF32LE },
+        { "csUTF32LE", UTF32LE },
+        { "UCS-4LE", UTF32LE },
+        { "UTF-32BE", UTF32BE },
+        { "csUTF32BE", UTF32BE },
+        { "UCS-4BE", UTF32BE },
+        { "wchar_t", WCHAR }
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof (names) / sizeof (names[0]); i++) {
+        assert (parse_charset (names[i].name) == names[i].charset);
+    }
+}
+
+
+/* Built-in and registered single-byte character sets */
+static void
+test_tables (void)
+{
+    const struct charset_table *tp;
+    uint32_t map[256];
+    charset_t t;
+    charset_t t2;
+    unsigned i;
+
+    /* ASCII maps to lower half only */
+    tp = get_charset_table (ASCII);
+    assert (tp != NULL);
+    assert (tp->decode['A'] == 'A');
+    assert (tp->decode[0x80] == CHARSET_UNMAPPED);
+    assert (tp->encode[tp->page[0]]['A'] == 'A');
+
+    /* ISO 8859-1 maps every byte */
+    tp = get_charset_table (ISO8859_1);
+    assert (tp != NULL);
+    assert (tp->decode[0xE4] == 0xE4);
+    assert (tp->encode[tp->page[0]][0xFF] == 0xFF);
+
+    /* Unicode character sets have no table */
+    assert (get_charset_table (UTF8) == NULL);
+    assert (get_charset_table (INVALID_CHARSET) == NULL);
+
+    /* Register Windows code page 1252 with a few of its characters */
+    for (i = 0; i < 256; i++) {
+        map[i] = i;
+    }
+    map[0x80] = 0x20AC;
+    map[0x8A] = 0x0160;
+    map[0x81] = CHARSET_UNMAPPED;
+    t = register_charset_table ("CP1252", map);
+    assert (t != INVALID_CHARSET);
+    assert (strcmp (nameof_charset (t), "cp1252") == 0);
+    assert (parse_charset ("cp1252") == t);
+    assert (parse_charset (" Cp1252\n") == t);
+    assert (resolve_charset (t) == t);
+    tp = get_charset_table (t);
+    assert (tp != NULL);
+    assert (tp->decode[0x80] == 0x20AC);
+    assert (tp->encode[tp->page[0x20]][0xAC] == 0x80);
+
+    /* Registering the same table again returns the same character set */
+    t2 = register_charset_table ("cp1252", map);
+    assert (t2 == t);
+
+    /* Name cannot be reused for a different table */
+    map[0x8A] = 0x0161;
+    t2 = register_charset_table ("cp1252", map);
+    assert (t2 == INVALID_CHARSET);
+
+    /* Built-in names are taken */
+    t2 = register_charset_table ("utf-8", map);
+    assert (t2 == INVALID_CHARSET);
+
+    /* Invalid names */
+    assert (register_charset_table ("", map) == INVALID_CHARSET);
+    assert (register_charset_table ("my charset", map) == INVALID_CHARSET);
+    assert (register_charset_table (
+        "abcdefghijklmnopqrstuvwxyz0123456789", map) == INVALID_CHARSET);
+
+    /* Two bytes cannot map to the same character */
+    map[0x8A] = 'A';
+    assert (register_charset_table ("dup", map) == INVALID_CHARSET);
+
+    /* Characters must come from Basic Multilingual Plane */
+    map[0x8A] = 0x1F600;
+    assert (register_charset_table ("emoji", map) == INVALID_CHARSET);
+    map[0x8A] = 0xD800;
+    assert (register_charset_table ("surrogate", map) == INVALID_CHARSET);
+
+    /* Table is limited to a few pages */
+    for (i = 0; i < 256; i++) {
+        map[i] = i * 0x100;
+    }
+    assert (register_charset_table ("sparse", map) == INVALID_CHARSET);
+    assert (parse_charset ("sparse") == INVALID_CHARSET);
+
+    /* Registry fills up */
+    for (i = 0; i < 256; i++) {
+        map[i] = i;
+    }
+    i = 1;
+    while (1) {
+        char name[16];
+        sprintf (name, "table-%u", i);
+        map[0x80] = 0x100 + i;
+        if (register_charset_table (name, map) == INVALID_CHARSET) {
+            break;
+        }
+        i++;
+    }
+    assert (i == T7_MAX_CHARSET_TABLES);
+    assert (parse_charset ("table-1") != INVALID_CHARSET);
+}
+
+
+/* Detect character set of locale from environment */
+static void
+test_locale (void)
+{
+#if !defined(_WIN32)
+    /* Program runs in the C locale so character set comes from environment */
+    unsetenv ("LC_CTYPE");
+    unsetenv ("LANG");
+    setenv ("LC_ALL", "fi_FI.ISO-8859-1@euro", 1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == ISO8859_1);
+#if !defined(__APPLE__)
+    assert (resolve_charset (FILESYSTEM_CHARSET) == ISO8859_1);
+#endif
+
+    /* Character sets are cached until refreshed */
+    setenv ("LC_ALL", "C.UTF-8", 1);
+    assert (resolve_charset (LOCALE_CHARSET) == ISO8859_1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == UTF8);
+    assert (resolve_charset (FILESYSTEM_CHARSET) == UTF8);
+
+    /* C locale uses ASCII but file names are assumed to be UTF-8 */
+    setenv ("LC_ALL", "C", 1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == ASCII);
+    assert (resolve_charset (FILESYSTEM_CHARSET) == UTF8);
+    unsetenv ("LC_ALL");
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == ASCII);
+
+    /* Empty variables are skipped */
+    setenv ("LC_ALL", "", 1);
+    setenv ("LANG", "en_US.utf8", 1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == UTF8);
+
+    /* Registered character set may be used in locale */
+    setenv ("LC_ALL", "fr_FR.CP1252", 1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == parse_charset ("cp1252"));
+    assert (resolve_charset (LOCALE_CHARSET) != INVALID_CHARSET);
+
+    /* Unsupported character set */
+    setenv ("LC_ALL", "ja_JP.EUC-JP", 1);
+    refresh_charsets ();
+    assert (resolve_charset (LOCALE_CHARSET) == INVALID_CHARSET);
+    assert (resolve_charset (FILESYSTEM_CHARSET) != INVALID_CHARSET);
+    unsetenv ("LC_ALL");
+    unsetenv ("LANG");
+    refresh_charsets ();
+#endif
+}
+
+
+/* Validate UTF-8 at every position of block */
+static void
+test_validate (void)
+{
+    static const char *good[] = {
+        "\xC3\xA4",
+        "\xE2\x82\xAC",
+        "\xF0\x9F\x98\x80",
+        "\xEF\xBF\xBF",
+        "\xF4\x8F\xBF\xBF",
+        "\xED\x9F\xBF",
+    };
+    static const char *bad[] = {
+        "\x80",
+        "\xBF",
+        "\xC0\x80",
+        "\xC1\xBF",
+        "\xE0\x9F\xBF",
+        "\xED\xA0\x80",
+        "\xF0\x8F\xBF\xBF",
+        "\xF4\x90\x80\x80",
+        "\xF5\x80\x80\x80",
+        "\xFF",
+        "\xC3",
+        "\xE2\x82",
+        "\xF0\x9F\x98",
+        "\xC3\xA4\xA4",
+        "\xE2\x41\xAC",
+    };
+    char buffer[300];
+    size_t len;
+    size_t pos;
+    size_t m;
+    size_t i;
+
+    /* Empty string is valid */
+    assert (validate_utf8 ("", 0));
+    assert (count_utf8_codepoints ("", 0) == 0);
+
+    /* Insert sequence at every position of ASCII and non-ASCII text */
+    for (pos = 0; pos < 140; pos++) {
+        for (i = 0; i < sizeof (good) / sizeof (good[0]); i++) {
+            len = strlen (good[i]);
+
+            /* ASCII around sequence */
+            memset (buffer, 'a', sizeof (buffer));
+            memcpy (buffer + pos, good[i], len);
+            assert (validate_utf8 (buffer, pos + len));
+            assert (validate_utf8 (buffer, 200));
+            assert (count_utf8_codepoints (buffer, 200) == 200 - len + 1);
+
+            /* Two-byte characters before sequence */
+            m = pos & ~(size_t) 1;
+            if (m > 8) {
+                m = 8;
+            }
+            memset (buffer, 'b', sizeof (buffer));
+            memcpy (buffer, "\xC3\xA4\xC3\xA4\xC3\xA4\xC3\xA4", m);
+            memcpy (buffer + pos, good[i], len);
+            assert (validate_utf8 (buffer, 200));
+        }
+        for (i = 0; i < sizeof (bad) / sizeof (bad[0]); i++) {
+            len = strlen (bad[i]);
+
+            /* Invalid sequence in the middle of text */
+            memset (buffer, 'a', sizeof (buffer));
+            memcpy (buffer + pos, bad[i], len);
+            assert (!validate_utf8 (buffer, 200));
+
+            /* Invalid sequence at end of text */
+            assert (!validate_utf8 (buffer, pos + len));
+        }
+    }
+}
+
+
+/* Compare against reference implementation with random input */
+static void
+test_fuzz (void)
+{
+    static const unsigned char bytes[] = {
+        0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2,
+        0xDF, 0xE0, 0xE1, 0xED, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5, 0xFF
+    };
+    unsigned char buffer[256];
+    size_t round;
+    size_t len;
+    size_t i;
+    int valid = 0;
+
+    for (round = 0; round < 20000; round++) {
+
+        /* Mostly valid text with occasional random bytes */
+        len = random_number () % sizeof (buffer);
+        i = 0;
+        while (i < len) {
+            unsigned r = random_number () % 100;
+            if (r < 60  ||  len - i < 4) {
+                buffer[i++] = (unsigned char) ('a' + r % 26);
+            } else if (r < 75) {
+                buffer[i++] = 0xC3;
+                buffer[i++] = 0xA4;
+            } else if (r < 85) {
+                buffer[i++] = 0xE2;
+                buffer[i++] = 0x82;
+                buffer[i++] = 0xAC;
+            } else if (r < 95) {
+                buffer[i++] = 0xF0;
+                buffer[i++] = 0x9F;
+                buffer[i++] = 0x98;
+                buffer[i++] = 0x80;
+            } else if (round % 2 == 0) {
+                buffer[i++] = bytes[random_number () % sizeof (bytes)];
+            } else {
+                buffer[i++] = 'z';
+            }
+        }
+
+        /* Vector and scalar implementation must agree */
+        assert (
+            validate_utf8 ((const char*) buffer, i)
+            == reference_validate (buffer, i));
+        if (reference_validate (buffer, i)) {
+            assert (
+                count_utf8_codepoints ((const char*) buffer, i)
+                == reference_count (buffer, i));
+            valid++;
+        }
+
+    }
+
+    /* Both valid and invalid inputs were tried */
+    assert (valid > 1000  &&  valid < 19000);
+}
+
+
+/* Decode UTF-8 character by character */
+static int
+reference_validate (const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    size_t len;
+    size_t j;
+    unsigned long cp;
+
+    while (i < n) {
+        if (p[i] < 0x80) {
+            i++;
+            continue;
+        } else if ((p[i] & 0xE0) == 0xC0) {
+            len = 2;
+            cp = p[i] & 0x1F;
+        } else if ((p[i] & 0xF0) == 0xE0) {
+            len = 3;
+            cp = p[i] & 0x0F;
+        } else if ((p[i] & 0xF8) == 0xF0) {
+            len = 4;
+            cp = p[i] & 0x07;
+        } else {
+            return 0;
+        }
+        if (n - i < len) {
+            return 0;
+        }
+        for (j = 1; j < len; j++) {
+            if ((p[i + j] & 0xC0) != 0x80) {
+                return 0;
+            }
+            cp = (cp << 6) | (p[i + j] & 0x3F);
+        }
+
+        /* Reject overlong forms, surrogates and too large values */
+        if ((len == 2  &&  cp < 0x80)  ||  (len == 3  &&  cp < 0x800)
+            ||  (len == 4  &&  cp < 0x10000)
+            ||  (cp >= 0xD800  &&  cp <= 0xDFFF)  ||  cp > 0x10FFFF) {
+            return 0;
+        }
+        i += len;
+    }
+    return 1;
+}
+
+
+/* Count characters one at a time */
+static size_t
+reference_count (const unsigned char *p, size_t n)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        if (p[i] < 0x80) {
+            i += 1;
+        } else if (p[i] < 0xE0) {
+            i += 2;
+        } else if (p[i] < 0xF0) {
+            i += 3;
+        } else {
+            i += 4;
+        }
+        count++;
+    }
+    return count;
+}
+
+
+/* Deterministic pseudo random numbers */
+static unsigned
+random_number (void)
+{
+    static unsigned long state = 12345;
+    state = state * 1103515245UL + 12345UL;
+    return (unsigned) ((state >> 16) & 0x7FFF);
+}
+
@@ -8,6 +8,7 @@
 #include "t7/types.h"
 #include "t7/exit-handler.h"
 #include "t7/terminate.h"
+#include "t7/thread.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -19,12 +20,60 @@ void exit2 (void);
 void exit3 (void);
 void exit4 (void);
 void exit5 (void);
+static void many (int i);
+static int register_many (void);
+static int register_thread (thread_t *tp);
+static void tier1 (void);
+static void tier2 (void);
+static void meet (void);
 
 
 /* Number of exit functions called */
 static int count = 0;
 
 
+/* Define eight exit functions many_I0 ... many_I7 */
+#define MANY(i) \
+    static void many_##i##0 (void) { many (i * 8 + 0); } \
+    static void many_##i##1 (void) { many (i * 8 + 1); } \
+    static void many_##i##2 (void) { many (i * 8 + 2); } \
+    static void many_##i##3 (void) { many (i * 8 + 3); } \
+    static void many_##i##4 (void) { many (i * 8 + 4); } \
+    static void many_##i##5 (void) { many (i * 8 + 5); } \
+    static void many_##i##6 (void) { many (i * 8 + 6); } \
+    static void many_##i##7 (void) { many (i * 8 + 7); }
+MANY(0) MANY(1) MANY(2) MANY(3) MANY(4) MANY(5) MANY(6) MANY(7)
+#undef MANY
+
+/* List of exit functions many_00 ... many_77 */
+#define MANY(i) \
+    many_##i##0, many_##i##1, many_##i##2, many_##i##3, \
+    many_##i##4, many_##i##5, many_##i##6, many_##i##7
+static exit_function *many_functions[] = {
+    MANY(0), MANY(1), MANY(2), MANY(3), MANY(4), MANY(5), MANY(6), MANY(7)
+};
+#undef MANY
+#define NUM_MANY (sizeof (many_functions) / sizeof (many_functions[0]))
+
+/* Number of times each exit function many_XX has been called */
+static int many_called[NUM_MANY];
+
+/* Thread which registers exit functions many_XX */
+static const thread_type_t register_type = {
+    allocate_thread,
+    free_thread,
+    create_thread,
+    destroy_thread,
+    register_thread
+};
+
+/* Number of threads registering the same exit functions */
+#define NUM_THREADS 4
+
+/* Number of concurrent exit functions called */
+static int arrived = 0;
+
+
 int
 main (void)
 {
@@ -58,6 +107,48 @@ main (void)
     ok = exit_handler (exit1, 0);
     assert (!ok);
 
+    /*
+     * Register many exit functions between functions 5 and 3.  If threads
+     * are available, then several threads try to register the same
+     * functions at once and exactly one of them succeeds for each function.
+     */
+    if (has_threads ()) {
+        thread_t *threads[NUM_THREADS];
+        int registered = 0;
+        size_t i;
+
+        for (i = 0; i < NUM_THREADS; i++) {
+            threads[i] = new_thread (&register_type);
+            assert (threads[i] != NULL);
+        }
+        for (i = 0; i < NUM_THREADS; i++) {
+            ok = start_thread (threads[i]);
+            assert (ok);
+        }
+        for (i = 0; i < NUM_THREADS; i++) {
+            registered += join_thread (threads[i]);
+            delete_thread (threads[i]);
+        }
+        assert (registered == (int) NUM_MANY);
+
+    } else {
+
+        assert (register_many () == (int) NUM_MANY);
+
+    }
+    assert (register_many () == 0);
+
+    /*
+     * Register two concurrent exit functions which run after function 5.
+     * With threads, each waits for the other one to start.
+     */
+    ok = exit_handler_flags (tier1, 60, EXIT_CONCURRENT | EXIT_RELEASES_MEMORY);
+    assert (ok);
+    ok = exit_handler_flags (tier2, 60, EXIT_CONCURRENT);
+    assert (ok);
+    ok = exit_handler_flags (tier2, 60, EXIT_CONCURRENT);
+    assert (!ok);
+
     /*
      * Return with non-zero exit status to make the test fail if the exit
      * functions are not called.
@@ -85,6 +176,17 @@ exit5 (void)
 void
 exit3 (void)
 {
+    size_t i;
+
+    /* Exit functions released memory as program is not exiting fast */
+    assert (!is_fast_exit ());
+    assert (__atomic_load_n (&arrived, __ATOMIC_ACQUIRE) == 2);
+
+    /* Each of the many exit functions has been called once */
+    for (i = 0; i < NUM_MANY; i++) {
+        assert (many_called[i] == 1);
+    }
+
     assert (count == 2);
     count++;
 }
@@ -108,3 +210,71 @@ exit1 (void)
     exit_application (0);
 }
 
+
+
+/* Exit function many_XX with priority between functions 5 and 3 */
+static void
+many (int i)
+{
+    assert (count == 2);
+    assert (arrived == 2);
+    many_called[i]++;
+}
+
+
+/* Register exit functions many_XX and return number of new registrations */
+static int
+register_many (void)
+{
+    int registered = 0;
+    size_t i;
+
+    for (i = 0; i < NUM_MANY; i++) {
+        if (exit_handler (many_functions[i], 50)) {
+            registered++;
+        }
+    }
+    return registered;
+}
+
+
+/* Register exit functions from thread */
+static int
+register_thread (thread_t *tp)
+{
+    (void) tp;
+    return register_many ();
+}
+
+
+/* Concurrent exit functions */
+static void
+tier1 (void)
+{
+    meet ();
+}
+
+
+static void
+tier2 (void)
+{
+    meet ();
+}
+
+
+/* Wait for other concurrent exit function */
+static void
+meet (void)
+{
+    long i;
+
+    assert (count == 2);
+    __atomic_add_fetch (&arrived, 1, __ATOMIC_ACQ_REL);
+    if (has_threads ()) {
+        i = 0;
+        while (__atomic_load_n (&arrived, __ATOMIC_ACQUIRE) < 2) {
+            assert (i++ < 10000000);
+            yield ();
+        }
+    }
+}
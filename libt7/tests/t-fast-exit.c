@@ -0,0 +1,161 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/exit-handler.h"
+#include "t7/terminate.h"
+#include "t7/allocator.h"
+#include "t7/static-allocator.h"
+#include "t7/memory.h"
+#include "t7/tls.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Local functions */
+static void release1 (void);
+static void release2 (void);
+static void close1 (void);
+static void close2 (void);
+static void destroy_leaky (struct allocator *ap);
+static tls_variable_t *allocate_variable (void);
+static void free_variable (tls_variable_t *vp);
+static void destroy_variable (tls_variable_t *vp);
+static void *get_variable (tls_variable_t *vp);
+
+
+/* Static allocator which must not be destroyed */
+static const struct allocator_vtable leaky_allocator = {
+    allocate_static_allocator,
+    free_static_allocator,
+    create_static_allocator,
+    destroy_leaky,
+    static_grab_memory,
+    static_release_memory,
+    static_resize_memory
+};
+
+/* Thread-local variable which must not be destroyed */
+static const tls_type_t leaky_variable = {
+    allocate_variable,
+    free_variable,
+    create_tls,
+    destroy_variable,
+    get_variable,
+    NULL
+};
+
+
+/* Number of exit functions called */
+static int count = 0;
+
+
+int
+main (void)
+{
+    struct allocator *ap;
+    int ok;
+
+    /* Allocators and thread-local storage are not released on fast exit */
+    ap = get_allocator (&leaky_allocator);
+    assert (ap != NULL);
+    assert (allocator_allocate_memory (ap, 100) != NULL);
+    assert (get_tls (&leaky_variable) != NULL);
+
+    /* Functions releasing memory are skipped on fast exit */
+    ok = exit_handler_flags (release1, 200, EXIT_RELEASES_MEMORY);
+    assert (ok);
+    ok = exit_handler_flags (
+        release2, 100, EXIT_CONCURRENT | EXIT_RELEASES_MEMORY);
+    assert (ok);
+
+    /* Other functions are called as usual */
+    ok = exit_handler_flags (close1, 100, EXIT_CONCURRENT);
+    assert (ok);
+    ok = exit_handler (close2, 0);
+    assert (ok);
+
+    /*
+     * Exit with non-zero exit status to make the test fail if the exit
+     * functions are not called.
+     */
+    assert (!is_fast_exit ());
+    fast_exit (1);
+    return 1;
+}
+
+
+static void
+release1 (void)
+{
+    assert (0);
+}
+
+
+static void
+release2 (void)
+{
+    assert (0);
+}
+
+
+static void
+close1 (void)
+{
+    assert (is_fast_exit ());
+    assert (count == 0);
+    count++;
+}
+
+
+static void
+close2 (void)
+{
+    assert (count == 1);
+    count++;
+
+    /* Exit immediately with exit status of zero */
+    exit_application (0);
+}
+
+
+static void
+destroy_leaky (struct allocator *ap)
+{
+    (void) ap;
+    assert (0);
+}
+
+
+static tls_variable_t *
+allocate_variable (void)
+{
+    return (tls_variable_t*) allocate_memory (sizeof (tls_variable_t));
+}
+
+
+static void
+free_variable (tls_variable_t *vp)
+{
+    free_memory (vp);
+}
+
+
+static void
+destroy_variable (tls_variable_t *vp)
+{
+    (void) vp;
+    assert (0);
+}
+
+
+static void *
+get_variable (tls_variable_t *vp)
+{
+    return vp;
+}
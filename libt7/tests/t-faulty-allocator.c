@@ -9,6 +9,8 @@
 #include "t7/fixture.h"
 #include "t7/simulate-failure.h"
 #include "t7/memory.h"
+#include "t7/faulty-allocator.h"
+#include "t7/static-allocator.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -19,6 +21,11 @@ static int allocate (void);
 static int sequential (void);
 static int handler1 (void);
 static int handler2 (void);
+static void test_backing (void);
+static int backed (void);
+
+/* Backing allocator of test_backing */
+static struct static_allocator *backing;
 
 /* Code paths taken */
 static int path1;
@@ -99,10 +106,80 @@ main (void)
     assert (path3 == 1);
     assert (path4 == 1);
 
+    /* Test faulty allocator on top of static allocator */
+    test_backing ();
+
     return 0;
 }
 
 
+/* Forward allocations to custom backing allocator */
+static void
+test_backing (void)
+{
+    struct allocator *sp;
+    struct allocator *ap;
+    int ok;
+
+    /* Create faulty allocator on top of static allocator */
+    sp = new_allocator (static_allocator);
+    assert (sp != NULL);
+    backing = (struct static_allocator*) sp;
+    ap = new_faulty_allocator (sp);
+    assert (ap != NULL);
+
+    /* Run test in a scope which uses the faulty allocator */
+    assert (push_allocator (ap));
+    path1 = 0;
+    ok = repeat_test (backed);
+    assert (ok);
+    assert (path1 == 1);
+    pop_fixture ();
+
+    /* Release allocators in reverse order */
+    delete_allocator (ap);
+    delete_allocator (sp);
+}
+
+
+/* Make sure that memory comes from the backing allocator */
+static int
+backed (void)
+{
+    char *p;
+    char *q;
+    int ok;
+
+    p = allocate_memory (100);
+    if (p) {
+
+        /* Memory is located within the buffer of static allocator */
+        assert (backing->buffer <= p);
+        assert (p < backing->buffer + backing->size);
+
+        /* Resize is forwarded as well */
+        q = resize_memory (p, 1000);
+        if (q) {
+            assert (backing->buffer <= q);
+            assert (q < backing->buffer + backing->size);
+            p = q;
+            ok = 1;
+        } else {
+            ok = 0;
+        }
+        free_memory (p);
+
+    } else {
+
+        /* Simulated failure */
+        path1++;
+        ok = 0;
+
+    }
+    return ok;
+}
+
+
 /* Test memory allocation functions */
 static int
 allocate (void)
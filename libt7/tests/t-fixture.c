@@ -19,6 +19,7 @@
 /* Custom fixture & thread functions */
 static struct allocator *get_my_allocator(fixture_t *fp);
 static int my_run_thread (thread_t *tp);
+static int inherit_thread(thread_t *tp);
 
 /* Define custom fixture type */
 static fixture_t static_fixture = {
@@ -36,17 +37,37 @@ static thread_type_t def1 = {
 };
 static thread_type_t *my_thread = &def1;
 
+/* Define thread type for checking inherited fixture */
+static thread_type_t def2 = {
+	allocate_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	inherit_thread
+};
+static thread_type_t *child_thread = &def2;
+
+/* Fixture and allocator seen by child thread */
+static fixture_t *inherited;
+static struct allocator *inherited_allocator;
+
 
 /* Test functions */
 void test_static_allocator(void);
 void test_allocator(void);
 void test_thread(void);
+void test_inherit(void);
+void test_scopes(void);
 
 
 int main(void)
 {
 	test_static_allocator();
 	test_thread();
+	test_scopes();
+	if (has_threads()) {
+		test_inherit();
+	}
 	return 0;
 }
 
@@ -112,6 +133,82 @@ test_thread (void)
 }
 
 
+/* New thread uses the fixture of its parent */
+void test_inherit(void)
+{
+	fixture_t *orig = get_fixture();
+
+	/* Allocate thread with original fixture */
+	thread_t *tp = new_thread(child_thread);
+	assert(tp != NULL);
+
+	/* Start thread while custom fixture is active */
+	set_fixture(my_fixture);
+	inherited = NULL;
+	assert(start_thread(tp));
+
+	/* Changing fixture of parent does not affect running thread */
+	set_fixture(orig);
+	assert(join_thread(tp) == 1);
+	delete_thread(tp);
+
+	/* Thread saw the very same fixture object */
+	assert(inherited == my_fixture);
+
+	/* Thread inherits allocator of scope */
+	tp = new_thread(child_thread);
+	assert(tp != NULL);
+	assert(push_allocator(get_allocator(static_allocator)));
+	inherited_allocator = NULL;
+	assert(start_thread(tp));
+	pop_fixture();
+	assert(join_thread(tp) == 1);
+	delete_thread(tp);
+	assert(inherited_allocator == get_allocator(static_allocator));
+}
+
+
+/* Nested scopes */
+void test_scopes(void)
+{
+	fixture_t *orig = get_fixture();
+	struct allocator *def = get_default_allocator();
+	struct allocator *stat = get_allocator(static_allocator);
+	assert(def != stat);
+
+	/* Override allocator only */
+	assert(push_allocator(stat));
+	assert(get_fixture() == orig);
+	assert(get_default_allocator() == stat);
+	test_allocator();
+
+	/* Override fixture within the scope */
+	assert(push_fixture(default_fixture));
+	assert(get_fixture() == default_fixture);
+	assert(get_default_allocator() == def);
+	test_allocator();
+
+	/* End scopes */
+	pop_fixture();
+	assert(get_default_allocator() == stat);
+	pop_fixture();
+	assert(get_fixture() == orig);
+	assert(get_default_allocator() == def);
+	assert(get_scope_allocator() == NULL);
+
+	/* Scopes nest up to maximum depth */
+	size_t n = 0;
+	while (push_allocator(stat)) {
+		n++;
+	}
+	assert(n == T7_MAX_FIXTURE_DEPTH);
+	while (n-- > 0) {
+		pop_fixture();
+	}
+	assert(get_default_allocator() == def);
+}
+
+
 /* Allocate memory using default allocator */
 void
 test_allocator (void)
@@ -176,3 +273,12 @@ static int my_run_thread(thread_t *tp)
 	return 1;
 }
 
+
+/* Save fixture of child thread */
+static int inherit_thread(thread_t *tp)
+{
+	(void) tp;
+	inherited = get_fixture();
+	inherited_allocator = get_default_allocator();
+	return 1;
+}
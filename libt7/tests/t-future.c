@@ -0,0 +1,262 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/future.h"
+#include "t7/thread.h"
+#include "t7/critical-section.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Test functions */
+static void test_pipeline(void);
+static void test_failure(void);
+static void test_when_all(void);
+static void test_when_any(void);
+static void test_timeout(void);
+
+/* Tasks and continuations */
+static int decode(void *arg, void *result);
+static int fail(void *arg, void *result);
+static int wait_for_flag(void *arg, void *result);
+static int transform(void *arg, const void *input, void *result);
+static int write_out(void *arg, const void *input, void *result);
+
+/* Set to release wait_for_flag */
+static volatile int flag;
+
+/* Number of times write_out has been called */
+static int writes;
+
+/* Input strings */
+static char inputs[][3] = { "1", "2", "3", "4", "5", "7", "8", "21" };
+
+
+int main(void)
+{
+	test_pipeline();
+	test_failure();
+	test_when_all();
+	test_when_any();
+	if (has_threads()) {
+		test_timeout();
+	}
+	return 0;
+}
+
+
+/* Chain dependent stages */
+static void test_pipeline(void)
+{
+	writes = 0;
+
+	/* Build pipeline of decode, transform and write */
+	future_t *f1 = async_task(decode, inputs[7], sizeof(int));
+	assert(f1 != NULL);
+	future_t *f2 = then_future(f1, transform, NULL, sizeof(int));
+	assert(f2 != NULL);
+	future_t *f3 = then_future(f2, write_out, NULL, sizeof(int));
+	assert(f3 != NULL);
+
+	/* Wait for the last stage only */
+	assert(wait_future(f3) == FUTURE_READY);
+	assert(is_future_ready(f1));
+	assert(is_future_ready(f2));
+	assert(*(int*) get_future_result(f1) == 21);
+	assert(*(int*) get_future_result(f2) == 42);
+	assert(*(int*) get_future_result(f3) == 42);
+	assert(writes == 1);
+
+	/* Continuation of a completed future executes immediately */
+	future_t *f4 = then_future(f2, transform, NULL, sizeof(int));
+	assert(f4 != NULL);
+	assert(is_future_ready(f4));
+	assert(*(int*) get_future_result(f4) == 84);
+
+	/* Futures may be deleted in any order */
+	delete_future(f1);
+	delete_future(f4);
+	delete_future(f3);
+	delete_future(f2);
+}
+
+
+/* Failure skips continuations */
+static void test_failure(void)
+{
+	writes = 0;
+
+	/* Failed task fails all dependent futures */
+	future_t *f1 = async_task(fail, NULL, sizeof(int));
+	assert(f1 != NULL);
+	future_t *f2 = then_future(f1, write_out, NULL, sizeof(int));
+	assert(f2 != NULL);
+	assert(wait_future(f2) == FUTURE_FAILED);
+	assert(wait_future(f1) == FUTURE_FAILED);
+	assert(writes == 0);
+
+	/* Source may be deleted before the continuation */
+	delete_future(f1);
+	delete_future(f2);
+}
+
+
+/* Wait for multiple tasks */
+static void test_when_all(void)
+{
+	future_t *fps[5];
+
+	/* Start tasks */
+	for (size_t i = 0; i < 5; i++) {
+		fps[i] = async_task(decode, inputs[i], sizeof(int));
+		assert(fps[i] != NULL);
+	}
+
+	/* Combined future completes after all tasks */
+	future_t *all = when_all(fps, 5);
+	assert(all != NULL);
+	assert(wait_future(all) == FUTURE_READY);
+	assert(get_future_result(all) == NULL);
+	int sum = 0;
+	for (size_t i = 0; i < 5; i++) {
+		assert(is_future_ready(fps[i]));
+		sum += *(int*) get_future_result(fps[i]);
+	}
+	assert(sum == 15);
+	delete_future(all);
+
+	/* Failure of one future fails the combined future */
+	future_t *bad = async_task(fail, NULL, 0);
+	assert(bad != NULL);
+	future_t *mixed[2] = { fps[0], bad };
+	all = when_all(mixed, 2);
+	assert(all != NULL);
+	assert(wait_future(all) == FUTURE_FAILED);
+	delete_future(all);
+	delete_future(bad);
+
+	/* Empty set completes immediately */
+	all = when_all(NULL, 0);
+	assert(all != NULL);
+	assert(is_future_ready(all));
+	assert(wait_future(all) == FUTURE_READY);
+	delete_future(all);
+
+	for (size_t i = 0; i < 5; i++) {
+		delete_future(fps[i]);
+	}
+}
+
+
+/* Wait for first task */
+static void test_when_any(void)
+{
+	future_t *fps[2];
+
+	/* Task which is already complete wins */
+	fps[0] = async_task(decode, inputs[5], sizeof(int));
+	assert(fps[0] != NULL);
+	assert(wait_future(fps[0]) == FUTURE_READY);
+	fps[1] = async_task(decode, inputs[6], sizeof(int));
+	assert(fps[1] != NULL);
+
+	future_t *any = when_any(fps, 2);
+	assert(any != NULL);
+	assert(wait_future(any) == FUTURE_READY);
+	assert(*(size_t*) get_future_result(any) == 0);
+	delete_future(any);
+
+	delete_future(fps[0]);
+	delete_future(fps[1]);
+}
+
+
+/* Timed wait returns pending future */
+static void test_timeout(void)
+{
+	flag = 0;
+
+	/* Start task which blocks until flag is set */
+	future_t *fp = async_task(wait_for_flag, NULL, sizeof(int));
+	assert(fp != NULL);
+
+	/* Continuation is not executed while source is pending */
+	future_t *next = then_future(fp, transform, NULL, sizeof(int));
+	assert(next != NULL);
+
+	/* Wait times out */
+	assert(wait_future_for(fp, 10) == FUTURE_PENDING);
+	assert(!is_future_ready(fp));
+	assert(!is_future_ready(next));
+
+	/* Release the task and wait again */
+	enter_critical();
+	flag = 1;
+	leave_critical();
+	assert(wait_future_for(next, 10000) == FUTURE_READY);
+	assert(*(int*) get_future_result(next) == 2);
+
+	delete_future(fp);
+	delete_future(next);
+}
+
+
+/* Convert string to integer */
+static int decode(void *arg, void *result)
+{
+	*(int*) result = atoi((const char*) arg);
+	return 1;
+}
+
+
+/* Task which always fails */
+static int fail(void *arg, void *result)
+{
+	(void) arg;
+	(void) result;
+	return 0;
+}
+
+
+/* Wait until flag is set */
+static int wait_for_flag(void *arg, void *result)
+{
+	(void) arg;
+
+	int done = 0;
+	while (!done) {
+		enter_critical();
+		done = flag;
+		leave_critical();
+		yield();
+	}
+	*(int*) result = 1;
+	return 1;
+}
+
+
+/* Double integer */
+static int transform(void *arg, const void *input, void *result)
+{
+	(void) arg;
+	*(int*) result = *(const int*) input * 2;
+	return 1;
+}
+
+
+/* Count writes */
+static int write_out(void *arg, const void *input, void *result)
+{
+	(void) arg;
+	enter_critical();
+	writes++;
+	leave_critical();
+	*(int*) result = *(const int*) input;
+	return 1;
+}
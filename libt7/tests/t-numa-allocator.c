@@ -0,0 +1,224 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/numa-allocator.h"
+#include "t7/static-allocator.h"
+#include "t7/thread.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Number of threads allocating at once */
+#define NUM_THREADS 4
+
+/* Number of blocks allocated in growth test */
+#define NUM_BLOCKS 80
+
+/* Size of blocks in growth test, 5 MiB in total */
+#define BLOCK_SIZE (64 * 1024)
+
+
+/* Test functions */
+static void test_default(void);
+static void test_nodes(void);
+static void test_growth(void);
+static void test_threads(void);
+static int run_thread(thread_t *tp);
+static int is_owned(struct allocator *bp, const void *p);
+
+
+/* Thread type */
+static const thread_type_t def1 = {
+	allocate_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	run_thread
+};
+
+/* Allocator shared by threads */
+static struct allocator *shared;
+
+/* Block allocated by main thread and released by other threads */
+static char *blocks[NUM_THREADS];
+
+/* Index of next block to release */
+static size_t next_block;
+
+/* Node which main thread started on */
+static int main_node;
+
+
+int main(void)
+{
+	test_default();
+	test_nodes();
+	test_growth();
+	if (has_threads())
+		test_threads();
+	return 0;
+}
+
+
+/* Allocator retrieved by type */
+static void test_default(void)
+{
+	struct allocator *ap = get_allocator(numa_allocator);
+	assert(ap != NULL);
+
+	/* Memory is usable */
+	char *p = allocator_allocate_memory(ap, 100);
+	assert(p != NULL);
+	memset(p, 'a', 100);
+
+	/* Contents remain when block is resized */
+	p = allocator_resize_memory(ap, p, 10000);
+	assert(p != NULL);
+	for (size_t i = 0; i < 100; i++)
+		assert(p[i] == 'a');
+	memset(p, 'b', 10000);
+	allocator_free_memory(ap, p);
+}
+
+
+/* Allocators of nodes */
+static void test_nodes(void)
+{
+	struct allocator *ap = new_numa_allocator(static_allocator);
+	assert(ap != NULL);
+
+	/* Allocator of node is created once */
+	int node = get_current_node();
+	assert(node >= 0);
+	struct allocator *bp = get_node_allocator(ap, node);
+	assert(bp != NULL);
+	assert(get_node_allocator(ap, node) == bp);
+
+	/* Nodes beyond the limit share allocators */
+	assert(get_node_allocator(ap, T7_MAX_NUMA_NODES)
+		== get_node_allocator(ap, 0));
+
+	/* Memory comes from allocator of current node */
+	char *p = allocator_allocate_memory(ap, 1000);
+	assert(p != NULL);
+	assert(is_owned(bp, p));
+	memset(p, 'x', 1000);
+
+	/* Resized block stays with its owner */
+	p = allocator_resize_memory(ap, p, 2000);
+	assert(p != NULL);
+	assert(is_owned(bp, p));
+	assert(p[999] == 'x');
+	allocator_free_memory(ap, p);
+
+	/* Backing allocators are deleted with NUMA allocator */
+	delete_allocator(ap);
+}
+
+
+/* Node allocates more memory than one arena holds */
+static void test_growth(void)
+{
+	struct allocator *ap = get_allocator(numa_allocator);
+	assert(ap != NULL);
+
+	/* Blocks fill several arenas */
+	static char *chunks[NUM_BLOCKS];
+	for (size_t i = 0; i < NUM_BLOCKS; i++) {
+		chunks[i] = allocator_allocate_memory(ap, BLOCK_SIZE);
+		assert(chunks[i] != NULL);
+		memset(chunks[i], (int) i, BLOCK_SIZE);
+	}
+	for (size_t i = 0; i < NUM_BLOCKS; i++)
+		assert(chunks[i][BLOCK_SIZE - 1] == (char) i);
+
+	/* Block grows beyond arena */
+	char *p = allocator_resize_memory(ap, chunks[0], 3 * 1024 * 1024);
+	assert(p != NULL);
+	assert(p[BLOCK_SIZE - 1] == 0);
+	memset(p, 'x', 3 * 1024 * 1024);
+	chunks[0] = p;
+
+	/* Large block does not fit in arena */
+	p = allocator_allocate_memory(ap, 4 * 1024 * 1024);
+	assert(p != NULL);
+	memset(p, 'y', 4 * 1024 * 1024);
+	allocator_free_memory(ap, p);
+
+	for (size_t i = 0; i < NUM_BLOCKS; i++)
+		allocator_free_memory(ap, chunks[i]);
+}
+
+
+/* Blocks are returned to their owner from other threads */
+static void test_threads(void)
+{
+	shared = new_numa_allocator(static_allocator);
+	assert(shared != NULL);
+	main_node = get_current_node();
+
+	/* Allocate blocks for threads to release */
+	for (size_t i = 0; i < NUM_THREADS; i++) {
+		blocks[i] = allocator_allocate_memory(shared, 100);
+		assert(blocks[i] != NULL);
+		blocks[i][0] = (char) i;
+	}
+
+	/* Run threads on the node of main thread */
+	thread_t *threads[NUM_THREADS];
+	for (size_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = new_thread(&def1);
+		assert(threads[i] != NULL);
+		assert(start_thread_on_node(threads[i], main_node));
+	}
+	for (size_t i = 0; i < NUM_THREADS; i++) {
+		assert(join_thread(threads[i]) == 1);
+		delete_thread(threads[i]);
+	}
+
+	/* All memory has been returned to allocator of node */
+	struct allocator *bp = get_node_allocator(shared, main_node);
+	char *p = allocator_allocate_memory(bp, 1000000);
+	assert(p != NULL);
+	allocator_free_memory(bp, p);
+	delete_allocator(shared);
+}
+
+
+/* Release block of main thread and allocate more */
+static int run_thread(thread_t *tp)
+{
+	(void) tp;
+
+	/* Thread stays on node it was bound to */
+	assert(get_current_node() == main_node);
+
+	/* Release block allocated by main thread */
+	size_t i = __atomic_fetch_add(&next_block, 1, __ATOMIC_RELAXED);
+	assert(i < NUM_THREADS);
+	assert(blocks[i][0] == (char) i);
+	allocator_free_memory(shared, blocks[i]);
+
+	for (int round = 0; round < 1000; round++) {
+		char *p = allocator_allocate_memory(shared, 64);
+		assert(p != NULL);
+		memset(p, 0, 64);
+		allocator_free_memory(shared, p);
+	}
+	return 1;
+}
+
+
+/* Returns true if block P is in buffer of static allocator BP */
+static int is_owned(struct allocator *bp, const void *p)
+{
+	struct static_allocator *sp = (struct static_allocator*) bp;
+	const char *c = (const char*) p;
+	return sp->buffer <= c && c < sp->buffer + sp->size;
+}
@@ -0,0 +1,238 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/queue.h"
+#include "t7/thread.h"
+#include "t7/static-allocator.h"
+#include "t7/critical-section.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Number of items pushed by each producer */
+#define ITEMS 20000
+
+/* Number of producer and consumer threads */
+#define PRODUCERS 4
+#define CONSUMERS 4
+
+
+/* Test functions */
+static void test_single(struct allocator *ap);
+static void test_batch(void);
+static void test_threads(void);
+static int produce(thread_t *tp);
+static int consume(thread_t *tp);
+
+/* Define thread types */
+static thread_type_t def1 = {
+	allocate_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	produce
+};
+static thread_type_t *producer_thread = &def1;
+
+static thread_type_t def2 = {
+	allocate_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	consume
+};
+static thread_type_t *consumer_thread = &def2;
+
+/* Queue shared by threads */
+static queue_t *shared;
+
+/* Number of producers started so far */
+static size_t producers;
+
+/* Sum of items received by consumers */
+static size_t received;
+
+
+int main(void)
+{
+	test_single(NULL);
+	test_single(get_allocator(static_allocator));
+	test_batch();
+	if (has_threads()) {
+		test_threads();
+	}
+	return 0;
+}
+
+
+/* Push and pop in one thread */
+static void test_single(struct allocator *ap)
+{
+	void *item;
+	char data[10];
+
+	/* Capacity is rounded up to power of two */
+	queue_t *qp = new_queue(ap, 5);
+	assert(qp != NULL);
+
+	/* Queue is empty at first */
+	assert(!try_pop_queue(qp, &item));
+
+	/* Fill the queue */
+	for (size_t i = 0; i < 8; i++) {
+		assert(try_push_queue(qp, &data[i]));
+	}
+	assert(!try_push_queue(qp, &data[8]));
+
+	/* Items come out in order */
+	for (size_t i = 0; i < 8; i++) {
+		assert(try_pop_queue(qp, &item));
+		assert(item == &data[i]);
+	}
+	assert(!try_pop_queue(qp, &item));
+
+	/* Wrap around the ring multiple times */
+	for (size_t i = 0; i < 100; i++) {
+		push_queue(qp, &data[i % 10]);
+		push_queue(qp, NULL);
+		assert(pop_queue(qp) == &data[i % 10]);
+		assert(pop_queue(qp) == NULL);
+	}
+
+	delete_queue(qp);
+}
+
+
+/* Push and pop multiple items at once */
+static void test_batch(void)
+{
+	void *in[10];
+	void *out[10];
+	char data[10];
+
+	for (size_t i = 0; i < 10; i++) {
+		in[i] = &data[i];
+	}
+
+	queue_t *qp = new_queue(NULL, 8);
+	assert(qp != NULL);
+
+	/* Batch is truncated to the free space */
+	assert(push_queue_batch(qp, in, 3) == 3);
+	assert(push_queue_batch(qp, in + 3, 7) == 5);
+	assert(push_queue_batch(qp, in + 8, 2) == 0);
+
+	/* Batch is truncated to the available items */
+	assert(pop_queue_batch(qp, out, 2) == 2);
+	assert(out[0] == &data[0] && out[1] == &data[1]);
+	assert(pop_queue_batch(qp, out, 10) == 6);
+	for (size_t i = 0; i < 6; i++) {
+		assert(out[i] == &data[i + 2]);
+	}
+	assert(pop_queue_batch(qp, out, 10) == 0);
+
+	/* Batches and single items mix across the wrap point */
+	assert(push_queue_batch(qp, in, 5) == 5);
+	assert(pop_queue_batch(qp, out, 4) == 4);
+	assert(push_queue_batch(qp, in + 5, 5) == 5);
+	for (size_t i = 4; i < 10; i++) {
+		assert(pop_queue(qp) == &data[i]);
+	}
+
+	delete_queue(qp);
+}
+
+
+/* Pass items between multiple producers and consumers */
+static void test_threads(void)
+{
+	thread_t *tp[PRODUCERS + CONSUMERS];
+
+	/* Small queue forces threads to block */
+	shared = new_queue(NULL, 16);
+	assert(shared != NULL);
+	producers = 0;
+	received = 0;
+
+	/* Start threads */
+	for (size_t i = 0; i < CONSUMERS; i++) {
+		tp[i] = new_thread(consumer_thread);
+		assert(tp[i] != NULL);
+		assert(start_thread(tp[i]));
+	}
+	for (size_t i = CONSUMERS; i < CONSUMERS + PRODUCERS; i++) {
+		tp[i] = new_thread(producer_thread);
+		assert(tp[i] != NULL);
+		assert(start_thread(tp[i]));
+	}
+
+	/* Wait for producers to finish */
+	for (size_t i = CONSUMERS; i < CONSUMERS + PRODUCERS; i++) {
+		assert(join_thread(tp[i]));
+		delete_thread(tp[i]);
+	}
+
+	/* Stop consumers */
+	for (size_t i = 0; i < CONSUMERS; i++) {
+		push_queue(shared, NULL);
+	}
+	for (size_t i = 0; i < CONSUMERS; i++) {
+		assert(join_thread(tp[i]));
+		delete_thread(tp[i]);
+	}
+
+	/* Every item was received exactly once */
+	size_t n = (size_t) PRODUCERS * ITEMS;
+	assert(received == n * (n + 1) / 2);
+
+	delete_queue(shared);
+}
+
+
+/* Push numbers to queue */
+static int produce(thread_t *tp)
+{
+	(void) tp;
+
+	/* Pick range of numbers for this producer */
+	enter_critical();
+	size_t first = producers++ * ITEMS + 1;
+	leave_critical();
+
+	/* Alternate between single and batched pushes */
+	for (size_t i = 0; i < ITEMS; i++) {
+		void *item = (void*) (first + i);
+		if (i % 2 == 0) {
+			push_queue(shared, item);
+		} else {
+			while (push_queue_batch(shared, &item, 1) == 0) {
+				yield();
+			}
+		}
+	}
+	return 1;
+}
+
+
+/* Sum numbers from queue until NULL is received */
+static int consume(thread_t *tp)
+{
+	(void) tp;
+
+	size_t sum = 0;
+	void *item;
+	while ((item = pop_queue(shared)) != NULL) {
+		sum += (size_t) item;
+	}
+
+	enter_critical();
+	received += sum;
+	leave_critical();
+	return 1;
+}
@@ -0,0 +1,222 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/ring.h"
+#include "t7/thread.h"
+#include "t7/static-allocator.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Number of bytes passed between threads */
+#define TOTAL 1000000
+
+
+/* Test functions */
+static void test_plain(struct allocator *ap);
+static void test_mirror(void);
+static void test_threads(int flags);
+static int produce(thread_t *tp);
+
+/* Define thread type */
+static thread_type_t def1 = {
+	allocate_thread,
+	free_thread,
+	create_thread,
+	destroy_thread,
+	produce
+};
+static thread_type_t *producer_thread = &def1;
+
+/* Ring shared by threads */
+static ring_t *shared;
+
+
+int main(void)
+{
+	test_plain(NULL);
+	test_plain(get_allocator(static_allocator));
+	test_mirror();
+	if (has_threads()) {
+		test_threads(0);
+		test_threads(RING_MIRROR);
+	}
+	return 0;
+}
+
+
+/* Write and read in one thread without mirror */
+static void test_plain(struct allocator *ap)
+{
+	struct ring_span span;
+
+	/* Size is rounded up to power of two */
+	ring_t *rp = new_ring(ap, 12, 0);
+	assert(rp != NULL);
+
+	/* Ring is empty at first */
+	span = peek_ring(rp);
+	assert(span.size == 0);
+
+	/* Whole ring is writable */
+	span = reserve_ring(rp, 1);
+	assert(span.size == 16);
+	assert(reserve_ring(rp, 17).size == 0);
+
+	/* Write 10 bytes */
+	memcpy(span.data, "0123456789", 10);
+	commit_ring(rp, 10);
+	assert(reserve_ring(rp, 7).size == 0);
+	assert(reserve_ring(rp, 6).size == 6);
+
+	/* Read 8 bytes */
+	span = peek_ring(rp);
+	assert(span.size == 10);
+	assert(memcmp(span.data, "01234567", 8) == 0);
+	release_ring(rp, 8);
+
+	/* Space at the end of buffer is returned first */
+	span = reserve_ring(rp, 10);
+	assert(span.size == 6);
+	memcpy(span.data, "abcdef", 6);
+	commit_ring(rp, 6);
+
+	/* Remaining space is at the start of buffer */
+	span = reserve_ring(rp, 8);
+	assert(span.size == 8);
+	memcpy(span.data, "ghijklmn", 8);
+	commit_ring(rp, 8);
+	assert(reserve_ring(rp, 1).size == 0);
+
+	/* Reader sees new data after consuming the old */
+	span = peek_ring(rp);
+	assert(span.size == 2);
+	assert(memcmp(span.data, "89", 2) == 0);
+	release_ring(rp, 2);
+
+	/* Reader gets wrapped data in two parts as well */
+	span = peek_ring(rp);
+	assert(span.size == 6);
+	assert(memcmp(span.data, "abcdef", 6) == 0);
+	release_ring(rp, 6);
+	span = peek_ring(rp);
+	assert(span.size == 8);
+	assert(memcmp(span.data, "ghijklmn", 8) == 0);
+	release_ring(rp, 8);
+	assert(peek_ring(rp).size == 0);
+
+	delete_ring(rp);
+}
+
+
+/* Wrapped data is contiguous in mirrored ring */
+static void test_mirror(void)
+{
+	struct ring_span span;
+
+	ring_t *rp = new_ring(NULL, 100, RING_MIRROR);
+	if (!rp) {
+		/* Mirroring not supported on this platform */
+		return;
+	}
+
+	/* Size is rounded to whole pages */
+	span = reserve_ring(rp, 100);
+	size_t size = span.size;
+	assert(size >= 100);
+	assert((size & (size - 1)) == 0);
+
+	/* Move to the end of buffer */
+	commit_ring(rp, size - 3);
+	release_ring(rp, peek_ring(rp).size);
+
+	/* Write record which wraps around the end */
+	span = reserve_ring(rp, 10);
+	assert(span.size == size);
+	memcpy(span.data, "0123456789", 10);
+	commit_ring(rp, 10);
+
+	/* Read the record in one piece */
+	span = peek_ring(rp);
+	assert(span.size == 10);
+	assert(memcmp(span.data, "0123456789", 10) == 0);
+
+	/* Both mappings refer to the same memory */
+	assert(memcmp(span.data - (size - 3), "3456789", 7) == 0);
+	release_ring(rp, 10);
+
+	delete_ring(rp);
+}
+
+
+/* Pass records from one thread to another */
+static void test_threads(int flags)
+{
+	/* Use small ring so that producer and consumer wait for each other */
+	shared = new_ring(NULL, 256, flags);
+	if (!shared) {
+		assert((flags & RING_MIRROR));
+		return;
+	}
+
+	thread_t *tp = new_thread(producer_thread);
+	assert(tp != NULL);
+	assert(start_thread(tp));
+
+	/* Read bytes and verify that they arrive in order */
+	size_t received = 0;
+	while (received < TOTAL) {
+		struct ring_span span = peek_ring(shared);
+		if (span.size == 0) {
+			yield();
+			continue;
+		}
+		for (size_t i = 0; i < span.size; i++) {
+			assert(span.data[i] == (char) ((received + i) % 251));
+		}
+		received += span.size;
+		release_ring(shared, span.size);
+	}
+	assert(received == TOTAL);
+
+	assert(join_thread(tp));
+	delete_thread(tp);
+	delete_ring(shared);
+}
+
+
+/* Write numbered bytes to ring in variable size records */
+static int produce(thread_t *tp)
+{
+	(void) tp;
+
+	size_t sent = 0;
+	size_t len = 1;
+	while (sent < TOTAL) {
+		/* Pick length of next record */
+		len = len % 37 + 1;
+		if (len > TOTAL - sent)
+			len = TOTAL - sent;
+
+		struct ring_span span = reserve_ring(shared, len);
+		if (span.size == 0) {
+			yield();
+			continue;
+		}
+
+		/* Write as much of the record as fits in span */
+		size_t n = span.size < len ? span.size : len;
+		for (size_t i = 0; i < n; i++) {
+			span.data[i] = (char) ((sent + i) % 251);
+		}
+		commit_ring(shared, n);
+		sent += n;
+	}
+	return 1;
+}
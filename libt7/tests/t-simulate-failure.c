@@ -8,6 +8,8 @@
 #include "t7/types.h"
 #include "t7/simulate-failure.h"
 #include "t7/thread.h"
+#include "t7/fixture.h"
+#include "t7/memory.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -18,12 +20,30 @@ static int always (void);
 static int second (void);
 static int fourth (void);
 static int recursive (void);
+static int many (void);
+static int combinations (void);
+static int robust (void);
+static int fragile (void);
+static void test_parallel (void);
+static void test_forked (void);
+static int crashing (void);
+static void test_sampled (void);
+static void test_report (void);
+static int named (void);
+static int allocating (void);
 static int in_thread (void);
 static int thread_main (thread_t *tp);
+static thread_t *allocate_draw_thread (void);
+static int draw_main (thread_t *tp);
+static thread_t *start_draws (unsigned long stream, size_t count);
+static void test_streams (void);
 
 /* For keeping up with the number of test runs */
 static int counter = 0;
 
+/* Number of fallible calls in function many */
+#define MANY 5000
+
 /* Define thread types */
 static thread_type_t def1 = {
     allocate_thread,
@@ -34,6 +54,36 @@ static thread_type_t def1 = {
 };
 static thread_type_t *my_thread = &def1;
 
+/* Number of calls made by draw threads */
+#define DRAWS 200
+
+/* Thread calling simulate_failure in sampled mode */
+struct draw_thread {
+
+    /* Base thread, must be the first member of the structure */
+    thread_t base;
+
+    /* Stream number of thread */
+    unsigned long stream;
+
+    /* Number of calls to make, at most DRAWS are recorded */
+    size_t count;
+
+    /* Results of first calls */
+    unsigned char draws[DRAWS];
+
+};
+
+/* Thread type for drawing sampled failures */
+static thread_type_t def2 = {
+    allocate_draw_thread,
+    free_thread,
+    create_thread,
+    destroy_thread,
+    draw_main
+};
+static thread_type_t *draw_thread = &def2;
+
 
 int
 main (void)
@@ -48,6 +98,18 @@ main (void)
     ok = repeat_test (in_thread);
     assert (ok);
 
+    /* Execute test runs in parallel */
+    test_parallel ();
+
+    /* Explore failures in child processes */
+    test_forked ();
+
+    /* Attribute failures to call sites */
+    test_report ();
+
+    /* Fail randomly outside of repeat_test */
+    test_sampled ();
+
     return 0;
 }
 
@@ -103,6 +165,18 @@ recursive (void)
     assert (!ok);
     assert (counter == 1);
 
+    /* Test may call simulate_failure any number of times */
+    counter = 0;
+    ok = repeat_test (many);
+    assert (ok);
+    assert (counter == MANY + 1);
+
+    /* Failures are simulated in every combination if test ignores them */
+    counter = 0;
+    ok = repeat_test (combinations);
+    assert (ok);
+    assert (counter == 8);
+
     return 1;
 }
 
@@ -132,6 +206,375 @@ in_thread (void)
 }
 
 
+/* Distribute failure points to threads */
+static void
+test_parallel (void)
+{
+    size_t k;
+    int ok;
+
+    /* Test passes when every failure is handled */
+    k = 12345;
+    ok = repeat_test_parallel (robust, 4, &k);
+    assert (ok);
+    assert (k == 12345);
+
+    /* First unhandled failure is reported */
+    ok = repeat_test_parallel (fragile, 4, &k);
+    assert (!ok);
+    assert (k == 37);
+
+    /* Same result with one thread */
+    ok = repeat_test_parallel (fragile, 1, &k);
+    assert (!ok);
+    assert (k == 37);
+
+    /* Failure without simulated failures */
+    ok = repeat_test_parallel (never, 4, &k);
+    assert (!ok);
+    assert (k == (size_t) -2);
+}
+
+
+/* Explore failure points in child processes */
+static void
+test_forked (void)
+{
+#if !defined(_WIN32)
+    size_t k;
+    int ok;
+
+    /* Test passes when every failure is handled */
+    k = 12345;
+    ok = repeat_test_forked (robust, 4, &k);
+    assert (ok);
+    assert (k == 12345);
+
+    /* First unhandled failure is reported */
+    ok = repeat_test_forked (fragile, 4, &k);
+    assert (!ok);
+    assert (k == 37);
+
+    /* Same result with one child at a time */
+    ok = repeat_test_forked (fragile, 1, &k);
+    assert (!ok);
+    assert (k == 37);
+
+    /* Crash in child process counts as failure */
+    ok = repeat_test_forked (crashing, 8, &k);
+    assert (!ok);
+    assert (k == 50);
+
+    /* Failure without simulated failures */
+    ok = repeat_test_forked (never, 4, &k);
+    assert (!ok);
+    assert (k == (size_t) -2);
+#endif
+}
+
+
+/* Print report of call sites */
+static void
+test_report (void)
+{
+    char line[200];
+    char site[100];
+    unsigned long hits;
+    unsigned long failures;
+    unsigned long iterations;
+    fixture_t *orig;
+    int found;
+    FILE *out;
+    int ok;
+
+    /* Write report to temporary file */
+    out = tmpfile ();
+    assert (out != NULL);
+    set_failure_report (out);
+    ok = repeat_test (named);
+    assert (ok);
+    set_failure_report (NULL);
+
+    /* Summary comes first */
+    rewind (out);
+    assert (fgets (line, sizeof (line), out) != NULL);
+    assert (sscanf (line, "repeat_test: %lu iterations", &iterations) == 1);
+    assert (iterations == 4);
+
+    /* Header of table */
+    assert (fgets (line, sizeof (line), out) != NULL);
+
+    /* Sites are listed by decreasing number of calls */
+    found = 0;
+    while (fgets (line, sizeof (line), out) != NULL) {
+        assert (sscanf (line, "%99s %lu %lu", site, &hits, &failures) == 3);
+        if (strcmp (site, "first") == 0) {
+            assert (found == 0);
+            assert (hits == 4  &&  failures == 1);
+        } else if (strcmp (site, "second") == 0) {
+            assert (found == 1);
+            assert (hits == 3  &&  failures == 1);
+        } else {
+            /* Unnamed caller */
+            assert (found == 2);
+            assert (hits == 2  &&  failures == 1);
+        }
+        found++;
+    }
+    assert (found == 3);
+    fclose (out);
+
+    /* Allocations are charged to callers of allocate_memory */
+    out = tmpfile ();
+    assert (out != NULL);
+    orig = get_fixture ();
+    set_fixture (test_fixture);
+    set_failure_report (out);
+    ok = repeat_test (allocating);
+    assert (ok);
+    set_failure_report (NULL);
+    set_fixture (orig);
+    rewind (out);
+    assert (fgets (line, sizeof (line), out) != NULL);
+    assert (fgets (line, sizeof (line), out) != NULL);
+    found = 0;
+    while (fgets (line, sizeof (line), out) != NULL) {
+        assert (sscanf (line, "%99s %lu %lu", site, &hits, &failures) == 3);
+        found++;
+    }
+#if defined(__GNUC__)
+    /* Three sites rather than two inside faulty allocator */
+    assert (found == 3);
+#else
+    assert (found == 1);
+#endif
+    fclose (out);
+
+    /* Reporting does not affect result */
+    counter = 0;
+    assert (repeat_test (fourth));
+    assert (counter == 4);
+}
+
+
+/* Test function allocating memory at three call sites */
+static int
+allocating (void)
+{
+    void *p;
+    void *q;
+    void *r;
+
+    p = allocate_memory (10);
+    if (!p) {
+        return 1;
+    }
+    q = allocate_memory (10);
+    if (!q) {
+        free_memory (p);
+        return 1;
+    }
+    r = resize_memory (q, 20);
+    if (r) {
+        q = r;
+    }
+    free_memory (q);
+    free_memory (p);
+    return 1;
+}
+
+
+/* Test function with named call sites */
+static int
+named (void)
+{
+    if (simulate_failure_at ("first")) {
+        return 1;
+    }
+    if (simulate_failure_at ("second")) {
+        return 1;
+    }
+    if (simulate_failure ()) {
+        return 1;
+    }
+    return 1;
+}
+
+
+/* Sampled failures for soak runs */
+static void
+test_sampled (void)
+{
+    unsigned char first[200];
+    fixture_t *orig;
+    size_t failures;
+    void *p;
+    int i;
+
+    /* Nothing fails by default */
+    for (i = 0; i < 100; i++) {
+        assert (!simulate_failure ());
+    }
+
+    /* Fail every fourth call */
+    enable_sampled_failures (0.0, 4, 1);
+    for (i = 1; i <= 100; i++) {
+        assert (simulate_failure () == (i % 4 == 0));
+    }
+
+    /* Fail about half of the calls */
+    enable_sampled_failures (0.5, 0, 42);
+    failures = 0;
+    for (i = 0; i < 10000; i++) {
+        if (simulate_failure ()) {
+            failures++;
+        }
+    }
+    assert (4000 < failures  &&  failures < 6000);
+
+    /* Same seed gives the same failures */
+    enable_sampled_failures (0.5, 0, 7);
+    for (i = 0; i < 200; i++) {
+        first[i] = (unsigned char) simulate_failure ();
+    }
+    enable_sampled_failures (0.5, 0, 7);
+    for (i = 0; i < 200; i++) {
+        assert (simulate_failure () == first[i]);
+    }
+
+    /* Probability of one fails every call */
+    enable_sampled_failures (1.0, 0, 7);
+    for (i = 0; i < 100; i++) {
+        assert (simulate_failure ());
+    }
+
+    /* Exhaustive testing is not affected */
+    counter = 0;
+    assert (repeat_test (second));
+    assert (counter == 2);
+
+    /* Allocations through test fixture fail as well */
+    orig = get_fixture ();
+    set_fixture (test_fixture);
+    enable_sampled_failures (0.0, 2, 1);
+    p = allocate_memory (10);
+    assert (p != NULL);
+    assert (allocate_memory (10) == NULL);
+    free_memory (p);
+    set_fixture (orig);
+
+    /* Streams of threads do not depend on thread schedule */
+    if (has_threads ()) {
+        test_streams ();
+    }
+
+    /* Disabled again */
+    disable_sampled_failures ();
+    for (i = 0; i < 100; i++) {
+        assert (!simulate_failure ());
+    }
+}
+
+
+/* Sampled failures in multiple threads */
+static void
+test_streams (void)
+{
+    unsigned char first[DRAWS];
+    unsigned char second[DRAWS];
+    struct draw_thread *t1;
+    struct draw_thread *t2;
+    int i;
+
+    /* Draw failures of streams 1 and 2 in main thread */
+    enable_sampled_failures (0.5, 0, 9);
+    set_failure_stream (1);
+    for (i = 0; i < DRAWS; i++) {
+        first[i] = (unsigned char) simulate_failure ();
+    }
+    set_failure_stream (2);
+    for (i = 0; i < DRAWS; i++) {
+        second[i] = (unsigned char) simulate_failure ();
+    }
+    assert (memcmp (first, second, DRAWS) != 0);
+    set_failure_stream (0);
+
+    /* Threads started in reverse order draw the same failures */
+    t2 = (struct draw_thread*) start_draws (2, DRAWS);
+    t1 = (struct draw_thread*) start_draws (1, DRAWS);
+    assert (join_thread (&t1->base));
+    assert (join_thread (&t2->base));
+    assert (memcmp (t1->draws, first, DRAWS) == 0);
+    assert (memcmp (t2->draws, second, DRAWS) == 0);
+    delete_thread (&t1->base);
+    delete_thread (&t2->base);
+
+    /* Configuration may be replaced while threads are running */
+    t1 = (struct draw_thread*) start_draws (1, 100000);
+    for (i = 0; i < 100; i++) {
+        enable_sampled_failures (0.1 * (i % 10), (size_t) i % 7, 3);
+    }
+    assert (join_thread (&t1->base));
+    delete_thread (&t1->base);
+}
+
+
+/* Start thread which calls simulate_failure COUNT times */
+static thread_t *
+start_draws (unsigned long stream, size_t count)
+{
+    struct draw_thread *tp;
+
+    tp = (struct draw_thread*) new_thread (draw_thread);
+    assert (tp != NULL);
+    tp->stream = stream;
+    tp->count = count;
+    assert (start_thread (&tp->base));
+    return &tp->base;
+}
+
+
+/* Allocate room for draw thread */
+static thread_t *
+allocate_draw_thread (void)
+{
+    return allocate_memory (sizeof (struct draw_thread));
+}
+
+
+/* Record results of simulate_failure in sampled mode */
+static int
+draw_main (thread_t *tp)
+{
+    struct draw_thread *dp = (struct draw_thread*) tp;
+    unsigned char result;
+    size_t i;
+
+    set_failure_stream (dp->stream);
+    for (i = 0; i < dp->count; i++) {
+        result = (unsigned char) simulate_failure ();
+        if (i < DRAWS) {
+            dp->draws[i] = result;
+        }
+    }
+    return 1;
+}
+
+
+/* Test function which crashes on failure of 50th call */
+static int
+crashing (void)
+{
+    int i;
+    for (i = 0; i < 100; i++) {
+        if (simulate_failure ()  &&  i == 50) {
+            abort ();
+        }
+    }
+    return 1;
+}
+
+
 /* Test function which never returns true */
 static int
 never (void)
@@ -191,3 +634,58 @@ fourth (void)
     return ok;
 }
 
+
+/* Test function which succeeds after MANY failures */
+static int
+many (void)
+{
+    int i;
+    counter++;
+    for (i = 0; i < MANY; i++) {
+        if (simulate_failure ()) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* Test function which continues after failures */
+static int
+combinations (void)
+{
+    counter++;
+    simulate_failure ();
+    simulate_failure ();
+    simulate_failure ();
+    return 1;
+}
+
+
+/* Test function which handles failure of any call */
+static int
+robust (void)
+{
+    int i;
+    int failures = 0;
+    for (i = 0; i < 100; i++) {
+        if (simulate_failure ()) {
+            failures++;
+        }
+    }
+    return failures <= 1;
+}
+
+
+/* Test function which cannot handle failure after 37th call */
+static int
+fragile (void)
+{
+    int i;
+    for (i = 0; i < 100; i++) {
+        if (simulate_failure ()  &&  i >= 37) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -19,6 +19,7 @@ static void free_my_allocator(struct allocator *ap);
 static int create_my_allocator(
 	struct allocator *ap, const struct allocator_vtable *vtable);
 static void destroy_my_allocator(struct allocator *ap);
+static void test_map(int options);
 
 /* Custom allocator type */
 static struct allocator_vtable def = {
@@ -80,6 +81,20 @@ main (void)
 		allocator_free_memory(ap, ptrs[i]);
 	}
 
+	/* Buffer may be mapped with any combination of options */
+	for (int options = 0; options < 8; options++) {
+		test_map(options);
+	}
+
+	/* Mapped allocator type */
+	ap = new_allocator(mapped_static_allocator);
+	assert(ap != NULL);
+	p1 = allocator_allocate_memory(ap, 1024 * 1024);
+	assert(p1 != NULL);
+	memset(p1, 1, 1024 * 1024);
+	allocator_free_memory(ap, p1);
+	delete_allocator(ap);
+
 	return 0;
 }
 
@@ -116,3 +131,26 @@ static void destroy_my_allocator(struct allocator *ap)
 }
 
 
+/* Create static allocator with mapped buffer */
+static void test_map(int options)
+{
+	struct static_allocator sa;
+	struct allocator *ap = &sa.base;
+
+	/* Size is rounded up to whole pages */
+	assert(create_static_allocator_with_map(
+		ap, static_allocator, 10000, options));
+	assert(sa.size >= 10000);
+
+	/* Memory is mapped rather than taken from heap */
+#if defined(HAVE_MMAP)
+	assert(sa.mapped);
+#endif
+
+	/* Whole buffer is usable */
+	char *p = allocator_allocate_memory(ap, 9000);
+	assert(p != NULL);
+	memset(p, 1, 9000);
+	allocator_free_memory(ap, p);
+	destroy_static_allocator(ap);
+}
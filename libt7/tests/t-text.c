@@ -0,0 +1,288 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/text.h"
+#include "t7/fixture.h"
+#include "t7/static-allocator.h"
+#include "t7/simulate-failure.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Sample text "Aä€😀" in UTF-16LE */
+static const char utf16le[] =
+	"A\0" "\xE4\0" "\xAC\x20" "\x3D\xD8\x00\xDE";
+
+
+/* Test functions */
+static void test_views(void);
+static void test_empty(void);
+static void test_fragments(struct allocator *ap);
+static void test_transcoder(struct allocator *ap);
+static void test_charsets(void);
+static void test_references(void);
+static void test_errors(void);
+static void test_large(void);
+static int build_text(void);
+static void check(text_builder_t *bp, const char *expect, size_t len);
+
+
+int main(void)
+{
+	test_views();
+	test_empty();
+	test_fragments(NULL);
+	test_charsets();
+	test_references();
+	test_errors();
+	test_large();
+
+	/* Chunks grow through static allocator */
+	struct allocator *ap = new_allocator(static_allocator);
+	assert(ap != NULL);
+	test_fragments(ap);
+	test_transcoder(ap);
+	delete_allocator(ap);
+
+	/* Builder handles allocation failures */
+	set_fixture(test_fixture);
+	assert(repeat_test(build_text));
+	return 0;
+}
+
+
+/* Views refer to text in place */
+static void test_views(void)
+{
+	static const char s[] = "abc";
+
+	text_view_t v = make_string_view(s, UTF8);
+	assert(v.data == s);
+	assert(v.len == 3);
+	assert(v.charset == UTF8);
+
+	v = make_text_view(utf16le, sizeof(utf16le) - 1, UTF16LE);
+	assert(v.data == utf16le);
+	assert(v.len == 10);
+	assert(v.charset == UTF16LE);
+}
+
+
+/* Builder without text */
+static void test_empty(void)
+{
+	text_builder_t *bp = new_text_builder(NULL, UTF16);
+	assert(bp != NULL);
+
+	/* Empty fragments are ignored */
+	assert(append_text(bp, make_text_view(NULL, 0, UTF8)));
+	check(bp, "", 0);
+
+	/* Text is in resolved character set */
+	text_view_t v;
+	assert(get_text(bp, &v));
+	assert(v.charset == resolve_charset(UTF16));
+	delete_text_builder(bp);
+
+	/* Character set must be known */
+	assert(new_text_builder(NULL, INVALID_CHARSET) == NULL);
+}
+
+
+/* Join many small fragments */
+static void test_fragments(struct allocator *ap)
+{
+	static char expect[200000];
+	size_t n = 0;
+
+	text_builder_t *bp = new_text_builder(ap, UTF8);
+	assert(bp != NULL);
+	while (n + 20 < sizeof(expect)) {
+		char s[20];
+		int k = sprintf(s, "<%zu>", n);
+		assert(k > 0);
+		assert(append_text(bp, make_text_view(s, (size_t) k, UTF8)));
+		memcpy(expect + n, s, (size_t) k);
+		n += (size_t) k;
+	}
+	check(bp, expect, n);
+
+	/* Joined text is returned again without copying */
+	text_view_t v1;
+	text_view_t v2;
+	assert(get_text(bp, &v1));
+	assert(get_text(bp, &v2));
+	assert(v1.data == v2.data);
+
+	/* Text may be appended after the text has been joined */
+	assert(append_text(bp, make_string_view("end", ASCII)));
+	memcpy(expect + n, "end", 3);
+	check(bp, expect, n + 3);
+	delete_text_builder(bp);
+}
+
+
+/* Transcoder is allocated from allocator of builder */
+static void test_transcoder(struct allocator *ap)
+{
+	text_builder_t *bp = new_text_builder(ap, UTF8);
+	assert(bp != NULL);
+	assert(append_text(
+		bp, make_text_view(utf16le, sizeof(utf16le) - 1, UTF16LE)));
+
+	/* Default allocator fails every call while text is joined */
+	fixture_t *orig = get_fixture();
+	set_fixture(test_fixture);
+	enable_sampled_failures(1.0, 0, 1);
+	check(bp, "A\xC3\xA4\xE2\x82\xAC\xF0\x9F\x98\x80", 10);
+	disable_sampled_failures();
+	set_fixture(orig);
+	delete_text_builder(bp);
+}
+
+
+/* Fragments are transcoded to character set of builder */
+static void test_charsets(void)
+{
+	text_builder_t *bp = new_text_builder(NULL, UTF16LE);
+	assert(bp != NULL);
+	assert(append_text(bp, make_string_view("A", ASCII)));
+	assert(append_text(bp, make_string_view("\xE4", ISO8859_1)));
+	assert(append_text(bp, make_string_view("\xE2\x82", UTF8)));
+	assert(append_text(bp, make_string_view("\xAC", UTF8)));
+	assert(append_text(bp, make_text_view("\x00\xF6\x01\0", 4, UTF32LE)));
+	check(bp, utf16le, sizeof(utf16le) - 1);
+
+	/* Text in the same character set is joined as is */
+	assert(append_text(bp, make_text_view(utf16le, 2, UTF16LE)));
+	char expect[sizeof(utf16le) + 2];
+	memcpy(expect, utf16le, sizeof(utf16le) - 1);
+	memcpy(expect + sizeof(utf16le) - 1, "A\0", 2);
+	check(bp, expect, sizeof(utf16le) + 1);
+	delete_text_builder(bp);
+}
+
+
+/* Referenced text is not copied */
+static void test_references(void)
+{
+	static const char s[] = "referenced";
+
+	/* Only piece in the right character set is returned in place */
+	text_builder_t *bp = new_text_builder(NULL, UTF8);
+	assert(bp != NULL);
+	assert(append_text_ref(bp, make_string_view(s, UTF8)));
+	text_view_t v;
+	assert(get_text(bp, &v));
+	assert(v.data == s);
+	assert(v.len == 10);
+	delete_text_builder(bp);
+
+	/* Sequence may continue from one referenced piece to the next */
+	bp = new_text_builder(NULL, UTF32BE);
+	assert(bp != NULL);
+	assert(append_text_ref(bp, make_string_view("\xE2", UTF8)));
+	assert(append_text_ref(bp, make_string_view("\x82\xAC", UTF8)));
+	assert(append_text(bp, make_string_view("!", UTF8)));
+	check(bp, "\0\0\x20\xAC" "\0\0\0!", 8);
+	delete_text_builder(bp);
+}
+
+
+/* Invalid fragments are detected on demand */
+static void test_errors(void)
+{
+	/* Character set of fragment must be known */
+	text_builder_t *bp = new_text_builder(NULL, ASCII);
+	assert(bp != NULL);
+	assert(!append_text(bp, make_string_view("x", INVALID_CHARSET)));
+	assert(!append_text_ref(bp, make_string_view("x", INVALID_CHARSET)));
+
+	/* Character cannot be represented in ASCII */
+	assert(append_text(bp, make_string_view("abc", ASCII)));
+	assert(append_text(bp, make_string_view("\xE4", ISO8859_1)));
+	text_view_t v;
+	assert(!get_text(bp, &v));
+	assert(!get_text(bp, &v));
+	delete_text_builder(bp);
+
+	/* Sequence cut short by the end of text */
+	bp = new_text_builder(NULL, UTF16BE);
+	assert(bp != NULL);
+	assert(append_text(bp, make_string_view("a\xE2\x82", UTF8)));
+	assert(!get_text(bp, &v));
+
+	/* Sequence cut short by text in another character set */
+	assert(append_text(bp, make_string_view("b", ASCII)));
+	assert(!get_text(bp, &v));
+	delete_text_builder(bp);
+}
+
+
+/* Fragments larger than chunks */
+static void test_large(void)
+{
+	static char big[150000];
+	memset(big, 'x', sizeof(big));
+
+	text_builder_t *bp = new_text_builder(NULL, ISO8859_1);
+	assert(bp != NULL);
+	assert(append_text(bp, make_string_view("<", ASCII)));
+	assert(append_text(bp, make_text_view(big, sizeof(big), ISO8859_1)));
+	assert(append_text(bp, make_text_view(big, sizeof(big), UTF8)));
+	assert(append_text(bp, make_string_view(">", ASCII)));
+
+	text_view_t v;
+	assert(get_text(bp, &v));
+	assert(v.len == 2 * sizeof(big) + 2);
+	assert(v.data[0] == '<');
+	assert(v.data[1] == 'x');
+	assert(v.data[2 * sizeof(big)] == 'x');
+	assert(v.data[2 * sizeof(big) + 1] == '>');
+	delete_text_builder(bp);
+}
+
+
+/* Build text with default allocator */
+static int build_text(void)
+{
+	int ok = 0;
+
+	text_builder_t *bp = new_text_builder(NULL, UTF16LE);
+	if (!bp)
+		goto exit;
+
+	for (size_t i = 0; i < 100; i++) {
+		if (!append_text(bp, make_string_view("A", ASCII)))
+			goto exit_delete;
+		if (!append_text(bp, make_string_view("\xC3\xA4", UTF8)))
+			goto exit_delete;
+	}
+	text_view_t v;
+	if (!get_text(bp, &v))
+		goto exit_delete;
+	assert(v.len == 400);
+	assert(memcmp(v.data + 396, "A\0\xE4\0", 4) == 0);
+	ok = 1;
+
+exit_delete:
+	delete_text_builder(bp);
+exit:
+	return ok;
+}
+
+
+/* Get text of builder and compare result */
+static void check(text_builder_t *bp, const char *expect, size_t len)
+{
+	text_view_t v;
+	assert(get_text(bp, &v));
+	assert(v.len == len);
+	assert(memcmp(v.data, expect, len) == 0);
+}
@@ -15,6 +15,18 @@
 #include <assert.h>
 
 
+/*
+ * Variables are found by slot number if compiler has thread-local storage.
+ * Configure with -DHAVE_THREAD_LOCAL= to test the hash table and cache
+ * which serve lookups otherwise.
+ */
+#if defined(T7_DISABLE_THREADS)
+#   define FAST_TLS
+#elif defined(HAVE_THREAD_LOCAL)  &&  !defined(_WIN32)
+#   define FAST_TLS
+#endif
+
+
 /* Local functions */
 static tls_variable_t *allocate_dummy (void);
 static void free_dummy (tls_variable_t *vp);
@@ -31,6 +43,10 @@ static void *get_dynamic (tls_variable_t *vp);
 static int my_main (thread_t *tp);
 
 static void test_single (void);
+static void test_many (void);
+static void test_statistics (void);
+static void test_first_lookups (void);
+static void test_slots (void);
 static void test_threads (void);
 
 
@@ -46,13 +62,18 @@ struct dynamic_tls_variable {
     char *buffer;
 };
 
-/* Thread-local variable 1 */
+/* Slot numbers of variables 2 and 3 */
+static size_t slot2;
+static size_t slot3;
+
+/* Thread-local variable 1, slot number is kept in library */
 static tls_type_t mytp1 = {
     allocate_dummy,
     free_dummy,
     create_dummy,
     destroy_dummy,
     get_dummy,
+    NULL
 };
 
 /* Thread-local variable 2 */
@@ -62,15 +83,17 @@ static tls_type_t mytp2 = {
     create_dummy,
     destroy_dummy,
     get_dummy,
+    &slot2
 };
 
-/* Thread-local variable 3 */
-static tls_type_t mytp3 = {
+/* Thread-local variable 3, types may be placed in read-only memory */
+static const tls_type_t mytp3 = {
     allocate_dynamic,
     free_dynamic,
     create_dynamic,
     destroy_dynamic,
     get_dynamic,
+    &slot3
 };
 
 /* Custom thread */
@@ -83,11 +106,18 @@ static thread_type_t def1 = {
 };
 static thread_type_t *my_thread = &def1;
 
+/* Large number of thread-local variables */
+#define MANY 100
+static tls_type_t many[MANY];
+
 
 int
 main (void)
 {
     test_single ();
+    test_slots ();
+    test_many ();
+    test_statistics ();
     if (has_threads ()) {
         test_threads ();
     }
@@ -95,6 +125,133 @@ main (void)
 }
 
 
+/* Slot numbers are stored to variables of types */
+static void
+test_slots (void)
+{
+    struct tls_statistics before;
+    struct tls_statistics after;
+    int ok;
+
+    /* Variables exist after test_single */
+    ok = get_tls_statistics (&before);
+    assert (ok);
+    assert (get_tls (&mytp2) != NULL);
+    assert (get_tls (&mytp3) != NULL);
+    ok = get_tls_statistics (&after);
+    assert (ok);
+
+#if defined(FAST_TLS)
+    /* Types have distinct slots and are found by slot number */
+    assert (slot2 != 0  &&  slot3 != 0  &&  slot2 != slot3);
+    assert (after.fast == before.fast + 2);
+#else
+    /* Slot numbers are not used */
+    assert (slot2 == 0  &&  slot3 == 0);
+    assert (after.fast == before.fast);
+#endif
+}
+
+
+/* Use more variables than fit in the initial slot array */
+static void
+test_many (void)
+{
+    size_t i;
+    int *p;
+
+    /* Create variables */
+    for (i = 0; i < MANY; i++) {
+        many[i] = mytp1;
+        p = get_tls (&many[i]);
+        assert (p != NULL);
+        assert (*p == 0);
+        *p = (int) i;
+    }
+
+    /* Variables retain their values */
+    for (i = 0; i < MANY; i++) {
+        p = get_tls (&many[i]);
+        assert (p != NULL);
+        assert (*p == (int) i);
+    }
+}
+
+
+/* Lookups are counted */
+static void
+test_statistics (void)
+{
+    struct tls_statistics before;
+    struct tls_statistics after;
+    size_t i;
+    int ok;
+
+    /* Look up existing variables */
+    ok = get_tls_statistics (&before);
+    assert (ok);
+    for (i = 0; i < MANY; i++) {
+        assert (get_tls (&many[i]) != NULL);
+        assert (get_tls (&many[i]) != NULL);
+    }
+    ok = get_tls_statistics (&after);
+    assert (ok);
+
+    /* Every lookup was satisfied without creating variables */
+    assert (after.created == before.created);
+    assert (after.misses == before.misses);
+    assert (after.fast + after.cached + after.hashed
+        == before.fast + before.cached + before.hashed + 2 * MANY);
+    assert (after.probes >= before.probes);
+
+#if defined(FAST_TLS)
+    /* Each type has a slot of its own */
+    assert (after.fast == before.fast + 2 * MANY);
+    assert (after.cached == before.cached);
+    assert (after.hashed == before.hashed);
+#else
+    /*
+     * Without slots, the first lookup of each type finds the variable from
+     * hash table and the second one from the cache.
+     */
+    assert (after.fast == before.fast);
+    assert (after.hashed == before.hashed + MANY);
+    assert (after.cached == before.cached + MANY);
+    assert (after.probes >= before.probes + MANY);
+#endif
+}
+
+
+/* Variables are searched from storage when first used in a thread */
+static void
+test_first_lookups (void)
+{
+    struct tls_statistics before;
+    struct tls_statistics after;
+    size_t i;
+    int ok;
+
+    /* Look up variables which do not exist in this thread yet */
+    ok = get_tls_statistics (&before);
+    assert (ok);
+    for (i = 0; i < MANY; i++) {
+        assert (get_tls (&many[i]) != NULL);
+    }
+    ok = get_tls_statistics (&after);
+    assert (ok);
+
+    /* Each lookup went through storage and created variable */
+    assert (after.fast == before.fast);
+    assert (after.cached == before.cached);
+    assert (after.hashed == before.hashed);
+    assert (after.misses == before.misses + MANY);
+    assert (after.created == before.created + MANY);
+
+    /* Subsequent lookups find the variables */
+    test_statistics ();
+}
+
+
 /* Make sure that TLS variables work on a single thread (also main thread) */
 static void
 test_single (void)
@@ -217,6 +374,7 @@ my_main (thread_t *tp)
     (void) tp;
 
     /* Execute single-threaded test */
+    test_first_lookups ();
     test_single ();
     return 1;
 }
@@ -0,0 +1,615 @@
+/*
+ * Test-Driven Development Framework 7 for C
+ *
+ * Copyright (C) 2018 Toni Ronkko
+ * This file is part of T7.  T7 may be freely distributed under the MIT
+ * license.  For more information, see https://github.com/tronkko/t7
+ */
+#include "t7/types.h"
+#include "t7/transcoder.h"
+#include "t7/fixture.h"
+#include "t7/memory.h"
+#include "t7/simulate-failure.h"
+#include <stdint.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+
+/* Sample text "Aä€😀" in various character sets */
+static const char utf8[] = "A\xC3\xA4\xE2\x82\xAC\xF0\x9F\x98\x80";
+static const char utf16le[] =
+	"A\0" "\xE4\0" "\xAC\x20" "\x3D\xD8\x00\xDE";
+static const char utf16be[] =
+	"\0A" "\0\xE4" "\x20\xAC" "\xD8\x3D\xDE\x00";
+static const char utf32le[] =
+	"A\0\0\0" "\xE4\0\0\0" "\xAC\x20\0\0" "\x00\xF6\x01\0";
+static const char utf32be[] =
+	"\0\0\0A" "\0\0\0\xE4" "\0\0\x20\xAC" "\0\x01\xF6\x00";
+
+
+/* Test functions */
+static void test_convert(void);
+static void test_chunks(void);
+static void test_small_output(void);
+static void test_errors(void);
+static void test_long(void);
+static void test_long_errors(void);
+static void test_latin1(void);
+static void test_registered(void);
+static int one_shot(void);
+static void check(
+	charset_t from, const char *in, size_t in_len,
+	charset_t to, const char *expect, size_t expect_len);
+static void check_chunked(
+	charset_t from, const char *in, size_t in_len,
+	charset_t to, const char *expect, size_t expect_len);
+static void check_error(
+	charset_t from, const char *in, size_t in_len, charset_t to,
+	size_t at);
+static size_t encode(charset_t t, uint32_t cp, char *p);
+static uint32_t random_number(void);
+
+/* Unicode encodings */
+static const charset_t unicode[] = {
+	UTF8, UTF16LE, UTF16BE, UTF32LE, UTF32BE
+};
+#define NUM_UNICODE (sizeof(unicode) / sizeof(unicode[0]))
+
+/* Maximum number of characters in long text */
+#define MAX_LONG 300
+
+
+int main(void)
+{
+	test_convert();
+	test_chunks();
+	test_small_output();
+	test_errors();
+	test_long();
+	test_long_errors();
+	test_latin1();
+	test_registered();
+
+	/* One-shot conversion handles allocation failures */
+	set_fixture(test_fixture);
+	assert(repeat_test(one_shot));
+	return 0;
+}
+
+
+/* Convert between all Unicode encodings */
+static void test_convert(void)
+{
+	const struct {
+		charset_t t;
+		const char *p;
+		size_t n;
+	} texts[] = {
+		{ UTF8, utf8, sizeof(utf8) - 1 },
+		{ UTF16LE, utf16le, sizeof(utf16le) - 1 },
+		{ UTF16BE, utf16be, sizeof(utf16be) - 1 },
+		{ UTF32LE, utf32le, sizeof(utf32le) - 1 },
+		{ UTF32BE, utf32be, sizeof(utf32be) - 1 },
+	};
+	size_t n = sizeof(texts) / sizeof(texts[0]);
+
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			check(texts[i].t, texts[i].p, texts[i].n,
+				texts[j].t, texts[j].p, texts[j].n);
+		}
+	}
+
+	/* ISO 8859-1 maps to first 256 code points */
+	check(ISO8859_1, "A\xE4", 2, UTF8, "A\xC3\xA4", 3);
+	check(UTF8, "A\xC3\xA4", 3, ISO8859_1, "A\xE4", 2);
+	check(ASCII, "abc", 3, UTF16BE, "\0a\0b\0c", 6);
+
+	/* Pseudo character sets are resolved */
+	check(UTF8, "A", 1, WCHAR, (const char*) L"A", sizeof(wchar_t));
+
+	/* File system character set is resolved to a supported one */
+	check(FILESYSTEM_CHARSET, "abc", 3, UTF8, "abc", 3);
+	assert(open_transcoder(UTF8, INVALID_CHARSET) == NULL);
+}
+
+
+/* Feed input one byte at a time */
+static void test_chunks(void)
+{
+	transcoder_t *tp = open_transcoder(UTF8, UTF16BE);
+	assert(tp != NULL);
+
+	char out[64];
+	size_t o = 0;
+	for (size_t i = 0; i < sizeof(utf8) - 1; i++) {
+		size_t k;
+		size_t m;
+		assert(transcode(tp, utf8 + i, 1, out + o, sizeof(out) - o, &k, &m));
+		assert(k == 1);
+		o += m;
+	}
+
+	/* Nothing is left over at the end */
+	size_t k;
+	size_t m;
+	assert(transcode(tp, NULL, 0, out + o, sizeof(out) - o, &k, &m));
+	assert(m == 0);
+	assert(o == sizeof(utf16be) - 1);
+	assert(memcmp(out, utf16be, o) == 0);
+
+	close_transcoder(tp);
+}
+
+
+/* Conversion stops when output is full */
+static void test_small_output(void)
+{
+	transcoder_t *tp = open_transcoder(UTF8, UTF32LE);
+	assert(tp != NULL);
+
+	/* Room for one character at a time */
+	char out[64];
+	size_t o = 0;
+	size_t i = 0;
+	while (i < sizeof(utf8) - 1) {
+		size_t k;
+		size_t m;
+		assert(transcode(tp, utf8 + i, sizeof(utf8) - 1 - i,
+			out + o, 5, &k, &m));
+		assert(m == 4);
+		i += k;
+		o += m;
+	}
+	assert(o == sizeof(utf32le) - 1);
+	assert(memcmp(out, utf32le, o) == 0);
+
+	/* Output buffer too small for surrogate pair */
+	reset_transcoder(tp);
+	close_transcoder(tp);
+	tp = open_transcoder(UTF8, UTF16LE);
+	size_t k;
+	size_t m;
+	assert(transcode(tp, "\xF0\x9F\x98\x80", 4, out, 3, &k, &m));
+	assert(k == 0 && m == 0);
+	close_transcoder(tp);
+}
+
+
+/* Invalid and unrepresentable input */
+static void test_errors(void)
+{
+	const char *bad[] = {
+		"\x80",                 /* Lone continuation byte */
+		"\xC0\xAF",             /* Overlong */
+		"\xE0\x80\xAF",         /* Overlong */
+		"\xED\xA0\x80",         /* Surrogate */
+		"\xF4\x90\x80\x80",     /* Beyond U+10FFFF */
+		"\xF5\x80\x80\x80",     /* Invalid lead byte */
+		"\xC3\x41",             /* Missing continuation */
+	};
+	char out[16];
+	size_t k;
+	size_t m;
+
+	transcoder_t *tp = open_transcoder(UTF8, UTF32LE);
+	assert(tp != NULL);
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		reset_transcoder(tp);
+		assert(!transcode(tp, bad[i], strlen(bad[i]), out, sizeof(out),
+			&k, &m));
+		assert(k == 0);
+	}
+
+	/* Error position follows valid output */
+	reset_transcoder(tp);
+	assert(!transcode(tp, "ab\xFF", 3, out, sizeof(out), &k, &m));
+	assert(k == 2 && m == 8);
+
+	/* Truncated sequence at end of text */
+	reset_transcoder(tp);
+	assert(transcode(tp, "a\xE2\x82", 3, out, sizeof(out), &k, &m));
+	assert(k == 3 && m == 4);
+	assert(!transcode(tp, NULL, 0, out, sizeof(out), &k, &m));
+	close_transcoder(tp);
+
+	/* Lone surrogates in UTF-16 */
+	tp = open_transcoder(UTF16LE, UTF8);
+	assert(!transcode(tp, "\x00\xDC", 2, out, sizeof(out), &k, &m));
+	reset_transcoder(tp);
+	assert(!transcode(tp, "\x00\xD8" "A\0", 4, out, sizeof(out), &k, &m));
+	close_transcoder(tp);
+
+	/* Character outside of target character set */
+	tp = open_transcoder(UTF8, ASCII);
+	assert(!transcode(tp, "a\xC3\xA4", 3, out, sizeof(out), &k, &m));
+	assert(k == 1 && m == 1);
+	close_transcoder(tp);
+
+	/* One-shot conversion rejects truncated input */
+	assert(transcode_all(UTF8, UTF16LE, "\xE2\x82", 2, &m) == NULL);
+}
+
+
+/* Long texts cross vector blocks at every position */
+static void test_long(void)
+{
+	static char text[NUM_UNICODE][4 * MAX_LONG];
+	size_t len[NUM_UNICODE];
+
+	for (size_t round = 0; round < 200; round++) {
+		/* Mix runs of ASCII with characters of given length */
+		size_t kind = round % 4;
+		size_t count = random_number() % MAX_LONG;
+		for (size_t t = 0; t < NUM_UNICODE; t++)
+			len[t] = 0;
+		for (size_t i = 0; i < count; i++) {
+			uint32_t cp = random_number() % 0x80;
+			if (random_number() % 8 == 0) {
+				switch (kind) {
+				case 0:
+					cp = 0x80 + random_number() % 0x80;
+					break;
+				case 1:
+					cp = 0x80 + random_number() % (0x800 - 0x80);
+					break;
+				case 2:
+					/* Avoid surrogates */
+					cp = 0x800 + random_number() % (0xD800 - 0x800);
+					break;
+				default:
+					cp = 0x10000 + random_number() % 0x100000;
+				}
+			}
+			for (size_t t = 0; t < NUM_UNICODE; t++)
+				len[t] += encode(unicode[t], cp, text[t] + len[t]);
+		}
+
+		/* Convert between all pairs */
+		for (size_t i = 0; i < NUM_UNICODE; i++) {
+			for (size_t j = 0; j < NUM_UNICODE; j++) {
+				check(unicode[i], text[i], len[i],
+					unicode[j], text[j], len[j]);
+				check_chunked(unicode[i], text[i], len[i],
+					unicode[j], text[j], len[j]);
+			}
+		}
+	}
+}
+
+
+/* Errors are reported at exact position after long valid prefix */
+static void test_long_errors(void)
+{
+	static const struct {
+		const char *p;
+		int truncated;
+	} bad[] = {
+		{ "\xC0\xAF", 0 },              /* Overlong */
+		{ "\xC1\xBF", 0 },              /* Overlong */
+		{ "\xE0\x9F\xBF", 0 },          /* Overlong */
+		{ "\xF0\x8F\xBF\xBF", 0 },      /* Overlong */
+		{ "\xED\xA0\x80", 0 },          /* High surrogate */
+		{ "\xED\xBF\xBF", 0 },          /* Low surrogate */
+		{ "\x80", 0 },                  /* Lone continuation byte */
+		{ "\xC3\xC3", 0 },              /* Missing continuation */
+		{ "\xC3", 1 },                  /* Truncated at end of text */
+		{ "\xF0\x9F\x98", 1 },          /* Truncated at end of text */
+	};
+	char in[256];
+
+	for (size_t b = 0; b < sizeof(bad) / sizeof(bad[0]); b++) {
+		size_t n = strlen(bad[b].p);
+		for (size_t at = 0; at < 64; at++) {
+			/* Prefix of ASCII and two-byte characters */
+			for (size_t i = 0; i < at; i++)
+				in[i] = (char) ('a' + i % 26);
+			for (size_t i = 1; i + 1 < at; i += 7) {
+				in[i] = '\xC3';
+				in[i + 1] = '\xA4';
+			}
+			memcpy(in + at, bad[b].p, n);
+			memset(in + at + n, 'z', sizeof(in) - at - n);
+
+			size_t end = bad[b].truncated ? at + n : sizeof(in);
+			for (size_t t = 0; t < NUM_UNICODE; t++)
+				check_error(UTF8, in, end, unicode[t], at);
+		}
+	}
+
+	/* Lone surrogates in UTF-16 and UTF-32 after long run */
+	static const struct {
+		charset_t t;
+		const char *p;
+		size_t n;
+	} units[] = {
+		{ UTF16LE, "\x00\xDC", 2 },
+		{ UTF16LE, "\x00\xD8" "A\0", 4 },
+		{ UTF16BE, "\xDC\x00", 2 },
+		{ UTF16BE, "\xD8\x00" "\0A", 4 },
+		{ UTF32LE, "\x00\xD8\x00\x00", 4 },
+		{ UTF32BE, "\x00\x00\xDF\xFF", 4 },
+	};
+	for (size_t u = 0; u < sizeof(units) / sizeof(units[0]); u++) {
+		for (size_t at = 0; at < 40; at++) {
+			size_t o = 0;
+			for (size_t i = 0; i < at; i++)
+				o += encode(units[u].t, (uint32_t) ('a' + i % 26), in + o);
+			memcpy(in + o, units[u].p, units[u].n);
+			size_t end = o + units[u].n;
+			for (size_t t = 0; t < NUM_UNICODE; t++) {
+				if (unicode[t] != units[u].t)
+					check_error(units[u].t, in, end, unicode[t], o);
+			}
+		}
+	}
+}
+
+
+/* ISO 8859-1 converts to and from all Unicode encodings */
+static void test_latin1(void)
+{
+	static char text[NUM_UNICODE][4 * MAX_LONG];
+	static char latin1[MAX_LONG];
+	size_t len[NUM_UNICODE];
+
+	for (size_t round = 0; round < 200; round++) {
+		/* Mix runs of ASCII with upper half of ISO 8859-1 */
+		size_t count = random_number() % MAX_LONG;
+		size_t every = 1 + round % 16;
+		for (size_t t = 0; t < NUM_UNICODE; t++)
+			len[t] = 0;
+		for (size_t i = 0; i < count; i++) {
+			uint32_t cp = random_number() % 0x80;
+			if (random_number() % every == 0)
+				cp = random_number() % 0x100;
+			latin1[i] = (char) cp;
+			for (size_t t = 0; t < NUM_UNICODE; t++)
+				len[t] += encode(unicode[t], cp, text[t] + len[t]);
+		}
+
+		check(ISO8859_1, latin1, count, ISO8859_1, latin1, count);
+		for (size_t t = 0; t < NUM_UNICODE; t++) {
+			check(ISO8859_1, latin1, count, unicode[t], text[t], len[t]);
+			check(unicode[t], text[t], len[t], ISO8859_1, latin1, count);
+			check_chunked(
+				ISO8859_1, latin1, count, unicode[t], text[t], len[t]);
+			check_chunked(
+				unicode[t], text[t], len[t], ISO8859_1, latin1, count);
+		}
+	}
+
+	/* Characters beyond U+00FF cannot be represented */
+	char in[256];
+	for (size_t at = 0; at < 40; at++) {
+		for (size_t t = 0; t < NUM_UNICODE; t++) {
+			size_t o = 0;
+			for (size_t i = 0; i < at; i++) {
+				uint32_t cp = i % 5 == 1 ? 0xE4 : (uint32_t) ('a' + i % 26);
+				o += encode(unicode[t], cp, in + o);
+			}
+			size_t bad = o;
+			o += encode(unicode[t], 0x100, in + o);
+			for (size_t i = 0; i < 20; i++)
+				o += encode(unicode[t], 'z', in + o);
+			check_error(unicode[t], in, o, ISO8859_1, bad);
+		}
+
+		/* Upper half of ISO 8859-1 is not ASCII */
+		memset(in, 'a', 64);
+		in[at] = '\xE4';
+		check_error(ISO8859_1, in, 64, ASCII, at);
+		check_error(ASCII, in, 64, UTF8, at);
+	}
+}
+
+
+/* Registered single-byte character sets */
+static void test_registered(void)
+{
+	uint32_t map[256];
+	for (size_t i = 0; i < 256; i++)
+		map[i] = (uint32_t) i;
+	map[0x80] = 0x20AC;
+	map[0x81] = CHARSET_UNMAPPED;
+	charset_t cp1252 = register_charset_table("cp1252", map);
+	assert(cp1252 != INVALID_CHARSET);
+
+	/* Euro sign has a byte of its own */
+	check(cp1252, "a\x80\xE4", 3, UTF8, "a\xE2\x82\xAC\xC3\xA4", 6);
+	check(UTF8, "a\xE2\x82\xAC\xC3\xA4", 6, cp1252, "a\x80\xE4", 3);
+	check(cp1252, "\x80", 1, UTF16BE, "\x20\xAC", 2);
+	check(cp1252, "a\xE4", 2, ISO8859_1, "a\xE4", 2);
+
+	/* Unmapped byte and unrepresentable character */
+	check_error(cp1252, "ab\x81", 3, UTF8, 2);
+	check_error(UTF8, "ab\xC2\x80", 4, cp1252, 2);
+	check_error(ISO8859_1, "ab\x80", 3, cp1252, 2);
+
+	/* Long text goes through bulk conversion of ASCII */
+	char in[200];
+	char out[400];
+	size_t o = 0;
+	for (size_t i = 0; i < sizeof(in); i++) {
+		in[i] = (char) (i % 50 == 49 ? 0x80 : 'a' + i % 26);
+		o += encode(UTF8, map[(unsigned char) in[i]], out + o);
+	}
+	check(cp1252, in, sizeof(in), UTF8, out, o);
+	check(UTF8, out, o, cp1252, in, sizeof(in));
+	check_chunked(cp1252, in, sizeof(in), UTF8, out, o);
+
+	/* Registered name works in one-shot conversion */
+	check(parse_charset("CP1252"), "\x80", 1, UTF32LE, "\xAC\x20\0\0", 4);
+}
+
+
+/* Convert text at once */
+static int one_shot(void)
+{
+	size_t n;
+	char *p = transcode_all(
+		UTF16BE, UTF8, utf16be, sizeof(utf16be) - 1, &n);
+	if (!p)
+		return 0;
+
+	assert(n == sizeof(utf8) - 1);
+	assert(memcmp(p, utf8, n) == 0);
+	assert(p[n] == '\0');
+	free_memory(p);
+	return 1;
+}
+
+
+/* Convert text in one go and compare result */
+static void check(
+	charset_t from, const char *in, size_t in_len,
+	charset_t to, const char *expect, size_t expect_len)
+{
+	size_t n;
+	char *p = transcode_all(from, to, in, in_len, &n);
+	assert(p != NULL);
+	assert(n == expect_len);
+	assert(memcmp(p, expect, n) == 0);
+	free_memory(p);
+}
+
+
+/* Convert text in small pieces to small output buffer */
+static void check_chunked(
+	charset_t from, const char *in, size_t in_len,
+	charset_t to, const char *expect, size_t expect_len)
+{
+	static char out[4 * MAX_LONG];
+	transcoder_t *tp = open_transcoder(from, to);
+	assert(tp != NULL);
+
+	size_t i = 0;
+	size_t o = 0;
+	while (i < in_len) {
+		size_t chunk = 1 + random_number() % 70;
+		if (chunk > in_len - i)
+			chunk = in_len - i;
+		size_t cap = 4 + random_number() % 70;
+		if (cap > sizeof(out) - o)
+			cap = sizeof(out) - o;
+
+		size_t k;
+		size_t m;
+		assert(transcode(tp, in + i, chunk, out + o, cap, &k, &m));
+		i += k;
+		o += m;
+	}
+
+	size_t k;
+	size_t m;
+	assert(transcode(tp, NULL, 0, out + o, sizeof(out) - o, &k, &m));
+	assert(o == expect_len);
+	assert(memcmp(out, expect, o) == 0);
+	close_transcoder(tp);
+}
+
+
+/* Conversion fails at position AT */
+static void check_error(
+	charset_t from, const char *in, size_t in_len, charset_t to,
+	size_t at)
+{
+	static char out[1024];
+	transcoder_t *tp = open_transcoder(from, to);
+	assert(tp != NULL);
+
+	size_t k;
+	size_t m;
+	if (transcode(tp, in, in_len, out, sizeof(out), &k, &m)) {
+		/* Truncated sequence is kept until end of text */
+		assert(k == in_len);
+		assert(!transcode(tp, NULL, 0, out, sizeof(out), &k, &m));
+	} else {
+		assert(k == at);
+	}
+	close_transcoder(tp);
+
+	/* One-shot conversion fails as well */
+	assert(transcode_all(from, to, in, in_len, &m) == NULL);
+}
+
+
+/* Encode character in Unicode encoding */
+static size_t encode(charset_t t, uint32_t cp, char *p)
+{
+	unsigned char *q = (unsigned char*) p;
+	uint16_t u[2];
+	size_t n;
+
+	switch (t) {
+	case UTF8:
+		if (cp < 0x80) {
+			q[0] = (unsigned char) cp;
+			return 1;
+		}
+		if (cp < 0x800) {
+			q[0] = (unsigned char) (0xC0 | (cp >> 6));
+			q[1] = (unsigned char) (0x80 | (cp & 0x3F));
+			return 2;
+		}
+		if (cp < 0x10000) {
+			q[0] = (unsigned char) (0xE0 | (cp >> 12));
+			q[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+			q[2] = (unsigned char) (0x80 | (cp & 0x3F));
+			return 3;
+		}
+		q[0] = (unsigned char) (0xF0 | (cp >> 18));
+		q[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+		q[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+		q[3] = (unsigned char) (0x80 | (cp & 0x3F));
+		return 4;
+
+	case UTF16LE:
+	case UTF16BE:
+		if (cp < 0x10000) {
+			u[0] = (uint16_t) cp;
+			n = 1;
+		} else {
+			u[0] = (uint16_t) (0xD800 + ((cp - 0x10000) >> 10));
+			u[1] = (uint16_t) (0xDC00 + ((cp - 0x10000) & 0x3FF));
+			n = 2;
+		}
+		for (size_t i = 0; i < n; i++) {
+			unsigned char hi = (unsigned char) (u[i] >> 8);
+			unsigned char lo = (unsigned char) u[i];
+			q[2 * i] = t == UTF16LE ? lo : hi;
+			q[2 * i + 1] = t == UTF16LE ? hi : lo;
+		}
+		return 2 * n;
+
+	case UTF32LE:
+	case UTF32BE:
+		for (size_t i = 0; i < 4; i++) {
+			unsigned char c = (unsigned char) (cp >> (8 * i));
+			q[t == UTF32LE ? i : 3 - i] = c;
+		}
+		return 4;
+
+	case INVALID_CHARSET:
+	case ASCII:
+	case ISO8859_1:
+	case UTF16:
+	case UTF32:
+	case WCHAR:
+	case FILESYSTEM_CHARSET:
+	case LOCALE_CHARSET:
+	default:
+		assert(0);
+		return 0;
+	}
+}
+
+
+/* Pseudo-random number generator for repeatable tests */
+static uint32_t random_number(void)
+{
+	static uint32_t state = 12345;
+	state = state * 1103515245u + 12345u;
+	return state >> 8;
+}